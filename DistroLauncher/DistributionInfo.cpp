@@ -4,74 +4,103 @@
 //
 
 #include "stdafx.h"
+#include "Ubuntu/DirectExec.h"
+#include "Ubuntu/Probe.h"
+#include "Ubuntu/Provisioning.h"
+#include "Ubuntu/UserDbCache.h"
+#include "Ubuntu/Utf8.h"
+#include "Ubuntu/WslProcess.h"
 
-bool DistributionInfo::CreateUser(std::wstring_view userName)
+ULONG DistributionInfo::CreateUser(Ubuntu::WslApiBackend& api, std::wstring_view userName,
+                                   bool deleteResolvConf)
 {
-    // Create the user account.
-    DWORD exitCode;
-    std::wstring commandLine = L"adduser --quiet --gecos '' ";
-    commandLine += userName;
-    HRESULT hr = g_wslApi.WslLaunchInteractive(commandLine.c_str(), true, &exitCode);
-    if ((FAILED(hr)) || (exitCode != 0)) {
-        return false;
+    Ubuntu::Trace::Span span{"CreateUser", "install"};
+
+    // Create the user account, add it to any relevant groups and query its UID, all in a single
+    // launch. Should any of that fail, the user account is deleted. Its password is asked next.
+    std::vector<Ubuntu::ProvisioningStep> steps;
+    if (deleteResolvConf) {
+        steps.push_back(Ubuntu::deleteResolvConfStep());
     }
 
-    // Add the user account to any relevant groups.
-    commandLine = L"usermod -aG adm,dialout,cdrom,floppy,sudo,audio,dip,video,plugdev,netdev ";
-    commandLine += userName;
-    hr = g_wslApi.WslLaunchInteractive(commandLine.c_str(), true, &exitCode);
-    if ((FAILED(hr)) || (exitCode != 0)) {
+    auto account = Ubuntu::createUserSteps({std::wstring{userName}});
+    steps.insert(steps.end(), account.begin(), account.end());
+    auto result = Ubuntu::provision(api, steps);
+    if (!result) {
+        return UID_INVALID;
+    }
 
-        // Delete the user if the group add command failed.
-        commandLine = L"deluser ";
-        commandLine += userName;
-        g_wslApi.WslLaunchInteractive(commandLine.c_str(), true, &exitCode);
-        return false;
+    auto uid = Ubuntu::createdUid(*result);
+    if (!uid || !Ubuntu::askPassword(api, userName)) {
+        return UID_INVALID;
     }
 
-    return true;
+    return *uid;
 }
 
-ULONG DistributionInfo::QueryUid(std::wstring_view userName)
+ULONG DistributionInfo::QueryUid(Ubuntu::WslApiBackend& api, std::wstring_view userName)
 {
-    // Create a pipe to read the output of the launched process.
-    HANDLE readPipe;
-    HANDLE writePipe;
-    SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
-    ULONG uid = UID_INVALID;
-    if (CreatePipe(&readPipe, &writePipe, &sa, 0)) {
-        // Query the UID of the supplied username.
-        std::wstring command = L"id -u ";
-        command += userName;
-        int returnValue = 0;
-        HANDLE child;
-        HRESULT hr = g_wslApi.WslLaunch(command.c_str(), true, GetStdHandle(STD_INPUT_HANDLE), writePipe, GetStdHandle(STD_ERROR_HANDLE), &child);
-        if (SUCCEEDED(hr)) {
-            // Wait for the child to exit and ensure process exited successfully.
-            WaitForSingleObject(child, INFINITE);
-            DWORD exitCode;
-            if ((GetExitCodeProcess(child, &exitCode) == false) || (exitCode != 0)) {
-                hr = E_INVALIDARG;
-            }
+    Ubuntu::Trace::Span span{"QueryUid", "init"};
 
-            CloseHandle(child);
-            if (SUCCEEDED(hr)) {
-                char buffer[64];
-                DWORD bytesRead;
+    // Look the user up in the snapshot of the user database first, which doesn't launch any Linux
+    // process while /etc/passwd is unchanged.
+    const auto cache = Ubuntu::UserDbCache::forDistro(Name);
+    auto snapshot = cache.load();
+    bool current = false;
+    if (!userName.empty() && snapshot) {
+        auto stamp = Ubuntu::UserDbCache::currentStamp(api);
+        current = stamp && (*stamp == snapshot->stamp);
+        if (current) {
+            span.arg("cache", std::string_view{"hit"});
+            if (auto uid = Ubuntu::UserDbCache::uidOf(snapshot->users, userName)) {
+                return *uid;
+            }
+        }
+    }
 
-                // Read the output of the command from the pipe and convert to a UID.
-                if (ReadFile(readPipe, buffer, (sizeof(buffer) - 1), &bytesRead, nullptr)) {
-                    buffer[bytesRead] = ANSI_NULL;
-                    try {
-                        uid = std::stoul(buffer, nullptr, 10);
+    // Users coming from other NSS sources may not be enumerable, so the UID is asked directly. A
+    // stale snapshot is refreshed in the same launch: the distro enumerates the database only if
+    // the stamp of /etc/passwd doesn't match the snapshot's.
+    std::wstring id = L"id -u";
+    if (!userName.empty()) {
+        id += L' ' + Ubuntu::shellQuote(userName);
+    }
+    std::wstring passwd = L"getent passwd";
+    if (snapshot) {
+        passwd = L"[ \"$(" + std::wstring{Ubuntu::PasswdStampCommand} + L")\" = '" +
+                 Ubuntu::toWide(snapshot->stamp.str()) + L"' ] || " + passwd;
+    }
+    std::vector<Ubuntu::ProbeQuery> queries{{L"id", id}};
+    if (!userName.empty() && !current) {
+        queries.push_back({L"passwd-stamp", Ubuntu::PasswdStampCommand});
+        queries.push_back({L"passwd", passwd});
+    }
 
-                    } catch( ... ) { }
-                }
-            }
+    ULONG uid = UID_INVALID;
+    std::optional<Ubuntu::PasswdStamp> stamp;
+    Ubuntu::ProbeDemultiplexer demux{[&](Ubuntu::ProbeSection&& section) {
+        if (section.exitCode != 0) {
+            return;
+        }
+        if (section.name == "id") {
+            try {
+                uid = std::stoul(section.data, nullptr, 10);
+            } catch (...) { }
+        } else if (section.name == "passwd-stamp") {
+            stamp = Ubuntu::PasswdStamp::parse(section.data);
+        } else if ((section.name == "passwd") && stamp && !section.data.empty()) {
+            // Stamping before enumerating makes a concurrent change to /etc/passwd invalidate the
+            // snapshot.
+            cache.store(*stamp, Ubuntu::UserTable{section.data});
         }
+    }};
 
-        CloseHandle(readPipe);
-        CloseHandle(writePipe);
+    // The probe is a POSIX shell script, while the default user may log in with any shell.
+    Ubuntu::WslProcess process{
+        Ubuntu::directExecCommand({L"/bin/sh", L"-c", Ubuntu::probeCommand(queries)})};
+    auto result = process.run(api, INFINITE, [&](std::string_view chunk) { demux.feed(chunk); });
+    if (!result.error.empty()) {
+        return UID_INVALID;
     }
 
     return uid;
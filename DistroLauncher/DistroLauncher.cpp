@@ -4,54 +4,141 @@
 //
 
 #include "stdafx.h"
+#include "Ubuntu/ProcessPool.h"
 
 // Commandline arguments: 
 #define ARG_CONFIG              L"config"
 #define ARG_CONFIG_DEFAULT_USER L"--default-user"
+#define ARG_CONFIG_USERS        L"--users"
 #define ARG_INSTALL             L"install"
 #define ARG_INSTALL_ROOT        L"--root"
+#define ARG_INSTALL_ANSWERS     L"--answers"
+#define ARG_INSTALL_TRACE       L"--trace"
 #define ARG_RUN                 L"run"
 #define ARG_RUN_C               L"-c"
+#define ARG_RUN_EXEC            L"--exec"
+#define ARG_EXEC                L"exec"
 #define ARG_HELP                L"help"
 
 // Helper class for calling WSL Functions:
 // https://msdn.microsoft.com/en-us/library/windows/desktop/mt826874(v=vs.85).aspx
 WslApiLoader g_wslApi(DistributionInfo::Name);
 
-static HRESULT InstallDistribution(bool createUser);
+// Forwards to g_wslApi, recording every call while tracing is enabled (see Ubuntu/Trace.h).
+Ubuntu::Trace::TracedWslApi g_tracedWslApi(g_wslApi);
+
+static HRESULT InstallDistribution(bool createUser, const Ubuntu::AnswerFile* answers);
 static HRESULT SetDefaultUser(std::wstring_view userName);
+static HRESULT AddUsers(const std::filesystem::path& rosterPath);
+static HRESULT DeleteResolvConf();
 
-HRESULT InstallDistribution(bool createUser)
+HRESULT InstallDistribution(bool createUser, const Ubuntu::AnswerFile* answers)
 {
-    // Register the distribution.
+    Ubuntu::Trace::Span span{"InstallDistribution", "install"};
+
+    // Register the distribution. The rootfs is decompressed on all cores first when its format
+    // allows it, and the decompressed copy is deleted as soon as WSL imported it. Its index tells
+    // what the initialization tasks will need before the distro even exists. A rootfs that doesn't
+    // match the hash tree shipped with it is not registered at all.
     Helpers::PrintMessage(MSG_STATUS_INSTALLING);
-    HRESULT hr = g_wslApi.WslRegisterDistribution();
+    HRESULT hr;
+    Ubuntu::ImageFacts image;
+    {
+        Ubuntu::StagedRootfs rootfs{L"install.tar.gz", L"install.tar.zst"};
+        if (rootfs.corrupt()) {
+            return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+        }
+
+        image = Ubuntu::ImageFacts::inspect(rootfs);
+        hr = g_tracedWslApi.WslRegisterDistribution(rootfs.path().c_str());
+    }
     if (FAILED(hr)) {
         return hr;
     }
 
+    // The answer file may rule cloud-init out, whatever the image holds.
+    if ((answers != nullptr) && answers->skipCloudInit) {
+        image.cloudInit = false;
+    }
+
     // Delete /etc/resolv.conf to allow WSL to generate a version based on Windows networking information.
-    DWORD exitCode;
-    hr = g_wslApi.WslLaunchInteractive(L"rm /etc/resolv.conf", true, &exitCode);
-    if (FAILED(hr)) {
+    // Unless cloud-init may write it meanwhile, that's left to the script creating the user account or
+    // applying the answer file, saving a launch. Otherwise that launch boots the VM, thus it runs in the
+    // background, as do the initialization tasks.
+    const bool deferResolvConf = (createUser || (answers != nullptr)) && (image.cloudInit == false);
+    std::future<HRESULT> resolvConf;
+    if (!deferResolvConf) {
+        resolvConf = std::async(std::launch::async, DeleteResolvConf);
+    }
+
+    const auto resolvConfDeleted = [&resolvConf]() {
+        return resolvConf.valid() ? resolvConf.get() : S_OK;
+    };
+
+    // Apply the answer file, which tells which user account to create, if any, instead of the user
+    // and whether --root was given or not.
+    if (answers != nullptr) {
+        hr = resolvConfDeleted();
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        Ubuntu::CheckInitTasks(g_tracedWslApi, false, image);
+        ULONG uid = Ubuntu::applyAnswers(g_tracedWslApi, *answers, deferResolvConf);
+        if (uid == UID_INVALID) {
+            return E_FAIL;
+        }
+
+        if (uid != 0) {
+            hr = g_tracedWslApi.WslConfigureDistribution(uid, WSL_DISTRIBUTION_FLAGS_DEFAULT);
+        }
+
         return hr;
     }
 
-    if (Ubuntu::CheckInitTasks(g_wslApi, createUser)) {
-        return ERROR_SUCCESS;
+    // When the image tells that the user account will have to be created, its name is asked while
+    // the initialization tasks run, so that waiting for the user and waiting for the VM overlap.
+    Ubuntu::BackgroundInitTasks initTasks{g_tracedWslApi, createUser, image};
+    const bool promptNow = createUser && Ubuntu::defaultUserNeeded(image);
+    if (!promptNow && initTasks.finish()) {
+        hr = resolvConfDeleted();
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        return deferResolvConf ? DeleteResolvConf() : ERROR_SUCCESS;
     }
 
     // Create a user account.
     if (createUser) {
         Helpers::PrintMessage(MSG_CREATE_USER_PROMPT);
-        std::wstring userName;
+        ULONG uid;
         do {
-            userName = Helpers::GetUserInput(MSG_ENTER_USERNAME, 32);
+            std::wstring userName;
+            {
+                Ubuntu::Trace::Span prompt{"GetUserInput", "install"};
+                userName = Helpers::GetUserInput(MSG_ENTER_USERNAME, 32);
+            }
 
-        } while (!DistributionInfo::CreateUser(userName));
+            // The passwd database was most likely read while the user typed, thus names already
+            // taken are refused without launching anything.
+            if (initTasks.userExists(userName)) {
+                Helpers::PrintMessage(MSG_USER_EXISTS, userName.c_str());
+                uid = UID_INVALID;
+                continue;
+            }
+
+            hr = resolvConfDeleted();
+            if (FAILED(hr)) {
+                return hr;
+            }
+
+            uid = DistributionInfo::CreateUser(g_tracedWslApi, userName, deferResolvConf);
+
+        } while (uid == UID_INVALID);
 
         // Set this user account as the default.
-        hr = SetDefaultUser(userName);
+        hr = g_tracedWslApi.WslConfigureDistribution(uid, WSL_DISTRIBUTION_FLAGS_DEFAULT);
         if (FAILED(hr)) {
             return hr;
         }
@@ -60,16 +147,29 @@ HRESULT InstallDistribution(bool createUser)
     return hr;
 }
 
+HRESULT DeleteResolvConf()
+{
+    // This may run in the background while the user name is asked, thus it must leave the console
+    // alone: it reads an empty input, and a failure to find the file is not worth showing.
+    Ubuntu::Trace::Span span{"DeleteResolvConf", "install"};
+    Ubuntu::WslProcessPool::Request request;
+    request.command = L"rm /etc/resolv.conf";
+    request.input.emplace();
+    request.onError = [](std::string_view) {};
+    auto result = Ubuntu::WslProcessPool::shared().launch(g_tracedWslApi, std::move(request)).get();
+    return result.error.empty() ? S_OK : E_FAIL;
+}
+
 HRESULT SetDefaultUser(std::wstring_view userName)
 {
     // Query the UID of the given user name and configure the distribution
     // to use this UID as the default.
-    ULONG uid = DistributionInfo::QueryUid(userName);
+    ULONG uid = DistributionInfo::QueryUid(g_tracedWslApi, userName);
     if (uid == UID_INVALID) {
         return E_INVALIDARG;
     }
 
-    HRESULT hr = g_wslApi.WslConfigureDistribution(uid, WSL_DISTRIBUTION_FLAGS_DEFAULT);
+    HRESULT hr = g_tracedWslApi.WslConfigureDistribution(uid, WSL_DISTRIBUTION_FLAGS_DEFAULT);
     if (FAILED(hr)) {
         return hr;
     }
@@ -77,6 +177,21 @@ HRESULT SetDefaultUser(std::wstring_view userName)
     return hr;
 }
 
+HRESULT AddUsers(const std::filesystem::path& rosterPath)
+{
+    // Validate the whole roster before launching anything.
+    std::wstring error;
+    std::optional<Ubuntu::Roster> roster = Ubuntu::Roster::load(rosterPath, error);
+    if (!roster) {
+        Helpers::PrintMessage(MSG_ROSTER_INVALID, rosterPath.c_str(), error.c_str());
+        return S_FALSE;
+    }
+
+    // Create all the accounts in a single launch. What became of each was printed already, thus
+    // failures are only reported through the exit code.
+    return Ubuntu::applyRoster(g_tracedWslApi, *roster) ? S_OK : S_FALSE;
+}
+
 int DebugReportHook(int reportType, char *message, int *returnValue)
 {
     const auto type = [=]() -> std::string_view {
@@ -101,7 +216,7 @@ int wmain(int argc, wchar_t const *argv[])
     _CrtSetReportHook(DebugReportHook);
 
     // Update the title bar of the console window.
-    SetConsoleTitleW(DistributionInfo::WindowTitle.c_str());
+    SetConsoleTitleW(DistributionInfo::WindowTitle);
 
     // Initialize a vector of arguments.
     std::vector<std::wstring_view> arguments;
@@ -115,9 +230,55 @@ int wmain(int argc, wchar_t const *argv[])
         return 0;
     }
 
+    // Parse the install options.
+    bool installOnly = ((arguments.size() > 0) && (arguments[0] == ARG_INSTALL));
+    bool useRoot = false;
+    std::filesystem::path tracePath;
+    std::filesystem::path answersPath;
+    if (installOnly) {
+        for (size_t index = 1; index < arguments.size(); index += 1) {
+            if (arguments[index] == ARG_INSTALL_ROOT) {
+                useRoot = true;
+
+            } else if ((arguments[index] == ARG_INSTALL_ANSWERS) && (index + 1 < arguments.size())) {
+                index += 1;
+                answersPath = arguments[index];
+
+            } else if ((arguments[index] == ARG_INSTALL_TRACE) && (index + 1 < arguments.size())) {
+                index += 1;
+                tracePath = arguments[index];
+            }
+        }
+    }
+
+    // Tracing can also be enabled through the environment, for any command.
+    if (tracePath.empty()) {
+        wchar_t buffer[MAX_PATH];
+        DWORD length = GetEnvironmentVariableW(Ubuntu::Trace::EnvironmentVariable, buffer, MAX_PATH);
+        if ((length > 0) && (length < MAX_PATH)) {
+            tracePath = buffer;
+        }
+    }
+
+    std::optional<Ubuntu::Trace::Session> trace;
+    if (!tracePath.empty()) {
+        trace.emplace(tracePath);
+    }
+
+    // Validate the answer file before launching anything, so that mistakes cost nothing.
+    std::optional<Ubuntu::AnswerFile> answers;
+    if (!answersPath.empty()) {
+        std::wstring error;
+        answers = Ubuntu::AnswerFile::load(answersPath, error);
+        if (!answers) {
+            Helpers::PrintMessage(MSG_ANSWER_FILE_INVALID, answersPath.c_str(), error.c_str());
+            return 1;
+        }
+    }
+
     // Ensure that the Windows Subsystem for Linux optional component is installed.
     DWORD exitCode = 1;
-    if (!g_wslApi.WslIsOptionalComponentInstalled()) {
+    if (!g_tracedWslApi.WslIsOptionalComponentInstalled()) {
         Helpers::PrintErrorMessage(HRESULT_FROM_WIN32(ERROR_LINUX_SUBSYSTEM_NOT_PRESENT));
         if (arguments.empty()) {
             Helpers::PromptForInput();
@@ -127,16 +288,17 @@ int wmain(int argc, wchar_t const *argv[])
     }
 
     // Install the distribution if it is not already.
-    bool installOnly = ((arguments.size() > 0) && (arguments[0] == ARG_INSTALL));
     HRESULT hr = S_OK;
-    if (!g_wslApi.WslIsDistributionRegistered()) {
+    if (!g_tracedWslApi.WslIsDistributionRegistered()) {
 
         // If the "--root" option is specified, do not create a user account.
-        bool useRoot = ((installOnly) && (arguments.size() > 1) && (arguments[1] == ARG_INSTALL_ROOT));
-        hr = InstallDistribution(!useRoot);
+        hr = InstallDistribution(!useRoot, answers ? &*answers : nullptr);
         if (FAILED(hr)) {
             if (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS)) {
                 Helpers::PrintMessage(MSG_INSTALL_ALREADY_EXISTS);
+
+            } else if (hr == HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT)) {
+                Helpers::PrintMessage(MSG_ROOTFS_CORRUPT);
             }
 
         } else {
@@ -149,7 +311,7 @@ int wmain(int argc, wchar_t const *argv[])
     // Parse the command line arguments.
     if ((SUCCEEDED(hr)) && (!installOnly)) {
         if (arguments.empty()) {
-            hr = g_wslApi.WslLaunchInteractive(L"", false, &exitCode);
+            hr = g_tracedWslApi.WslLaunchInteractive(L"", false, &exitCode);
 
             // Check exitCode to see if wsl.exe returned that it could not start the Linux process
             // then prompt users for input so they can view the error message.
@@ -157,6 +319,19 @@ int wmain(int argc, wchar_t const *argv[])
                 Helpers::PromptForInput();
             }
 
+        } else if ((arguments[0] == ARG_EXEC) ||
+                   ((arguments[0] == ARG_RUN) && (arguments.size() > 1) && (arguments[1] == ARG_RUN_EXEC))) {
+
+            // The arguments are passed as they are, without any shell interpreting them.
+            size_t first = (arguments[0] == ARG_EXEC) ? 1 : 2;
+            std::vector<std::wstring_view> execArguments(arguments.begin() + first, arguments.end());
+            if (execArguments.empty()) {
+                Helpers::PrintMessage(MSG_USAGE);
+                return exitCode;
+            }
+
+            hr = Ubuntu::directExec(g_tracedWslApi, execArguments, exitCode);
+
         } else if ((arguments[0] == ARG_RUN) ||
                    (arguments[0] == ARG_RUN_C)) {
 
@@ -166,18 +341,38 @@ int wmain(int argc, wchar_t const *argv[])
                 command += arguments[index];
             }
 
-            hr = g_wslApi.WslLaunchInteractive(command.c_str(), true, &exitCode);
+            // Scripts calling the launcher in a loop may opt in to the agent, which runs commands
+            // without launching a process through WSL each time. Should it be unreachable, or the
+            // command have an input or a console to read, the command is launched as usual.
+            std::optional<DWORD> agentExitCode;
+            if (Ubuntu::Agent::enabled()) {
+                auto request = Ubuntu::Agent::ExecRequest::shellCommand(command);
+                agentExitCode = Ubuntu::Agent::run(request);
+            }
+
+            if (agentExitCode) {
+                exitCode = *agentExitCode;
+
+            } else {
+                hr = g_tracedWslApi.WslLaunchInteractive(command.c_str(), true, &exitCode);
+            }
+
+        } else if (arguments[0] == Ubuntu::Agent::ServerArgument) {
+            exitCode = Ubuntu::Agent::serve(g_tracedWslApi);
 
         } else if (arguments[0] == ARG_CONFIG) {
             hr = E_INVALIDARG;
             if (arguments.size() == 3) {
                 if (arguments[1] == ARG_CONFIG_DEFAULT_USER) {
                     hr = SetDefaultUser(arguments[2]);
+
+                } else if (arguments[1] == ARG_CONFIG_USERS) {
+                    hr = AddUsers(arguments[2]);
                 }
             }
 
             if (SUCCEEDED(hr)) {
-                exitCode = 0;
+                exitCode = (hr == S_OK) ? 0 : 1;
             }
 
         } else {
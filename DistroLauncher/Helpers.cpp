@@ -5,14 +5,10 @@
 
 #include "stdafx.h"
 
-namespace {
-    HRESULT FormatMessageHelperVa(DWORD messageId, va_list vaList, std::wstring* message);
-    HRESULT PrintMessageVa(DWORD messageId, va_list vaList);
-}
-
-std::wstring Helpers::GetUserInput(DWORD promptMsg, DWORD maxCharacters)
+#ifdef _WIN32
+std::wstring Helpers::GetUserInput(const Ubuntu::Message<>& prompt, DWORD maxCharacters)
 {
-    Helpers::PrintMessage(promptMsg);
+    Helpers::PrintMessage(prompt);
     size_t bufferSize = maxCharacters + 1;
     std::unique_ptr<wchar_t[]> inputBuffer(new wchar_t[bufferSize]);
     std::wstring input;
@@ -32,66 +28,32 @@ std::wstring Helpers::GetUserInput(DWORD promptMsg, DWORD maxCharacters)
 
 void Helpers::PrintErrorMessage(HRESULT error)
 {
-    PWSTR buffer = nullptr; 
-    ::FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER,
-                     nullptr,
-                     error,
-                     0,
-                     (PWSTR)&buffer,
-                     0,
-                     nullptr);
-
-    Helpers::PrintMessage(MSG_ERROR_CODE, error, buffer);
-    if (buffer != nullptr) {
-        HeapFree(GetProcessHeap(), 0, buffer);
+    // System messages are short: a buffer on the stack saves a heap allocation.
+    wchar_t buffer[512];
+    if (::FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+                         nullptr,
+                         error,
+                         0,
+                         buffer,
+                         ARRAYSIZE(buffer),
+                         nullptr) == 0) {
+        buffer[0] = L'\0';
     }
 
+    Helpers::PrintMessage(MSG_ERROR_CODE, error, buffer);
     return;
 }
 
-HRESULT Helpers::PrintMessage(DWORD messageId, ...)
-{
-    va_list argList;
-    va_start(argList, messageId);
-    HRESULT hr = PrintMessageVa(messageId, argList);
-    va_end(argList);
-    return hr;
-}
-
 void Helpers::PromptForInput()
 {
     Helpers::PrintMessage(MSG_PRESS_A_KEY);
     _getwch();
     return;
 }
-
-namespace {
-    HRESULT FormatMessageHelperVa(DWORD messageId, va_list vaList, std::wstring* message)
-    {
-        PWSTR buffer = nullptr; 
-        DWORD written = ::FormatMessageW(FORMAT_MESSAGE_FROM_HMODULE | FORMAT_MESSAGE_ALLOCATE_BUFFER,
-                                         nullptr,
-                                         messageId,
-                                         0,
-                                         (PWSTR)&buffer,
-                                         10,
-                                         &vaList);
-        *message = buffer;
-        if (buffer != nullptr) {
-            HeapFree(GetProcessHeap(), 0, buffer);
-        }
-
-        return (written > 0) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
-    }
-
-    HRESULT PrintMessageVa(DWORD messageId, va_list vaList)
-    {
-        std::wstring message;
-        HRESULT hr = FormatMessageHelperVa(messageId, vaList, &message);
-        if (SUCCEEDED(hr)) {
-            wprintf(L"%ls", message.c_str());
-        }
-
-        return hr;
-    }
+#else
+// There are no system messages to describe errors on POSIX hosts, only their code is printed.
+void Helpers::PrintErrorMessage(HRESULT error)
+{
+    Helpers::PrintMessage(MSG_ERROR_CODE, error, L"");
 }
+#endif
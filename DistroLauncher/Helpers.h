@@ -9,8 +9,16 @@
 
 namespace Helpers
 {
-    std::wstring GetUserInput(DWORD promptMsg, DWORD maxCharacters);
+    std::wstring GetUserInput(const Ubuntu::Message<>& prompt, DWORD maxCharacters);
     void PrintErrorMessage(HRESULT hr);
-    HRESULT PrintMessage(DWORD messageId, ...);
     void PromptForInput();
+
+    // Print a message of the catalog (see messages.h) to the standard output, with an argument per
+    // insert of the message.
+    template <Ubuntu::Insert... Inserts, class... Args>
+    HRESULT PrintMessage(const Ubuntu::Message<Inserts...>& message, const Args&... args)
+    {
+        const std::wstring text = Ubuntu::formatMessage(message, args...);
+        return (wprintf(L"%ls", text.c_str()) < 0) ? E_FAIL : S_OK;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,8 @@
+// Generated by wsl-builder/prepare-build from the rootfs it packed. DO NOT EDIT.
+#pragma once
+#include <array>
+
+#include "Ubuntu/HashTree.h"
+
+// The root hashes of the hash trees of the rootfs files shipped for the architecture being built.
+inline constexpr std::array<Ubuntu::ExpectedRootHash, 0> ExpectedRootHashes{};
@@ -0,0 +1,1104 @@
+#include <stdafx.h>
+#include "Agent.h"
+#include "Probe.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#ifdef _WIN32
+#include <sddl.h>
+#else
+#include <cerrno>
+#include <csignal>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+namespace Ubuntu::Agent {
+
+namespace {
+// The server exits, and the agent with it, once no client connected for that long.
+constexpr std::chrono::minutes IdleTimeout{10};
+
+// How long clients wait for a server they started, and servers for their agent, which includes
+// booting the VM.
+constexpr std::chrono::seconds StartTimeout{60};
+
+constexpr std::size_t ChunkSize = 64 * 1024;
+
+// A client that lets that much output pile up without reading it is disconnected.
+constexpr std::size_t MaxQueuedSize = 16 * 1024 * 1024;
+
+// The agent. It greets with a ready frame and then runs each exec request on a thread of its own,
+// streaming the output of the command as it comes. Commands run in sessions of their own, so that
+// killing one kills whatever it spawned too.
+constexpr std::wstring_view agentScript = LR"py(import os, subprocess, sys, threading
+lock = threading.Lock()
+running = {}
+cwds = {}
+def send(kind, id, data=b''):
+    with lock:
+        sys.stdout.buffer.write(b'%s %d %d\n' % (kind, id, len(data)) + data)
+        sys.stdout.buffer.flush()
+def linux(path):
+    if path not in cwds:
+        try:
+            cwds[path] = subprocess.run(['wslpath', '-u', path], stdout=subprocess.PIPE,
+                stderr=subprocess.DEVNULL, check=True).stdout.rstrip(b'\n')
+        except Exception:
+            cwds[path] = None
+    return cwds[path]
+def pump(id, stream, kind):
+    for data in iter(lambda: os.read(stream.fileno(), 65536), b''):
+        send(kind, id, data)
+def run(id, request):
+    fields = request.split(b'\0')
+    end = fields.index(b'', 1)
+    env = dict(os.environb)
+    env.update(e.partition(b'=')[::2] for e in fields[1:end])
+    argv = fields[end + 1:-1]
+    if argv and not argv[0]:
+        argv[0] = env.get(b'SHELL', b'/bin/sh')
+    try:
+        p = subprocess.Popen(argv, cwd=linux(fields[0]) if fields[0] else None, env=env,
+            stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+            start_new_session=True)
+    except (OSError, IndexError) as e:
+        send(b'err', id, b'%s\n' % str(e).encode())
+        send(b'exit', id, b'127')
+        return
+    running[id] = p
+    pumps = [threading.Thread(target=pump, args=(id, s, k))
+             for s, k in ((p.stdout, b'out'), (p.stderr, b'err'))]
+    for t in pumps: t.start()
+    for t in pumps: t.join()
+    code = p.wait()
+    running.pop(id, None)
+    send(b'exit', id, b'%d' % (code if code >= 0 else 128 - code))
+send(b'ready', 0)
+for header in iter(sys.stdin.buffer.readline, b''):
+    kind, id, size = header.split()
+    data = sys.stdin.buffer.read(int(size))
+    if kind == b'exec':
+        threading.Thread(target=run, args=(int(id), data), daemon=True).start()
+    elif kind == b'kill' and int(id) in running:
+        try:
+            os.killpg(running[int(id)].pid, 9)
+        except OSError:
+            pass
+)py";
+
+std::string frame(std::string_view kind, int id, std::string_view payload = {}) {
+  std::string result{kind};
+  result += ' ';
+  result += std::to_string(id);
+  result += ' ';
+  result += std::to_string(payload.size());
+  result += '\n';
+  result += payload;
+  return result;
+}
+
+std::optional<std::string> environmentVariable(const std::wstring& name) {
+#ifdef _WIN32
+  DWORD size = GetEnvironmentVariableW(name.c_str(), nullptr, 0);
+  if (size == 0) {
+    return std::nullopt;
+  }
+  std::wstring value(size, L'\0');
+  value.resize(GetEnvironmentVariableW(name.c_str(), value.data(), size));
+  return toUtf8(value);
+#else
+  if (const char* value = std::getenv(toUtf8(name).c_str())) {
+    return value;
+  }
+  return std::nullopt;
+#endif
+}
+
+#ifdef _WIN32
+// A connected byte stream. Reads and writes block, even on handles opened for overlapped I/O, so
+// that reading and writing from different threads at once is possible.
+class Channel {
+ public:
+  Channel() = default;
+  Channel(HANDLE handle, bool overlapped) : handle_{handle}, overlapped_{overlapped} {}
+  Channel(Channel&& other) noexcept :
+      handle_{std::exchange(other.handle_, nullptr)}, overlapped_{other.overlapped_} {}
+  Channel& operator=(Channel&& other) noexcept {
+    close();
+    handle_ = std::exchange(other.handle_, nullptr);
+    overlapped_ = other.overlapped_;
+    return *this;
+  }
+  ~Channel() { close(); }
+
+  bool valid() const { return handle_ != nullptr; }
+
+  // Reads whatever is available into [chunk]. Returns false once the stream ended.
+  bool read(std::string& chunk) {
+    chunk.resize(ChunkSize);
+    DWORD count = 0;
+    const bool ok = transfer(&ReadFile, chunk.data(), ChunkSize, count);
+    chunk.resize(count);
+    return ok && count > 0;
+  }
+
+  bool write(std::string_view data) {
+    while (!data.empty()) {
+      DWORD count = 0;
+      const auto size = static_cast<DWORD>(std::min<std::size_t>(data.size(), ChunkSize));
+      if (!transfer(&WriteFile, data.data(), size, count) || count == 0) {
+        return false;
+      }
+      data.remove_prefix(count);
+    }
+    return true;
+  }
+
+  // Ends the stream for the peer and fails the reads pending on our side.
+  void shutdown() {
+    if (valid()) {
+      DisconnectNamedPipe(handle_);
+      CancelIoEx(handle_, nullptr);
+    }
+  }
+
+  void close() {
+    if (valid()) {
+      CloseHandle(std::exchange(handle_, nullptr));
+    }
+  }
+
+  // Writes to a standard handle of the launcher.
+  static bool writeStd(DWORD which, std::string_view data) {
+    Channel output{GetStdHandle(which), false};
+    const bool ok = output.write(data);
+    output.handle_ = nullptr;
+    return ok;
+  }
+
+ private:
+  template <typename Function, typename Buffer>
+  bool transfer(Function* function, Buffer* buffer, DWORD size, DWORD& count) {
+    if (!overlapped_) {
+      return function(handle_, buffer, size, &count, nullptr) != FALSE;
+    }
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (overlapped.hEvent == nullptr) {
+      return false;
+    }
+    BOOL ok = function(handle_, buffer, size, nullptr, &overlapped);
+    if (ok || GetLastError() == ERROR_IO_PENDING) {
+      ok = GetOverlappedResult(handle_, &overlapped, &count, TRUE);
+    }
+    CloseHandle(overlapped.hEvent);
+    return ok != FALSE;
+  }
+
+  HANDLE handle_ = nullptr;
+  bool overlapped_ = false;
+};
+
+// The TOKEN_USER of [process], holding the SID of the user it runs as.
+std::optional<std::vector<unsigned char>> processUser(HANDLE process) {
+  HANDLE token = nullptr;
+  if (!OpenProcessToken(process, TOKEN_QUERY, &token)) {
+    return std::nullopt;
+  }
+  DWORD size = 0;
+  GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+  std::vector<unsigned char> user(size);
+  const BOOL ok = size != 0 && GetTokenInformation(token, TokenUser, user.data(), size, &size);
+  CloseHandle(token);
+  if (!ok) {
+    return std::nullopt;
+  }
+  return user;
+}
+
+PSID sidOf(std::vector<unsigned char>& user) {
+  return reinterpret_cast<TOKEN_USER*>(user.data())->User.Sid;
+}
+
+// Pipe names are shared by every user of the machine, so the name alone proves nothing: the server
+// only lets the user running it in, and clients only talk to a server running as themselves, lest
+// another user squatting the name gets their commands.
+bool runsAsCurrentUser(HANDLE pipe) {
+  ULONG pid = 0;
+  if (!GetNamedPipeServerProcessId(pipe, &pid)) {
+    return false;
+  }
+  HANDLE server = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+  if (server == nullptr) {
+    return false;
+  }
+  auto serverUser = processUser(server);
+  CloseHandle(server);
+  auto currentUser = processUser(GetCurrentProcess());
+  return serverUser && currentUser && EqualSid(sidOf(*serverUser), sidOf(*currentUser));
+}
+
+// \\.\pipe\<distro>.agent.<session>: each Windows session of the user has a server of its own.
+std::wstring pipeName() {
+  DWORD session = 0;
+  ProcessIdToSessionId(GetCurrentProcessId(), &session);
+  return std::wstring{L"\\\\.\\pipe\\"} + DistributionInfo::Name + L".agent." +
+         std::to_wstring(session);
+}
+
+class Listener {
+ public:
+  ~Listener() {
+    if (pending_ != nullptr) {
+      CloseHandle(pending_);
+    }
+    if (security_ != nullptr) {
+      LocalFree(security_);
+    }
+    for (auto event : {connected_, stop_}) {
+      if (event != nullptr) {
+        CloseHandle(event);
+      }
+    }
+  }
+
+  // Creates the pipe. Fails if another server created it already.
+  bool listen() {
+    if (!restrictToCurrentUser()) {
+      return false;
+    }
+    connected_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    stop_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    pending_ = createInstance(FILE_FLAG_FIRST_PIPE_INSTANCE);
+    return connected_ != nullptr && stop_ != nullptr && pending_ != nullptr;
+  }
+
+  // Waits for the next client for up to [timeout]. Returns an invalid channel if none connected
+  // by then or stop() was called.
+  Channel accept(std::chrono::milliseconds timeout) {
+    if (pending_ == nullptr && (pending_ = createInstance(0)) == nullptr) {
+      return {};
+    }
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = connected_;
+    ResetEvent(connected_);
+    BOOL connected = ConnectNamedPipe(pending_, &overlapped);
+    if (!connected && GetLastError() == ERROR_PIPE_CONNECTED) {
+      connected = TRUE;
+    } else if (!connected && GetLastError() == ERROR_IO_PENDING) {
+      const HANDLE events[] = {connected_, stop_};
+      if (WaitForMultipleObjects(2, events, FALSE, static_cast<DWORD>(timeout.count())) !=
+          WAIT_OBJECT_0) {
+        CancelIoEx(pending_, &overlapped);
+      }
+      // A client may have connected meanwhile, in which case it's served.
+      DWORD ignored = 0;
+      connected = GetOverlappedResult(pending_, &overlapped, &ignored, TRUE);
+    }
+    if (!connected) {
+      // The client may have gone already, the instance is not worth reusing then.
+      if (GetLastError() != ERROR_OPERATION_ABORTED) {
+        CloseHandle(std::exchange(pending_, nullptr));
+      }
+      return {};
+    }
+    return Channel{std::exchange(pending_, nullptr), true};
+  }
+
+  void stop() {
+    stopped_ = true;
+    SetEvent(stop_);
+  }
+
+  bool stopped() const { return stopped_; }
+
+ private:
+  // Builds a security descriptor whose protected DACL grants access to the current user alone,
+  // rather than the default one, which lets in anyone able to read the launcher's executable.
+  bool restrictToCurrentUser() {
+    auto user = processUser(GetCurrentProcess());
+    wchar_t* sid = nullptr;
+    if (!user || !ConvertSidToStringSidW(sidOf(*user), &sid)) {
+      return false;
+    }
+    const std::wstring sddl = L"D:P(A;;GA;;;" + std::wstring{sid} + L")";
+    LocalFree(sid);
+    return ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(), SDDL_REVISION_1,
+                                                                &security_, nullptr) != FALSE;
+  }
+
+  HANDLE createInstance(DWORD flags) {
+    SECURITY_ATTRIBUTES attributes{sizeof(attributes), security_, FALSE};
+    HANDLE pipe = CreateNamedPipeW(pipeName().c_str(),
+                                   PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | flags,
+                                   PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+                                       PIPE_REJECT_REMOTE_CLIENTS,
+                                   PIPE_UNLIMITED_INSTANCES, ChunkSize, ChunkSize, 0, &attributes);
+    return pipe == INVALID_HANDLE_VALUE ? nullptr : pipe;
+  }
+
+  PSECURITY_DESCRIPTOR security_ = nullptr;
+  HANDLE pending_ = nullptr;
+  HANDLE connected_ = nullptr;
+  HANDLE stop_ = nullptr;
+  std::atomic<bool> stopped_{false};
+};
+
+Channel connect() {
+  const auto name = pipeName();
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    // The server may only identify the client, not act on its behalf.
+    const DWORD flags = FILE_FLAG_OVERLAPPED | SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION;
+    HANDLE pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING,
+                              flags, nullptr);
+    if (pipe != INVALID_HANDLE_VALUE) {
+      if (!runsAsCurrentUser(pipe)) {
+        CloseHandle(pipe);
+        return {};
+      }
+      return Channel{pipe, true};
+    }
+    // All instances are busy until the server creates the next one.
+    if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeW(name.c_str(), 1000)) {
+      break;
+    }
+  }
+  return {};
+}
+
+// The environment of the launcher but for the trace file, as CreateProcessW takes it.
+std::wstring serverEnvironment() {
+  const std::wstring_view traced{Trace::EnvironmentVariable};
+  std::wstring block;
+  wchar_t* strings = GetEnvironmentStringsW();
+  if (strings == nullptr) {
+    return block;
+  }
+  for (const wchar_t* entry = strings; *entry != L'\0'; entry += wcslen(entry) + 1) {
+    const std::wstring_view variable{entry};
+    // Names are case-insensitive.
+    if (variable.size() > traced.size() && variable[traced.size()] == L'=' &&
+        _wcsnicmp(entry, traced.data(), traced.size()) == 0) {
+      continue;
+    }
+    block += variable;
+    block += L'\0';
+  }
+  FreeEnvironmentStringsW(strings);
+  block += L'\0';
+  return block;
+}
+
+// Starts the server detached from the console and, if allowed, from the job of the caller, as build
+// systems tend to kill whatever their steps leave behind. It inherits no handles, so callers
+// capturing the output of the launcher don't wait for the server to exit, nor the trace file, which
+// it would overwrite when it exits, long after the launcher wrote its own trace.
+bool startServer() {
+  wchar_t path[MAX_PATH];
+  DWORD length = GetModuleFileNameW(nullptr, path, MAX_PATH);
+  if ((length == 0) || (length >= MAX_PATH)) {
+    return false;
+  }
+  std::wstring commandLine = L"\"" + std::wstring{path} + L"\" " + ServerArgument;
+  STARTUPINFOW startup{};
+  startup.cb = sizeof(startup);
+  startup.dwFlags = STARTF_USESTDHANDLES;
+  PROCESS_INFORMATION process{};
+  std::wstring environment = serverEnvironment();
+  void* block = environment.empty() ? nullptr : environment.data();
+  const DWORD flags = DETACHED_PROCESS | CREATE_NEW_PROCESS_GROUP | CREATE_UNICODE_ENVIRONMENT;
+  if (!CreateProcessW(path, commandLine.data(), nullptr, nullptr, FALSE,
+                      flags | CREATE_BREAKAWAY_FROM_JOB, block, nullptr, &startup, &process) &&
+      !CreateProcessW(path, commandLine.data(), nullptr, nullptr, FALSE, flags, block, nullptr,
+                      &startup, &process)) {
+    return false;
+  }
+  CloseHandle(process.hThread);
+  CloseHandle(process.hProcess);
+  return true;
+}
+
+// Creates a pipe whose end of ours is not inheritable, unlike the end of the agent.
+bool createPipe(Channel& ours, HANDLE& theirs, bool inbound) {
+  SECURITY_ATTRIBUTES attributes{sizeof(attributes), nullptr, TRUE};
+  HANDLE read = nullptr;
+  HANDLE write = nullptr;
+  if (!CreatePipe(&read, &write, &attributes, 0)) {
+    return false;
+  }
+  ours = Channel{inbound ? read : write, false};
+  theirs = inbound ? write : read;
+  return SetHandleInformation(inbound ? read : write, HANDLE_FLAG_INHERIT, 0) != FALSE;
+}
+
+HANDLE openNull() {
+  SECURITY_ATTRIBUTES attributes{sizeof(attributes), nullptr, TRUE};
+  HANDLE null = CreateFileW(L"NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &attributes,
+                            OPEN_EXISTING, 0, nullptr);
+  return null == INVALID_HANDLE_VALUE ? nullptr : null;
+}
+
+void closeTheirs(HANDLE handle) {
+  if (handle != nullptr) {
+    CloseHandle(handle);
+  }
+}
+
+void waitForAgent(HANDLE process) {
+  WaitForSingleObject(process, 5000);
+  CloseHandle(process);
+}
+
+std::string currentDirectory() {
+  DWORD size = GetCurrentDirectoryW(0, nullptr);
+  std::wstring directory(size, L'\0');
+  directory.resize(GetCurrentDirectoryW(size, directory.data()));
+  return toUtf8(directory);
+}
+
+bool stdInIsNull() {
+  HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+  if ((input == nullptr) || (input == INVALID_HANDLE_VALUE)) {
+    return true;
+  }
+  // NUL is a character device, as consoles are.
+  DWORD mode;
+  return (GetFileType(input) == FILE_TYPE_CHAR) && (GetConsoleMode(input, &mode) == FALSE);
+}
+#else
+// A connected byte stream: a socket or a pipe.
+class Channel {
+ public:
+  Channel() = default;
+  explicit Channel(int fd) : fd_{fd} {}
+  Channel(Channel&& other) noexcept : fd_{std::exchange(other.fd_, -1)} {}
+  Channel& operator=(Channel&& other) noexcept {
+    close();
+    fd_ = std::exchange(other.fd_, -1);
+    return *this;
+  }
+  ~Channel() { close(); }
+
+  bool valid() const { return fd_ >= 0; }
+
+  // Reads whatever is available into [chunk]. Returns false once the stream ended.
+  bool read(std::string& chunk) {
+    chunk.resize(ChunkSize);
+    ssize_t count;
+    while ((count = ::read(fd_, chunk.data(), ChunkSize)) < 0 && errno == EINTR) {
+    }
+    chunk.resize(count > 0 ? count : 0);
+    return count > 0;
+  }
+
+  bool write(std::string_view data) { return writeAll(fd_, data); }
+
+  // Ends the stream for the peer and fails the reads pending on our side.
+  void shutdown() {
+    if (valid()) {
+      ::shutdown(fd_, SHUT_RDWR);
+    }
+  }
+
+  void close() {
+    if (valid()) {
+      ::close(std::exchange(fd_, -1));
+    }
+  }
+
+  // Writes to a standard handle of the launcher.
+  static bool writeStd(DWORD which, std::string_view data) {
+    return writeAll(fdFromHandle(GetStdHandle(which)), data);
+  }
+
+  int fd() const { return fd_; }
+
+ private:
+  static bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+      // Sockets don't raise SIGPIPE when the peer is gone, pipes rely on it being ignored.
+      ssize_t count = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+      if (count < 0 && errno == ENOTSOCK) {
+        count = ::write(fd, data.data(), data.size());
+      }
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      if (count <= 0) {
+        return false;
+      }
+      data.remove_prefix(count);
+    }
+    return true;
+  }
+
+  int fd_ = -1;
+};
+
+// <runtime directory>/<distro>.agent.sock, or the empty string without a runtime directory private
+// to the user. Falling back to a directory shared with other users would let them squat the socket.
+std::string socketPath() {
+  const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+  struct stat directory;
+  if (runtime == nullptr || *runtime == '\0' || stat(runtime, &directory) != 0 ||
+      !S_ISDIR(directory.st_mode) || directory.st_uid != getuid() ||
+      (directory.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+    return {};
+  }
+  return std::string{runtime} + '/' + toUtf8(DistributionInfo::Name) + ".agent.sock";
+}
+
+bool toAddress(const std::string& path, sockaddr_un& address) {
+  address = {};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  path.copy(address.sun_path, path.size());
+  return true;
+}
+
+Channel connect() {
+  sockaddr_un address;
+  if (!toAddress(socketPath(), address)) {
+    return {};
+  }
+  Channel channel{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+  if (!channel.valid() ||
+      ::connect(channel.fd(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    return {};
+  }
+  return channel;
+}
+
+class Listener {
+ public:
+  ~Listener() {
+    if (fd_ >= 0) {
+      close(fd_);
+      unlink(path_.c_str());
+    }
+    for (int fd : wake_) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  // Creates the socket. Fails if another server listens on it already.
+  bool listen() {
+    path_ = socketPath();
+    sockaddr_un address;
+    if (!toAddress(path_, address) || pipe2(wake_, O_CLOEXEC) != 0) {
+      return false;
+    }
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // The socket is created private to the user, rather than made so after the fact. Changing the
+    // umask of the process is fine as no other thread runs yet.
+    const auto bindTo = [&] {
+      const mode_t mask = umask(0177);
+      const bool bound = bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+      umask(mask);
+      return bound;
+    };
+    // A socket nobody listens on is left behind by a server that crashed.
+    if (fd_ >= 0 && !bindTo() && errno == EADDRINUSE && !connect().valid()) {
+      unlink(path_.c_str());
+      bindTo();
+    }
+    if (fd_ < 0 || ::listen(fd_, SOMAXCONN) != 0) {
+      if (fd_ >= 0) {
+        close(std::exchange(fd_, -1));
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // Waits for the next client for up to [timeout]. Returns an invalid channel if none connected
+  // by then or stop() was called.
+  Channel accept(std::chrono::milliseconds timeout) {
+    pollfd fds[] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+    int ready;
+    while ((ready = poll(fds, 2, static_cast<int>(timeout.count()))) < 0 && errno == EINTR) {
+    }
+    if (ready <= 0 || stopped_ || !(fds[0].revents & POLLIN)) {
+      return {};
+    }
+    return Channel{accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC)};
+  }
+
+  void stop() {
+    stopped_ = true;
+    const char byte = 0;
+    while (::write(wake_[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+  }
+
+  bool stopped() const { return stopped_; }
+
+ private:
+  std::string path_;
+  int fd_ = -1;
+  int wake_[2] = {-1, -1};
+  std::atomic<bool> stopped_{false};
+};
+
+// The environment of the launcher but for the trace file, as posix_spawn takes it.
+std::vector<char*> serverEnvironment() {
+  const std::string traced = toUtf8(Trace::EnvironmentVariable) + '=';
+  std::vector<char*> environment;
+  for (char** entry = environ; *entry != nullptr; ++entry) {
+    if (std::string_view{*entry}.rfind(traced, 0) != 0) {
+      environment.push_back(*entry);
+    }
+  }
+  environment.push_back(nullptr);
+  return environment;
+}
+
+// Starts the server in a session of its own, with its standard streams on /dev/null, so callers
+// capturing the output of the launcher don't wait for the server to exit. It doesn't inherit the
+// trace file, which it would overwrite when it exits, long after the launcher wrote its own trace.
+bool startServer() {
+  const std::string argument = toUtf8(ServerArgument);
+  char* argv[] = {const_cast<char*>("launcher"), const_cast<char*>(argument.c_str()), nullptr};
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attributes;
+  posix_spawn_file_actions_init(&actions);
+  for (int fd : {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO}) {
+    posix_spawn_file_actions_addopen(&actions, fd, "/dev/null", O_RDWR, 0);
+  }
+  posix_spawnattr_init(&attributes);
+  posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSID);
+  pid_t pid;
+  auto environment = serverEnvironment();
+  const bool started =
+      posix_spawn(&pid, "/proc/self/exe", &actions, &attributes, argv, environment.data()) == 0;
+  posix_spawnattr_destroy(&attributes);
+  posix_spawn_file_actions_destroy(&actions);
+  return started;
+}
+
+bool createPipe(Channel& ours, HANDLE& theirs, bool inbound) {
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    return false;
+  }
+  ours = Channel{fds[inbound ? 0 : 1]};
+  theirs = handleFromFd(fds[inbound ? 1 : 0]);
+  return true;
+}
+
+HANDLE openNull() {
+  const int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  return fd < 0 ? nullptr : handleFromFd(fd);
+}
+
+void closeTheirs(HANDLE handle) {
+  if (handle != nullptr) {
+    close(fdFromHandle(handle));
+  }
+}
+
+void waitForAgent(HANDLE process) {
+  int status;
+  while (waitpid(fdFromHandle(process), &status, 0) < 0 && errno == EINTR) {
+  }
+}
+
+std::string currentDirectory() {
+  std::error_code error;
+  return std::filesystem::current_path(error).string();
+}
+
+bool stdInIsNull() {
+  struct stat attributes;
+  if (fstat(STDIN_FILENO, &attributes) != 0) {
+    return true;
+  }
+  // /dev/null is a character device, as terminals are.
+  return S_ISCHR(attributes.st_mode) && (isatty(STDIN_FILENO) == 0);
+}
+#endif
+
+// A connected client. What is sent to it is queued and written by a thread of its own, so that a
+// client not reading its output holds up neither the agent nor the other clients.
+class Client {
+ public:
+  explicit Client(Channel channel) : channel_{std::move(channel)} {
+    writer_ = std::thread{&Client::writeQueued, this};
+  }
+
+  // Only destroyed once the client is gone or shut down, thus the writer is never stuck writing.
+  ~Client() {
+    {
+      std::scoped_lock lock{mutex_};
+      closing_ = true;
+    }
+    queued_.notify_all();
+    channel_.shutdown();
+    writer_.join();
+  }
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  // Reads whatever the client sent into [chunk]. Returns false once it's gone.
+  bool read(std::string& chunk) { return channel_.read(chunk); }
+
+  // Queues [data] for the client, which is disconnected if it fell too far behind.
+  void send(std::string data) {
+    std::scoped_lock lock{mutex_};
+    if (failed_) {
+      return;
+    }
+    queuedSize_ += data.size();
+    if (queuedSize_ > MaxQueuedSize) {
+      fail();
+      return;
+    }
+    queue_.push_back(std::move(data));
+    queued_.notify_one();
+  }
+
+  void shutdown() { channel_.shutdown(); }
+
+ private:
+  void writeQueued() {
+    std::unique_lock lock{mutex_};
+    while (true) {
+      queued_.wait(lock, [this] { return !queue_.empty() || closing_; });
+      if (closing_) {
+        return;
+      }
+      std::string data = std::move(queue_.front());
+      queue_.pop_front();
+      queuedSize_ -= data.size();
+      lock.unlock();
+      const bool written = channel_.write(data);
+      lock.lock();
+      if (!written) {
+        fail();
+      }
+    }
+  }
+
+  // Drops what is queued and disconnects the client, which makes its commands be killed.
+  void fail() {
+    failed_ = true;
+    queue_.clear();
+    queuedSize_ = 0;
+    channel_.shutdown();
+  }
+
+  Channel channel_;
+  std::thread writer_;
+  // Guards the queue.
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::deque<std::string> queue_;
+  std::size_t queuedSize_ = 0;
+  bool failed_ = false;
+  bool closing_ = false;
+};
+
+// Relays requests between the clients and the agent.
+class Server {
+ public:
+  explicit Server(WslApiBackend& api) : api_{api} {}
+
+  int run() {
+    if (!listener_.listen()) {
+      return 1;
+    }
+    if (!startAgent()) {
+      return 1;
+    }
+
+    // Idle means no client connected for a while and none is still being served.
+    while (true) {
+      Channel client = listener_.accept(IdleTimeout);
+      std::scoped_lock lock{mutex_};
+      if (client.valid()) {
+        ++clients_;
+        std::thread{&Server::serve, this, std::make_shared<Client>(std::move(client))}.detach();
+      } else if (listener_.stopped() || clients_ == 0) {
+        break;
+      }
+    }
+
+    // The agent exits once its standard input is closed.
+    {
+      std::scoped_lock lock{agentMutex_};
+      toAgent_.close();
+    }
+    reader_.join();
+    std::unique_lock lock{mutex_};
+    clientsDone_.wait(lock, [this] { return clients_ == 0; });
+    waitForAgent(process_);
+    return 0;
+  }
+
+ private:
+  bool startAgent() {
+    Trace::Span span{"Agent::start", "agent"};
+    HANDLE stdIn = nullptr;
+    HANDLE stdOut = nullptr;
+    HANDLE stdErr = openNull();
+    bool launched = createPipe(toAgent_, stdIn, false) && createPipe(fromAgent_, stdOut, true) &&
+                    stdErr != nullptr;
+    if (launched) {
+      const std::wstring command = L"cd; exec python3 -c " + shellQuote(agentScript);
+      launched =
+          SUCCEEDED(api_.WslLaunch(command.c_str(), FALSE, stdIn, stdOut, stdErr, &process_));
+    }
+    for (auto handle : {stdIn, stdOut, stdErr}) {
+      closeTheirs(handle);
+    }
+    if (!launched) {
+      return false;
+    }
+
+    auto ready = agentReady_.get_future();
+    reader_ = std::thread{&Server::readAgent, this};
+    if (ready.wait_for(StartTimeout) != std::future_status::ready || !ready.get()) {
+      // Without its standard input, the agent exits if it ever starts, and so does the reader.
+      {
+        std::scoped_lock lock{agentMutex_};
+        toAgent_.close();
+      }
+      reader_.join();
+      waitForAgent(process_);
+      return false;
+    }
+    return true;
+  }
+
+  // Routes the frames of the agent to the clients they answer.
+  void readAgent() {
+    bool ready = false;
+    ProbeDemultiplexer demux{[&](ProbeSection&& section) {
+      if (section.name == "ready" && !ready) {
+        ready = true;
+        agentReady_.set_value(true);
+        return;
+      }
+      std::shared_ptr<Client> client;
+      {
+        std::scoped_lock lock{mutex_};
+        auto request = requests_.find(section.exitCode);
+        if (request == requests_.end()) {
+          return;
+        }
+        client = request->second;
+        if (section.name == "exit") {
+          requests_.erase(request);
+        }
+      }
+      client->send(frame(section.name, section.exitCode, section.data));
+    }};
+
+    std::string chunk;
+    while (fromAgent_.read(chunk) && demux.feed(chunk)) {
+    }
+    if (!ready) {
+      agentReady_.set_value(false);
+    }
+
+    // Clients waiting for a command of the gone agent would wait forever.
+    std::scoped_lock lock{mutex_};
+    for (auto& [id, client] : requests_) {
+      client->shutdown();
+    }
+    requests_.clear();
+    listener_.stop();
+  }
+
+  // Serves a client until it disconnects, killing the command it didn't wait for.
+  void serve(std::shared_ptr<Client> client) {
+    std::vector<int> ids;
+    ProbeDemultiplexer demux{[&](ProbeSection&& section) {
+      if (section.name != "exec") {
+        return;
+      }
+      std::scoped_lock lock{agentMutex_};
+      const int id = nextId_++;
+      {
+        std::scoped_lock requestsLock{mutex_};
+        requests_.emplace(id, client);
+      }
+      ids.push_back(id);
+      // The agent is gone, the client learns it by being disconnected.
+      if (!toAgent_.write(frame("exec", id, section.data))) {
+        client->shutdown();
+      }
+    }};
+
+    std::string chunk;
+    client->send(frame("ready", 0));
+    while (client->read(chunk) && demux.feed(chunk)) {
+    }
+
+    for (int id : ids) {
+      bool running;
+      {
+        std::scoped_lock lock{mutex_};
+        running = requests_.erase(id) > 0;
+      }
+      if (running) {
+        std::scoped_lock lock{agentMutex_};
+        toAgent_.write(frame("kill", id));
+      }
+    }
+
+    std::scoped_lock lock{mutex_};
+    --clients_;
+    clientsDone_.notify_all();
+  }
+
+  WslApiBackend& api_;
+  Listener listener_;
+  HANDLE process_ = nullptr;
+  std::thread reader_;
+  std::promise<bool> agentReady_;
+
+  // Guards the standard input of the agent and the request IDs.
+  std::mutex agentMutex_;
+  Channel toAgent_;
+  int nextId_ = 1;
+
+  Channel fromAgent_;
+
+  // Guards the requests in flight and the count of clients.
+  std::mutex mutex_;
+  std::unordered_map<int, std::shared_ptr<Client>> requests_;
+  std::size_t clients_ = 0;
+  std::condition_variable clientsDone_;
+};
+}  // namespace
+
+bool enabled() {
+  return environmentVariable(EnvironmentVariable) == "1";
+}
+
+std::string ExecRequest::encode() const {
+  std::string payload = cwd + '\0';
+  for (const auto& variable : env) {
+    payload += variable + '\0';
+  }
+  payload += '\0';
+  for (const auto& argument : argv) {
+    payload += argument + '\0';
+  }
+  return payload;
+}
+
+ExecRequest ExecRequest::shellCommand(std::wstring_view command) {
+  ExecRequest request;
+  request.argv = {"", "-c", toUtf8(command)};
+  request.cwd = currentDirectory();
+  // WSLENV lists NAME[/flags] entries separated with colons.
+  const auto shared = environmentVariable(L"WSLENV").value_or("");
+  for (std::size_t start = 0; start < shared.size();) {
+    auto end = shared.find(':', start);
+    if (end == std::string::npos) {
+      end = shared.size();
+    }
+    const auto entry = std::string_view{shared}.substr(start, end - start);
+    const auto name = std::string{entry.substr(0, entry.find('/'))};
+    if (!name.empty()) {
+      if (const auto value = environmentVariable(toWide(name))) {
+        request.env.push_back(name + '=' + *value);
+      }
+    }
+    start = end + 1;
+  }
+  return request;
+}
+
+std::optional<DWORD> run(const ExecRequest& request) {
+  Trace::Span span{"Agent::run", "agent"};
+  // The agent gives commands /dev/null to read and no terminal: any other input would be lost.
+  if (!stdInIsNull()) {
+    span.arg("stdin", std::string_view{"not null"});
+    return std::nullopt;
+  }
+  Channel server = connect();
+  if (!server.valid()) {
+    span.arg("server", std::string_view{"started"});
+    if (!startServer()) {
+      return std::nullopt;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + StartTimeout;
+    while (!(server = connect()).valid()) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        return std::nullopt;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    }
+  }
+
+  bool ready = false;
+  std::optional<DWORD> exitCode;
+  ProbeDemultiplexer demux{[&](ProbeSection&& section) {
+    if (section.name == "ready") {
+      ready = true;
+    } else if (section.name == "exit") {
+      DWORD code = 1;
+      std::from_chars(section.data.data(), section.data.data() + section.data.size(), code);
+      exitCode = code;
+    }
+  }};
+  demux.stream("out", [](std::string_view chunk) { Channel::writeStd(STD_OUTPUT_HANDLE, chunk); });
+  demux.stream("err", [](std::string_view chunk) { Channel::writeStd(STD_ERROR_HANDLE, chunk); });
+
+  // Nothing ran if the server went away before it was ready, e.g. because the agent couldn't start.
+  std::string chunk;
+  while (!ready && server.read(chunk) && demux.feed(chunk)) {
+  }
+  if (!ready || !server.write(frame("exec", 0, request.encode()))) {
+    return std::nullopt;
+  }
+
+  while (!exitCode && server.read(chunk) && demux.feed(chunk)) {
+  }
+  if (!exitCode) {
+    _putws(L"ERROR: the launcher agent stopped before the command completed");
+    return 1;
+  }
+  return exitCode;
+}
+
+int serve(WslApiBackend& api) {
+  Trace::Span span{"Agent::serve", "agent"};
+#ifndef _WIN32
+  // Writes to the agent or to clients that are gone must fail rather than kill the server.
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  return Server{api}.run();
+}
+
+}  // namespace Ubuntu::Agent
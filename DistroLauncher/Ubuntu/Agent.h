@@ -0,0 +1,68 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// An optional fast path for `run` and `-c`, for scripts calling the launcher thousands of times.
+// Instead of paying a WslLaunchInteractive each (process creation, shell start-up, profiles), the
+// commands are handed to a long-lived agent in the distro, which spawns them directly.
+//
+// The first call starts a server: the launcher itself, running detached with ServerArgument. It
+// launches the agent, a Python script, over WslLaunch stdio and listens on a named pipe per Windows
+// session, which only the user may open and whose server clients check runs as that user (a Unix
+// socket in the user's runtime directory on POSIX hosts, without which there is no agent). Every
+// call then connects to the pipe, sends its request and streams the output and exit code back. The
+// server exits, stopping the agent, once no client connected for a while.
+//
+// Both the pipe and the agent stdio carry frames shaped as probe sections (see Probe.h), the exit
+// code field holding the request ID instead:
+//
+//   <kind> <id> <length>\n<length bytes of payload>
+//
+// Clients send an `exec` frame, after the server sent `ready`. They then receive `out` and `err`
+// frames with the output of the command and finally an `exit` frame with its exit code in decimal.
+// A client disconnecting before that kills the command.
+namespace Ubuntu::Agent {
+// Setting this environment variable to 1 routes `run` and `-c` through the agent.
+inline constexpr wchar_t EnvironmentVariable[] = L"UBUNTU_LAUNCHER_AGENT";
+
+// The hidden launcher command serving the agent.
+inline constexpr wchar_t ServerArgument[] = L"agent-server";
+
+// Whether the environment asks for the agent.
+bool enabled();
+
+// A command for the agent to run. Its standard input is /dev/null.
+struct ExecRequest {
+  // The program, looked up in the PATH of the agent, and its arguments. An empty program stands for
+  // the default shell of the user.
+  std::vector<std::string> argv;
+  // The Windows working directory, translated with wslpath(1) in the distro. The command runs in
+  // the home directory if empty.
+  std::string cwd;
+  // NAME=value pairs added to the environment of the agent.
+  std::vector<std::string> env;
+
+  // The payload of the exec frame: NUL-terminated strings, the working directory first, then the
+  // environment, followed by an empty string, and finally the arguments.
+  std::string encode() const;
+
+  // Runs [command] with the default shell in the current working directory, as `run` does. The
+  // variables listed in WSLENV are passed along, their values as they are: path translation flags
+  // are ignored.
+  static ExecRequest shellCommand(std::wstring_view command);
+};
+
+// Runs [request] through the agent, starting the server if none is listening. The output streams to
+// the standard output and error of the launcher as the command writes it. Returns the exit code of
+// the command, or nullopt if the agent couldn't be reached, in which case nothing ran. Nothing runs
+// either unless the standard input of the launcher is the null device, as the command's is: a
+// console or anything redirected would go unread.
+std::optional<DWORD> run(const ExecRequest& request);
+
+// Launches the agent and serves requests until no client connected for a while or the agent
+// stopped. Returns the exit code of the launcher: non-zero if the agent couldn't be started or
+// another server is listening already.
+int serve(WslApiBackend& api);
+}  // namespace Ubuntu::Agent
@@ -0,0 +1,239 @@
+#include <stdafx.h>
+#include "AnswerFile.h"
+#include "IniFile.h"
+#include "Provisioning.h"
+#include "SplitView.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+namespace Ubuntu {
+
+namespace {
+// Answer files hold a handful of keys.
+constexpr std::uintmax_t MaxAnswerFileSize = 1024 * 1024;
+
+// As many characters as the user name prompt accepts.
+constexpr std::size_t MaxUserNameSize = 32;
+
+std::optional<bool> parseBool(std::string_view value) {
+  for (const auto yes : {"true", "yes", "on", "1"}) {
+    if (iequals(value, yes)) {
+      return true;
+    }
+  }
+  for (const auto no : {"false", "no", "off", "0"}) {
+    if (iequals(value, no)) {
+      return false;
+    }
+  }
+  return std::nullopt;
+}
+
+// Section and key names of /etc/wsl.conf.
+bool isIniName(std::string_view name) {
+  return !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+  });
+}
+
+std::wstring invalid(std::string_view section, std::string_view key, std::wstring_view reason) {
+  return L"[" + toWide(section) + L"] " + toWide(key) + L": " + std::wstring{reason};
+}
+}  // namespace
+
+bool isPasswordHash(std::string_view hash) {
+  // crypt(3) hashes are made of these, possibly prefixed with '!' when the password is locked.
+  if (!hash.empty() && hash.front() == '!') {
+    hash.remove_prefix(1);
+  }
+  const bool characters = std::all_of(hash.begin(), hash.end(), [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '/' || c == '$' ||
+           c == '=' || c == ',' || c == '-';
+  });
+  // Either $<id>$..., or the 13 characters of a traditional DES hash. Anything else is most likely
+  // a password in clear, which must not end up in /etc/shadow.
+  const bool modular = hash.size() > 3 && hash.front() == '$' && hash.find('$', 2) != hash.npos;
+  const bool traditional = hash.size() == 13 && hash.find('$') == hash.npos;
+  return characters && (modular || traditional);
+}
+
+bool isValidUserName(std::string_view name) {
+  // ^[a-z][-a-z0-9_]*\$?$
+  if (name.size() > MaxUserNameSize) {
+    return false;
+  }
+  if (!name.empty() && name.back() == '$') {
+    name.remove_suffix(1);
+  }
+  const auto lower = [](char c) { return c >= 'a' && c <= 'z'; };
+  return !name.empty() && lower(name.front()) && std::all_of(name.begin(), name.end(), [&](char c) {
+    return lower(c) || (c >= '0' && c <= '9') || c == '-' || c == '_';
+  });
+}
+
+std::optional<AnswerFile> AnswerFile::parse(std::string_view contents, std::wstring& error) {
+  const IniFile ini{contents};
+  AnswerFile answers;
+  for (const auto& entry : ini.entries()) {
+    const auto section = entry.section;
+    const auto key = entry.key;
+    const auto value = entry.value;
+    if (iequals(section, "user") && iequals(key, "name")) {
+      if (!isValidUserName(value)) {
+        error = invalid(section, key, L"not a valid user name, see NAME_REGEX in adduser.conf(5)");
+        return std::nullopt;
+      }
+      answers.userName = value;
+    } else if (iequals(section, "user") && iequals(key, "password")) {
+      if (!isPasswordHash(value)) {
+        error = invalid(section, key, L"not a password hash, see crypt(5)");
+        return std::nullopt;
+      }
+      answers.passwordHash = std::string{value};
+    } else if (iequals(section, "user") && iequals(key, "groups")) {
+      for (const auto group : SplitView{value, ','}) {
+        if (!isValidUserName(trim(group))) {
+          error = invalid(section, key, L"not a comma-separated list of group names");
+          return std::nullopt;
+        }
+        answers.extraGroups.emplace_back(trim(group));
+      }
+    } else if (iequals(section, "install") && iequals(key, "skip-cloud-init")) {
+      const auto skip = parseBool(value);
+      if (!skip) {
+        error = invalid(section, key, L"expected true or false");
+        return std::nullopt;
+      }
+      answers.skipCloudInit = *skip;
+    } else if (iequals(section, "wsl.conf")) {
+      const auto dot = key.find('.');
+      const auto wslConfSection = key.substr(0, dot);
+      const auto wslConfKey = dot == std::string_view::npos ? "" : key.substr(dot + 1);
+      if (!isIniName(wslConfSection) || !isIniName(wslConfKey)) {
+        error = invalid(section, key, L"expected <section>.<key>");
+        return std::nullopt;
+      }
+      if (!toWideStrict(value)) {
+        error = invalid(section, key, L"not valid UTF-8");
+        return std::nullopt;
+      }
+      answers.wslConf.push_back(
+          {std::string{wslConfSection}, std::string{wslConfKey}, std::string{value}});
+    } else {
+      // Most likely a typo, which is better reported than silently ignored.
+      error = invalid(section, key, L"unknown setting");
+      return std::nullopt;
+    }
+  }
+  if (answers.userName.empty() && (answers.passwordHash || !answers.extraGroups.empty())) {
+    error = L"[user] the password and groups require a name";
+    return std::nullopt;
+  }
+  return answers;
+}
+
+std::optional<AnswerFile> AnswerFile::load(const std::filesystem::path& file,
+                                           std::wstring& error) {
+  std::error_code sizeError;
+  const auto size = std::filesystem::file_size(file, sizeError);
+  if (!sizeError && size > MaxAnswerFileSize) {
+    error = L"the file is too large";
+    return std::nullopt;
+  }
+  std::ifstream stream{file, std::ios::binary};
+  std::ostringstream contents;
+  if (sizeError || !stream || !(contents << stream.rdbuf())) {
+    error = L"could not read the file";
+    return std::nullopt;
+  }
+  return parse(contents.str(), error);
+}
+
+unsigned long applyAnswers(WslApiBackend& api, const AnswerFile& answers, bool deleteResolvConf) {
+  Trace::Span span{"applyAnswers", "install"};
+  std::vector<ProvisioningStep> steps;
+  if (deleteResolvConf) {
+    steps.push_back(deleteResolvConfStep());
+  }
+  if (answers.skipCloudInit) {
+    // cloud-init may be running already, as the distro booted, but won't on the next boots.
+    steps.push_back(
+        {"cloud-init", L"[ ! -d /etc/cloud ] || touch /etc/cloud/cloud-init.disabled", L"", true});
+  }
+
+  if (!answers.wslConf.empty()) {
+    // The current file is read through the distro file system, so that the script only has to
+    // write the updated one, or to restore the current one should a later step fail. It must be
+    // reachable though, or a missing file couldn't be told from an unreachable one.
+    const auto root = api.DistributionRootPath();
+    std::error_code error;
+    if (!std::filesystem::is_directory(root / L"etc", error)) {
+      _putws(L"failed to apply the answer file: the distro file system is not reachable");
+      return UID_INVALID;
+    }
+    std::optional<std::string> current;
+    if (std::ifstream file{root / L"etc" / L"wsl.conf", std::ios::binary}; file) {
+      std::ostringstream contents;
+      contents << file.rdbuf();
+      current = contents.str();
+    }
+    std::string updated = current.value_or("");
+    for (const auto& [section, key, value] : answers.wslConf) {
+      updated = setIniValue(updated, section, key, value);
+    }
+    const auto wideCurrent = toWideStrict(current.value_or(""));
+    const auto wideUpdated = toWideStrict(updated);
+    if (!wideCurrent || !wideUpdated) {
+      _putws(L"failed to apply the answer file: /etc/wsl.conf is not valid UTF-8");
+      return UID_INVALID;
+    }
+    steps.push_back({"wsl.conf", L"printf '%s' " + shellQuote(*wideUpdated) + L" >/etc/wsl.conf",
+                     current ? L"printf '%s' " + shellQuote(*wideCurrent) + L" >/etc/wsl.conf"
+                             : L"rm -f /etc/wsl.conf"});
+  }
+
+  if (!answers.userName.empty()) {
+    UserAccount account{toWide(answers.userName)};
+    if (answers.passwordHash) {
+      account.passwordHash = toWide(*answers.passwordHash);
+    }
+    for (const auto& group : answers.extraGroups) {
+      account.extraGroups.push_back(toWide(group));
+    }
+    const auto user = createUserSteps(account);
+    steps.insert(steps.end(), user.begin(), user.end());
+  }
+
+  if (steps.empty()) {
+    return 0;
+  }
+  const auto result = provision(api, steps);
+  if (!result) {
+    _putws(L"failed to apply the answer file: the provisioning script didn't report its results");
+    return UID_INVALID;
+  }
+  if (!result->committed) {
+    // The script stops at the first required step failing.
+    for (const auto& step : steps) {
+      const auto* section = result->find(step.name);
+      if (!step.optional && (!section || section->exitCode != 0)) {
+        _putws((L"failed to apply the answer file: " + toWide(step.name) + L" exited with " +
+                std::to_wstring(section ? section->exitCode : -1) + L", the changes were undone")
+                   .c_str());
+        break;
+      }
+    }
+    return UID_INVALID;
+  }
+  if (answers.userName.empty()) {
+    return 0;
+  }
+  return createdUid(*result).value_or(UID_INVALID);
+}
+
+}  // namespace Ubuntu
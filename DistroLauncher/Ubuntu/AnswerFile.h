@@ -0,0 +1,63 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ubuntu {
+// What `install --answers <file>` reads instead of asking, so that the distro can be installed with
+// no console. The file is an INI file (see IniFile.h):
+//
+//   [user]
+//   # The account to create and make the default user. None is created if there is no name, as
+//   # with --root.
+//   name = alice
+//   # Its password, as a crypt(3) hash as found in /etc/shadow. It is disabled if there is none.
+//   password = $6$...
+//   # Groups to add it to, on top of the ones every default user is in.
+//   groups = docker,libvirt
+//
+//   [install]
+//   # Neither wait for cloud-init nor let it run on later boots.
+//   skip-cloud-init = true
+//
+//   [wsl.conf]
+//   # Keys to set in /etc/wsl.conf, as <section>.<key>.
+//   boot.systemd = true
+//
+// Everything is validated before anything is launched in the distro, so that a typo costs nothing.
+struct AnswerFile {
+  struct WslConfKey {
+    std::string section;
+    std::string key;
+    std::string value;
+  };
+
+  std::string userName;
+  std::optional<std::string> passwordHash;
+  std::vector<std::string> extraGroups;
+  bool skipCloudInit = false;
+  std::vector<WslConfKey> wslConf;
+
+  // Parses and validates [contents]. Returns nullopt with the reason in [error] if they're invalid.
+  static std::optional<AnswerFile> parse(std::string_view contents, std::wstring& error);
+
+  // Reads and validates [file], as parse() does.
+  static std::optional<AnswerFile> load(const std::filesystem::path& file, std::wstring& error);
+};
+
+// Whether [name] is a valid user or group name according to Debian's default NAME_REGEX,
+// ^[a-z][-a-z0-9_]*\$?$, and no longer than what the launcher lets users type.
+bool isValidUserName(std::string_view name);
+
+// Whether [hash] looks like a crypt(3) hash, as found in /etc/shadow, which can be written there
+// as is, rather than a password in clear.
+bool isPasswordHash(std::string_view hash);
+
+// Applies [answers] to the freshly registered distro in a single provisioning launch, non
+// interactively, deleting /etc/resolv.conf on the way if [deleteResolvConf]. Returns the UID to set
+// as the default: the one of the account created or root's, or UID_INVALID if anything failed, in
+// which case the reason was printed and nothing was changed.
+unsigned long applyAnswers(WslApiBackend& api, const AnswerFile& answers, bool deleteResolvConf);
+}  // namespace Ubuntu
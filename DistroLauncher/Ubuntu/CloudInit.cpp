@@ -0,0 +1,100 @@
+#include <stdafx.h>
+#include "CloudInit.h"
+#include "Utf8.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <system_error>
+
+namespace Ubuntu {
+
+namespace {
+// cloud-init writes result.json once its last stage completes. It lives in /run, thus one left by a
+// previous boot can't be mistaken for the current one.
+constexpr std::wstring_view ResultMarker = L"run/cloud-init/result.json";
+constexpr std::wstring_view DisabledMarker = L"etc/cloud/cloud-init.disabled";
+constexpr std::wstring_view Executable = L"usr/bin/cloud-init";
+
+bool inDistro(std::filesystem::path path) {
+  // Errors, such as the distro file system not being reachable, count as the file not existing.
+  std::error_code error;
+  return std::filesystem::exists(path.make_preferred(), error);
+}
+
+// Where the WSL data source of cloud-init looks for user data, relative to the user profile.
+const std::filesystem::path UserDataDirectories[] = {L".cloud-init", L".ubuntupro/.cloud-init"};
+
+std::filesystem::path userProfile() {
+#ifdef _WIN32
+  wchar_t buffer[MAX_PATH];
+  DWORD length = GetEnvironmentVariableW(L"USERPROFILE", buffer, MAX_PATH);
+  if ((length == 0) || (length >= MAX_PATH)) {
+    return {};
+  }
+  return buffer;
+#else
+  if (const char* home = std::getenv("HOME"); home && *home) {
+    return home;
+  }
+  return {};
+#endif
+}
+}  // namespace
+
+bool cloudInitDone(const WslApiBackend& api) {
+  Trace::Span span{"cloudInitDone", "init"};
+  const auto root = api.DistributionRootPath();
+  if (inDistro(root / ResultMarker)) {
+    span.arg("marker", std::string_view{"result"});
+    return true;
+  }
+  if (inDistro(root / DisabledMarker)) {
+    span.arg("marker", std::string_view{"disabled"});
+    return true;
+  }
+  // Checked last, because when the distro file system is not reachable everything looks absent.
+  // The probe in the distro then decides.
+  if (!inDistro(root / Executable) && inDistro(root / L"usr" / L"bin")) {
+    span.arg("marker", std::string_view{"absent"});
+    return true;
+  }
+  return false;
+}
+
+bool cloudInitWillRun(const TarIndex& rootfs) {
+  return rootfs.find(toUtf8(Executable)) != nullptr &&
+         rootfs.find(toUtf8(DisabledMarker)) == nullptr;
+}
+
+bool cloudInitUserDataExists() {
+  Trace::Span span{"cloudInitUserDataExists", "install"};
+  const auto profile = userProfile();
+  if (profile.empty()) {
+    return false;
+  }
+  for (auto directory : UserDataDirectories) {
+    std::error_code error;
+    for (std::filesystem::directory_iterator it{profile / directory.make_preferred(), error}, end;
+         !error && it != end; it.increment(error)) {
+      if (it->path().extension() == L".user-data") {
+        span.arg("file", toUtf8(it->path().filename().wstring()));
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::wstring cloudInitWaitCommand(std::chrono::seconds deadline) {
+  // Succeeds when there is nothing to wait for, so that only a timeout or a failure is reported.
+  std::wstring command{L"if command -v cloud-init >/dev/null && [ ! -e /"};
+  command += DisabledMarker;
+  command += L" ] && [ ! -e /";
+  command += ResultMarker;
+  command += L" ]; then timeout ";
+  command += std::to_wstring(deadline.count());
+  command += L" cloud-init status --wait >/dev/null 2>&1; fi";
+  return command;
+}
+
+}  // namespace Ubuntu
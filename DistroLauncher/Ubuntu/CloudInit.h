@@ -0,0 +1,34 @@
+#pragma once
+#include <chrono>
+#include <string>
+
+#include "TarIndex.h"
+
+namespace Ubuntu {
+// How long the launcher waits for cloud-init before carrying on without it. Only the wait is
+// abandoned, cloud-init itself keeps running in the distro.
+inline constexpr std::chrono::seconds CloudInitDeadline{300};
+
+// The exit code of cloudInitWaitCommand() when the deadline expires, as reported by timeout(1).
+inline constexpr int CloudInitTimedOut = 124;
+
+// Whether cloud-init has nothing left to do, judging by the files it leaves behind in the distro:
+// it's either not installed, disabled or already wrote its final result. Checked from the Windows
+// side, so no Linux process is launched.
+bool cloudInitDone(const WslApiBackend& api);
+
+// Whether cloud-init will run on the first boot of the rootfs indexed by [rootfs], judging by the
+// same markers before it's even registered: it's installed and not disabled.
+bool cloudInitWillRun(const TarIndex& rootfs);
+
+// Whether any user data is waiting for cloud-init on the Windows side, where its WSL data source
+// looks for it: *.user-data files in %USERPROFILE%\.cloud-init, or in the .cloud-init directory of
+// %USERPROFILE%\.ubuntupro for data provided by Ubuntu Pro. Checked without launching anything.
+// Without user data, cloud-init creates no user accounts.
+bool cloudInitUserDataExists();
+
+// A shell command that waits for cloud-init to finish for up to [deadline]. The same markers as
+// cloudInitDone() are checked first, so cloud-init's Python interpreter only starts when there is
+// really something to wait for.
+std::wstring cloudInitWaitCommand(std::chrono::seconds deadline = CloudInitDeadline);
+}  // namespace Ubuntu
@@ -0,0 +1,70 @@
+#include <stdafx.h>
+#include "DefaultUserSelector.h"
+#include "PasswdScanner.h"
+
+namespace Ubuntu {
+
+namespace {
+// UIDs below this are reserved for system accounts.
+constexpr std::uint32_t FirstRegularUid = 1000;
+}  // namespace
+
+void DefaultUserSelector::feed(std::string_view chunk) {
+  // Complete the line left over from the previous chunk first.
+  if (!partialLine_.empty()) {
+    auto eol = chunk.find('\n');
+    if (eol == std::string_view::npos) {
+      partialLine_ += chunk;
+      return;
+    }
+    partialLine_ += chunk.substr(0, eol + 1);
+    scan(partialLine_);
+    partialLine_.clear();
+    chunk.remove_prefix(eol + 1);
+  }
+
+  auto lastEol = chunk.rfind('\n');
+  if (lastEol == std::string_view::npos) {
+    partialLine_ = chunk;
+    return;
+  }
+  scan(chunk.substr(0, lastEol + 1));
+  partialLine_ = chunk.substr(lastEol + 1);
+}
+
+void DefaultUserSelector::finish() {
+  if (!partialLine_.empty()) {
+    scan(partialLine_);
+    partialLine_.clear();
+  }
+}
+
+void DefaultUserSelector::scan(std::string_view lines) {
+  PasswdScanner scanner{lines};
+  PasswdScanner::Line line;
+  while (scanner.next(line)) {
+    // Ill-formed lines are skipped, the system behaves as if they don't exist.
+    if (auto entry = parsePasswdEntry(line)) {
+      consider(entry->name, entry->uid, entry->hasLogin);
+    }
+  }
+}
+
+void DefaultUserSelector::feed(const UserTable& users) {
+  for (UserTable::Index i = 0; i < users.size(); ++i) {
+    consider(users.name(i), users.uid(i), users.hasLogin(i));
+  }
+}
+
+void DefaultUserSelector::consider(std::string_view name, std::uint32_t uid, bool hasLogin) {
+  sawUsers_ = true;
+  // Ties are broken in favour of the entry seen first.
+  if (!wanted_.empty() && name == wanted_ && (!named_ || uid < *named_)) {
+    named_ = uid;
+  }
+  if (hasLogin && uid >= FirstRegularUid && (!firstLogin_ || uid < *firstLogin_)) {
+    firstLogin_ = uid;
+  }
+}
+
+}  // namespace Ubuntu
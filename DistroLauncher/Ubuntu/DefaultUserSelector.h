@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "UserTable.h"
+
+namespace Ubuntu {
+// Picks the default user candidates out of a passwd database as it's streamed in chunks of
+// arbitrary size. Only the best candidates found so far are kept, entries are not stored.
+class DefaultUserSelector {
+ public:
+  // Makes named() report the user named [name].
+  void lookFor(std::string name) { wanted_ = std::move(name); }
+
+  // Consumes the next chunk of the database.
+  void feed(std::string_view chunk);
+
+  // Consumes the last line, in case the database doesn't end with a new line.
+  void finish();
+
+  // Consumes a whole, already parsed, database.
+  void feed(const UserTable& users);
+
+  // Whether no well-formed entries were seen.
+  bool empty() const { return !sawUsers_; }
+
+  // The UID of the user looked for, if seen.
+  std::optional<std::uint32_t> named() const { return named_; }
+
+  // The lowest UID of a non-system user allowed to log in, if any.
+  std::optional<std::uint32_t> firstLoginUser() const { return firstLogin_; }
+
+ private:
+  void scan(std::string_view lines);
+  void consider(std::string_view name, std::uint32_t uid, bool hasLogin);
+
+  std::string wanted_;
+  // The trailing part of the last chunk not terminated by a new line yet.
+  std::string partialLine_;
+  bool sawUsers_ = false;
+  std::optional<std::uint32_t> named_;
+  std::optional<std::uint32_t> firstLogin_;
+};
+}  // namespace Ubuntu
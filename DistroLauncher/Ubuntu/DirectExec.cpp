@@ -0,0 +1,55 @@
+#include <stdafx.h>
+#include "DirectExec.h"
+#include "Probe.h"
+
+#ifndef _WIN32
+#include <cerrno>
+
+#include <sys/wait.h>
+#endif
+
+namespace Ubuntu {
+
+std::wstring directExecCommand(const std::vector<std::wstring_view>& argv) {
+  std::wstring command{L"exec"};
+  for (const auto argument : argv) {
+    command += L' ';
+    command += shellQuote(argument);
+  }
+  return command;
+}
+
+HRESULT directExec(WslApiBackend& api, const std::vector<std::wstring_view>& argv,
+                   DWORD& exitCode) {
+  Trace::Span span{"directExec", "run"};
+  const std::wstring command = directExecCommand(argv);
+  HANDLE process = nullptr;
+  HRESULT hr = api.WslLaunch(command.c_str(), TRUE, GetStdHandle(STD_INPUT_HANDLE),
+                             GetStdHandle(STD_OUTPUT_HANDLE), GetStdHandle(STD_ERROR_HANDLE),
+                             &process);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+#ifdef _WIN32
+  WaitForSingleObject(process, INFINITE);
+  if (!GetExitCodeProcess(process, &exitCode)) {
+    hr = HRESULT_FROM_WIN32(GetLastError());
+  }
+  CloseHandle(process);
+#else
+  int status = 0;
+  const pid_t pid = fdFromHandle(process);
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return E_FAIL;
+    }
+  }
+  // As a shell would report it.
+  exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+#endif
+  span.arg("exitCode", std::to_string(exitCode));
+  return hr;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ubuntu {
+// `exec` and `run --exec`: runs a program with its arguments exactly as given, instead of a command
+// line re-parsed by the shell.
+//
+// The WSL API only takes command lines, which it hands to the default shell of the user without
+// sourcing any profile. The command line built here makes that shell exec the program straight
+// away, every argument single-quoted, so nothing is expanded, split or globbed along the way.
+
+// The command line executing [argv], argv[0] being looked up in the PATH.
+std::wstring directExecCommand(const std::vector<std::wstring_view>& argv);
+
+// Runs [argv] in the current working directory, with the standard handles of the launcher, and
+// waits for it. [exitCode] receives its exit code as is. Returns the failure of WslLaunch, if any.
+HRESULT directExec(WslApiBackend& api, const std::vector<std::wstring_view>& argv,
+                   DWORD& exitCode);
+}  // namespace Ubuntu
@@ -0,0 +1,182 @@
+#include <stdafx.h>
+#ifndef _WIN32
+#include "FakeWslApi.h"
+#include "Utf8.h"
+
+#include <thread>
+
+#include <sys/wait.h>
+
+namespace Ubuntu {
+
+namespace {
+// Single-quotes a string for the shell.
+std::string quote(const std::string& str) {
+  std::string quoted{"'"};
+  for (char c : str) {
+    if (c == '\'') {
+      quoted += "'\\''";
+    } else {
+      quoted += c;
+    }
+  }
+  quoted += '\'';
+  return quoted;
+}
+
+DWORD waitExitCode(int pid) {
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid) {
+    return static_cast<DWORD>(-1);
+  }
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  // As a shell would report it.
+  return 128 + WTERMSIG(status);
+}
+}  // namespace
+
+FakeWslApi::FakeWslApi(Options options) : options_{std::move(options)} {
+  // A previously unpacked root counts as registered.
+  registered_ = !options_.root.empty() && std::filesystem::exists(options_.root / "etc");
+}
+
+BOOL FakeWslApi::WslIsOptionalComponentInstalled() {
+  return TRUE;
+}
+
+BOOL FakeWslApi::WslIsDistributionRegistered() {
+  simulateLatency();
+  return registered_;
+}
+
+HRESULT FakeWslApi::WslRegisterDistribution(PCWSTR tarGzFilename) {
+  simulateLatency();
+  if (registered_) {
+    return HRESULT_FROM_WIN32(183L);  // ERROR_ALREADY_EXISTS
+  }
+
+  if (!options_.root.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(options_.root, ec);
+    if (ec) {
+      return E_FAIL;
+    }
+    // Like WSL, tar tells compressed and uncompressed tarballs apart by itself.
+    std::wstring command = L"tar -xpf ";
+    const std::filesystem::path tarball{tarGzFilename};
+    command += std::filesystem::path{quote(tarball.string())}.wstring();
+    command += L" -C ";
+    command += std::filesystem::path{quote(options_.root.string())}.wstring();
+    int pid = spawn(command.c_str(), true, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, false);
+    if (pid < 0 || waitExitCode(pid) != 0) {
+      return E_FAIL;
+    }
+  }
+
+  registered_ = true;
+  return S_OK;
+}
+
+HRESULT FakeWslApi::WslConfigureDistribution(ULONG defaultUID,
+                                             WSL_DISTRIBUTION_FLAGS wslDistributionFlags) {
+  simulateLatency();
+  defaultUid_ = defaultUID;
+  flags_ = wslDistributionFlags;
+  return S_OK;
+}
+
+HRESULT FakeWslApi::WslGetDistributionConfiguration(DistributionConfiguration& configuration) {
+  simulateLatency();
+  // Commands running directly on the host don't need a registered distribution.
+  if (!registered_ && !options_.root.empty()) {
+    return E_FAIL;
+  }
+  // WSL 2, with the environment a freshly registered distribution gets.
+  configuration.version = 2;
+  configuration.defaultUid = defaultUid_;
+  configuration.flags = flags_;
+  configuration.defaultEnvironment = {"HOSTTYPE=x86_64", "LANG=en_US.UTF-8",
+                                      "PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:"
+                                      "/bin:/usr/games:/usr/local/games",
+                                      "TERM=xterm-256color"};
+  return S_OK;
+}
+
+HRESULT FakeWslApi::WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkingDirectory,
+                                         DWORD* exitCode) {
+  simulateLatency();
+  int pid = spawn(command, useCurrentWorkingDirectory, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO,
+                  true);
+  if (pid < 0) {
+    return E_FAIL;
+  }
+
+  *exitCode = waitExitCode(pid);
+  return S_OK;
+}
+
+HRESULT FakeWslApi::WslLaunch(PCWSTR command, BOOL useCurrentWorkingDirectory, HANDLE stdIn,
+                              HANDLE stdOut, HANDLE stdErr, HANDLE* process) {
+  simulateLatency();
+  int pid = spawn(command, useCurrentWorkingDirectory, fdFromHandle(stdIn), fdFromHandle(stdOut),
+                  fdFromHandle(stdErr), true);
+  if (pid < 0) {
+    return E_FAIL;
+  }
+
+  *process = handleFromFd(pid);
+  return S_OK;
+}
+
+std::filesystem::path FakeWslApi::DistributionRootPath() const {
+  return options_.root.empty() ? std::filesystem::path{"/"} : options_.root;
+}
+
+int FakeWslApi::spawn(PCWSTR command, bool useCurrentWorkingDirectory, int in, int out, int err,
+                      bool confined) {
+  // Everything the child needs is prepared before forking.
+  const std::string cmd = toUtf8(command);
+  const std::string root = options_.root.string();
+  const char* shell = options_.shell.c_str();
+  const bool chroot = confined && !root.empty();
+  const bool switchUser = confined && geteuid() == 0 && defaultUid_ != 0;
+
+  pid_t pid = fork();
+  if (pid != 0) {
+    return pid;
+  }
+
+  // In the child: only async-signal-safe calls from now on.
+  if ((in != STDIN_FILENO && dup2(in, STDIN_FILENO) < 0) ||
+      (out != STDOUT_FILENO && dup2(out, STDOUT_FILENO) < 0) ||
+      (err != STDERR_FILENO && dup2(err, STDERR_FILENO) < 0)) {
+    _exit(127);
+  }
+  if (chroot && ::chroot(root.c_str()) != 0) {
+    _exit(127);
+  }
+  if ((chroot || !useCurrentWorkingDirectory) && chdir("/") != 0) {
+    _exit(127);
+  }
+  if (switchUser && setuid(defaultUid_) != 0) {
+    _exit(127);
+  }
+
+  if (cmd.empty()) {
+    execl(shell, shell, "-l", static_cast<char*>(nullptr));
+  } else {
+    execl(shell, shell, "-c", cmd.c_str(), static_cast<char*>(nullptr));
+  }
+  _exit(127);
+}
+
+void FakeWslApi::simulateLatency() const {
+  if (options_.latency.count() > 0) {
+    std::this_thread::sleep_for(options_.latency);
+  }
+}
+
+}  // namespace Ubuntu
+#endif  // !_WIN32
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef _WIN32
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+namespace Ubuntu {
+// An in-process stand-in for wslapi.dll for Linux hosts, so the launcher core can be profiled and
+// load-tested on our build farm. Commands run as local subprocesses of the default shell, either
+// directly on the host or confined to a chroot holding an unpacked rootfs, after an optional delay
+// modelling the cost of reaching the WSL VM.
+//
+// CMakeLists.txt builds the portable core along with it, and the tests running on top of it.
+class FakeWslApi : public WslApiBackend {
+ public:
+  struct Options {
+    // Directory holding the distribution root filesystem. Commands run chrooted into it, which
+    // requires CAP_SYS_CHROOT. If empty, commands run directly on the host.
+    std::filesystem::path root;
+    // Latency added to each API call.
+    std::chrono::milliseconds latency{0};
+    // Shell launching the commands, like the distribution's default shell would.
+    std::string shell = "/bin/sh";
+  };
+
+  explicit FakeWslApi(Options options);
+
+  BOOL WslIsOptionalComponentInstalled() override;
+
+  BOOL WslIsDistributionRegistered() override;
+
+  HRESULT WslRegisterDistribution(PCWSTR tarGzFilename) override;
+
+  HRESULT WslConfigureDistribution(ULONG defaultUID,
+                                   WSL_DISTRIBUTION_FLAGS wslDistributionFlags) override;
+
+  HRESULT WslGetDistributionConfiguration(DistributionConfiguration& configuration) override;
+
+  HRESULT WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkingDirectory,
+                               DWORD* exitCode) override;
+
+  HRESULT WslLaunch(PCWSTR command, BOOL useCurrentWorkingDirectory, HANDLE stdIn, HANDLE stdOut,
+                    HANDLE stdErr, HANDLE* process) override;
+
+  std::filesystem::path DistributionRootPath() const override;
+
+  // What WslConfigureDistribution last stored.
+  ULONG defaultUid() const { return defaultUid_; }
+  WSL_DISTRIBUTION_FLAGS flags() const { return flags_; }
+
+ private:
+  Options options_;
+  bool registered_ = false;
+  ULONG defaultUid_ = 0;
+  WSL_DISTRIBUTION_FLAGS flags_ = WSL_DISTRIBUTION_FLAGS_DEFAULT;
+
+  // Forks and executes the command with the provided standard file descriptors, returning the
+  // child PID or -1 on failure.
+  int spawn(PCWSTR command, bool useCurrentWorkingDirectory, int in, int out, int err,
+            bool confined);
+  void simulateLatency() const;
+};
+}  // namespace Ubuntu
+#endif  // !_WIN32
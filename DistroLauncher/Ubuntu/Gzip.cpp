@@ -0,0 +1,512 @@
+#include <stdafx.h>
+#include "Gzip.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace Ubuntu {
+
+namespace {
+std::uint16_t load16(const unsigned char* p) {
+  return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+}
+
+std::uint32_t load32(const unsigned char* p) {
+  return std::uint32_t{p[0]} | (std::uint32_t{p[1]} << 8) | (std::uint32_t{p[2]} << 16) |
+         (std::uint32_t{p[3]} << 24);
+}
+
+const unsigned char* bytes(std::string_view str) {
+  return reinterpret_cast<const unsigned char*>(str.data());
+}
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes.
+using CrcTables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+constexpr CrcTables makeCrcTables() {
+  CrcTables tables{};
+  for (std::uint32_t b = 0; b < 256; ++b) {
+    std::uint32_t crc = b;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+    }
+    tables[0][b] = crc;
+  }
+  for (std::size_t k = 1; k < tables.size(); ++k) {
+    for (std::size_t b = 0; b < 256; ++b) {
+      tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+    }
+  }
+  return tables;
+}
+
+constexpr CrcTables crcTables = makeCrcTables();
+
+// Reads the DEFLATE bit stream, least significant bit first. Reading past the end of the input
+// yields zeros, which is detected by overrun() once decoding is done.
+class BitReader {
+ public:
+  explicit BitReader(std::string_view input) :
+      next_{bytes(input)}, end_{next_ + input.size()} {}
+
+  // Makes at least 56 bits available, enough to decode a whole length-distance pair.
+  void refill() {
+    if (end_ - next_ >= 8) {
+      std::uint64_t word;
+      std::memcpy(&word, next_, sizeof(word));  // Windows only runs on little-endian machines.
+      bits_ |= word << count_;
+      next_ += (63 - count_) >> 3;
+      count_ |= 56;
+      return;
+    }
+    while (count_ <= 56) {
+      if (next_ < end_) {
+        bits_ |= std::uint64_t{*next_++} << count_;
+      } else {
+        ++padding_;
+      }
+      count_ += 8;
+    }
+  }
+
+  std::uint32_t peek(unsigned n) const {
+    return static_cast<std::uint32_t>(bits_ & ((std::uint64_t{1} << n) - 1));
+  }
+
+  void consume(unsigned n) {
+    bits_ >>= n;
+    count_ -= n;
+  }
+
+  // Callers must have refilled enough bits before.
+  std::uint32_t bits(unsigned n) {
+    auto value = peek(n);
+    consume(n);
+    return value;
+  }
+
+  // Discards the bits up to the next byte boundary and returns where the stream continues, or
+  // nullptr if that's past the end of the input.
+  const unsigned char* alignToByte() {
+    consume(count_ % 8);
+    const unsigned buffered = count_ / 8;
+    if (buffered < padding_) {
+      return nullptr;
+    }
+    return next_ - (buffered - padding_);
+  }
+
+  // Restarts reading from [position], a byte within the input.
+  void seek(const unsigned char* position) {
+    next_ = position;
+    bits_ = 0;
+    count_ = 0;
+    padding_ = 0;
+  }
+
+  const unsigned char* end() const { return end_; }
+
+  // Whether more bits were consumed than the input holds.
+  bool overrun() const { return count_ / 8 < padding_; }
+
+ private:
+  const unsigned char* next_;
+  const unsigned char* end_;
+  std::uint64_t bits_ = 0;
+  unsigned count_ = 0;
+  // Zero bytes appended to the buffer past the end of the input.
+  unsigned padding_ = 0;
+};
+
+constexpr unsigned MaxCodeLength = 15;
+constexpr unsigned FastBits = 10;
+constexpr std::size_t MaxLiteralCodes = 288;
+constexpr std::size_t MaxDistanceCodes = 30;
+
+// A canonical Huffman code. Codes up to FastBits long are decoded with a single table lookup, the
+// rare longer ones bit by bit from the canonical description.
+class Huffman {
+ public:
+  // Returns false if the lengths over-subscribe the code space.
+  bool build(const std::uint8_t* lengths, std::size_t n) {
+    count_.fill(0);
+    for (std::size_t symbol = 0; symbol < n; ++symbol) {
+      ++count_[lengths[symbol]];
+    }
+    count_[0] = 0;
+
+    int left = 1;
+    for (unsigned len = 1; len <= MaxCodeLength; ++len) {
+      left = (left << 1) - count_[len];
+      if (left < 0) {
+        return false;
+      }
+    }
+
+    std::array<std::uint16_t, MaxCodeLength + 1> offsets{};
+    for (unsigned len = 1; len < MaxCodeLength; ++len) {
+      offsets[len + 1] = offsets[len] + count_[len];
+    }
+    for (std::size_t symbol = 0; symbol < n; ++symbol) {
+      if (lengths[symbol] != 0) {
+        symbols_[offsets[lengths[symbol]]++] = static_cast<std::uint16_t>(symbol);
+      }
+    }
+
+    fast_.fill(0);
+    unsigned code = 0;
+    std::size_t index = 0;
+    for (unsigned len = 1; len <= FastBits; ++len) {
+      for (unsigned k = 0; k < count_[len]; ++k, ++code) {
+        const auto entry = static_cast<std::uint16_t>((symbols_[index++] << 4) | len);
+        for (unsigned slot = reverse(code, len); slot < fast_.size(); slot += 1u << len) {
+          fast_[slot] = entry;
+        }
+      }
+      code <<= 1;
+    }
+    return true;
+  }
+
+  // The next symbol, or -1 if the bits don't form a code. At least MaxCodeLength bits must be
+  // available in [in].
+  int decode(BitReader& in) const {
+    if (auto entry = fast_[in.peek(FastBits)]; entry != 0) {
+      in.consume(entry & 0xF);
+      return entry >> 4;
+    }
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (unsigned len = 1; len <= MaxCodeLength; ++len) {
+      code |= static_cast<int>(in.bits(1));
+      const int count = count_[len];
+      if (code - count < first) {
+        return symbols_[index + (code - first)];
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+    return -1;
+  }
+
+ private:
+  static unsigned reverse(unsigned code, unsigned len) {
+    unsigned reversed = 0;
+    for (unsigned bit = 0; bit < len; ++bit) {
+      reversed = (reversed << 1) | ((code >> bit) & 1);
+    }
+    return reversed;
+  }
+
+  std::array<std::uint16_t, 1u << FastBits> fast_;
+  std::array<std::uint16_t, MaxCodeLength + 1> count_;
+  std::array<std::uint16_t, MaxLiteralCodes> symbols_;
+};
+
+constexpr std::uint16_t lengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10,  11,  13,
+                                          15, 17, 19, 23, 27, 31, 35, 43,  51,  59,
+                                          67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                          2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::uint16_t distanceBase[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::uint8_t distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                            6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+struct FixedCodes {
+  Huffman literals;
+  Huffman distances;
+
+  FixedCodes() {
+    std::array<std::uint8_t, MaxLiteralCodes> lengths{};
+    std::fill(lengths.begin(), lengths.begin() + 144, std::uint8_t{8});
+    std::fill(lengths.begin() + 144, lengths.begin() + 256, std::uint8_t{9});
+    std::fill(lengths.begin() + 256, lengths.begin() + 280, std::uint8_t{7});
+    std::fill(lengths.begin() + 280, lengths.end(), std::uint8_t{8});
+    literals.build(lengths.data(), lengths.size());
+    lengths.fill(5);
+    distances.build(lengths.data(), MaxDistanceCodes);
+  }
+};
+
+class Inflater {
+ public:
+  Inflater(std::string_view input, unsigned char* output, std::size_t outputSize) :
+      in_{input}, begin_{output}, out_{output}, end_{output + outputSize} {}
+
+  bool run() {
+    bool last = false;
+    while (!last) {
+      in_.refill();
+      last = in_.bits(1) == 1;
+      bool ok = false;
+      switch (in_.bits(2)) {
+        case 0:
+          ok = stored();
+          break;
+        case 1: {
+          static const FixedCodes fixed;
+          ok = codes(fixed.literals, fixed.distances);
+          break;
+        }
+        case 2:
+          ok = dynamic();
+          break;
+        default:
+          break;
+      }
+      if (!ok) {
+        return false;
+      }
+    }
+    return out_ == end_ && !in_.overrun();
+  }
+
+ private:
+  bool stored() {
+    const unsigned char* next = in_.alignToByte();
+    if (next == nullptr || in_.end() - next < 4) {
+      return false;
+    }
+    const std::uint16_t length = load16(next);
+    if (static_cast<std::uint16_t>(~load16(next + 2)) != length) {
+      return false;
+    }
+    next += 4;
+    if (in_.end() - next < length || end_ - out_ < length) {
+      return false;
+    }
+    std::memcpy(out_, next, length);
+    out_ += length;
+    in_.seek(next + length);
+    return true;
+  }
+
+  bool dynamic() {
+    static constexpr std::uint8_t order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                               11, 4,  12, 3, 13, 2, 14, 1, 15};
+    const unsigned literalCount = in_.bits(5) + 257;
+    const unsigned distanceCount = in_.bits(5) + 1;
+    const unsigned codeLengthCount = in_.bits(4) + 4;
+    if (literalCount > 286 || distanceCount > MaxDistanceCodes) {
+      return false;
+    }
+
+    std::array<std::uint8_t, MaxLiteralCodes + MaxDistanceCodes> lengths{};
+    for (unsigned i = 0; i < codeLengthCount; ++i) {
+      in_.refill();
+      lengths[order[i]] = static_cast<std::uint8_t>(in_.bits(3));
+    }
+    Huffman lengthCode;
+    if (!lengthCode.build(lengths.data(), 19)) {
+      return false;
+    }
+
+    lengths.fill(0);
+    const unsigned total = literalCount + distanceCount;
+    for (unsigned index = 0; index < total;) {
+      in_.refill();
+      const int symbol = lengthCode.decode(in_);
+      if (symbol < 0) {
+        return false;
+      }
+      if (symbol < 16) {
+        lengths[index++] = static_cast<std::uint8_t>(symbol);
+        continue;
+      }
+      std::uint8_t length = 0;
+      unsigned repeat;
+      if (symbol == 16) {
+        if (index == 0) {
+          return false;
+        }
+        length = lengths[index - 1];
+        repeat = 3 + in_.bits(2);
+      } else if (symbol == 17) {
+        repeat = 3 + in_.bits(3);
+      } else {
+        repeat = 11 + in_.bits(7);
+      }
+      if (index + repeat > total) {
+        return false;
+      }
+      std::fill_n(lengths.begin() + index, repeat, length);
+      index += repeat;
+    }
+    // Without an end-of-block code the block could never end.
+    if (lengths[256] == 0) {
+      return false;
+    }
+
+    Huffman literals;
+    Huffman distances;
+    return literals.build(lengths.data(), literalCount) &&
+           distances.build(lengths.data() + literalCount, distanceCount) &&
+           codes(literals, distances);
+  }
+
+  bool codes(const Huffman& literals, const Huffman& distances) {
+    for (;;) {
+      in_.refill();
+      int symbol = literals.decode(in_);
+      if (symbol < 256) {
+        if (symbol < 0 || out_ == end_) {
+          return false;
+        }
+        *out_++ = static_cast<unsigned char>(symbol);
+        continue;
+      }
+      if (symbol == 256) {
+        return true;
+      }
+
+      symbol -= 257;
+      if (symbol >= 29) {
+        return false;
+      }
+      const std::size_t length = lengthBase[symbol] + in_.bits(lengthExtra[symbol]);
+      const int distanceSymbol = distances.decode(in_);
+      if (distanceSymbol < 0 || distanceSymbol >= 30) {
+        return false;
+      }
+      const std::size_t distance =
+          distanceBase[distanceSymbol] + in_.bits(distanceExtra[distanceSymbol]);
+      if (distance > static_cast<std::size_t>(out_ - begin_) ||
+          length > static_cast<std::size_t>(end_ - out_)) {
+        return false;
+      }
+
+      const unsigned char* from = out_ - distance;
+      if (distance >= length) {
+        std::memcpy(out_, from, length);
+      } else {
+        // Overlapping copies repeat the last [distance] bytes.
+        for (std::size_t i = 0; i < length; ++i) {
+          out_[i] = from[i];
+        }
+      }
+      out_ += length;
+    }
+  }
+
+  BitReader in_;
+  unsigned char* begin_;
+  unsigned char* out_;
+  unsigned char* end_;
+};
+
+// Member header flags.
+constexpr unsigned char FlagHeaderCrc = 0x02;
+constexpr unsigned char FlagExtra = 0x04;
+constexpr unsigned char FlagName = 0x08;
+constexpr unsigned char FlagComment = 0x10;
+
+// ID1, ID2, CM (deflate), FLG, MTIME, XFL, OS.
+constexpr std::size_t FixedHeaderSize = 10;
+// CRC32 and ISIZE.
+constexpr std::size_t TrailerSize = 8;
+
+bool isGzipHeader(const unsigned char* p) {
+  return p[0] == 0x1F && p[1] == 0x8B && p[2] == 8;
+}
+}  // namespace
+
+std::optional<std::size_t> bgzfMemberSize(std::string_view data) {
+  const auto* p = bytes(data);
+  if (data.size() < FixedHeaderSize + 2 || !isGzipHeader(p) || (p[3] & FlagExtra) == 0) {
+    return std::nullopt;
+  }
+  const std::size_t extraSize = load16(p + FixedHeaderSize);
+  if (data.size() < FixedHeaderSize + 2 + extraSize) {
+    return std::nullopt;
+  }
+  // The extra field is a list of subfields: SI1, SI2, LEN and LEN bytes of data.
+  const auto* subfield = p + FixedHeaderSize + 2;
+  const auto* extraEnd = subfield + extraSize;
+  while (extraEnd - subfield >= 4) {
+    const std::size_t length = load16(subfield + 2);
+    if (static_cast<std::size_t>(extraEnd - subfield - 4) < length) {
+      break;
+    }
+    // BGZF stores the whole member size minus one in the "BC" subfield.
+    if (subfield[0] == 'B' && subfield[1] == 'C' && length == 2) {
+      return std::size_t{load16(subfield + 4)} + 1;
+    }
+    subfield += 4 + length;
+  }
+  return std::nullopt;
+}
+
+std::optional<GzipMember> parseGzipMember(std::string_view member) {
+  const auto* p = bytes(member);
+  const auto* end = p + member.size();
+  if (member.size() < FixedHeaderSize + TrailerSize || !isGzipHeader(p)) {
+    return std::nullopt;
+  }
+  const unsigned char flags = p[3];
+  const auto* next = p + FixedHeaderSize;
+  const auto* payloadLimit = end - TrailerSize;
+  if ((flags & FlagExtra) != 0) {
+    if (payloadLimit - next < 2) {
+      return std::nullopt;
+    }
+    const std::size_t extraSize = load16(next);
+    if (static_cast<std::size_t>(payloadLimit - next - 2) < extraSize) {
+      return std::nullopt;
+    }
+    next += 2 + extraSize;
+  }
+  for (unsigned char flag : {FlagName, FlagComment}) {
+    if ((flags & flag) != 0) {
+      next = static_cast<const unsigned char*>(std::memchr(next, 0, payloadLimit - next));
+      if (next == nullptr) {
+        return std::nullopt;
+      }
+      ++next;
+    }
+  }
+  if ((flags & FlagHeaderCrc) != 0) {
+    if (payloadLimit - next < 2) {
+      return std::nullopt;
+    }
+    next += 2;
+  }
+
+  GzipMember parsed;
+  parsed.deflate = std::string_view{reinterpret_cast<const char*>(next),
+                                    static_cast<std::size_t>(payloadLimit - next)};
+  parsed.crc = load32(payloadLimit);
+  parsed.size = load32(payloadLimit + 4);
+  return parsed;
+}
+
+bool gunzipMember(const GzipMember& member, unsigned char* output) {
+  return inflate(member.deflate, output, member.size) &&
+         crc32(0, output, member.size) == member.crc;
+}
+
+bool inflate(std::string_view input, unsigned char* output, std::size_t outputSize) {
+  return Inflater{input, output, outputSize}.run();
+}
+
+std::uint32_t crc32(std::uint32_t crc, const unsigned char* data, std::size_t size) {
+  const auto& t = crcTables;
+  crc = ~crc;
+  for (; size >= 8; data += 8, size -= 8) {
+    const std::uint32_t low = load32(data) ^ crc;
+    const std::uint32_t high = load32(data + 4);
+    crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+          t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^
+          t[0][high >> 24];
+  }
+  for (; size > 0; ++data, --size) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+  }
+  return ~crc;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace Ubuntu {
+// A self-contained gzip (RFC 1952) decoder, tailored to files made of many small independent
+// members, such as the ones written by bgzip, the Blocked GNU Zip Format (BGZF) tool. Every member
+// of such a file records its own compressed size in its header, thus the file can be split into
+// members without decoding it, and the members decoded in parallel.
+//
+// A BGZF file is a valid gzip file: any other tool, WSL included, reads it as usual. The image
+// build recompresses the rootfs as BGZF for that reason (see wsl-builder/prepare-build/rootfs).
+
+// A whole gzip member split into its DEFLATE payload and trailer.
+struct GzipMember {
+  std::string_view deflate;
+  // CRC-32 of the uncompressed data.
+  std::uint32_t crc = 0;
+  // Size of the uncompressed data, modulo 2^32. BGZF members never exceed 64 KiB.
+  std::uint32_t size = 0;
+};
+
+// The largest uncompressed size of a BGZF member.
+constexpr std::uint32_t MaxBgzfMemberSize = 65536;
+
+// The size in bytes of the BGZF member starting at [data], as recorded in its header, or nullopt if
+// [data] doesn't start with a BGZF member header. Only the header needs to be available.
+std::optional<std::size_t> bgzfMemberSize(std::string_view data);
+
+// Splits a whole gzip member into its payload and trailer, or nullopt if it's malformed.
+std::optional<GzipMember> parseGzipMember(std::string_view member);
+
+// Decodes [member] into [output], which must hold exactly member.size bytes. Returns false if the
+// member is corrupt, in which case the contents of [output] are unspecified.
+bool gunzipMember(const GzipMember& member, unsigned char* output);
+
+// Decodes a raw DEFLATE stream (RFC 1951) into [output], which must be exactly as large as the
+// decoded data.
+bool inflate(std::string_view input, unsigned char* output, std::size_t outputSize);
+
+// The CRC-32 gzip uses (ISO 3309), continuing from [crc], which must be 0 at the start.
+std::uint32_t crc32(std::uint32_t crc, const unsigned char* data, std::size_t size);
+}  // namespace Ubuntu
@@ -0,0 +1,265 @@
+#include <stdafx.h>
+#include "HashTree.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+#include <RootfsHashes.h>
+#include "SplitView.h"
+
+namespace Ubuntu {
+
+namespace {
+// Manifests list a few hundred chunks. Anything much larger is not a manifest.
+constexpr std::uintmax_t MaxManifestSize = 16 * 1024 * 1024;
+
+// Chunks spread over several pieces are buffered, so they can't be arbitrarily large.
+constexpr std::uint64_t MaxChunkSize = 256 * 1024 * 1024;
+
+constexpr std::uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+std::uint32_t rotr(std::uint32_t value, int bits) {
+  return (value >> bits) | (value << (32 - bits));
+}
+
+std::uint32_t loadBigEndian(const unsigned char* p) {
+  return (std::uint32_t{p[0]} << 24) | (std::uint32_t{p[1]} << 16) | (std::uint32_t{p[2]} << 8) |
+         std::uint32_t{p[3]};
+}
+
+// Mixes the 64-byte [block] into [state].
+void compress(std::uint32_t (&state)[8], const unsigned char* block) {
+  std::uint32_t w[64];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = loadBigEndian(block + 4 * i);
+  }
+  for (int i = 16; i < 64; ++i) {
+    const auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    const auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  auto [a, b, c, d, e, f, g, h] = state;
+  for (int i = 0; i < 64; ++i) {
+    const auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+    const auto choice = (e & f) ^ (~e & g);
+    const auto t1 = h + s1 + choice + roundConstants[i] + w[i];
+    const auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+    const auto majority = (a & b) ^ (a & c) ^ (b & c);
+    const auto t2 = s0 + majority;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+std::optional<Sha256Digest> parseDigest(std::string_view hex) {
+  Sha256Digest digest;
+  if (hex.size() != 2 * digest.size()) {
+    return std::nullopt;
+  }
+  for (std::size_t i = 0; i < digest.size(); ++i) {
+    const char* begin = hex.data() + 2 * i;
+    auto [end, error] = std::from_chars(begin, begin + 2, digest[i], 16);
+    if (error != std::errc{} || end != begin + 2) {
+      return std::nullopt;
+    }
+  }
+  return digest;
+}
+
+std::optional<std::uint64_t> parseNumber(std::string_view text) {
+  std::uint64_t value = 0;
+  auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc{} || end != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+}  // namespace
+
+Sha256Digest sha256(const unsigned char* data, std::size_t size) {
+  std::uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  const std::size_t whole = size - size % 64;
+  for (std::size_t offset = 0; offset < whole; offset += 64) {
+    compress(state, data + offset);
+  }
+
+  // The last block is padded with a single set bit, zeros, and the message length in bits.
+  unsigned char tail[128] = {};
+  const std::size_t left = size - whole;
+  std::memcpy(tail, data + whole, left);
+  tail[left] = 0x80;
+  const std::size_t tailSize = left < 56 ? 64 : 128;
+  const std::uint64_t bits = std::uint64_t{size} * 8;
+  for (int i = 0; i < 8; ++i) {
+    tail[tailSize - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+  }
+  for (std::size_t offset = 0; offset < tailSize; offset += 64) {
+    compress(state, tail + offset);
+  }
+
+  Sha256Digest digest;
+  for (int i = 0; i < 8; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      digest[4 * i + j] = static_cast<unsigned char>(state[i] >> (24 - 8 * j));
+    }
+  }
+  return digest;
+}
+
+std::optional<HashTree> HashTree::parse(std::string_view manifest) {
+  SplitView lines{manifest, '\n'};
+  const auto header = lines.next();
+  if (!header) {
+    return std::nullopt;
+  }
+
+  // The header: chunk size, file size, root hash.
+  SplitView fields{*header, ' '};
+  const auto chunkSizeField = fields.next();
+  const auto fileSizeField = fields.next();
+  const auto rootField = fields.next();
+  if (!chunkSizeField || !fileSizeField || !rootField || fields.next()) {
+    return std::nullopt;
+  }
+  const auto chunkSize = parseNumber(*chunkSizeField);
+  const auto fileSize = parseNumber(*fileSizeField);
+  const auto root = parseDigest(*rootField);
+  if (!chunkSize || *chunkSize == 0 || *chunkSize > MaxChunkSize || !fileSize || !root) {
+    return std::nullopt;
+  }
+
+  HashTree tree;
+  tree.root_ = *root;
+  tree.chunkSize_ = *chunkSize;
+  tree.fileSize_ = *fileSize;
+  const std::uint64_t count = *fileSize / *chunkSize + (*fileSize % *chunkSize != 0 ? 1 : 0);
+  // Bounds the allocation by the manifest size, however large the header claims the file is.
+  if (count > manifest.size() / (2 * root->size())) {
+    return std::nullopt;
+  }
+  tree.chunks_.reserve(static_cast<std::size_t>(count));
+  while (const auto line = lines.next()) {
+    auto digest = parseDigest(*line);
+    if (!digest) {
+      return std::nullopt;
+    }
+    tree.chunks_.push_back(*digest);
+  }
+  if (tree.chunks_.size() != count) {
+    return std::nullopt;
+  }
+
+  const auto* digests = reinterpret_cast<const unsigned char*>(tree.chunks_.data());
+  if (sha256(digests, tree.chunks_.size() * sizeof(Sha256Digest)) != *root) {
+    return std::nullopt;
+  }
+  return tree;
+}
+
+std::size_t HashTree::chunkSize(std::size_t index) const {
+  return static_cast<std::size_t>(std::min(chunkSize_, fileSize_ - index * chunkSize_));
+}
+
+bool HashTree::verify(std::size_t index, std::string_view data) const {
+  return index < chunks_.size() && data.size() == chunkSize(index) &&
+         sha256(reinterpret_cast<const unsigned char*>(data.data()), data.size()) ==
+             chunks_[index];
+}
+
+std::string_view expectedRootHash(const std::filesystem::path& file) {
+  const auto name = file.filename().wstring();
+  for (const auto& expected : ExpectedRootHashes) {
+    if (expected.file == name) {
+      return expected.root;
+    }
+  }
+  return {};
+}
+
+ShippedHashTree loadHashTree(const std::filesystem::path& file, std::string_view expectedRoot) {
+  if (expectedRoot.empty()) {
+    return {};
+  }
+
+  ShippedHashTree shipped;
+  auto path = file;
+  path += L".hashtree";
+  std::error_code error;
+  const auto size = std::filesystem::file_size(path, error);
+  std::ifstream manifest{path, std::ios::binary};
+  std::ostringstream contents;
+  if (!error && size <= MaxManifestSize && manifest && contents << manifest.rdbuf()) {
+    shipped.tree = HashTree::parse(contents.str());
+  }
+  if (shipped.tree && shipped.tree->root() != parseDigest(expectedRoot)) {
+    shipped.tree.reset();
+  }
+  shipped.malformed = !shipped.tree;
+  return shipped;
+}
+
+bool ChunkVerifier::feed(std::string_view piece) {
+  jobs_.clear();
+  if (piece.size() > tree_.fileSize() - position_) {
+    failed_ = true;
+    return false;
+  }
+  while (!piece.empty()) {
+    const auto chunk = static_cast<std::size_t>(position_ / tree_.chunkSize());
+    const auto size = tree_.chunkSize(chunk);
+    const auto offset = static_cast<std::size_t>(position_ % tree_.chunkSize());
+    const auto taken = std::min(piece.size(), size - offset);
+    if (offset == 0 && taken == size) {
+      // Whole chunks are hashed in place.
+      jobs_.push_back({chunk, piece.substr(0, taken)});
+    } else {
+      partial_.append(piece.data(), taken);
+      if (partial_.size() == size) {
+        // A piece completes at most one chunk started by a previous one: its first.
+        joined_ = std::move(partial_);
+        partial_.clear();
+        jobs_.push_back({chunk, joined_});
+      }
+    }
+    position_ += taken;
+    piece.remove_prefix(taken);
+  }
+  return true;
+}
+
+bool ChunkVerifier::run(std::size_t index) const {
+  if (!tree_.verify(jobs_[index].chunk, jobs_[index].data)) {
+    failed_ = true;
+  }
+  return !failed_;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,110 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ubuntu {
+using Sha256Digest = std::array<unsigned char, 32>;
+
+// The SHA-256 (FIPS 180-4) of [size] bytes at [data].
+Sha256Digest sha256(const unsigned char* data, std::size_t size);
+
+// The SHA-256 of every fixed-size chunk of a file, tied together by a root hash: the SHA-256 of the
+// chunk digests concatenated. Chunks can thus be verified independently, in any order, as soon as
+// they are read, and the whole list is vouched for by the root hash alone.
+//
+// The build writes the tree of each rootfs next to it, as "<rootfs>.hashtree", in text form: a
+// line holding the chunk size, the file size and the root hash, followed by a line per chunk
+// holding its hash. Hashes are written in lowercase hexadecimal. As anyone able to replace the
+// rootfs can replace the manifest along with it, the build also embeds the root hash of each
+// rootfs into the launcher (RootfsHashes.h), and a manifest is only trusted if it matches.
+class HashTree {
+ public:
+  // Parses a manifest, or returns nullopt if it is malformed or its root hash doesn't match.
+  static std::optional<HashTree> parse(std::string_view manifest);
+
+  const Sha256Digest& root() const { return root_; }
+  std::uint64_t chunkSize() const { return chunkSize_; }
+  std::uint64_t fileSize() const { return fileSize_; }
+  std::size_t chunkCount() const { return chunks_.size(); }
+
+  // The size of chunk [index], the last one being shorter unless the file size is a multiple of
+  // the chunk size.
+  std::size_t chunkSize(std::size_t index) const;
+
+  // Whether [data] is chunk [index].
+  bool verify(std::size_t index, std::string_view data) const;
+
+ private:
+  Sha256Digest root_{};
+  std::uint64_t chunkSize_ = 0;
+  std::uint64_t fileSize_ = 0;
+  std::vector<Sha256Digest> chunks_;
+};
+
+// A root hash the build embedded into the launcher, in hexadecimal, for the rootfs named [file].
+struct ExpectedRootHash {
+  std::wstring_view file;
+  std::string_view root;
+};
+
+// The root hash embedded for the rootfs at [file], or an empty string if there is none, as in
+// builds that didn't go through wsl-builder/prepare-build.
+std::string_view expectedRootHash(const std::filesystem::path& file);
+
+// The hash tree shipped next to [file], whose root hash must be [expectedRoot]: nullopt if no root
+// hash is expected, an error if the manifest is missing, can't be read or parsed, or doesn't match.
+struct ShippedHashTree {
+  std::optional<HashTree> tree;
+  bool malformed = false;
+};
+ShippedHashTree loadHashTree(const std::filesystem::path& file, std::string_view expectedRoot);
+
+// Verifies a file against its hash tree as it's read sequentially, in pieces of any size, so it
+// costs no I/O of its own. Hashing is split into jobs, one per chunk completed by the last piece,
+// for the caller to run on its worker threads along with whatever else it does with that piece.
+class ChunkVerifier {
+ public:
+  explicit ChunkVerifier(const HashTree& tree) : tree_{tree} {}
+
+  ChunkVerifier(const ChunkVerifier&) = delete;
+  ChunkVerifier& operator=(const ChunkVerifier&) = delete;
+
+  // Accounts for the next [piece] of the file, which must outlive the jobs it makes ready. Returns
+  // false if the file is larger than the tree says.
+  bool feed(std::string_view piece);
+
+  // The number of hashing jobs made ready by the last piece.
+  std::size_t jobs() const { return jobs_.size(); }
+
+  // Runs the hashing job [index]. Jobs may run concurrently. Returns false on a mismatch.
+  bool run(std::size_t index) const;
+
+  // Whether the whole file was fed. Its last chunk may only be verified then.
+  bool complete() const { return position_ == tree_.fileSize(); }
+
+  // Whether the file was found not to match the tree, either by a job or by being too large.
+  bool failed() const { return failed_; }
+
+ private:
+  struct Job {
+    std::size_t chunk;
+    std::string_view data;
+  };
+
+  const HashTree& tree_;
+  std::uint64_t position_ = 0;
+  std::vector<Job> jobs_;
+  mutable std::atomic<bool> failed_{false};
+  // The beginning of a chunk spread over several pieces.
+  std::string partial_;
+  // Such a chunk once complete, until its job runs.
+  std::string joined_;
+};
+}  // namespace Ubuntu
@@ -0,0 +1,44 @@
+#include <stdafx.h>
+#include "ImageFacts.h"
+#include "CloudInit.h"
+#include "DefaultUserSelector.h"
+#include "IniFile.h"
+
+namespace Ubuntu {
+
+namespace {
+// Configuration files are a few KiB at most. Anything larger is not worth reading up front.
+constexpr std::size_t MaxFileSize = 64 * 1024;
+}  // namespace
+
+ImageFacts ImageFacts::inspect(const StagedRootfs& rootfs) {
+  Trace::Span span{"ImageFacts", "install"};
+  ImageFacts facts;
+  const auto* index = rootfs.index();
+  if (!index) {
+    return facts;
+  }
+
+  facts.cloudInit = cloudInitWillRun(*index);
+  span.arg("cloudInit", std::string_view{*facts.cloudInit ? "yes" : "no"});
+
+  if (!index->find("etc/wsl.conf")) {
+    facts.wslConfUser.emplace();
+  } else if (const auto wslConf = rootfs.extract("etc/wsl.conf", MaxFileSize)) {
+    facts.wslConfUser = IniFile{*wslConf}.get("user", "default").value_or("");
+  }
+  if (facts.wslConfUser) {
+    span.arg("wslConfUser", *facts.wslConfUser);
+  }
+
+  if (const auto passwd = rootfs.extract("etc/passwd", MaxFileSize)) {
+    DefaultUserSelector users;
+    users.feed(*passwd);
+    users.finish();
+    facts.loginUser = users.firstLoginUser().has_value();
+    span.arg("loginUser", std::string_view{*facts.loginUser ? "yes" : "no"});
+  }
+  return facts;
+}
+
+}  // namespace Ubuntu
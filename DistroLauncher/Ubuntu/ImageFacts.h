@@ -0,0 +1,22 @@
+#pragma once
+#include <optional>
+#include <string>
+
+namespace Ubuntu {
+class StagedRootfs;
+
+// What the launcher learns from the rootfs before registering it, so the initialization tasks can
+// be planned up front instead of discovered in the distro afterwards. Facts are unknown when the
+// rootfs couldn't be inspected, which is the case when it wasn't staged.
+struct ImageFacts {
+  // Whether cloud-init will run on first boot.
+  std::optional<bool> cloudInit;
+  // The default user set in /etc/wsl.conf, empty if none.
+  std::optional<std::string> wslConfUser;
+  // Whether /etc/passwd lists a non-system user allowed to log in, who would become the default.
+  std::optional<bool> loginUser;
+
+  // Reads the facts out of the index of a staged [rootfs], without unpacking it.
+  static ImageFacts inspect(const StagedRootfs& rootfs);
+};
+}  // namespace Ubuntu
@@ -0,0 +1,138 @@
+#include <stdafx.h>
+#include "IniFile.h"
+#include "SplitView.h"
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+
+namespace Ubuntu {
+
+namespace {
+// Hashes and compares names as GetPrivateProfileString does, case-insensitively.
+struct NameHash {
+  std::size_t operator()(std::string_view name) const {
+    std::size_t hash = 14695981039346656037ull;
+    for (const unsigned char c : name) {
+      hash = (hash ^ static_cast<std::size_t>(std::tolower(c))) * 1099511628211ull;
+    }
+    return hash;
+  }
+};
+
+struct NameEqual {
+  bool operator()(std::string_view a, std::string_view b) const { return iequals(a, b); }
+};
+
+std::string_view unquote(std::string_view value) {
+  if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+    return value.substr(1, value.size() - 2);
+  }
+  return value;
+}
+}  // namespace
+
+std::string_view trim(std::string_view str) {
+  auto first = str.find_first_not_of(" \t\r");
+  if (first == std::string_view::npos) {
+    return {};
+  }
+  return str.substr(first, str.find_last_not_of(" \t\r") - first + 1);
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) ==
+                  std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+IniFile::IniFile(std::string_view contents) {
+  std::string_view section;
+  // The sections met so far, not to scan all of them at every header.
+  std::unordered_set<std::string_view, NameHash, NameEqual> seen;
+  for (auto line : SplitView{contents, '\n'}) {
+    line = trim(line);
+    if (line.empty() || line.front() == '#' || line.front() == ';') {
+      continue;
+    }
+
+    if (line.front() == '[') {
+      section = trim(line.substr(1, line.find(']') - 1));
+      if (seen.insert(section).second) {
+        sections_.push_back(section);
+      }
+      continue;
+    }
+
+    if (auto eq = line.find('='); eq != std::string_view::npos) {
+      entries_.push_back(
+          Entry{section, trim(line.substr(0, eq)), unquote(trim(line.substr(eq + 1)))});
+    }
+  }
+}
+
+std::optional<std::string_view> IniFile::get(std::string_view section, std::string_view key) const {
+  for (const auto& entry : entries_) {
+    if (iequals(entry.section, section) && iequals(entry.key, key)) {
+      return entry.value;
+    }
+  }
+  return std::nullopt;
+}
+
+std::string setIniValue(std::string_view contents, std::string_view section, std::string_view key,
+                        std::string_view value) {
+  const IniFile ini{contents};
+  // Lines are added with the line breaks the file already uses, so as not to mix CRLF and LF.
+  const std::string_view newline = contents.find("\r\n") == std::string_view::npos ? "\n" : "\r\n";
+  std::string line{key};
+  line += " = ";
+  line += value;
+  // Where the line holding [p], a pointer into the contents, ends, before its line break.
+  auto lineEnd = [&](const char* p) {
+    auto end = std::min(contents.find('\n', static_cast<std::size_t>(p - contents.data())),
+                        contents.size());
+    if (end > 0 && contents[end - 1] == '\r') {
+      --end;
+    }
+    return end;
+  };
+
+  std::string result{contents};
+  const IniFile::Entry* last = nullptr;
+  for (const auto& entry : ini.entries()) {
+    if (entry.key.empty() || !iequals(entry.section, section)) {
+      continue;
+    }
+    if (iequals(entry.key, key)) {
+      const auto offset = static_cast<std::size_t>(entry.key.data() - contents.data());
+      const auto previous = contents.rfind('\n', offset);
+      const auto begin = previous == std::string_view::npos ? 0 : previous + 1;
+      return result.replace(begin, lineEnd(entry.key.data()) - begin, line);
+    }
+    last = &entry;
+  }
+
+  line.insert(0, newline);
+  if (last) {
+    return result.insert(lineEnd(last->key.data()), line);
+  }
+  const auto& sections = ini.sections();
+  auto header = std::find_if(sections.begin(), sections.end(),
+                             [&](std::string_view s) { return iequals(s, section); });
+  if (header != sections.end() && !header->empty()) {
+    return result.insert(lineEnd(header->data()), line);
+  }
+  if (!result.empty() && result.back() != '\n') {
+    result += newline;
+  }
+  result += '[';
+  result += section;
+  result += ']';
+  result += line;
+  result += newline;
+  return result;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,54 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ubuntu {
+// A read-only view of an INI file, such as /etc/wsl.conf, parsed in memory in a single pass.
+//
+// Nothing is copied: sections, keys and values are views into the contents, which are required to
+// outlive this object. The syntax follows what GetPrivateProfileString accepts:
+// - [section] headers, with blanks around the name ignored;
+// - key = value lines, with blanks around keys and values ignored and a value enclosed in double
+//   quotes unquoted;
+// - lines starting with '#' or ';' are comments, other lines without '=' are ignored.
+// Section and key names are compared case-insensitively.
+class IniFile {
+ public:
+  struct Entry {
+    // Empty for keys preceding the first section header.
+    std::string_view section;
+    std::string_view key;
+    std::string_view value;
+  };
+
+  explicit IniFile(std::string_view contents);
+
+  // The value of the first occurrence of [key] in [section], if any.
+  std::optional<std::string_view> get(std::string_view section, std::string_view key) const;
+
+  // All sections, in the order they first appear, including the ones with no keys.
+  const std::vector<std::string_view>& sections() const { return sections_; }
+
+  // All key-value pairs, in file order.
+  const std::vector<Entry>& entries() const { return entries_; }
+
+ private:
+  std::vector<std::string_view> sections_;
+  std::vector<Entry> entries_;
+};
+
+// [contents] with [key] set to [value] in [section], leaving everything else as is: the first
+// occurrence of the key in the section is rewritten, or else the key is added after the last one in
+// the section, or else the section is added at the end.
+std::string setIniValue(std::string_view contents, std::string_view section, std::string_view key,
+                        std::string_view value);
+
+// [str] without its leading and trailing blanks, as INI files and the files built on their rules
+// ignore them around names and values.
+std::string_view trim(std::string_view str);
+
+// Whether ASCII strings [a] and [b] are equal but for case, as INI section and key names compare.
+bool iequals(std::string_view a, std::string_view b);
+}  // namespace Ubuntu
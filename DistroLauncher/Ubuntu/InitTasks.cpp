@@ -1,10 +1,22 @@
 #include <stdafx.h>
 #include "InitTasks.h"
+#include "CloudInit.h"
+#include "DefaultUserSelector.h"
+#include "DirectExec.h"
+#include "IniFile.h"
+#include "Probe.h"
+#include "ProgressIndicator.h"
+#include "TaskGraph.h"
+#include "UserDbCache.h"
+#include "Utf8.h"
+#include "WslProcess.h"
 
 #include <algorithm>
 #include <charconv>
+#include <chrono>
 #include <exception>
-#include <filesystem>
+#include <future>
+#include <mutex>
 #include <optional>
 #include <vector>
 #include <system_error>
@@ -12,47 +24,222 @@
 namespace Ubuntu {
 
 namespace {
-// Blocks the current thread until all initialization tasks finish.
-void waitForInitTasks(WslApiLoader& api);
-
-// Enforces the existence of a default WSL user either:
-// - defined in /etc/wsl.conf (which might not be in effect yet)
-// - defined in WSL API/registry
-// - or the lowest non-system account with UID >= 1000 in the NSS passwd database
-// Returns false if a default user couldn't be set.
-bool enforceDefaultUser(WslApiLoader& api);
+// Shown while waiting for cloud-init.
+constexpr std::wstring_view CloudInitProgress = L"Waiting for cloud-init to finish...";
+
+// Shows that the launcher waits for cloud-init, but only while both the probe waits for cloud-init
+// and the launcher waits for the probe: a probe running in the background must not garble a prompt.
+class CloudInitWait {
+ public:
+  // Called by the probe when it starts or stops waiting for cloud-init.
+  void setPending(bool pending) {
+    std::scoped_lock lock{mutex_};
+    pending_ = pending;
+    update();
+  }
+
+  // Called by the launcher when it starts or stops waiting for the probe.
+  void setWatched(bool watched) {
+    std::scoped_lock lock{mutex_};
+    watched_ = watched;
+    update();
+  }
+
+ private:
+  void update() {
+    if (pending_ && watched_) {
+      if (!progress_) {
+        progress_.emplace(std::wstring{CloudInitProgress});
+      }
+    } else {
+      progress_.reset();
+    }
+  }
+
+  std::mutex mutex_;
+  bool pending_ = false;
+  bool watched_ = false;
+  std::optional<ProgressIndicator> progress_;
+};
+
+// Holds what the tasks running in the background have to tell the user until the launcher waits
+// for them, as printing right away would garble the prompt the launcher may be showing meanwhile.
+class DeferredMessages {
+ public:
+  // Queues a line.
+  void add(std::wstring line) {
+    std::scoped_lock lock{mutex_};
+    lines_.push_back(std::move(line));
+  }
+
+  // Prints the lines queued so far, in order.
+  void print() {
+    std::vector<std::wstring> lines;
+    {
+      std::scoped_lock lock{mutex_};
+      lines.swap(lines_);
+    }
+    for (const auto& line : lines) {
+      _putws(line.c_str());
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::wstring> lines_;
+};
+
+// Blocks the current thread until all initialization tasks finish or the deadline expires.
+void waitForInitTasks(WslApiBackend& api, const ImageFacts& image, CloudInitWait& wait,
+                      DeferredMessages& messages);
+
+// Tells the user the launcher stopped waiting for cloud-init.
+void reportCloudInitTimedOut(DeferredMessages& messages);
+
+// Waits for cloud-init and then collects what the distro knows about the default user, all in a
+// single Linux process launch. Whatever [image] already tells is not asked again. The passwd
+// database goes to [users], if enumerated.
+void probeDefaultUser(WslApiBackend& api, const ImageFacts& image, CloudInitWait& wait,
+                      DeferredMessages& messages, DefaultUserProbes& probes,
+                      std::optional<UserTable>& users);
 }  // namespace
 
-bool CheckInitTasks(WslApiLoader& api, bool checkDefaultUser) {
-  waitForInitTasks(api);
+bool CheckInitTasks(WslApiBackend& api, bool checkDefaultUser, const ImageFacts& image) {
+  return BackgroundInitTasks{api, checkDefaultUser, image}.finish();
+}
+
+struct BackgroundInitTasks::State {
+  WslApiBackend& api;
+  bool checkDefaultUser;
+  ImageFacts image;
+  CloudInitWait cloudInit;
+  DeferredMessages messages;
+  DefaultUserProbes probes;
+  std::optional<UserTable> users;
+  // Waits for cloud-init and, if [checkDefaultUser], probes the default user.
+  std::future<void> probe;
+
+  // Blocks until the probe completes, showing the progress of cloud-init meanwhile, and then what
+  // it had to tell.
+  void wait() {
+    cloudInit.setWatched(true);
+    probe.wait();
+    cloudInit.setWatched(false);
+    messages.print();
+  }
+};
+
+BackgroundInitTasks::BackgroundInitTasks(WslApiBackend& api, bool checkDefaultUser,
+                                         const ImageFacts& image) :
+    state_{new State{api, checkDefaultUser, image}} {
+  Trace::Span span{"BackgroundInitTasks", "init"};
+  span.arg("image", std::string_view{image.cloudInit ? "inspected" : "unknown"});
+  State& state = *state_;
+  state.probe = std::async(std::launch::async, [&state] {
+    if (state.checkDefaultUser) {
+      probeDefaultUser(state.api, state.image, state.cloudInit, state.messages, state.probes,
+                       state.users);
+    } else {
+      waitForInitTasks(state.api, state.image, state.cloudInit, state.messages);
+    }
+  });
+}
+
+BackgroundInitTasks::~BackgroundInitTasks() {
+  if (state_->probe.valid()) {
+    state_->wait();
+  }
+}
 
-  if (!checkDefaultUser) {
+bool BackgroundInitTasks::finish() try {
+  Trace::Span span{"CheckInitTasks", "init"};
+  State& state = *state_;
+  if (!state.checkDefaultUser) {
+    state.wait();
+    state.probe.get();
     return true;
   }
 
-  return enforceDefaultUser(api);
+  bool success = true;
+  TaskGraph tasks;
+  // The probe waits for cloud-init itself. The registry is not affected by cloud-init, thus
+  // reading it overlaps with the wait.
+  auto probe = tasks.add("probe", [&] {
+    state.wait();
+    state.probe.get();
+  });
+  auto registry =
+      tasks.add("registry", [&] { state.probes.registryUid = registryDefaultUid(state.api); });
+  tasks.add(
+      "default user", [&] { success = enforceDefaultUser(state.api, state.probes); },
+      {probe, registry});
+  tasks.run();
+
+  return success;
+} catch (const std::exception& err) {
+  _putws(L"ERROR: Unexpected failure when enforcing the default user: ");
+  _putws(toWide(err.what()).c_str());
+  return false;
+}
+
+bool BackgroundInitTasks::userExists(std::wstring_view userName) {
+  State& state = *state_;
+  state.wait();
+  return state.users && UserDbCache::uidOf(*state.users, userName).has_value();
+}
+
+bool defaultUserNeeded(const ImageFacts& image) {
+  if (!image.cloudInit || !image.wslConfUser || !image.loginUser) {
+    return false;
+  }
+  if (!image.wslConfUser->empty() || *image.loginUser) {
+    return false;
+  }
+  return !*image.cloudInit || !cloudInitUserDataExists();
 }
 
 namespace {
-void waitForInitTasks(WslApiLoader& api) {
-  DWORD exitCode = -1;
-  // Try running cloud-init unconditionally, but avoid printing to console.
-  auto hr = api.WslLaunchInteractive(L"cloud-init status --wait >/dev/null 2>&1", FALSE, &exitCode);
-  if (FAILED(hr)) {
-    Helpers::PrintErrorMessage(hr);
+void waitForInitTasks(WslApiBackend& api, const ImageFacts& image, CloudInitWait& wait,
+                      DeferredMessages& messages) {
+  Trace::Span span{"waitForInitTasks", "init"};
+  // Without cloud-init in the image, there is nothing to wait for, nor to look for in the distro.
+  if (!image.cloudInit.value_or(true) || cloudInitDone(api)) {
     return;
   }
+
+  // The deadline is enforced inside the distro. The grace period only guards against WSL itself
+  // not responding.
+  constexpr auto grace = std::chrono::seconds{30};
+  const auto timeout =
+      std::chrono::duration_cast<std::chrono::milliseconds>(CloudInitDeadline + grace);
+  // Framing the wait as a probe section reports its exit code even though it prints nothing.
+  const std::wstring cloudInit = cloudInitWaitCommand();
+  int exitCode = -1;
+  ProbeDemultiplexer demux{[&](ProbeSection&& section) { exitCode = section.exitCode; }};
+  wait.setPending(true);
+  // The probe is a POSIX shell script, while the default user may log in with any shell.
+  WslProcess process{
+      directExecCommand({L"/bin/sh", L"-c", probeCommand({{L"cloud-init", cloudInit}})})};
+  process.setInput({});
+  auto result = process.run(api, static_cast<DWORD>(timeout.count()),
+                            [&](std::string_view chunk) { demux.feed(chunk); });
+  wait.setPending(false);
+  if (!result.error.empty()) {
+    messages.add(L"failed to wait for cloud-init: ");
+    messages.add(std::move(result.error));
+    return;
+  }
+  if (exitCode == CloudInitTimedOut) {
+    reportCloudInitTimedOut(messages);
+  }
 }
 
-namespace fs = std::filesystem;
-fs::path wslConfPath() {
-  // init-once, lazily.
-  static fs::path etcWslConf =
-      fs::path{L"\\\\wsl.localhost"} / DistributionInfo::Name / "etc\\wsl.conf";
-  return etcWslConf;
+void reportCloudInitTimedOut(DeferredMessages& messages) {
+  messages.add(L"cloud-init is taking too long, continuing without waiting for it. It keeps running "
+               L"in the background, run 'cloud-init status --wait' to follow it.");
 }
 
-bool setDefaultUserViaWslApi(WslApiLoader& api, unsigned long uid) {
+bool setDefaultUserViaWslApi(WslApiBackend& api, unsigned long uid) {
   if (auto hr = api.WslConfigureDistribution(uid, WSL_DISTRIBUTION_FLAGS_DEFAULT); FAILED(hr)) {
     _putws(L"ERROR: failed to set default user: ");
     Helpers::PrintErrorMessage(hr);
@@ -60,431 +247,213 @@ bool setDefaultUserViaWslApi(WslApiLoader& api, unsigned long uid) {
   }
   return true;
 }
-// Groups the pieces of information from a single user entry in the passwd database we care about.
-struct UserEntry {
-  std::string name;
-  ULONG uid = -1;
-  bool hasLogin = false;
-};
-
-// Collects all users found in the NSS passwd database, sorted by UID.
-std::vector<UserEntry> getAllUsers(WslApiLoader& api);
-
-// Returns the defaultUser set in /etc/wsl.conf or the empty string if none is set.
-std::string defaultUserInWslConf();
+}  // namespace
 
-// Converts a multi-byte null-terminated string into a wide string.
-std::wstring str2wide(std::string_view str, UINT codePage = CP_THREAD_ACP);
+ULONG registryDefaultUid(WslApiBackend& api) {
+  DistributionConfiguration configuration;
+  if (FAILED(api.WslGetDistributionConfiguration(configuration))) {
+    return UID_INVALID;
+  }
+  return configuration.defaultUid;
+}
 
-bool enforceDefaultUser(WslApiLoader& api) try {
-  auto users = getAllUsers(api);
+bool enforceDefaultUser(WslApiBackend& api, const DefaultUserProbes& probes) {
+  Trace::Span span{"enforceDefaultUser", "init"};
+  const auto& users = probes.users;
 
+  // Whether the database was enumerated or only the user named in /etc/wsl.conf looked up, no entry
+  // at all means reading it failed: a missing user makes the probe fall back to enumerating.
   if (users.empty()) {
     // unexpectedly nothing to do
     _putws(L"ERROR: couldn't find any users in NSS database\n");
     return false;
   }
+
   // 1. We read the default user name from /etc/wsl.conf
-  if (auto name = defaultUserInWslConf(); !name.empty()) {
+  if (const auto& name = probes.wslConfUser; !name.empty()) {
     // We still need the UID to be able to call the WSL API.
-    auto found = std::find_if(users.begin(), users.end(),
-                              [&name](const UserEntry& u) { return u.name == name; });
-    if (found == users.end()) {
+    auto uid = users.named();
+    if (!uid) {
       // no UID, nothing to do, the system is in a bad state where the user requested in wsl.conf
       // doesn't exist. We won't fix that.
       return true;
     }
-    return setDefaultUserViaWslApi(api, found->uid);
+    return setDefaultUserViaWslApi(api, *uid);
   }
+
   // 2. Check for the Windows registry
-  // This call returns the UID of the current default user, most likely root, unless someone set a
+  // This is the UID of the current default user, most likely root, unless someone set a
   // different UID via the registry editor or WSL API, for which case we are done.
-  if (auto uid = DistributionInfo::QueryUid(L""); uid != 0) {
+  if (probes.registryUid != 0) {
     return true;
   }
 
   // 3. Finally, search for the first non-system user.
-  auto found = std::find_if(users.begin(), users.end(),
-                            [](const UserEntry& u) { return u.uid > 999 && u.hasLogin; });
-  if (found != users.end()) {
-    return setDefaultUserViaWslApi(api, found->uid);
+  if (auto uid = users.firstLoginUser()) {
+    return setDefaultUserViaWslApi(api, *uid);
   }
 
-  return false;
-} catch (const std::exception& err) {
-  _putws(L"ERROR: Unexpected failure when enforcing the default user: ");
-  _putws(str2wide(err.what()).c_str());
   return false;
 }
 
-// A truly temporary file copy.
-//
-// Invariant: while this object exists, so does the underlying file,
-// being auto-deleted by the OS when this object goes out of scope.
-class TempFileCopy {
-  fs::path p;
-  HANDLE h = nullptr;
-
- public:
-  ~TempFileCopy() {
-    if (h) {
-      CloseHandle(h);
-    }
+namespace {
+// Prints the default user set in /etc/wsl.conf, if any, so that the passwd query can look it up
+// directly and large directories don't get enumerated when not needed. IniFile remains the
+// authority on the user name: the probe reports what this script found, and the launcher falls
+// back to enumerating the database if the two disagree or the lookup misses.
+constexpr std::wstring_view wslConfUserQuery = LR"sh(awk '
+  /^[ \t\r]*\[/ {
+    s = $0; sub(/^[ \t\r]*\[/, "", s); sub(/\].*/, "", s); gsub(/^[ \t\r]+|[ \t\r]+$/, "", s)
+    inUser = tolower(s) == "user"; next
   }
-  const fs::path& path() const { return p; }
-
-  // Creates a temporary copy of the source file configured for auto removal by the OS when this
-  // object goes out of scope under the system's preferred temporary directory.
-  explicit TempFileCopy(const fs::path& source) {
-    // When debugging fs::temp_directory_path() returns a path like LOCALAPPDATA\Temp, but once
-    // packaged it should point inside LOCALAPPDATA\Packages\<PackageFullName>\...
-    auto path = fs::temp_directory_path();
-
-    wchar_t rawDestination[MAX_PATH] = {'\0'};
-    if (auto uniqueCode = GetTempFileNameW(path.native().c_str(), L"wsl", 0, rawDestination);
-        uniqueCode == 0) {
-      std::string msg{"couldn't create a temporary file inside "};
-      msg += path.string();
-      throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), msg};
-    }
-    fs::path destination{rawDestination};
-
-    // GetTempFileNameA would have created a file for us thus we need to overwrite it.
-    fs::copy_file(source, destination, fs::copy_options::overwrite_existing);
-    fs::permissions(destination, fs::perms::owner_read | fs::perms::owner_write);
-
-    // Allow others to read but not write it, and configure it to be deleted automatically when the
-    // handle is closed (what's the destructor does automatically no matter what).
-    HANDLE file = CreateFileW(
-        rawDestination, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
-        FILE_ATTRIBUTE_TEMPORARY | FILE_ATTRIBUTE_READONLY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
-    if (file == INVALID_HANDLE_VALUE) {
-      std::string msg{"couldn't open file in auto-delete mode: "};
-      msg += path.string();
-      throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), msg};
+  inUser && (i = index($0, "=")) {
+    k = substr($0, 1, i - 1); gsub(/^[ \t\r]+|[ \t\r]+$/, "", k)
+    if (tolower(k) == "default") {
+      v = substr($0, i + 1); gsub(/^[ \t\r]+|[ \t\r]+$/, "", v)
+      if (v ~ /^".*"$/) v = substr(v, 2, length(v) - 2)
+      print v; exit
     }
-
-    // fully initializes the object.
-    p = destination;
-    h = file;
+  }' /etc/wsl.conf 2>/dev/null)sh";
+
+// Enumerates the whole passwd database in a launch of its own, when the probe didn't. The result
+// goes to [probes] and [users], and to the snapshot if [stamp] is known.
+void enumeratePasswd(WslApiBackend& api, const UserDbCache& cache,
+                     const std::optional<PasswdStamp>& stamp, DeferredMessages& messages,
+                     DefaultUserProbes& probes, std::optional<UserTable>& users) {
+  Trace::Span span{"enumeratePasswd", "init"};
+  WslProcess process{L"getent passwd"};
+  process.setInput({});
+  auto [error, exitCode, output] = process.run(api, INFINITE);
+  probes.users = {};
+  if (!error.empty() || exitCode != 0) {
+    messages.add(L"failed to read passwd database: getent exited with " +
+                 std::to_wstring(static_cast<int>(exitCode)));
+    return;
   }
-};
-
-// Reads [user].default from an existing wsl.conf file located at the ini path provided.
-std::string readIniDefaultUser(const fs::path& ini) {
-  // `getconf LOGIN_NAME_MAX` returns 256, but glibc restricts user login names to 32 chars long.
-  static constexpr auto utNameSize = 33;  // With room for the NULL terminator just in case.
-  char uname[utNameSize] = {'\0'};
-  auto len =
-      GetPrivateProfileStringA("user", "default", nullptr, uname, utNameSize, ini.string().c_str());
-
-  // GetPrivateProfileStringA set errno to ERROR_FILE_NOT_FOUND if the file
-  // or section or key are not found or if the file is ill-formed. We know the file exists.
-  // Absent user.default entry is a common case, we don't want to spam users for that.
-  // I don't see what other errors that could raise.
-  if (auto e = GetLastError(); len == 0 && e == ERROR_FILE_NOT_FOUND) {
-    return {};
+  probes.users.lookFor(probes.wslConfUser);
+  probes.users.feed(output);
+  probes.users.finish();
+  users.emplace(output);
+  if (stamp) {
+    cache.store(*stamp, *users);
   }
-
-  return uname;
 }
 
-std::string defaultUserInWslConf() try {
-  auto etcWslConf = wslConfPath();
-  if (!fs::exists(etcWslConf)) {
-    return {};
+void probeDefaultUser(WslApiBackend& api, const ImageFacts& image, CloudInitWait& wait,
+                      DeferredMessages& messages, DefaultUserProbes& probes,
+                      std::optional<UserTable>& users) {
+  // The passwd database doesn't need to be read at all if the snapshot of it is still valid.
+  const auto cache = UserDbCache::forDistro(DistributionInfo::Name);
+  auto snapshot = cache.load();
+  std::wstring passwd = L"u=$(" + std::wstring{wslConfUserQuery} +
+                        L"); if [ -n \"$u\" ]; then getent passwd \"$u\"; else getent passwd; fi";
+  if (snapshot) {
+    passwd = L"[ \"$(" + std::wstring{PasswdStampCommand} + L")\" = '" +
+             toWide(snapshot->stamp.str()) + L"' ] || { " + passwd + L"; }";
   }
-  // Copy /etc/wsl.conf to a temporary local path (guaranteed by the OS to be auto-deleted) from
-  // where GetPrivateProfileStringA can read it.
-  TempFileCopy copy(etcWslConf);
-  return readIniDefaultUser(copy.path());
-
-} catch (std::system_error const& err) {
-  // std::filesystem_error is child of std::system_error
-  std::wcout << L"ERROR: failed to read /etc/wsl.conf: " << err.code() << ": "
-             << str2wide(err.what());
-  return {};
-}
-
-std::wstring str2wide(std::string_view str, UINT codePage) {
-  if (str.empty() || str.size() >= INT_MAX) return {};
-
-  int inputSize = static_cast<int>(str.size());
-  int required = ::MultiByteToWideChar(codePage, 0, str.data(), inputSize, NULL, 0);
-  if (0 == required) return {};
-
-  std::wstring str2;
-  str2.resize(required);
-
-  int converted = ::MultiByteToWideChar(codePage, 0, str.data(), inputSize, &str2[0], required);
-  if (0 == converted) return {};
-
-  return str2;
-}
-
-// A non-interactive WSL process, turned into a class so we don't have to worry about closing
-// the process and pipe's handles.
-class WslProcess {
- private:
-  HANDLE process_ = nullptr;
-  HANDLE readPipe_ = nullptr;
-  HANDLE writePipe_ = nullptr;
-  std::wstring command_;
 
-  static constexpr auto MaxOutputSize = 4096;
-
- public:
-  ~WslProcess() {
-    if (process_) {
-      CloseHandle(process_);
-    }
-    if (writePipe_) {
-      CloseHandle(writePipe_);
-    }
-    if (readPipe_) {
-      CloseHandle(readPipe_);
-    }
+  // cloud-init may create users and write /etc/wsl.conf, so the other queries must run after it.
+  // There is no need to wait for it at all if it's not in the image or left the markers of being
+  // done.
+  std::vector<ProbeQuery> queries;
+  const std::wstring cloudInit = cloudInitWaitCommand();
+  const bool mayRunCloudInit = image.cloudInit.value_or(true);
+  if (mayRunCloudInit && !cloudInitDone(api)) {
+    queries.push_back({L"cloud-init", cloudInit});
+    wait.setPending(true);
   }
-
-  struct Result {
-    std::wstring error;
-    std::size_t exitCode = static_cast<std::size_t>(-1);
-    std::string stdOut;
-  };
-
-  // Runs the process via WSL api and wait for timeout milliseconds.
-  Result run(WslApiLoader& api, DWORD timeout);
-
-  explicit WslProcess(std::wstring command_) : command_{command_} {};
-};
-
-// Views a string as a collection of (most likely non-null terminated) substring slices split by the
-// provided delimiter, visited unidirectionally. The backing string is required to outlive this for
-// safe usage. Useful for lazy iteration.
-class SplitView {
- private:
-  std::string_view parent;
-  char delimiter;
-  std::string_view::const_iterator start;
-
- public:
-  SplitView(std::string_view str, char delimiter)
-      : parent(str), delimiter(delimiter), start(parent.begin()) {}
-
-  std::optional<std::string_view> next() {
-    if (start == parent.end()) {
-      return std::nullopt;
-    }
-
-    auto end = std::find(start, parent.end(), delimiter);
-    std::string_view token = parent.substr(start - parent.begin(), end - start);
-
-    if (end != parent.end()) {
-      start = end + 1;
-    } else {
-      start = end;
-    }
-
-    return token;
+  // Without cloud-init, nothing rewrote /etc/wsl.conf since it was read out of the image.
+  if (!mayRunCloudInit && image.wslConfUser) {
+    probes.wslConfUser = *image.wslConfUser;
+    probes.users.lookFor(probes.wslConfUser);
+  } else {
+    queries.push_back({L"wsl.conf", L"cat /etc/wsl.conf"});
   }
-
-  // This allows plugging the SplitView into std algorithms and range-for loops.
-  auto begin() { return iterator(this); }
-  auto end() { return iterator::sentinel(this); }
-
-  class iterator {
-   private:
-    SplitView* splitView;
-    std::optional<std::string_view> current;
-
-    iterator(SplitView* splitView, const std::optional<std::string_view>& current)
-        : splitView(splitView), current(current) {}
-
-   public:
-    // Creates a new iterator pointing to the next value of the SplitView, i.e. the
-    // begin-iterator.
-    iterator(SplitView* splitView) : splitView{splitView}, current{splitView->next()} {}
-    // Creates a new sentinel iterator for the provided SplitView, i.e. the end-iterator.
-    static iterator sentinel(SplitView* splitView) { return iterator{splitView, std::nullopt}; }
-
-    // boiler-plate to define a standard-compliant iterator interface.
-    using value_type = std::string_view;
-    using difference_type = std::ptrdiff_t;
-    using pointer = const std::string_view*;
-    using reference = const std::string_view&;
-    using iterator_category = std::input_iterator_tag;
-
-    reference operator*() const { return *current; }
-    pointer operator->() const { return &(*current); }
-
-    iterator& operator++() {
-      current = splitView->next();
-      return *this;
-    }
-
-    iterator operator++(int) {
-      iterator temp = *this;
-      ++(*this);
-      return temp;
+  queries.push_back({L"passwd-user", wslConfUserQuery});
+  queries.push_back({L"passwd-stamp", PasswdStampCommand});
+  // Streamed, for the default user to be selected while getent still enumerates the database.
+  queries.push_back({L"passwd", passwd, true});
+  const std::wstring command = probeCommand(queries);
+
+  // The user the passwd query looks up instead of enumerating the database, if any.
+  std::string lookedUp;
+  std::optional<PasswdStamp> stamp;
+  bool cacheHit = false;
+  // Only the whole database is worth a snapshot, thus it's kept only when enumerated.
+  std::optional<std::string> enumerated;
+  ProbeDemultiplexer demux{[&](ProbeSection&& section) {
+    Trace::Span span{section.name, "probe"};
+    span.arg("exitCode", std::to_string(section.exitCode));
+    if (section.name == "cloud-init") {
+      wait.setPending(false);
+      if (section.exitCode == CloudInitTimedOut) {
+        reportCloudInitTimedOut(messages);
+      }
+    } else if (section.name == "wsl.conf" && section.exitCode == 0) {
+      probes.wslConfUser = IniFile{section.data}.get("user", "default").value_or("");
+      probes.users.lookFor(probes.wslConfUser);
+    } else if (section.name == "passwd-user") {
+      // awk fails if there is no /etc/wsl.conf, printing nothing, as the passwd query expects.
+      lookedUp = std::move(section.data);
+      if (!lookedUp.empty() && lookedUp.back() == '\n') {
+        lookedUp.pop_back();
+      }
+    } else if (section.name == "passwd-stamp" && section.exitCode == 0) {
+      stamp = PasswdStamp::parse(section.data);
+      if (stamp && snapshot && snapshot->stamp == *stamp) {
+        span.arg("cache", std::string_view{"hit"});
+        probes.users.feed(snapshot->users);
+        users = std::move(snapshot->users);
+        cacheHit = true;
+      } else if (stamp && lookedUp.empty()) {
+        enumerated.emplace();
+      }
+    } else if (section.name == "passwd") {
+      probes.users.finish();
+      // getent exits with 2 when looking up a user that doesn't exist, which is not an error.
+      if (section.exitCode != 0 && lookedUp.empty()) {
+        messages.add(L"failed to read passwd database: getent exited with " +
+                     std::to_wstring(section.exitCode));
+        probes.users = {};
+      } else if (enumerated) {
+        users.emplace(std::move(*enumerated));
+        cache.store(*stamp, *users);
+      }
     }
-
-    friend bool operator==(const iterator& a, const iterator& b) {
-      return a.splitView == b.splitView && a.current == b.current;
-    }
-
-    friend bool operator!=(const iterator& a, const iterator& b) { return !(a == b); }
-  };
-};
-
-// Parses a string modelling a line of passwd into a UserEntry object.
-// We only care about login name, UID and the login shell, although the lines should have 7 fields:
-// ^NAME:ENCRYPTION:UID:...3 fields...:SHELL\n$
-// Returns std::nullopt on parse failure, the exact error for ill-formed lines is not needed.
-std::optional<UserEntry> userEntryFromString(std::string_view line);
-
-// Assuming UnaryOperation returns a std::optional, applies it to each element of the range
-// [first,last[ and stores the results that actually hold a value into the output range.
-// It's like std::transform, but skips the results of UnaryOperation that returns std::nullopt,
-// thus the output range size is going to be smaller than or equal to the input range size.
-template <typename InputIt, typename OutputIt, typename UnaryOperation>
-OutputIt transform_maybe(InputIt first, InputIt last, OutputIt d_first, UnaryOperation unary_op) {
-  while (first != last) {
-    auto&& in = *first;
-    std::optional maybe = unary_op(in);
-    if (maybe) {
-      *d_first++ = *maybe;
+  }};
+  // The candidates are selected as the passwd lines arrive.
+  demux.stream("passwd", [&](std::string_view chunk) {
+    probes.users.feed(chunk);
+    if (enumerated) {
+      *enumerated += chunk;
     }
-    ++first;
-  }
-  return d_first;
-}
-
-std::vector<UserEntry> getAllUsers(WslApiLoader& api) {
-  WslProcess getent{L"getent passwd"};
-  auto [error, exitCode, output] = getent.run(api, 10'000);
+  });
+
+  // Sections are parsed as soon as they arrive, while the probe still runs the next queries.
+  bool wellFormed = true;
+  // The probe is a POSIX shell script, while the default user may log in with any shell.
+  WslProcess probe{directExecCommand({L"/bin/sh", L"-c", command})};
+  probe.setInput({});
+  auto [error, exitCode, output] =
+      probe.run(api, INFINITE, [&](std::string_view chunk) { wellFormed = demux.feed(chunk); });
+  wait.setPending(false);
   if (!error.empty()) {
-    _putws(L"failed to read passwd database: ");
-    _putws(error.c_str());
-    if (exitCode != 0) {
-      wprintf(L"%lld", exitCode);
-    }
-    return {};
-  }
-
-  if (output.empty()) {
-    return {};
-  }
-
-  std::vector<UserEntry> users;
-  // Where the boilerplate pays-off: splits the getent output by lines
-  SplitView lines{output, '\n'};
-  // and store the parsed results in the users vector.
-  // NOTE about ill-formed lines in passwd: this algorithm just skips them.
-  // Broken lines in /etc/passwd won't prevent the effects of the good lines.
-  // getent itself reports errors for broken lines but still output the good ones.
-  // The system behaves as if they don't exist. So we can ignore them as well.
-  transform_maybe(lines.begin(), lines.end(), std::back_inserter(users), userEntryFromString);
-  // Finally sort that vector by UID.
-  std::sort(users.begin(), users.end(),
-            [](const UserEntry& a, const UserEntry& b) { return a.uid < b.uid; });
-  return users;
-}
-
-std::optional<UserEntry> userEntryFromString(std::string_view line) {
-  SplitView fields{line, ':'};
-  // Field 0: name
-  auto name = fields.next();
-  if (!name || name->empty()) {
-    return std::nullopt;
-  }
-  // Field 1: encryption flag, unused.
-  auto unused = fields.next();
-  if (!unused) {
-    return std::nullopt;
-  }
-  // Field 2: UID
-  auto u = fields.next();
-  if (!u) {
-    return std::nullopt;
-  }
-  ULONG uid = -1;
-  auto ud = std::from_chars(u->data(), u->data() + u->length(), uid);
-  if (ud.ec != std::errc{}) {
-    // cannot convert UID to an integer
-    return std::nullopt;
-  }
-  // Fields 3, 4 and 5: unused in this context, but still must be checked, otherwise the line is
-  // ill-formed.
-  for (int i = 0; i < 3; ++i) {
-    if (unused = fields.next(); !unused) {
-      return std::nullopt;
-    }
-  }
-  // Field 6: the login shell.
-  auto shell = fields.next();
-  if (!shell || shell->empty()) {
-    return std::nullopt;
-  }
-
-  // For this particular case it seems that an exclusion list is easier than a
-  // positive list of what shells are valid as there are more valid shell choices (sh, bash, csh,
-  // dash, ksh, tcsh, zsh, fish, ...).
-  bool hasLogin =
-      (shell->find("/sync") == std::string::npos && shell->find("/nologin") == std::string::npos &&
-       shell->find("/false") == std::string::npos);
-
-  return UserEntry{std::string{name->begin(), name->end()}, uid, hasLogin};
-}
-
-WslProcess::Result WslProcess::run(WslApiLoader& api, DWORD timeout) {
-  // Create a pipe to read the output of the launched process.
-  HANDLE read, write, process;
-  SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
-  ULONG uid = -1;
-  if (CreatePipe(&read, &write, &sa, 0) == FALSE) {
-    return {L"failed to create the stdio pipe"};
-  }
-  // We have to remember to close the pipe handles.
-  readPipe_ = read;
-  writePipe_ = write;
-
-  DWORD exitCode = -1;
-  auto hr = api.WslLaunch(command_.c_str(), FALSE, GetStdHandle(STD_INPUT_HANDLE), writePipe_,
-                          GetStdHandle(STD_ERROR_HANDLE), &process);
-  if (FAILED(hr)) {
-    return {L"failed to launch process"};
-  }
-  // Also need to remember to close the process handle.
-  process_ = process;
-
-  if (auto wait = WaitForSingleObject(process_, timeout); wait == WAIT_TIMEOUT) {
-    return {L"terminated due timed out"};
-  }
-
-  exitCode = -1;
-  if ((GetExitCodeProcess(process_, &exitCode) == false) || (exitCode != 0)) {
-    return {L"exited with error", exitCode};
+    messages.add(L"failed to probe the distribution: ");
+    messages.add(std::move(error));
+    return;
   }
 
-  // Check how many bytes we need to allocate to pump all contents out the pipe.
-  DWORD unreadBytes;
-  if (FALSE == PeekNamedPipe(readPipe_, 0, 0, 0, &unreadBytes, 0) || unreadBytes == 0) {
-    return {L"could not read the process output", 0};
-  }
-  std::size_t size = 1ULL + unreadBytes;
-  if (size > MaxOutputSize) {
-    return {L"process output is too big", 0};
+  if (!wellFormed || !demux.complete()) {
+    messages.add(L"ERROR: failed to parse the distribution probe output");
+    return;
   }
-  std::string contents(size, '\0');
 
-  // Finally we do the read.
-  DWORD readCount = 0, avail = 0;
-  if (FALSE == ReadFile(readPipe_, contents.data(), unreadBytes, &readCount, nullptr) ||
-      read == 0) {
-    return {L"could not read the process output", 0};
+  // The passwd section holds the wrong user if the awk script read /etc/wsl.conf differently from
+  // IniFile, and no user if the one named doesn't exist. The whole database tells either way.
+  if (!cacheHit && (lookedUp != probes.wslConfUser ||
+                    (!lookedUp.empty() && !probes.users.named().has_value()))) {
+    enumeratePasswd(api, cache, stamp, messages, probes, users);
   }
-
-  return {{}, 0, contents};
 }
 
 }  // namespace
@@ -1,8 +1,65 @@
 #pragma once
+#include "DefaultUserSelector.h"
+
 namespace Ubuntu
 {
 	// Returns true if system initialization tasks are complete.
 	// If [checkDefaultUser] is true, we consider creating the default user part of such tasks.
-	bool CheckInitTasks(WslApiLoader& api, bool checkDefaultUser);
+	// What [image] revealed before registration is trusted instead of being probed again.
+	bool CheckInitTasks(WslApiBackend& api, bool checkDefaultUser, const ImageFacts& image = {});
+
+	// The initialization tasks CheckInitTasks runs, started in the background as soon as the distro
+	// is registered: the probe boots the VM, waits for cloud-init and reads the passwd database
+	// while the launcher carries on, typically prompting for the user name. Progress, as well as
+	// what the tasks have to report, is only shown while the launcher waits for them. Their
+	// processes get an empty standard input rather than the console, not to take keystrokes meant
+	// for the prompt.
+	class BackgroundInitTasks {
+	public:
+		BackgroundInitTasks(WslApiBackend& api, bool checkDefaultUser, const ImageFacts& image = {});
+		// Waits for the tasks still running.
+		~BackgroundInitTasks();
+
+		BackgroundInitTasks(const BackgroundInitTasks&) = delete;
+		BackgroundInitTasks& operator=(const BackgroundInitTasks&) = delete;
+
+		// Waits for the tasks and then enforces the default user, if [checkDefaultUser]. Returns
+		// what CheckInitTasks returns.
+		bool finish();
+
+		// Waits for the probe and tells whether [userName] is in the passwd database it read. False
+		// if the database wasn't enumerated, e.g. because /etc/wsl.conf names the default user.
+		bool userExists(std::wstring_view userName);
+
+	private:
+		struct State;
+		std::unique_ptr<State> state_;
+	};
+
+	// Whether [image] tells for sure that the launcher will have to create the default user: no
+	// user can log in, none is set in /etc/wsl.conf and cloud-init either won't run or has no
+	// user data to create one from. The user name can then be asked while the tasks run.
+	bool defaultUserNeeded(const ImageFacts& image);
+
+	// What we need to learn from the distro in order to enforce a default user.
+	struct DefaultUserProbes {
+		// The candidates found in the NSS passwd database: either the user named in /etc/wsl.conf
+		// or, if none, the first non-system user.
+		DefaultUserSelector users;
+		// The defaultUser set in /etc/wsl.conf or the empty string if none is set.
+		std::string wslConfUser;
+		// The UID of the current default user according to the WSL API/registry.
+		ULONG registryUid = UID_INVALID;
+	};
+
+	// Reads the current default UID from the WSL API, without launching any Linux process.
+	ULONG registryDefaultUid(WslApiBackend& api);
+
+	// Enforces the existence of a default WSL user either:
+	// - defined in /etc/wsl.conf (which might not be in effect yet)
+	// - defined in WSL API/registry
+	// - or the lowest non-system account with UID >= 1000 in the NSS passwd database
+	// Returns false if a default user couldn't be set.
+	bool enforceDefaultUser(WslApiBackend& api, const DefaultUserProbes& probes);
 };
 
@@ -0,0 +1,52 @@
+#include <stdafx.h>
+#include "Message.h"
+
+namespace Ubuntu {
+namespace {
+void appendInsert(std::wstring& message, Insert format, const InsertValue& value) {
+  switch (format) {
+    case Insert::String:
+      message += value.string;
+      return;
+    case Insert::Decimal:
+      message += std::to_wstring(static_cast<std::int64_t>(value.number));
+      return;
+    case Insert::Unsigned:
+      message += std::to_wstring(value.number);
+      return;
+    case Insert::Hex: {
+      wchar_t digits[16];
+      std::size_t count = 0;
+      std::uint64_t number = value.number;
+      do {
+        digits[count++] = L"0123456789abcdef"[number & 0xf];
+        number >>= 4;
+      } while (number != 0);
+      while (count > 0) {
+        message += digits[--count];
+      }
+      return;
+    }
+  }
+}
+}  // namespace
+
+std::wstring formatMessage(std::wstring_view text, const Insert* inserts,
+                           const InsertValue* values) {
+  std::wstring message;
+  message.reserve(text.size());
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (text[i] != L'%' || i + 1 == text.size()) {
+      message += text[i];
+      continue;
+    }
+    const wchar_t next = text[++i];
+    if (next >= L'1' && next <= L'9') {
+      appendInsert(message, inserts[next - L'1'], values[next - L'1']);
+    } else {
+      message += next;
+    }
+  }
+  return message;
+}
+}  // namespace Ubuntu
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// The message catalog, messages.mc, is compiled by wsl-builder/compile-messages into messages.h,
+// declaring every message as a constant: its text, and the format of its inserts as its type.
+// Printing a message thus loads nothing from the resources of the launcher, works the same on POSIX
+// hosts, and passing arguments that don't match the inserts of a message fails to compile.
+namespace Ubuntu {
+// The format of a message insert, given by its !format! in messages.mc.
+enum class Insert { String, Decimal, Unsigned, Hex };
+
+// A message of the catalog, whose inserts are formatted as Inserts.
+template <Insert... Inserts>
+struct Message {
+  DWORD id;
+  // The text, line breaks included, where %1 to %9 stand for the inserts and %% for a percent sign.
+  std::wstring_view text;
+};
+
+// The argument of an insert, as the format of the insert takes it.
+struct InsertValue {
+  std::wstring_view string;
+  std::uint64_t number = 0;
+};
+
+// Converts [arg] for an insert formatted as Format, or fails to compile if they don't match.
+// Numbers keep the width of their type: an int -1 is printed as ffffffff, as with FormatMessage.
+template <Insert Format, class Arg>
+InsertValue insertValue(const Arg& arg) {
+  if constexpr (Format == Insert::String) {
+    static_assert(std::is_convertible_v<const Arg&, std::wstring_view>,
+                  "this message insert is a string");
+    if constexpr (std::is_pointer_v<Arg>) {
+      return {arg != nullptr ? arg : L""};
+    } else {
+      return {arg};
+    }
+  } else {
+    static_assert(std::is_integral_v<Arg> || std::is_enum_v<Arg>,
+                  "this message insert is a number");
+    if constexpr (Format == Insert::Decimal) {
+      return {{}, static_cast<std::uint64_t>(static_cast<std::int64_t>(arg))};
+    } else {
+      return {{}, static_cast<std::make_unsigned_t<Arg>>(arg)};
+    }
+  }
+}
+
+// Formats [text], replacing its inserts with [values], formatted as [inserts].
+std::wstring formatMessage(std::wstring_view text, const Insert* inserts,
+                           const InsertValue* values);
+
+// Formats [message] with an argument per insert.
+template <Insert... Inserts, class... Args>
+std::wstring formatMessage(const Message<Inserts...>& message, const Args&... args) {
+  static_assert(sizeof...(Args) == sizeof...(Inserts),
+                "the number of arguments doesn't match the inserts of the message");
+  // Ending with a placeholder, as arrays can't be empty.
+  constexpr Insert inserts[] = {Inserts..., Insert::String};
+  const InsertValue values[] = {insertValue<Inserts>(args)..., InsertValue{}};
+  return formatMessage(message.text, inserts, values);
+}
+}  // namespace Ubuntu
@@ -0,0 +1,218 @@
+#include <stdafx.h>
+#include "PasswdScanner.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <system_error>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define UBUNTU_SCANNER_X64
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(UBUNTU_SCANNER_X64) && defined(__GNUC__)
+#define UBUNTU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+// MSVC allows AVX2 intrinsics without enabling them for the whole translation unit.
+#define UBUNTU_TARGET_AVX2
+#endif
+
+namespace Ubuntu {
+
+namespace {
+constexpr char FieldDelimiter = ':';
+constexpr char LineDelimiter = '\n';
+
+// Each of these functions returns a mask with bit i set if byte i of the 64 bytes block is a
+// delimiter. The scalar one is the fallback for CPUs other than x64.
+std::uint64_t delimiterMaskScalar(const char* block) {
+  std::uint64_t mask = 0;
+  for (std::size_t i = 0; i < 64; ++i) {
+    if (block[i] == FieldDelimiter || block[i] == LineDelimiter) {
+      mask |= std::uint64_t{1} << i;
+    }
+  }
+  return mask;
+}
+
+#ifdef UBUNTU_SCANNER_X64
+std::uint64_t delimiterMaskSse2(const char* block) {
+  const __m128i field = _mm_set1_epi8(FieldDelimiter);
+  const __m128i line = _mm_set1_epi8(LineDelimiter);
+  std::uint64_t mask = 0;
+  for (int i = 0; i < 4; ++i) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+    __m128i found = _mm_or_si128(_mm_cmpeq_epi8(bytes, field), _mm_cmpeq_epi8(bytes, line));
+    mask |= std::uint64_t{static_cast<std::uint16_t>(_mm_movemask_epi8(found))} << (16 * i);
+  }
+  return mask;
+}
+
+UBUNTU_TARGET_AVX2 std::uint64_t delimiterMaskAvx2(const char* block) {
+  const __m256i field = _mm256_set1_epi8(FieldDelimiter);
+  const __m256i line = _mm256_set1_epi8(LineDelimiter);
+  std::uint64_t mask = 0;
+  for (int i = 0; i < 2; ++i) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+    __m256i found =
+        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, field), _mm256_cmpeq_epi8(bytes, line));
+    mask |= std::uint64_t{static_cast<std::uint32_t>(_mm256_movemask_epi8(found))} << (32 * i);
+  }
+  return mask;
+}
+
+bool cpuHasAvx2() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  // OSXSAVE and AVX, then the OS must be saving the YMM registers on context switches.
+  constexpr int osxsave = 1 << 27, avx = 1 << 28;
+  if ((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+unsigned lowestBit(std::uint64_t mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return index;
+#else
+  return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+}  // namespace
+
+bool PasswdScanner::supports(Isa isa) {
+  switch (isa) {
+    case Isa::Scalar:
+      return true;
+#ifdef UBUNTU_SCANNER_X64
+    case Isa::Sse2:
+      // SSE2 is part of the x64 baseline.
+      return true;
+    case Isa::Avx2: {
+      static const bool avx2 = cpuHasAvx2();
+      return avx2;
+    }
+#endif
+    default:
+      return false;
+  }
+}
+
+PasswdScanner::Isa PasswdScanner::bestIsa() {
+  if (supports(Isa::Avx2)) {
+    return Isa::Avx2;
+  }
+  return supports(Isa::Sse2) ? Isa::Sse2 : Isa::Scalar;
+}
+
+PasswdScanner::PasswdScanner(std::string_view passwd, Isa isa) :
+    text_{passwd}, delimiterMask_{delimiterMaskScalar} {
+#ifdef UBUNTU_SCANNER_X64
+  if (isa == Isa::Avx2) {
+    delimiterMask_ = delimiterMaskAvx2;
+  } else if (isa == Isa::Sse2) {
+    delimiterMask_ = delimiterMaskSse2;
+  }
+#endif
+  if (!text_.empty()) {
+    mask_ = blockMask(0);
+  }
+}
+
+std::uint64_t PasswdScanner::blockMask(std::size_t offset) const {
+  if (text_.size() - offset >= BlockSize) {
+    return delimiterMask_(text_.data() + offset);
+  }
+  // The last, partial, block is searched in a zero-padded copy of it.
+  char block[BlockSize] = {};
+  std::memcpy(block, text_.data() + offset, text_.size() - offset);
+  return delimiterMask_(block);
+}
+
+std::size_t PasswdScanner::nextDelimiter() {
+  while (mask_ == 0) {
+    if (block_ + BlockSize >= text_.size()) {
+      return text_.size();
+    }
+    block_ += BlockSize;
+    mask_ = blockMask(block_);
+  }
+  std::size_t delimiter = block_ + lowestBit(mask_);
+  // Clears the lowest bit set.
+  mask_ &= mask_ - 1;
+  return delimiter;
+}
+
+bool PasswdScanner::next(Line& line) {
+  if (pos_ >= text_.size()) {
+    return false;
+  }
+
+  line.count = 0;
+  while (true) {
+    const std::size_t end = nextDelimiter();
+    const bool endOfLine = end == text_.size() || text_[end] == LineDelimiter;
+    // A field starting right at the end of the line doesn't exist.
+    if (line.count < FieldCount && !(end == pos_ && endOfLine)) {
+      line.fields[line.count++] = text_.substr(pos_, end - pos_);
+    }
+    pos_ = std::min(end + 1, text_.size());
+    if (endOfLine) {
+      return true;
+    }
+  }
+}
+
+std::optional<PasswdEntry> parsePasswdEntry(const PasswdScanner::Line& line) {
+  // All 7 fields must be present, otherwise the line is ill-formed.
+  if (line.count < PasswdScanner::FieldCount) {
+    return std::nullopt;
+  }
+  PasswdEntry entry;
+  // Field 0: name
+  entry.name = line.fields[0];
+  if (entry.name.empty()) {
+    return std::nullopt;
+  }
+  // Field 1: encryption flag, unused.
+  // Field 2: UID
+  const auto u = line.fields[2];
+  if (auto ud = std::from_chars(u.data(), u.data() + u.length(), entry.uid); ud.ec != std::errc{}) {
+    // cannot convert UID to an integer
+    return std::nullopt;
+  }
+  // Fields 3, 4 and 5: unused in this context.
+  // Field 6: the login shell.
+  const auto shell = line.fields[6];
+  if (shell.empty()) {
+    return std::nullopt;
+  }
+
+  // For this particular case it seems that an exclusion list is easier than a
+  // positive list of what shells are valid as there are more valid shell choices (sh, bash, csh,
+  // dash, ksh, tcsh, zsh, fish, ...).
+  entry.hasLogin =
+      (shell.find("/sync") == std::string::npos && shell.find("/nologin") == std::string::npos &&
+       shell.find("/false") == std::string::npos);
+  return entry;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace Ubuntu {
+// Splits the contents of a passwd database into lines of colon-separated fields in a single pass.
+// Delimiters are searched 64 bytes at a time, with SSE2 or AVX2 instructions where available, and
+// the field boundaries are then read from the resulting bit masks.
+//
+// Splitting behaves exactly as nesting two SplitViews (lines split by '\n', each split by ':'),
+// which the passwd parser relied on before: a trailing new line doesn't make an extra empty line
+// and a field that would start at the end of a line is not reported.
+class PasswdScanner {
+ public:
+  static constexpr std::size_t FieldCount = 7;
+
+  struct Line {
+    // The first [count] fields of the line. Fields past the 7th are ignored.
+    std::array<std::string_view, FieldCount> fields;
+    std::size_t count = 0;
+  };
+
+  // The instructions delimiters are searched with.
+  enum class Isa { Scalar, Sse2, Avx2 };
+
+  // Whether the CPU running the launcher can search delimiters with [isa].
+  static bool supports(Isa isa);
+
+  // The fastest Isa the CPU supports.
+  static Isa bestIsa();
+
+  // The backing string is required to outlive the scanner and the lines it yields. [isa] must be
+  // supported, it is only chosen by tests and benchmarks comparing them.
+  explicit PasswdScanner(std::string_view passwd, Isa isa = bestIsa());
+
+  // Splits the next line into [line]. Returns false once all lines were visited.
+  bool next(Line& line);
+
+ private:
+  static constexpr std::size_t BlockSize = 64;
+
+  // Returns a mask with bit i set if byte i of the 64 bytes [block] is a delimiter.
+  using DelimiterMaskFn = std::uint64_t (*)(const char* block);
+
+  // The mask of the block at [offset], which may be partial if it's the last one.
+  std::uint64_t blockMask(std::size_t offset) const;
+
+  // Returns the offset of the next delimiter not yet visited, or the input size if there is none.
+  std::size_t nextDelimiter();
+
+  std::string_view text_;
+  DelimiterMaskFn delimiterMask_;
+  // Where the next field starts.
+  std::size_t pos_ = 0;
+  // Offset of the block currently being visited.
+  std::size_t block_ = 0;
+  // One bit per delimiter found in the current block not yet visited.
+  std::uint64_t mask_ = 0;
+};
+
+// The pieces of information from a single user entry in the passwd database we care about.
+struct PasswdEntry {
+  std::string_view name;
+  std::uint32_t uid = -1;
+  // Whether the login shell allows logging in.
+  bool hasLogin = false;
+};
+
+// Parses a line of passwd split into fields.
+// We only care about login name, UID and the login shell, although the lines should have 7 fields:
+// ^NAME:ENCRYPTION:UID:...3 fields...:SHELL\n$
+// Returns std::nullopt on parse failure, the exact error for ill-formed lines is not needed.
+std::optional<PasswdEntry> parsePasswdEntry(const PasswdScanner::Line& line);
+}  // namespace Ubuntu
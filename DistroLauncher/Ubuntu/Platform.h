@@ -0,0 +1,95 @@
+#pragma once
+// The launcher is a Windows application, but its core (init tasks, user database handling and the
+// process plumbing around the WSL API) is meant to also build on Linux hosts against the FakeWslApi
+// backend, so we can profile and regression-test install latency without a Windows box.
+// This header provides the small subset of Win32 types and macros that core relies on. It's a no-op
+// on Windows, where the real SDK headers are used instead.
+#ifndef _WIN32
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cwchar>
+
+#include <unistd.h>
+
+using BOOL = int;
+using UINT = unsigned int;
+using DWORD = std::uint32_t;
+using ULONG = std::uint32_t;
+using HRESULT = std::int32_t;
+using HANDLE = void*;
+using PSTR = char*;
+using PCWSTR = const wchar_t*;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define ANSI_NULL ((char)0)
+#define INFINITE 0xFFFFFFFF
+
+#define S_OK ((HRESULT)0L)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define HRESULT_FROM_WIN32(x) \
+  ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x)&0x0000FFFF) | (7 << 16) | 0x80000000)))
+
+#define CP_THREAD_ACP 3
+#define CP_UTF8 65001
+
+#define STD_INPUT_HANDLE ((DWORD)-10)
+#define STD_OUTPUT_HANDLE ((DWORD)-11)
+#define STD_ERROR_HANDLE ((DWORD)-12)
+
+// Mirrors the definitions in wslapi.h.
+typedef enum {
+  WSL_DISTRIBUTION_FLAGS_NONE = 0x0,
+  WSL_DISTRIBUTION_FLAGS_ENABLE_INTEROP = 0x1,
+  WSL_DISTRIBUTION_FLAGS_APPEND_NT_PATH = 0x2,
+  WSL_DISTRIBUTION_FLAGS_ENABLE_DRIVE_MOUNTING = 0x4
+} WSL_DISTRIBUTION_FLAGS;
+
+#define WSL_DISTRIBUTION_FLAGS_VALID                                                  \
+  (WSL_DISTRIBUTION_FLAGS)(WSL_DISTRIBUTION_FLAGS_ENABLE_INTEROP |                    \
+                           WSL_DISTRIBUTION_FLAGS_APPEND_NT_PATH |                    \
+                           WSL_DISTRIBUTION_FLAGS_ENABLE_DRIVE_MOUNTING)
+#define WSL_DISTRIBUTION_FLAGS_DEFAULT WSL_DISTRIBUTION_FLAGS_VALID
+
+namespace Ubuntu {
+// On POSIX hosts HANDLEs carry either a file descriptor or a process ID. They are offset by one so
+// that file descriptor 0 doesn't collide with the null handle.
+inline HANDLE handleFromFd(int fd) {
+  return reinterpret_cast<HANDLE>(static_cast<std::intptr_t>(fd) + 1);
+}
+inline int fdFromHandle(HANDLE h) {
+  return static_cast<int>(reinterpret_cast<std::intptr_t>(h) - 1);
+}
+}  // namespace Ubuntu
+
+inline HANDLE GetStdHandle(DWORD which) {
+  switch (which) {
+    case STD_INPUT_HANDLE:
+      return Ubuntu::handleFromFd(STDIN_FILENO);
+    case STD_OUTPUT_HANDLE:
+      return Ubuntu::handleFromFd(STDOUT_FILENO);
+    default:
+      return Ubuntu::handleFromFd(STDERR_FILENO);
+  }
+}
+
+// Writes the string followed by a new line, as the MSVC CRT does.
+inline int _putws(const wchar_t* str) {
+  if (std::fputws(str, stdout) < 0) {
+    return -1;
+  }
+  return std::fputwc(L'\n', stdout) == WEOF ? -1 : 0;
+}
+
+#endif  // !_WIN32
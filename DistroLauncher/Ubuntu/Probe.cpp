@@ -0,0 +1,219 @@
+#include <stdafx.h>
+#include "Probe.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace Ubuntu {
+
+namespace {
+// Runs a command line and writes its output as a section. The output is captured together with a
+// trailing marker, so trailing new lines survive the command substitution, and the marker carries
+// the exit code. The command runs in a subshell of its own, so that the marker is written even if
+// it exits. LC_ALL=C makes ${#o} count bytes instead of characters.
+constexpr std::wstring_view sectionFunction =
+    L"LC_ALL=C; export LC_ALL; "
+    L"s() { o=$( (eval \"$2\") 2>/dev/null; echo \"x$?\"); r=${o##*x}; o=${o%x*}; "
+    L"printf '%s %s %s\\n' \"$1\" \"$r\" \"${#o}\"; printf '%s' \"$o\"; }; ";
+
+// Runs a command line and writes its output as a streamed section, as sed frames the lines. The
+// line break written after the output makes even an output without a trailing one end in a full
+// line, and leaves the exit code alone on the last line, which sed doesn't prefix.
+constexpr std::wstring_view streamedSectionFunction =
+    L"t() { printf '%s -\\n' \"$1\"; "
+    L"{ (eval \"$2\") 2>/dev/null; printf '\\nx%s\\n' \"$?\"; } | sed '$!s/^/ /'; }; ";
+}  // namespace
+
+std::wstring shellQuote(std::wstring_view str) {
+  std::wstring quoted{L"'"};
+  for (auto c : str) {
+    if (c == L'\'') {
+      quoted += L"'\\''";
+    } else if (c == L'\\') {
+      quoted += L"'\\\\'";
+    } else {
+      quoted += c;
+    }
+  }
+  quoted += L'\'';
+  return quoted;
+}
+
+std::wstring probeCommand(const std::vector<ProbeQuery>& queries) {
+  std::wstring command{sectionFunction};
+  if (std::any_of(queries.begin(), queries.end(), [](const auto& q) { return q.streamed; })) {
+    command += streamedSectionFunction;
+  }
+  for (const auto& query : queries) {
+    command += query.streamed ? L"t " : L"s ";
+    command += query.name;
+    command += L' ';
+    command += shellQuote(query.command);
+    command += L"; ";
+  }
+  return command;
+}
+
+void ProbeDemultiplexer::stream(std::string name, ChunkHandler onChunk) {
+  streams_.emplace_back(std::move(name), std::move(onChunk));
+}
+
+bool ProbeDemultiplexer::feed(std::string_view chunk) {
+  while (!chunk.empty()) {
+    switch (state_) {
+      case State::Malformed:
+        return false;
+
+      case State::Header: {
+        auto eol = chunk.find('\n');
+        header_ += chunk.substr(0, eol);
+        if (eol == std::string_view::npos) {
+          return true;
+        }
+        chunk.remove_prefix(eol + 1);
+        if (!parseHeader()) {
+          state_ = State::Malformed;
+          return false;
+        }
+        break;
+      }
+
+      case State::Body: {
+        auto n = std::min(remaining_, chunk.size());
+        append(chunk.substr(0, n));
+        chunk.remove_prefix(n);
+        remaining_ -= n;
+        break;
+      }
+
+      case State::LineStart:
+        if (chunk.front() == ' ') {
+          if (lineRead_) {
+            append("\n");
+          }
+          lineRead_ = true;
+          state_ = State::Line;
+        } else if (chunk.front() == 'x') {
+          state_ = State::Trailer;
+        } else {
+          state_ = State::Malformed;
+          return false;
+        }
+        chunk.remove_prefix(1);
+        break;
+
+      case State::Line: {
+        // The line is handed over as far as it arrived, its end may take a while.
+        auto eol = chunk.find('\n');
+        append(chunk.substr(0, eol));
+        if (eol == std::string_view::npos) {
+          return true;
+        }
+        chunk.remove_prefix(eol + 1);
+        state_ = State::LineStart;
+        break;
+      }
+
+      case State::Trailer: {
+        auto eol = chunk.find('\n');
+        header_ += chunk.substr(0, eol);
+        if (eol == std::string_view::npos) {
+          return true;
+        }
+        chunk.remove_prefix(eol + 1);
+        if (!parseTrailer()) {
+          state_ = State::Malformed;
+          return false;
+        }
+        finishSection();
+        break;
+      }
+    }
+
+    if (state_ == State::Body && remaining_ == 0) {
+      finishSection();
+    }
+  }
+
+  return state_ != State::Malformed;
+}
+
+void ProbeDemultiplexer::append(std::string_view data) {
+  if (currentStream_) {
+    (*currentStream_)(data);
+  } else {
+    current_.data += data;
+  }
+}
+
+void ProbeDemultiplexer::finishSection() {
+  state_ = State::Header;
+  onSection_(std::move(current_));
+  current_ = {};
+  currentStream_ = nullptr;
+}
+
+bool ProbeDemultiplexer::parseHeader() {
+  // <name> <exit code> <length>, or <name> - if streamed.
+  std::string_view header{header_};
+  auto nameEnd = header.find(' ');
+  if (nameEnd == 0 || nameEnd == std::string_view::npos) {
+    return false;
+  }
+  auto codeEnd = header.find(' ', nameEnd + 1);
+  const bool streamed = header.substr(nameEnd + 1) == "-";
+  if (!streamed && codeEnd == std::string_view::npos) {
+    return false;
+  }
+  if (streamed) {
+    current_.name = header.substr(0, nameEnd);
+    selectStream();
+    lineRead_ = false;
+    header_.clear();
+    state_ = State::LineStart;
+    return true;
+  }
+
+  const char* codeFirst = header.data() + nameEnd + 1;
+  const char* codeLast = header.data() + codeEnd;
+  const char* lengthFirst = codeLast + 1;
+  const char* lengthLast = header.data() + header.size();
+  int exitCode = -1;
+  std::size_t length = 0;
+  if (auto [ptr, ec] = std::from_chars(codeFirst, codeLast, exitCode);
+      ec != std::errc{} || ptr != codeLast) {
+    return false;
+  }
+  if (auto [ptr, ec] = std::from_chars(lengthFirst, lengthLast, length);
+      ec != std::errc{} || ptr != lengthLast) {
+    return false;
+  }
+
+  current_.name = header.substr(0, nameEnd);
+  current_.exitCode = exitCode;
+  if (!selectStream()) {
+    current_.data.reserve(length);
+  }
+  remaining_ = length;
+  header_.clear();
+  state_ = State::Body;
+  return true;
+}
+
+bool ProbeDemultiplexer::parseTrailer() {
+  // x<exit code>, the x being consumed already.
+  const char* first = header_.data();
+  const char* last = first + header_.size();
+  auto [ptr, ec] = std::from_chars(first, last, current_.exitCode);
+  header_.clear();
+  return ec == std::errc{} && ptr == last;
+}
+
+bool ProbeDemultiplexer::selectStream() {
+  auto stream = std::find_if(streams_.begin(), streams_.end(),
+                             [this](const auto& s) { return s.first == current_.name; });
+  currentStream_ = stream != streams_.end() ? &stream->second : nullptr;
+  return currentStream_ != nullptr;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,92 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Ubuntu {
+// Batches several read-only queries into a single Linux process, so the launcher pays the cost of
+// creating a process inside the VM (and the pipe setup around it) only once.
+//
+// The probe command runs each query in order and frames its standard output as a section:
+//
+//   <name> <exit code> <length>\n<length bytes of output>
+//
+// The output of each query is captured in full before its section is written, so sections are
+// never interleaved. Streamed queries instead write their output as it comes, a line at a time,
+// since its length isn't known up front, with the exit code last:
+//
+//   <name> -\n
+//    <line>\n      (each line of the output followed by an extra line break, prefixed with a blank)
+//   x<exit code>\n
+struct ProbeQuery {
+  // Section name, must not contain blanks.
+  std::wstring_view name;
+  // Shell command line to run. Its standard error is discarded.
+  std::wstring_view command;
+  // Whether the output is written as it comes, for the launcher to consume it while the query runs,
+  // rather than once the query exits. The query then runs along with sed, to frame the lines.
+  bool streamed = false;
+};
+
+// Single-quotes [str] for the shell, so it's passed as a single word whatever it holds. Quotes and
+// backslashes are escaped outside of the quotes, where fish, the login shell of some users, reads
+// them as POSIX shells do, unlike within.
+std::wstring shellQuote(std::wstring_view str);
+
+// Builds the shell command line running all [queries] in order.
+std::wstring probeCommand(const std::vector<ProbeQuery>& queries);
+
+// The output of a single query of the probe.
+struct ProbeSection {
+  std::string name;
+  int exitCode = -1;
+  std::string data;
+};
+
+// Splits the probe output stream back into sections, as the bytes arrive. Feeding it with
+// arbitrarily sized chunks is supported, so consumers can start working on the first sections while
+// the probe is still running.
+class ProbeDemultiplexer {
+ public:
+  using SectionHandler = std::function<void(ProbeSection&&)>;
+  using ChunkHandler = std::function<void(std::string_view chunk)>;
+
+  explicit ProbeDemultiplexer(SectionHandler onSection) : onSection_{std::move(onSection)} {}
+
+  // Consumes the next chunk of the probe output, calling the handler once for each section
+  // completed by it. Returns false if the stream is malformed, in which case any further input is
+  // ignored.
+  bool feed(std::string_view chunk);
+
+  // Hands the data of the sections named [name] to [onChunk] as it arrives instead of buffering it.
+  // The section handler is still called once each of those sections completes, with empty data.
+  void stream(std::string name, ChunkHandler onChunk);
+
+  // True if all the input consumed so far formed complete sections.
+  bool complete() const { return state_ == State::Header && header_.empty(); }
+
+ private:
+  enum class State { Header, Body, LineStart, Line, Trailer, Malformed };
+
+  bool parseHeader();
+  bool parseTrailer();
+  // Points currentStream_ to the handler of the current section, if streamed. Returns whether it is.
+  bool selectStream();
+  void append(std::string_view data);
+  void finishSection();
+
+  SectionHandler onSection_;
+  State state_ = State::Header;
+  std::string header_;
+  ProbeSection current_;
+  // Where the data of the current section goes, if streamed.
+  const ChunkHandler* currentStream_ = nullptr;
+  std::vector<std::pair<std::string, ChunkHandler>> streams_;
+  std::size_t remaining_ = 0;
+  // Whether a line of the current streamed section was read, whose line break is only part of the
+  // output if another line follows.
+  bool lineRead_ = false;
+};
+}  // namespace Ubuntu
@@ -0,0 +1,891 @@
+#include <stdafx.h>
+#include "ProcessPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#endif
+
+namespace Ubuntu {
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// The size of the reads of the standard error and of the writes of the input.
+constexpr std::size_t PipeChunkSize = 64 * 1024;
+
+// Accumulates the process output in fixed size chunks, so growing never moves what was already
+// read. When the output is streamed to a handler instead, a single chunk is reused for all reads.
+class OutputBuffer {
+ public:
+  OutputBuffer(std::size_t maxSize, const WslProcessPool::OutputHandler& onOutput) :
+      maxSize_{maxSize}, onOutput_{onOutput} {}
+
+  // Where the next read should store its bytes.
+  std::pair<char*, std::size_t> writable() {
+    if (chunks_.empty() || used_ == ChunkSize) {
+      chunks_.push_back(std::make_unique<char[]>(ChunkSize));
+      used_ = 0;
+    }
+    return {chunks_.back().get() + used_, ChunkSize - used_};
+  }
+
+  // Accounts for [count] bytes stored by the last read into writable().
+  // Returns false if the output exceeded the maximum size.
+  bool commit(std::size_t count) {
+    size_ += count;
+    if (size_ > maxSize_) {
+      return false;
+    }
+    if (onOutput_) {
+      onOutput_(std::string_view{chunks_.back().get() + used_, count});
+      return true;
+    }
+    used_ += count;
+    return true;
+  }
+
+  std::size_t size() const { return size_; }
+
+  // Joins all the chunks, unless the output was streamed.
+  std::string str() const {
+    std::string contents;
+    if (onOutput_) {
+      return contents;
+    }
+    contents.reserve(size_);
+    for (std::size_t i = 0; i < chunks_.size(); ++i) {
+      contents.append(chunks_[i].get(), i + 1 == chunks_.size() ? used_ : ChunkSize);
+    }
+    return contents;
+  }
+
+ private:
+  static constexpr std::size_t ChunkSize = 64 * 1024;
+
+  std::size_t maxSize_;
+  const WslProcessPool::OutputHandler& onOutput_;
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  // Bytes used in the last chunk.
+  std::size_t used_ = 0;
+  std::size_t size_ = 0;
+};
+}  // namespace
+
+// A process in flight, as the loop sees it.
+struct WslProcessPool::Child {
+  Child(std::uint64_t id, Request request, Completion onDone) :
+      id{id}, request{std::move(request)}, onDone{std::move(onDone)} {}
+
+  Child(const Child&) = delete;
+  Child& operator=(const Child&) = delete;
+  ~Child();
+
+  std::uint64_t id;
+  Request request;
+  Completion onDone;
+  std::promise<Result> promise;
+  OutputBuffer output{request.maxOutputSize, request.onOutput};
+  std::unique_ptr<char[]> errorBuffer;
+  // What is left to write to the standard input.
+  std::string_view input;
+  std::optional<Clock::time_point> deadline;
+  // Whether the result was delivered. What is left to do then is tearing the process down.
+  bool done = false;
+  bool exited = false;
+  bool terminated = false;
+
+#ifdef _WIN32
+  // Each pipe, and the exit of the process, completes through the port as an Io.
+  struct Io {
+    enum class Kind { Output, Error, Input, Exit };
+
+    OVERLAPPED overlapped{};
+    Child* child = nullptr;
+    Kind kind = Kind::Output;
+    // Our end of the pipe.
+    HANDLE handle = nullptr;
+    // Whether an operation was started and its completion not dequeued yet.
+    bool pending = false;
+
+    void close() {
+      if (handle != nullptr) {
+        CloseHandle(handle);
+        handle = nullptr;
+      }
+    }
+  };
+
+  HANDLE port = nullptr;
+  HANDLE process = nullptr;
+  HANDLE wait = nullptr;
+  // Set by the wait callback before it posts the exit completion.
+  std::atomic<bool> exitPosted{false};
+  // Whether the exit completion may still be dequeued.
+  bool exitPending = false;
+  Io out;
+  Io err;
+  Io in;
+  Io exit;
+#else
+  pid_t pid = -1;
+  // Notifies the exit of the process, if the kernel supports it. Otherwise it's polled.
+  int pidfd = -1;
+  DWORD exitCode = static_cast<DWORD>(-1);
+  int out = -1;
+  int err = -1;
+  int in = -1;
+#endif
+
+  // Hands the result over, unless it was already.
+  void deliver(std::wstring error, DWORD exitCode = static_cast<DWORD>(-1)) {
+    if (done) {
+      return;
+    }
+    done = true;
+    Result result;
+    result.error = std::move(error);
+    result.exitCode = exitCode;
+    result.outputSize = output.size();
+    if (result.error.empty()) {
+      result.stdOut = output.str();
+    }
+    if (onDone) {
+      try {
+        onDone(result);
+      } catch (...) {
+        // The future still becomes ready.
+      }
+    }
+    promise.set_value(std::move(result));
+  }
+};
+
+// The wait loop, along with what launching needs to hand processes over to it.
+class WslProcessPool::Loop {
+ public:
+  Loop();
+  ~Loop();
+
+  Loop(const Loop&) = delete;
+  Loop& operator=(const Loop&) = delete;
+
+  bool ready() const { return ready_; }
+
+  // Launches the process of [child] and creates its pipes. Returns why it failed, if it did.
+  std::wstring spawn(WslApiBackend& api, Child& child);
+
+  // Hands a launched process over to the loop.
+  void add(std::unique_ptr<Child> child) {
+    {
+      std::lock_guard lock{mutex_};
+      incoming_.push_back(std::move(child));
+    }
+    wake();
+  }
+
+  void cancel(std::uint64_t id) {
+    {
+      std::lock_guard lock{mutex_};
+      cancelled_.push_back(id);
+    }
+    wake();
+  }
+
+ private:
+  void run();
+  void wake();
+  // Takes over the processes handed over and the cancellations.
+  bool takeRequests();
+  // Starts the first operations on the pipes of a new process.
+  void adopt(Child& child);
+  // Waits for the next events, at most [timeout] milliseconds, and handles them.
+  void dispatch(DWORD timeout);
+  // Delivers the result once everything is known, and tears the process down once delivered.
+  void settle(Child& child);
+  void fail(Child& child, std::wstring error) {
+    child.deliver(std::move(error));
+    settle(child);
+  }
+  // Whether [child] can be destroyed, nothing referring to it being in flight anymore.
+  bool finished(const Child& child) const;
+  // Milliseconds until the nearest deadline, after failing the processes past theirs.
+  DWORD expire();
+
+  bool ready_ = false;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Child>> incoming_;
+  std::vector<std::uint64_t> cancelled_;
+  bool stopping_ = false;
+  // Only touched by the loop thread.
+  std::unordered_map<std::uint64_t, std::unique_ptr<Child>> children_;
+#ifdef _WIN32
+  HANDLE port_ = nullptr;
+  static void CALLBACK onProcessExit(PVOID context, BOOLEAN);
+  void read(Child::Io& io);
+  void write(Child::Io& io);
+  void completed(Child::Io& io);
+#else
+  int wake_[2] = {-1, -1};
+  void reap(Child& child);
+#endif
+  std::thread thread_;
+};
+
+void WslProcessPool::Loop::run() {
+  while (true) {
+    const bool stopping = takeRequests();
+    if (stopping) {
+      for (auto& [id, child] : children_) {
+        fail(*child, L"cancelled");
+      }
+      if (children_.empty()) {
+        return;
+      }
+    }
+    dispatch(expire());
+    for (auto child = children_.begin(); child != children_.end();) {
+      child = finished(*child->second) ? children_.erase(child) : std::next(child);
+    }
+  }
+}
+
+bool WslProcessPool::Loop::takeRequests() {
+  std::vector<std::unique_ptr<Child>> incoming;
+  std::vector<std::uint64_t> cancelled;
+  bool stopping;
+  {
+    std::lock_guard lock{mutex_};
+    incoming.swap(incoming_);
+    cancelled.swap(cancelled_);
+    stopping = stopping_;
+  }
+  for (auto& child : incoming) {
+    auto& adopted = *children_.emplace(child->id, std::move(child)).first->second;
+    adopt(adopted);
+  }
+  for (const auto id : cancelled) {
+    if (auto child = children_.find(id); child != children_.end()) {
+      fail(*child->second, L"cancelled");
+    }
+  }
+  return stopping;
+}
+
+DWORD WslProcessPool::Loop::expire() {
+  const auto now = Clock::now();
+  std::optional<Clock::time_point> nearest;
+  for (auto& [id, child] : children_) {
+    if (child->done || !child->deadline) {
+      continue;
+    }
+    if (*child->deadline <= now) {
+      fail(*child, L"terminated due timed out");
+    } else if (!nearest || *child->deadline < *nearest) {
+      nearest = child->deadline;
+    }
+  }
+  if (!nearest) {
+    return INFINITE;
+  }
+  // Rounded up, not to wake up just before the deadline.
+  const auto left = std::chrono::ceil<std::chrono::milliseconds>(*nearest - now);
+  return static_cast<DWORD>(std::min<std::chrono::milliseconds::rep>(left.count(), INFINITE - 1));
+}
+
+#ifdef _WIN32
+namespace {
+// Anonymous pipes don't support overlapped I/O, which the completion port requires. Thus we create
+// a uniquely named pipe instead: our end is overlapped and the end of the process is inheritable,
+// just like CreatePipe would hand out. [inbound] pipes carry data from the process.
+bool createOverlappedPipe(HANDLE& ours, HANDLE& theirs, bool inbound) {
+  static std::atomic<unsigned> serial{0};
+  wchar_t name[64];
+  swprintf_s(name, L"\\\\.\\pipe\\UbuntuLauncher.%08lx.%08x", GetCurrentProcessId(), serial++);
+
+  const DWORD access = inbound ? PIPE_ACCESS_INBOUND : PIPE_ACCESS_OUTBOUND;
+  ours = CreateNamedPipeW(name, access | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                          PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 0, 0, 0,
+                          nullptr);
+  if (ours == INVALID_HANDLE_VALUE) {
+    ours = nullptr;
+    return false;
+  }
+
+  SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
+  theirs = CreateFileW(name, inbound ? GENERIC_WRITE : GENERIC_READ, 0, &sa, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (theirs == INVALID_HANDLE_VALUE) {
+    CloseHandle(ours);
+    ours = nullptr;
+    theirs = nullptr;
+    return false;
+  }
+  return true;
+}
+}  // namespace
+
+WslProcessPool::Child::~Child() {
+  for (Io* io : {&out, &err, &in}) {
+    io->close();
+  }
+  if (process != nullptr) {
+    CloseHandle(process);
+  }
+}
+
+WslProcessPool::Loop::Loop() : port_{CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1)} {
+  if (port_ != nullptr) {
+    ready_ = true;
+    thread_ = std::thread{[this] { run(); }};
+  }
+}
+
+WslProcessPool::Loop::~Loop() {
+  if (!ready_) {
+    return;
+  }
+  {
+    std::lock_guard lock{mutex_};
+    stopping_ = true;
+  }
+  wake();
+  thread_.join();
+  CloseHandle(port_);
+}
+
+// Runs on a thread pool thread once the process exits, and turns that into a completion.
+void CALLBACK WslProcessPool::Loop::onProcessExit(PVOID context, BOOLEAN) {
+  auto& child = *static_cast<Child*>(context);
+  child.exitPosted = true;
+  PostQueuedCompletionStatus(child.port, 0, 0, &child.exit.overlapped);
+}
+
+void WslProcessPool::Loop::wake() {
+  // Completions carrying no OVERLAPPED only wake the loop up.
+  PostQueuedCompletionStatus(port_, 0, 0, nullptr);
+}
+
+std::wstring WslProcessPool::Loop::spawn(WslApiBackend& api, Child& child) {
+  for (auto [io, kind] : {std::pair{&child.out, Child::Io::Kind::Output},
+                          std::pair{&child.err, Child::Io::Kind::Error},
+                          std::pair{&child.in, Child::Io::Kind::Input},
+                          std::pair{&child.exit, Child::Io::Kind::Exit}}) {
+    io->child = &child;
+    io->kind = kind;
+  }
+  child.port = port_;
+
+  // The ends of the process are closed once it's launched, as it holds copies of its own then.
+  std::vector<HANDLE> theirs;
+  const auto closeTheirs = [&] {
+    for (auto handle : theirs) {
+      CloseHandle(handle);
+    }
+  };
+  HANDLE out = nullptr;
+  if (!createOverlappedPipe(child.out.handle, out, true)) {
+    return L"failed to create the stdio pipe";
+  }
+  theirs.push_back(out);
+  HANDLE err = GetStdHandle(STD_ERROR_HANDLE);
+  if (child.request.onError) {
+    if (!createOverlappedPipe(child.err.handle, err, true)) {
+      closeTheirs();
+      return L"failed to create the stdio pipe";
+    }
+    theirs.push_back(err);
+    child.errorBuffer = std::make_unique<char[]>(PipeChunkSize);
+  }
+  HANDLE in = GetStdHandle(STD_INPUT_HANDLE);
+  if (child.request.input) {
+    if (!createOverlappedPipe(child.in.handle, in, false)) {
+      closeTheirs();
+      return L"failed to create the stdio pipe";
+    }
+    theirs.push_back(in);
+    child.input = *child.request.input;
+  }
+
+  const auto hr =
+      api.WslLaunch(child.request.command.c_str(), FALSE, in, out, err, &child.process);
+  closeTheirs();
+  if (FAILED(hr)) {
+    child.process = nullptr;
+    return L"failed to launch process";
+  }
+  return {};
+}
+
+void WslProcessPool::Loop::adopt(Child& child) {
+  for (Child::Io* io : {&child.out, &child.err, &child.in}) {
+    if (io->handle != nullptr && CreateIoCompletionPort(io->handle, port_, 0, 0) == nullptr) {
+      fail(child, L"could not read the process output");
+      return;
+    }
+  }
+  if (FALSE == RegisterWaitForSingleObject(&child.wait, child.process, onProcessExit, &child,
+                                           INFINITE, WT_EXECUTEONLYONCE)) {
+    child.wait = nullptr;
+    fail(child, L"could not wait for the process");
+    return;
+  }
+  child.exitPending = true;
+
+  read(child.out);
+  if (child.err.handle != nullptr) {
+    read(child.err);
+  }
+  if (child.in.handle != nullptr) {
+    write(child.in);
+  }
+  settle(child);
+}
+
+void WslProcessPool::Loop::read(Child::Io& io) {
+  auto& child = *io.child;
+  char* buffer = child.errorBuffer.get();
+  std::size_t capacity = PipeChunkSize;
+  if (io.kind == Child::Io::Kind::Output) {
+    std::tie(buffer, capacity) = child.output.writable();
+  }
+  io.overlapped = {};
+  // Even reads completing at once are dequeued from the port.
+  if (FALSE == ReadFile(io.handle, buffer, static_cast<DWORD>(capacity), nullptr, &io.overlapped) &&
+      GetLastError() != ERROR_IO_PENDING) {
+    const bool ended = GetLastError() == ERROR_BROKEN_PIPE;
+    io.close();
+    if (!ended && io.kind == Child::Io::Kind::Output) {
+      fail(child, L"could not read the process output");
+    }
+    return;
+  }
+  io.pending = true;
+}
+
+void WslProcessPool::Loop::write(Child::Io& io) {
+  auto& child = *io.child;
+  // Closing the pipe once everything was written lets the process read the end of its input.
+  if (child.input.empty()) {
+    io.close();
+    return;
+  }
+  io.overlapped = {};
+  const auto size = static_cast<DWORD>(std::min(child.input.size(), PipeChunkSize));
+  if (FALSE == WriteFile(io.handle, child.input.data(), size, nullptr, &io.overlapped) &&
+      GetLastError() != ERROR_IO_PENDING) {
+    // The process stopped reading.
+    io.close();
+    return;
+  }
+  io.pending = true;
+}
+
+void WslProcessPool::Loop::dispatch(DWORD timeout) {
+  OVERLAPPED_ENTRY entries[16];
+  ULONG count = 0;
+  if (FALSE == GetQueuedCompletionStatusEx(port_, entries, static_cast<ULONG>(std::size(entries)),
+                                           &count, timeout, FALSE)) {
+    return;
+  }
+  for (ULONG i = 0; i < count; ++i) {
+    if (entries[i].lpOverlapped != nullptr) {
+      completed(*CONTAINING_RECORD(entries[i].lpOverlapped, Child::Io, overlapped));
+    }
+  }
+}
+
+void WslProcessPool::Loop::completed(Child::Io& io) {
+  auto& child = *io.child;
+  io.pending = false;
+  if (io.kind == Child::Io::Kind::Exit) {
+    child.exited = true;
+    child.exitPending = false;
+    if (child.wait != nullptr) {
+      UnregisterWaitEx(child.wait, INVALID_HANDLE_VALUE);
+      child.wait = nullptr;
+    }
+    settle(child);
+    return;
+  }
+
+  DWORD transferred = 0;
+  const bool succeeded = GetOverlappedResult(io.handle, &io.overlapped, &transferred, FALSE);
+  const DWORD error = succeeded ? ERROR_SUCCESS : GetLastError();
+  if (child.done) {
+    settle(child);
+    return;
+  }
+  try {
+    switch (io.kind) {
+      case Child::Io::Kind::Output:
+        if (!succeeded) {
+          io.close();
+          if (error != ERROR_BROKEN_PIPE) {
+            fail(child, L"could not read the process output");
+          }
+        } else if (!child.output.commit(transferred)) {
+          fail(child, L"process output is too big");
+        } else {
+          read(io);
+        }
+        break;
+      case Child::Io::Kind::Error:
+        if (!succeeded) {
+          io.close();
+        } else {
+          child.request.onError(std::string_view{child.errorBuffer.get(), transferred});
+          read(io);
+        }
+        break;
+      case Child::Io::Kind::Input:
+        if (!succeeded) {
+          io.close();
+        } else {
+          child.input.remove_prefix(transferred);
+          write(io);
+        }
+        break;
+      case Child::Io::Kind::Exit:
+        break;
+    }
+  } catch (...) {
+    fail(child, L"could not handle the process output");
+  }
+  settle(child);
+}
+
+void WslProcessPool::Loop::settle(Child& child) {
+  if (!child.done) {
+    if (child.out.handle != nullptr || child.err.handle != nullptr || !child.exited) {
+      return;
+    }
+    DWORD exitCode = static_cast<DWORD>(-1);
+    GetExitCodeProcess(child.process, &exitCode);
+    child.deliver({}, exitCode);
+  }
+
+  // Tearing down: whatever is in flight is cancelled, and completes with an error.
+  if (!child.exited && !child.terminated) {
+    TerminateProcess(child.process, 1);
+    child.terminated = true;
+  }
+  for (Child::Io* io : {&child.out, &child.err, &child.in}) {
+    if (io->pending) {
+      CancelIoEx(io->handle, &io->overlapped);
+    } else {
+      io->close();
+    }
+  }
+  if (child.wait != nullptr) {
+    // Waits for the callback if it is running. Its completion is dequeued later if it posted one.
+    UnregisterWaitEx(child.wait, INVALID_HANDLE_VALUE);
+    child.wait = nullptr;
+    child.exitPending = child.exitPosted;
+  }
+}
+
+bool WslProcessPool::Loop::finished(const Child& child) const {
+  return child.done && !child.out.pending && !child.err.pending && !child.in.pending &&
+         !child.exitPending;
+}
+
+#else
+// POSIX counterpart of the implementation above, used with the FakeWslApi backend, which hands out
+// pipe file descriptors and process IDs as HANDLEs (see Platform.h).
+namespace {
+void close(int& fd) {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+}  // namespace
+
+WslProcessPool::Child::~Child() {
+  for (int* fd : {&out, &err, &in, &pidfd}) {
+    close(*fd);
+  }
+}
+
+WslProcessPool::Loop::Loop() {
+  if (pipe2(wake_, O_CLOEXEC | O_NONBLOCK) == 0) {
+    // A process that stops reading its input makes the writes fail with EPIPE, rather than raise
+    // SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+    ready_ = true;
+    thread_ = std::thread{[this] { run(); }};
+  }
+}
+
+WslProcessPool::Loop::~Loop() {
+  if (!ready_) {
+    return;
+  }
+  {
+    std::lock_guard lock{mutex_};
+    stopping_ = true;
+  }
+  wake();
+  thread_.join();
+  close(wake_[0]);
+  close(wake_[1]);
+}
+
+void WslProcessPool::Loop::wake() {
+  const char byte = 0;
+  while (::write(wake_[1], &byte, 1) < 0 && errno == EINTR) {
+  }
+}
+
+std::wstring WslProcessPool::Loop::spawn(WslApiBackend& api, Child& child) {
+  // Close-on-exec keeps processes launched concurrently from holding these pipes open. Our ends
+  // are non-blocking, as the loop only reads or writes what poll() said it could.
+  std::vector<int> theirs;
+  const auto closeTheirs = [&] {
+    for (auto fd : theirs) {
+      ::close(fd);
+    }
+  };
+  const auto createPipe = [&](int& ours, bool inbound) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+      return false;
+    }
+    ours = fds[inbound ? 0 : 1];
+    theirs.push_back(fds[inbound ? 1 : 0]);
+    fcntl(ours, F_SETFL, O_NONBLOCK);
+    return true;
+  };
+
+  if (!createPipe(child.out, true)) {
+    return L"failed to create the stdio pipe";
+  }
+  HANDLE out = handleFromFd(theirs.back());
+  HANDLE err = GetStdHandle(STD_ERROR_HANDLE);
+  if (child.request.onError) {
+    if (!createPipe(child.err, true)) {
+      closeTheirs();
+      return L"failed to create the stdio pipe";
+    }
+    err = handleFromFd(theirs.back());
+    child.errorBuffer = std::make_unique<char[]>(PipeChunkSize);
+  }
+  HANDLE in = GetStdHandle(STD_INPUT_HANDLE);
+  if (child.request.input) {
+    if (!createPipe(child.in, false)) {
+      closeTheirs();
+      return L"failed to create the stdio pipe";
+    }
+    in = handleFromFd(theirs.back());
+    child.input = *child.request.input;
+  }
+
+  HANDLE process;
+  const auto hr = api.WslLaunch(child.request.command.c_str(), FALSE, in, out, err, &process);
+  closeTheirs();
+  if (FAILED(hr)) {
+    return L"failed to launch process";
+  }
+  child.pid = static_cast<pid_t>(fdFromHandle(process));
+#ifdef SYS_pidfd_open
+  child.pidfd = static_cast<int>(syscall(SYS_pidfd_open, child.pid, 0));
+#endif
+  return {};
+}
+
+void WslProcessPool::Loop::adopt(Child& child) {
+  if (child.in >= 0 && child.input.empty()) {
+    close(child.in);
+  }
+  settle(child);
+}
+
+void WslProcessPool::Loop::reap(Child& child) {
+  if (child.exited) {
+    return;
+  }
+  int status = 0;
+  const auto reaped = waitpid(child.pid, &status, WNOHANG);
+  if (reaped == 0 || (reaped < 0 && errno == EINTR)) {
+    return;
+  }
+  child.exited = true;
+  if (reaped == child.pid && WIFEXITED(status)) {
+    child.exitCode = WEXITSTATUS(status);
+  }
+  close(child.pidfd);
+}
+
+void WslProcessPool::Loop::dispatch(DWORD timeout) {
+  enum class Kind { Wake, Output, Error, Input, Exit };
+  std::vector<pollfd> fds{{wake_[0], POLLIN, 0}};
+  std::vector<std::pair<Child*, Kind>> owners{{nullptr, Kind::Wake}};
+  bool polling = false;
+  for (auto& [id, child] : children_) {
+    for (auto [fd, events, kind] : {std::tuple{child->out, POLLIN, Kind::Output},
+                                    std::tuple{child->err, POLLIN, Kind::Error},
+                                    std::tuple{child->in, POLLOUT, Kind::Input},
+                                    std::tuple{child->pidfd, POLLIN, Kind::Exit}}) {
+      if (fd >= 0) {
+        fds.push_back({fd, static_cast<short>(events), 0});
+        owners.emplace_back(child.get(), kind);
+      }
+    }
+    polling = polling || (!child->exited && child->pidfd < 0);
+  }
+  // Without pidfds, exits are noticed by polling every millisecond, as the synchronous loop did.
+  int wait = timeout == INFINITE ? -1 : static_cast<int>(std::min<DWORD>(timeout, INT_MAX));
+  if (polling && (wait < 0 || wait > 1)) {
+    wait = 1;
+  }
+  if (poll(fds.data(), fds.size(), wait) < 0) {
+    return;
+  }
+
+  for (std::size_t i = 0; i < fds.size(); ++i) {
+    if (fds[i].revents == 0) {
+      continue;
+    }
+    auto [child, kind] = owners[i];
+    if (kind == Kind::Wake) {
+      char drained[64];
+      while (::read(wake_[0], drained, sizeof(drained)) > 0) {
+      }
+      continue;
+    }
+    if (child->done) {
+      if (kind == Kind::Exit) {
+        reap(*child);
+      }
+      continue;
+    }
+    try {
+      switch (kind) {
+        case Kind::Output: {
+          auto [buffer, capacity] = child->output.writable();
+          const auto count = ::read(child->out, buffer, capacity);
+          if (count == 0) {
+            close(child->out);
+          } else if (count < 0 && errno != EINTR && errno != EAGAIN) {
+            close(child->out);
+            fail(*child, L"could not read the process output");
+          } else if (count > 0 && !child->output.commit(static_cast<std::size_t>(count))) {
+            fail(*child, L"process output is too big");
+          }
+          break;
+        }
+        case Kind::Error: {
+          const auto count = ::read(child->err, child->errorBuffer.get(), PipeChunkSize);
+          if (count > 0) {
+            child->request.onError(
+                std::string_view{child->errorBuffer.get(), static_cast<std::size_t>(count)});
+          } else if (count == 0 || (errno != EINTR && errno != EAGAIN)) {
+            close(child->err);
+          }
+          break;
+        }
+        case Kind::Input: {
+          const auto size = std::min(child->input.size(), PipeChunkSize);
+          const auto count = ::write(child->in, child->input.data(), size);
+          if (count > 0) {
+            child->input.remove_prefix(static_cast<std::size_t>(count));
+          }
+          // Closing the pipe once everything was written lets the process read the end of its
+          // input. A process that stopped reading gets nothing more.
+          if (child->input.empty() || (count < 0 && errno != EINTR && errno != EAGAIN)) {
+            close(child->in);
+          }
+          break;
+        }
+        case Kind::Exit:
+          reap(*child);
+          break;
+        case Kind::Wake:
+          break;
+      }
+    } catch (...) {
+      fail(*child, L"could not handle the process output");
+    }
+    settle(*child);
+  }
+
+  for (auto& [id, child] : children_) {
+    if (!child->exited && child->pidfd < 0) {
+      reap(*child);
+      settle(*child);
+    }
+  }
+}
+
+void WslProcessPool::Loop::settle(Child& child) {
+  if (!child.done) {
+    if (child.out >= 0 || child.err >= 0 || !child.exited) {
+      return;
+    }
+    child.deliver({}, child.exitCode);
+  }
+
+  // Tearing down: the process is killed if still running, and reaped once it exits.
+  if (!child.exited && !child.terminated) {
+    kill(child.pid, SIGKILL);
+    child.terminated = true;
+  }
+  for (int* fd : {&child.out, &child.err, &child.in}) {
+    close(*fd);
+  }
+}
+
+bool WslProcessPool::Loop::finished(const Child& child) const {
+  return child.done && child.exited;
+}
+#endif
+
+void WslProcessPool::Process::cancel() const {
+  pool_->loop_->cancel(id_);
+}
+
+WslProcessPool::WslProcessPool() : loop_{std::make_unique<Loop>()} {}
+
+WslProcessPool::~WslProcessPool() = default;
+
+WslProcessPool::Process WslProcessPool::launch(WslApiBackend& api, Request request,
+                                               Completion onDone) {
+  const auto id = nextId_++;
+  auto child = std::make_unique<Child>(id, std::move(request), std::move(onDone));
+  Process process{*this, id, child->promise.get_future()};
+  if (!loop_->ready()) {
+    child->deliver(L"failed to start the wait loop");
+    return process;
+  }
+  if (child->request.timeout != INFINITE) {
+    child->deadline = Clock::now() + std::chrono::milliseconds{child->request.timeout};
+  }
+  if (auto error = loop_->spawn(api, *child); !error.empty()) {
+    child->deliver(std::move(error));
+    return process;
+  }
+  loop_->add(std::move(child));
+  return process;
+}
+
+WslProcessPool& WslProcessPool::shared() {
+  static WslProcessPool pool;
+  return pool;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace Ubuntu {
+// Runs non-interactive WSL processes asynchronously, any number of them in flight at once, all
+// served by a single wait loop on a thread of its own: an I/O completion port on Windows, poll(2)
+// on POSIX hosts. The loop reads the output pipes, writes the inputs and notices exits, timeouts
+// and cancellations, so a process in flight costs no thread, however long it runs.
+//
+// Launching still happens on the calling thread, as WSL may have to boot the VM first. Only then is
+// the process handed to the loop.
+class WslProcessPool {
+ public:
+  // Receives output as it is read, in chunks of arbitrary size. Called on the loop thread.
+  using OutputHandler = std::function<void(std::string_view chunk)>;
+
+  static constexpr std::size_t DefaultMaxOutputSize = 16 * 1024 * 1024;
+
+  struct Request {
+    // Shell command line.
+    std::wstring command;
+    // Written to the standard input of the process while its output is read, so that neither side
+    // waits for the other. The process reads the console otherwise.
+    std::optional<std::string> input;
+    // Receives the standard output. It's collected into Result::stdOut otherwise.
+    OutputHandler onOutput;
+    // Receives the standard error. It goes to the console otherwise.
+    OutputHandler onError;
+    // Milliseconds after which the process is terminated, counted from the launch.
+    DWORD timeout = INFINITE;
+    // The process is terminated if it writes more than that to its standard output.
+    std::size_t maxOutputSize = DefaultMaxOutputSize;
+  };
+
+  struct Result {
+    // Why the process didn't run to completion, if it didn't: it couldn't be launched, reading its
+    // output failed, it timed out or it was cancelled. Empty otherwise, whatever its exit code.
+    std::wstring error;
+    DWORD exitCode = static_cast<DWORD>(-1);
+    // The standard output, unless it was handed to Request::onOutput.
+    std::string stdOut;
+    // The size of the standard output, handed to Request::onOutput or not.
+    std::size_t outputSize = 0;
+  };
+
+  // Receives the result of a process once it completes, before its future is ready. Called on the
+  // loop thread.
+  using Completion = std::function<void(const Result&)>;
+
+  // A process in flight. Dropping it doesn't stop the process, whose result is then discarded.
+  class Process {
+   public:
+    // Blocks until the process completes.
+    Result get() { return result_.get(); }
+
+    std::future<Result>& future() { return result_; }
+
+    // Terminates the process, unless it completed already. Its result then tells it was cancelled.
+    void cancel() const;
+
+   private:
+    friend class WslProcessPool;
+    Process(WslProcessPool& pool, std::uint64_t id, std::future<Result> result) :
+        pool_{&pool}, id_{id}, result_{std::move(result)} {}
+
+    WslProcessPool* pool_;
+    std::uint64_t id_;
+    std::future<Result> result_;
+  };
+
+  WslProcessPool();
+  // Cancels the processes still in flight.
+  ~WslProcessPool();
+
+  WslProcessPool(const WslProcessPool&) = delete;
+  WslProcessPool& operator=(const WslProcessPool&) = delete;
+
+  // Launches [request] through [api], handing the result to [onDone], if any, once it completes.
+  Process launch(WslApiBackend& api, Request request, Completion onDone = {});
+
+  // The pool shared by the whole launcher.
+  static WslProcessPool& shared();
+
+ private:
+  struct Child;
+  class Loop;
+
+  std::atomic<std::uint64_t> nextId_{1};
+  std::unique_ptr<Loop> loop_;
+};
+}  // namespace Ubuntu
@@ -0,0 +1,81 @@
+#include <stdafx.h>
+#include "ProgressIndicator.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <iterator>
+
+namespace Ubuntu {
+
+namespace {
+constexpr wchar_t Frames[] = {L'|', L'/', L'-', L'\\'};
+constexpr std::chrono::milliseconds FrameInterval{250};
+
+bool stdOutIsConsole() {
+#ifdef _WIN32
+  DWORD mode;
+  return GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &mode) != FALSE;
+#else
+  return isatty(STDOUT_FILENO) != 0;
+#endif
+}
+}  // namespace
+
+ProgressIndicator::ProgressIndicator(std::wstring message, std::chrono::milliseconds delay) :
+    message_{std::move(message)} {
+  if (stdOutIsConsole()) {
+    thread_ = std::thread{[this, delay] { animate(delay); }};
+  }
+}
+
+ProgressIndicator::~ProgressIndicator() {
+  stop();
+}
+
+void ProgressIndicator::update(std::wstring message) {
+  std::lock_guard lock{mutex_};
+  message_ = std::move(message);
+}
+
+void ProgressIndicator::stop() {
+  {
+    std::lock_guard lock{mutex_};
+    stopped_ = true;
+  }
+  stopRequested_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void ProgressIndicator::animate(std::chrono::milliseconds delay) {
+  const auto start = std::chrono::steady_clock::now();
+  std::unique_lock lock{mutex_};
+  if (stopRequested_.wait_for(lock, delay, [this] { return stopped_; })) {
+    return;
+  }
+
+  int width = 0;
+  for (std::size_t frame = 0;; ++frame) {
+    const auto elapsed =
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
+    std::wstring line = message_;
+    line += L' ';
+    line += Frames[frame % std::size(Frames)];
+    line += L' ';
+    line += std::to_wstring(elapsed.count());
+    line += L's';
+    // Trailing blanks erase what's left of a longer message shown before.
+    const int length = static_cast<int>(line.size());
+    wprintf(L"\r%ls%*ls", line.c_str(), std::max(0, width - length), L"");
+    width = std::max(width, length);
+    fflush(stdout);
+    if (stopRequested_.wait_for(lock, FrameInterval, [this] { return stopped_; })) {
+      break;
+    }
+  }
+  wprintf(L"\r%*ls\r", width, L"");
+  fflush(stdout);
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Ubuntu {
+// Shows the user that the launcher is still busy while it waits for something slow, by animating
+// a spinner and the elapsed time after [message] from a background thread.
+//
+// Nothing is shown until [delay] elapses, so short waits don't flicker, nor when the standard
+// output is not a console, so redirected output is not cluttered with carriage returns.
+// The line is erased when the indicator stops.
+class ProgressIndicator {
+ public:
+  explicit ProgressIndicator(std::wstring message,
+                             std::chrono::milliseconds delay = std::chrono::seconds{1});
+  ~ProgressIndicator();
+
+  ProgressIndicator(const ProgressIndicator&) = delete;
+  ProgressIndicator& operator=(const ProgressIndicator&) = delete;
+
+  // Replaces the message shown from the next animation frame on.
+  void update(std::wstring message);
+
+  // Stops the animation and erases its line, if it was ever shown. Stopping twice is harmless.
+  void stop();
+
+ private:
+  void animate(std::chrono::milliseconds delay);
+
+  std::wstring message_;
+  std::mutex mutex_;
+  std::condition_variable stopRequested_;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+}  // namespace Ubuntu
@@ -0,0 +1,190 @@
+#include <stdafx.h>
+#include "Provisioning.h"
+
+#include <algorithm>
+#include <charconv>
+
+#include "DirectExec.h"
+#include "Utf8.h"
+#include "WslProcess.h"
+
+namespace Ubuntu {
+
+namespace {
+// Results go to the standard output the launcher reads, saved as file descriptor 3, while the
+// steps write theirs to the console through the standard error. As in the probe, LC_ALL=C makes
+// ${#o} count bytes, but only in the subshell writing a result, not to change the steps' language.
+constexpr std::wstring_view resultFunction =
+    L"exec 3>&1 1>&2; "
+    L"r() { (LC_ALL=C; o=$3; printf '%s %s %s\\n' \"$1\" \"$2\" \"${#o}\"; "
+    L"printf '%s' \"$o\") >&3; }; ";
+
+// Runs [step] and reports its result. Steps run in subshells, so that they can't exit the script,
+// and don't inherit the results' descriptor, which a daemon they start could otherwise keep open,
+// making the launcher wait for the end of the results forever. The input of a step is read by the
+// shell, whose read builtin doesn't consume past the line, and handed over by its printf builtin,
+// so it never shows up in the arguments of a process. When the script reads the inputs, steps
+// without one read nothing, or they would consume the inputs of the steps after them.
+std::wstring stepCommand(const ProvisioningStep& step, bool scriptInput) {
+  std::wstring command;
+  std::wstring feed;
+  std::wstring_view redirect = L" 3>&-";
+  if (step.input) {
+    command += L"IFS= read -r i; ";
+    feed = L"printf '%s\\n' \"$i\" | ";
+  } else if (scriptInput) {
+    redirect = L" </dev/null 3>&-";
+  }
+  if (step.capture) {
+    command += L"o=$(" + feed + L"eval ";
+    command += shellQuote(step.command);
+    command += redirect;
+    command += L"); e=$?; r ";
+    command.append(step.name.begin(), step.name.end());
+    command += L" $e \"$o\"; ";
+  } else {
+    command += feed + L"(eval ";
+    command += shellQuote(step.command);
+    command += L')';
+    command += redirect;
+    command += L"; e=$?; r ";
+    command.append(step.name.begin(), step.name.end());
+    command += L" $e ''; ";
+  }
+  if (step.input) {
+    command += L"i=; ";
+  }
+  return command;
+}
+}  // namespace
+
+std::wstring provisioningScript(const std::vector<ProvisioningStep>& steps) {
+  // Whether the transaction commits or not, the script succeeds as long as it reports the results,
+  // which tell.
+  std::wstring script{resultFunction};
+  const bool scriptInput = std::any_of(steps.begin(), steps.end(),
+                                       [](const auto& step) { return step.input.has_value(); });
+  for (auto step = steps.begin(); step != steps.end(); ++step) {
+    script += stepCommand(*step, scriptInput);
+    if (step->optional) {
+      continue;
+    }
+    script += L"if [ $e -ne 0 ]; then ";
+    for (auto done = std::make_reverse_iterator(step); done != steps.rend(); ++done) {
+      if (!done->undo.empty()) {
+        script += L"(eval ";
+        script += shellQuote(done->undo);
+        script += L") 3>&-; r undo-";
+        script.append(done->name.begin(), done->name.end());
+        script += L" $? ''; ";
+      }
+    }
+    script += L"exit 0; fi; ";
+  }
+  script += L"exit 0";
+  return script;
+}
+
+std::optional<std::string> provisioningInput(const std::vector<ProvisioningStep>& steps) {
+  std::optional<std::string> input;
+  for (const auto& step : steps) {
+    if (step.input) {
+      input = input.value_or("") + *step.input + '\n';
+    }
+  }
+  return input;
+}
+
+ProvisioningStep deleteResolvConfStep() {
+  return {"resolv.conf", L"rm -f /etc/resolv.conf", L"", true};
+}
+
+std::vector<ProvisioningStep> createUserSteps(const UserAccount& account) {
+  const std::wstring user = shellQuote(account.name);
+  std::vector<ProvisioningStep> steps;
+  steps.push_back({"adduser", L"adduser --quiet --gecos '' --disabled-password " + user,
+                   L"deluser " + user});
+  // Unlike usermod -p, chpasswd reads the hash from its input, which the script gets from its own
+  // input, so the hash doesn't show up in the arguments of any process.
+  if (account.passwordHash) {
+    ProvisioningStep password{"password", L"chpasswd -e"};
+    password.input = toUtf8(account.name + L':' + *account.passwordHash);
+    steps.push_back(std::move(password));
+  }
+  std::wstring groups{DefaultUserGroups};
+  for (const auto& group : account.extraGroups) {
+    groups += L',';
+    groups += group;
+  }
+  steps.push_back({"usermod", L"usermod -aG " + shellQuote(groups) + L' ' + user});
+  steps.push_back({"uid", L"id -u " + user, L"", false, true});
+  return steps;
+}
+
+std::optional<unsigned long> createdUid(const ProvisioningResult& result) {
+  const auto* uid = result.find("uid");
+  if (!result.committed || !uid) {
+    return std::nullopt;
+  }
+  unsigned long value = 0;
+  const auto* end = uid->data.data() + uid->data.size();
+  if (auto [ptr, error] = std::from_chars(uid->data.data(), end, value);
+      error != std::errc{} || ptr != end) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+bool askPassword(WslApiBackend& api, std::wstring_view name) {
+  Trace::Span span{"askPassword", "install"};
+  DWORD exitCode = 0;
+  const HRESULT hr =
+      api.WslLaunchInteractive(directExecCommand({L"passwd", name}).c_str(), FALSE, &exitCode);
+  if (SUCCEEDED(hr) && exitCode == 0) {
+    return true;
+  }
+  if (FAILED(hr)) {
+    Helpers::PrintErrorMessage(hr);
+  }
+
+  // As when a later provisioning step fails, the account is deleted for the user to start over.
+  WslProcess deluser{directExecCommand({L"deluser", L"--quiet", name})};
+  deluser.setInput({});
+  deluser.run(api, INFINITE);
+  return false;
+}
+
+const ProbeSection* ProvisioningResult::find(std::string_view name) const {
+  auto section = std::find_if(sections.begin(), sections.end(),
+                              [&](const auto& s) { return s.name == name; });
+  return section == sections.end() ? nullptr : &*section;
+}
+
+std::optional<ProvisioningResult> provision(WslApiBackend& api,
+                                            const std::vector<ProvisioningStep>& steps) {
+  Trace::Span span{"provision", "install"};
+  ProvisioningResult result;
+  ProbeDemultiplexer demux{[&](ProbeSection&& section) {
+    span.arg(section.name, std::to_string(section.exitCode));
+    result.sections.push_back(std::move(section));
+  }};
+  // The steps may wait for the user, so there is no telling how long they take.
+  // The script needs a POSIX shell, while the default user may log in with any shell.
+  WslProcess script{directExecCommand({L"/bin/sh", L"-c", provisioningScript(steps)})};
+  if (auto input = provisioningInput(steps)) {
+    script.setInput(std::move(*input));
+  }
+  const auto ran = script.run(api, INFINITE, [&](std::string_view chunk) { demux.feed(chunk); });
+  if (!ran.error.empty() || !demux.complete()) {
+    return std::nullopt;
+  }
+
+  const auto succeeded = [&](const ProvisioningStep& step) {
+    const auto* section = result.find(step.name);
+    return section && (section->exitCode == 0 || step.optional);
+  };
+  result.committed = std::all_of(steps.begin(), steps.end(), succeeded);
+  return result;
+}
+
+}  // namespace Ubuntu
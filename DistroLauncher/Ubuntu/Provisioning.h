@@ -0,0 +1,89 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Probe.h"
+
+namespace Ubuntu {
+// Changes the launcher makes to a freshly registered distro, such as creating the user account,
+// applied as a single transaction by a script run in a single launch rather than a launch each.
+//
+// Steps run in order. The first one failing stops the script, which then undoes the steps before it
+// in reverse order. Each step, and each undo, reports its result as a probe section (see Probe.h)
+// on the script's standard output, so the launcher learns what happened and gets the results it
+// needs, such as the UID of a new user, without launching anything else. Steps themselves write to
+// the console, but they get no terminal, thus they must not ask the user anything: a password, for
+// one, is asked afterwards by askPassword.
+struct ProvisioningStep {
+  // Result name, must not contain blanks.
+  std::string_view name;
+  // Shell command line.
+  std::wstring command;
+  // Shell command line undoing the step if a later one fails. Nothing is undone if empty.
+  std::wstring undo;
+  // Whether a failure is only reported, rather than stopping the script.
+  bool optional = false;
+  // Whether the standard output of the command is its result, captured instead of shown. Trailing
+  // new lines are removed.
+  bool capture = false;
+  // A line, without its line break, given to the command on its standard input. It reaches the
+  // script through the script's own standard input rather than its command line, where any process
+  // could read it. Steps can't read the console then, and those without input read nothing.
+  std::optional<std::string> input;
+};
+
+// Builds the shell command line running [steps] as a transaction.
+std::wstring provisioningScript(const std::vector<ProvisioningStep>& steps);
+
+// What the script running [steps] reads from its standard input: the input of each step, in order,
+// or nullopt if none has any, in which case the script reads the console.
+std::optional<std::string> provisioningInput(const std::vector<ProvisioningStep>& steps);
+
+struct ProvisioningResult {
+  // Whether every step succeeded, but for optional ones. Otherwise the steps that ran were undone.
+  bool committed = false;
+  // A section per step that ran, in order, followed by a section per step undone, named
+  // "undo-<step>", in the order they were undone.
+  std::vector<ProbeSection> sections;
+
+  // The result of the step [name], or nullptr if it didn't run.
+  const ProbeSection* find(std::string_view name) const;
+};
+
+// The step deleting /etc/resolv.conf, so that WSL generates it from the Windows networking
+// information. Optional, as nothing depends on it.
+ProvisioningStep deleteResolvConfStep();
+
+// The groups every user account the launcher creates is in, as on Ubuntu desktop installs.
+constexpr std::wstring_view DefaultUserGroups =
+    L"adm,dialout,cdrom,floppy,sudo,audio,dip,video,plugdev,netdev";
+
+// The user account created at install time.
+struct UserAccount {
+  std::wstring name;
+  // The password as a crypt(3) hash, as found in /etc/shadow. The password is disabled otherwise,
+  // until askPassword sets one.
+  std::optional<std::wstring> passwordHash;
+  // Groups to add the account to, on top of the ones every default user is in.
+  std::vector<std::wstring> extraGroups;
+};
+
+// The steps creating [account] and adding it to its groups. Should any of them fail, the account is
+// deleted. The last one, "uid", reports the UID of the new account.
+std::vector<ProvisioningStep> createUserSteps(const UserAccount& account);
+
+// The UID reported by the "uid" step of a committed [result].
+std::optional<unsigned long> createdUid(const ProvisioningResult& result);
+
+// Asks the user the password of the account [name], created by createUserSteps, in a launch of its
+// own: only WslLaunchInteractive gives passwd a terminal, to read the password without echoing it.
+// Should that fail, the account is deleted. Returns whether the password was set.
+bool askPassword(WslApiBackend& api, std::wstring_view name);
+
+// Runs [steps] in a single launch. Returns nullopt if the script couldn't be launched or didn't
+// report its results, in which case what it did is unknown.
+std::optional<ProvisioningResult> provision(WslApiBackend& api,
+                                            const std::vector<ProvisioningStep>& steps);
+}  // namespace Ubuntu
@@ -0,0 +1,435 @@
+#include <stdafx.h>
+#include "Rootfs.h"
+#include "Gzip.h"
+#include "HashTree.h"
+#include "ProgressIndicator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace Ubuntu {
+
+namespace {
+// Compressed bytes decoded per batch. Large enough to keep all cores busy with BGZF's members of up
+// to 64 KiB, small enough to bound memory usage to about five times as much.
+constexpr std::size_t BatchSize = 16 * 1024 * 1024;
+
+// A generous upper bound of the compression ratio of a rootfs, to make sure the decompressed tar
+// fits in the temporary directory before starting.
+constexpr std::uintmax_t ExpectedRatio = 5;
+
+// Where the launcher finds the file WSL resolves [tarball] to.
+std::filesystem::path locate(const std::filesystem::path& tarball) {
+#ifdef _WIN32
+  if (tarball.is_absolute()) {
+    return tarball;
+  }
+  wchar_t executable[MAX_PATH];
+  DWORD length = GetModuleFileNameW(nullptr, executable, MAX_PATH);
+  if ((length == 0) || (length >= MAX_PATH)) {
+    return tarball;
+  }
+  return std::filesystem::path{executable}.parent_path() / tarball;
+#else
+  return tarball;
+#endif
+}
+
+std::wstring megabytes(std::uint64_t bytes) {
+  return std::to_wstring(bytes / (1024 * 1024)) + L" MB";
+}
+
+// Runs [job] for the indexes in [0, count) on up to [workers] threads, until one of them fails.
+bool runParallel(std::size_t count, unsigned workers, const std::function<bool(std::size_t)>& job) {
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> failed{false};
+  auto run = [&] {
+    for (std::size_t i; !failed && (i = next++) < count;) {
+      if (!job(i)) {
+        failed = true;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t worker = 1; worker < std::min<std::size_t>(workers, count); ++worker) {
+    threads.emplace_back(run);
+  }
+  run();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return !failed;
+}
+
+// Runs [count] jobs as runParallel() does, along with the hashing jobs [verifier] has ready, if
+// any. Hashes are queued first, so that a corrupt file is usually caught as such by the verifier
+// rather than only found undecodable.
+bool runVerified(std::size_t count, unsigned workers, const ChunkVerifier* verifier,
+                 const std::function<bool(std::size_t)>& job) {
+  const std::size_t hashes = verifier ? verifier->jobs() : 0;
+  return runParallel(hashes + count, workers, [&](std::size_t i) {
+    return i < hashes ? verifier->run(i) : job(i - hashes);
+  });
+}
+
+using Decompressor = std::function<bool(const std::filesystem::path& destination,
+                                        const DecompressionProgress& onProgress)>;
+
+// Decompresses into the temporary directory with [decompress] on [workers] threads, showing the
+// progress and indexing the tarball, if there is room for [decompressedSize] bytes there. Returns
+// the decompressed tarball, or an empty path.
+std::filesystem::path stage(std::uintmax_t decompressedSize, unsigned workers,
+                            const Decompressor& decompress, TarIndex& index, Trace::Span& span) {
+  std::error_code error;
+  const auto directory = std::filesystem::temp_directory_path(error);
+  if (error) {
+    return {};
+  }
+  const auto space = std::filesystem::space(directory, error);
+  if (error || space.available < decompressedSize) {
+    return {};
+  }
+
+#ifdef _WIN32
+  const auto pid = GetCurrentProcessId();
+#else
+  const auto pid = getpid();
+#endif
+  auto destination = directory / (std::wstring{DistributionInfo::Name} + L"-" +
+                                  std::to_wstring(pid) + L"-rootfs.tar");
+
+  const std::wstring message = L"Decompressing the root filesystem...";
+  ProgressIndicator progress{message};
+  const auto start = std::chrono::steady_clock::now();
+  std::uint64_t total = 0;
+  const bool decompressed = decompress(destination, [&](std::string_view written) {
+    index.feed(written);
+    total += written.size();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const auto rate = static_cast<std::uint64_t>(total / std::max(elapsed.count(), 0.001));
+    progress.update(message + L' ' + megabytes(total) + L" (" + megabytes(rate) + L"/s)");
+  });
+  progress.stop();
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  const auto megabytesPerSecond = total / 1e6 / std::max(elapsed.count(), 0.001);
+  span.arg("workers", std::to_string(workers));
+  span.arg("bytes", std::to_string(total));
+  span.arg("MBps", std::to_string(static_cast<std::uint64_t>(megabytesPerSecond)));
+  span.arg("members", index.complete() ? std::to_string(index.size()) : "not indexed");
+  if (!decompressed) {
+    std::filesystem::remove(destination, error);
+    return {};
+  }
+  return destination;
+}
+
+// Whether the rootfs doesn't match the hash tree [shipped] next to it, as far as [verifier] saw
+// while it was being staged. A rootfs not staged is not verified: WSL reads it on its own, and
+// reading it once more only to hash it would double the I/O of the install.
+bool isCorrupt(const ShippedHashTree& shipped, const ChunkVerifier* verifier, bool staged,
+               Trace::Span& span) {
+  bool corrupt = shipped.malformed;
+  const bool verified = shipped.tree && verifier && (staged || verifier->failed());
+  if (verified) {
+    corrupt = verifier->failed() || !verifier->complete();
+  }
+  span.arg("verified", corrupt    ? "corrupt"
+                       : verified ? "yes"
+                                  : (shipped.tree ? "not staged" : "no hash tree"));
+  return corrupt;
+}
+}  // namespace
+
+bool isBlockGzip(const std::filesystem::path& tarball) {
+  std::ifstream file{tarball, std::ios::binary};
+  // The BGZF header is 18 bytes long, but other subfields may precede the one recording the size.
+  char header[64];
+  file.read(header, sizeof(header));
+  return bgzfMemberSize({header, static_cast<std::size_t>(file.gcount())}).has_value();
+}
+
+bool decompressBlockGzip(const std::filesystem::path& source,
+                         const std::filesystem::path& destination, unsigned workers,
+                         const DecompressionProgress& onProgress, ChunkVerifier* verifier) {
+  std::ifstream in{source, std::ios::binary};
+  std::ofstream out{destination, std::ios::binary | std::ios::trunc};
+  if (!in || !out) {
+    return false;
+  }
+
+  struct Job {
+    GzipMember member;
+    std::size_t offset;
+  };
+  std::vector<Job> jobs;
+  // Holds whole members, followed by the beginning of the next one not fully read yet.
+  std::string compressed;
+  std::vector<unsigned char> decompressed;
+  for (;;) {
+    const std::size_t kept = compressed.size();
+    compressed.resize(BatchSize);
+    in.read(compressed.data() + kept, static_cast<std::streamsize>(BatchSize - kept));
+    const auto read = static_cast<std::size_t>(in.gcount());
+    compressed.resize(kept + read);
+    if (in.bad() || (verifier && !verifier->feed({compressed.data() + kept, read}))) {
+      return false;
+    }
+    if (compressed.empty()) {
+      break;
+    }
+
+    // Members can be told apart without decoding them, thanks to the sizes in their headers.
+    jobs.clear();
+    std::size_t consumed = 0;
+    std::size_t decompressedSize = 0;
+    const std::string_view batch{compressed};
+    while (auto size = bgzfMemberSize(batch.substr(consumed))) {
+      if (*size > batch.size() - consumed) {
+        break;
+      }
+      // The sizes in the trailers are only checked once decoded, thus they are bounded before any
+      // memory is set aside for them.
+      auto member = parseGzipMember(batch.substr(consumed, *size));
+      if (!member || member->size > MaxBgzfMemberSize) {
+        return false;
+      }
+      jobs.push_back({*member, decompressedSize});
+      decompressedSize += member->size;
+      consumed += *size;
+    }
+    // Either not a BGZF member or truncated.
+    if (jobs.empty()) {
+      return false;
+    }
+
+    decompressed.resize(decompressedSize);
+    const bool decoded = runVerified(jobs.size(), workers, verifier, [&](std::size_t i) {
+      return gunzipMember(jobs[i].member, decompressed.data() + jobs[i].offset);
+    });
+    if (!decoded) {
+      return false;
+    }
+
+    if (!out.write(reinterpret_cast<const char*>(decompressed.data()),
+                   static_cast<std::streamsize>(decompressed.size()))) {
+      return false;
+    }
+    if (onProgress) {
+      onProgress({reinterpret_cast<const char*>(decompressed.data()), decompressed.size()});
+    }
+    compressed.erase(0, consumed);
+  }
+  return static_cast<bool>(out.flush());
+}
+
+std::optional<SeekableZstd> SeekableZstd::open(const std::filesystem::path& path) {
+  std::error_code error;
+  const auto fileSize = std::filesystem::file_size(path, error);
+  if (error || fileSize < SeekTable::FooterSize) {
+    return std::nullopt;
+  }
+  std::ifstream file{path, std::ios::binary};
+  char footer[SeekTable::FooterSize];
+  file.seekg(static_cast<std::streamoff>(fileSize - sizeof(footer)));
+  if (!file.read(footer, sizeof(footer))) {
+    return std::nullopt;
+  }
+  const auto tableSize = SeekTable::size({footer, sizeof(footer)});
+  if (!tableSize || *tableSize > fileSize) {
+    return std::nullopt;
+  }
+  std::string table(*tableSize, '\0');
+  file.seekg(static_cast<std::streamoff>(fileSize - table.size()));
+  if (!file.read(table.data(), static_cast<std::streamsize>(table.size()))) {
+    return std::nullopt;
+  }
+  auto parsed = SeekTable::parse(table, fileSize);
+  if (!parsed) {
+    return std::nullopt;
+  }
+  return SeekableZstd{std::move(file), std::move(*parsed), std::move(table)};
+}
+
+bool SeekableZstd::read(std::uint64_t offset, std::size_t size, unsigned char* out) {
+  if (offset > this->size() || size > this->size() - offset) {
+    return false;
+  }
+  while (size > 0) {
+    const auto index = table_.frameAt(offset);
+    const auto& frame = table_.frames[index];
+    if (cachedFrame_ != index) {
+      cachedFrame_.reset();
+      std::string compressed;
+      cache_.resize(frame.decompressedSize);
+      if (!readFrames(index, index + 1, compressed) ||
+          !decodeFrame(index, compressed, cache_.data())) {
+        return false;
+      }
+      cachedFrame_ = index;
+    }
+    const auto within = static_cast<std::size_t>(offset - frame.decompressedOffset);
+    const auto count = std::min<std::size_t>(size, frame.decompressedSize - within);
+    std::memcpy(out, cache_.data() + within, count);
+    out += count;
+    offset += count;
+    size -= count;
+  }
+  return true;
+}
+
+bool SeekableZstd::readFrames(std::size_t first, std::size_t last, std::string& compressed) {
+  const auto begin = table_.frames[first].compressedOffset;
+  const auto& lastFrame = table_.frames[last - 1];
+  const auto end = lastFrame.compressedOffset + lastFrame.compressedSize;
+  compressed.resize(static_cast<std::size_t>(end - begin));
+  file_.clear();
+  file_.seekg(static_cast<std::streamoff>(begin));
+  return static_cast<bool>(
+      file_.read(compressed.data(), static_cast<std::streamsize>(compressed.size())));
+}
+
+bool SeekableZstd::decodeFrame(std::size_t index, std::string_view compressed,
+                               unsigned char* out) const {
+  const auto& frame = table_.frames[index];
+  if (!decompressZstd(compressed, out, frame.decompressedSize)) {
+    return false;
+  }
+  return !frame.checksum ||
+         *frame.checksum == static_cast<std::uint32_t>(xxh64(out, frame.decompressedSize));
+}
+
+bool decompressSeekableZstd(const std::filesystem::path& source,
+                            const std::filesystem::path& destination, unsigned workers,
+                            const DecompressionProgress& onProgress, ChunkVerifier* verifier) {
+  auto reader = SeekableZstd::open(source);
+  std::ofstream out{destination, std::ios::binary | std::ios::trunc};
+  if (!reader || !out) {
+    return false;
+  }
+
+  const auto& frames = reader->table().frames;
+  std::string compressed;
+  std::vector<unsigned char> decompressed;
+  for (std::size_t first = 0; first < frames.size();) {
+    // The seek table tells where frames are, so batches can be read in one go.
+    std::size_t last = first;
+    std::uint64_t compressedSize = 0;
+    std::uint64_t decompressedSize = 0;
+    do {
+      compressedSize += frames[last].compressedSize;
+      decompressedSize += frames[last].decompressedSize;
+      ++last;
+    } while (last < frames.size() && compressedSize + frames[last].compressedSize <= BatchSize &&
+             decompressedSize + frames[last].decompressedSize <= BatchSize * ExpectedRatio);
+    if (!reader->readFrames(first, last, compressed) ||
+        (verifier && !verifier->feed(compressed))) {
+      return false;
+    }
+
+    decompressed.resize(static_cast<std::size_t>(decompressedSize));
+    const auto& base = frames[first];
+    const bool decoded = runVerified(last - first, workers, verifier, [&](std::size_t i) {
+      const auto& frame = frames[first + i];
+      const auto input = std::string_view{compressed}.substr(
+          static_cast<std::size_t>(frame.compressedOffset - base.compressedOffset),
+          frame.compressedSize);
+      auto* output = decompressed.data() + (frame.decompressedOffset - base.decompressedOffset);
+      return reader->decodeFrame(first + i, input, output);
+    });
+    if (!decoded) {
+      return false;
+    }
+
+    if (!out.write(reinterpret_cast<const char*>(decompressed.data()),
+                   static_cast<std::streamsize>(decompressed.size()))) {
+      return false;
+    }
+    if (onProgress) {
+      onProgress({reinterpret_cast<const char*>(decompressed.data()), decompressed.size()});
+    }
+    first = last;
+  }
+  // The seek table is the only part of the file not read above.
+  if (verifier && (!verifier->feed(reader->seekTable()) ||
+                   !runVerified(0, workers, verifier, nullptr))) {
+    return false;
+  }
+  return static_cast<bool>(out.flush());
+}
+
+StagedRootfs::StagedRootfs(std::filesystem::path tarball, const std::filesystem::path& seekable) :
+    tarball_{std::move(tarball)} {
+  Trace::Span span{"StagedRootfs", "install"};
+  const unsigned workers = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // WSL can't import zstd, so the seekable rootfs is staged even on a single core.
+  const auto zstd = locate(seekable);
+  if (auto reader = SeekableZstd::open(zstd)) {
+    span.arg("format", "zstd");
+    const auto shipped = loadHashTree(zstd, expectedRootHash(zstd));
+    std::optional<ChunkVerifier> verifier;
+    if (shipped.tree) {
+      verifier.emplace(*shipped.tree);
+    }
+    auto decompress = [&](const auto& destination, const DecompressionProgress& onProgress) {
+      return decompressSeekableZstd(zstd, destination, workers, onProgress,
+                                    verifier ? &*verifier : nullptr);
+    };
+    if (!shipped.malformed) {
+      staged_ = stage(reader->size(), workers, decompress, index_, span);
+    }
+    corrupt_ = isCorrupt(shipped, verifier ? &*verifier : nullptr, staged(), span);
+    if (staged() || corrupt_) {
+      return;
+    }
+  }
+
+  // Otherwise WSL will report what's wrong with the shipped tarball, if anything.
+  const auto source = locate(tarball_);
+  const auto shipped = loadHashTree(source, expectedRootHash(source));
+  std::optional<ChunkVerifier> verifier;
+  std::error_code error;
+  const auto compressedSize = std::filesystem::file_size(source, error);
+  if (workers >= 2 && !error && !shipped.malformed && isBlockGzip(source)) {
+    span.arg("format", "bgzf");
+    index_ = {};
+    if (shipped.tree) {
+      verifier.emplace(*shipped.tree);
+    }
+    auto decompress = [&](const auto& destination, const DecompressionProgress& onProgress) {
+      return decompressBlockGzip(source, destination, workers, onProgress,
+                                 verifier ? &*verifier : nullptr);
+    };
+    staged_ = stage(compressedSize * ExpectedRatio, workers, decompress, index_, span);
+  }
+  corrupt_ = isCorrupt(shipped, verifier ? &*verifier : nullptr, staged(), span);
+}
+
+std::optional<std::string> StagedRootfs::extract(std::string_view name,
+                                                 std::size_t maxSize) const {
+  const auto* members = index();
+  if (!members) {
+    return std::nullopt;
+  }
+  const auto* member = members->find(name);
+  if (!member) {
+    return std::nullopt;
+  }
+  return readTarMember(staged_, *member, maxSize);
+}
+
+StagedRootfs::~StagedRootfs() {
+  if (!staged_.empty()) {
+    std::error_code error;
+    std::filesystem::remove(staged_, error);
+  }
+}
+
+}  // namespace Ubuntu
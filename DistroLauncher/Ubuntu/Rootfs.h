@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "HashTree.h"
+#include "TarIndex.h"
+#include "Zstd.h"
+
+namespace Ubuntu {
+// Receives the uncompressed bytes as they are written, batch by batch, in order.
+using DecompressionProgress = std::function<void(std::string_view written)>;
+
+// Whether [tarball] is a block gzip (BGZF) file, made of members that can be decoded independently.
+bool isBlockGzip(const std::filesystem::path& tarball);
+
+// Decompresses the BGZF file [source] into [destination] on [workers] threads, in batches of
+// members decoded in parallel and written in order. Returns false on I/O errors or corrupt input,
+// leaving [destination] in an unspecified state.
+//
+// The compressed bytes are fed to [verifier], if any, as they are read, and hashed on the same
+// threads as the members they hold are decoded.
+bool decompressBlockGzip(const std::filesystem::path& source,
+                         const std::filesystem::path& destination, unsigned workers,
+                         const DecompressionProgress& onProgress = {},
+                         ChunkVerifier* verifier = nullptr);
+
+// Random access to the contents of a seekable zstd file, decoding only the frames a read overlaps.
+// The last decoded frame is kept, so that sequential small reads decode each frame once.
+class SeekableZstd {
+ public:
+  // Returns nullopt if [path] can't be read or doesn't end with a valid seek table.
+  static std::optional<SeekableZstd> open(const std::filesystem::path& path);
+
+  const SeekTable& table() const { return table_; }
+
+  // The seek table as stored at the end of the file, after the last frame.
+  std::string_view seekTable() const { return rawTable_; }
+
+  // The decompressed size.
+  std::uint64_t size() const { return table_.decompressedSize; }
+
+  // Copies [size] decompressed bytes from [offset] into [out]. Returns false if the range is out of
+  // bounds, on I/O errors or if a frame is corrupt.
+  bool read(std::uint64_t offset, std::size_t size, unsigned char* out);
+
+  // Reads the compressed frames [first, last) into [compressed], as they are contiguous.
+  bool readFrames(std::size_t first, std::size_t last, std::string& compressed);
+
+  // Decodes the frame [index] from its compressed bytes into [out], checking the seek table's
+  // checksum when there is one.
+  bool decodeFrame(std::size_t index, std::string_view compressed, unsigned char* out) const;
+
+ private:
+  SeekableZstd(std::ifstream file, SeekTable table, std::string rawTable) :
+      file_{std::move(file)}, table_{std::move(table)}, rawTable_{std::move(rawTable)} {}
+
+  std::ifstream file_;
+  SeekTable table_;
+  std::string rawTable_;
+  std::optional<std::size_t> cachedFrame_;
+  std::vector<unsigned char> cache_;
+};
+
+// Decompresses the seekable zstd file [source] into [destination] on [workers] threads, in batches
+// of frames decoded in parallel and written in order. Returns false on I/O errors or corrupt input,
+// leaving [destination] in an unspecified state. [verifier] is fed as decompressBlockGzip() does.
+bool decompressSeekableZstd(const std::filesystem::path& source,
+                            const std::filesystem::path& destination, unsigned workers,
+                            const DecompressionProgress& onProgress = {},
+                            ChunkVerifier* verifier = nullptr);
+
+// The rootfs tarball to hand to WslRegisterDistribution.
+//
+// WSL inflates the tarball on a single thread while importing it. When a seekable zstd rootfs is
+// shipped, which WSL can't import, or when the shipped tarball is a BGZF file, the rootfs is
+// instead decompressed up front on all cores into an uncompressed tar in the temporary directory,
+// deleted along with this object, so WSL only has to unpack it. Otherwise, or if anything goes
+// wrong while decompressing, the shipped tarball is used as is.
+//
+// The members of a staged tarball are indexed while it is written, so that small files can be read
+// out of the rootfs before registering it.
+//
+// When the build embedded the root hash of the rootfs into the launcher, the compressed file is
+// verified against the hash tree shipped next to it while it's decompressed. A corrupt rootfs is
+// then reported instead of failing halfway through registering it, or worse, not failing at all.
+// A tarball registered as is is left for WSL to check, as a pass of its own would double the I/O
+// of the install.
+class StagedRootfs {
+ public:
+  // [tarball] is the path WslRegisterDistribution would be given and [seekable] the seekable zstd
+  // rootfs preferred over it if present, relative paths being relative to the launcher executable.
+  StagedRootfs(std::filesystem::path tarball, const std::filesystem::path& seekable);
+  ~StagedRootfs();
+
+  StagedRootfs(const StagedRootfs&) = delete;
+  StagedRootfs& operator=(const StagedRootfs&) = delete;
+
+  // The tarball to register.
+  const std::filesystem::path& path() const { return staged_.empty() ? tarball_ : staged_; }
+
+  // Whether path() is a decompressed copy of the shipped tarball.
+  bool staged() const { return !staged_.empty(); }
+
+  // The members of the staged tarball, or nullptr if it's not staged or couldn't be indexed.
+  const TarIndex* index() const { return staged() && index_.complete() ? &index_ : nullptr; }
+
+  // The contents of the file at [name] in the rootfs, following symbolic links, or nullopt if there
+  // is no such file, it is larger than [maxSize] or the rootfs is not indexed.
+  std::optional<std::string> extract(std::string_view name, std::size_t maxSize) const;
+
+  // Whether the shipped rootfs doesn't match its hash tree, or the tree itself is corrupt. It must
+  // not be registered then.
+  bool corrupt() const { return corrupt_; }
+
+ private:
+  std::filesystem::path tarball_;
+  std::filesystem::path staged_;
+  TarIndex index_;
+  bool corrupt_ = false;
+};
+}  // namespace Ubuntu
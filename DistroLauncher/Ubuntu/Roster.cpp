@@ -0,0 +1,365 @@
+#include <stdafx.h>
+#include "Roster.h"
+#include "DirectExec.h"
+#include "IniFile.h"
+#include "Probe.h"
+#include "ProcessPool.h"
+#include "Provisioning.h"
+#include "SplitView.h"
+#include "UserTable.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+namespace Ubuntu {
+
+namespace {
+// Rosters list a few dozen accounts, a few hundred at most.
+constexpr std::uintmax_t MaxRosterSize = 1024 * 1024;
+
+// The exit code useradd reports when the user name is already in use.
+constexpr int UserExists = 9;
+
+// The script reads the newusers(8) input, a passwd line per account but for the home directory and
+// shell, from its standard input and feeds newusers with the lines of the accounts which don't exist
+// yet. As adduser does, it puts home directories in DHOME and gives accounts DSHELL, as set in
+// /etc/adduser.conf or defaulted by adduser. As in the provisioning script, results are written as
+// probe sections on file descriptor 3, while the commands write to the console. It holds no line
+// breaks, which tcsh refuses within the quotes of `/bin/sh -c`.
+//
+// The default user set in /etc/wsl.conf, if any, takes precedence over the one the launcher makes
+// root, in which case the script only reports who it runs as, having read its input.
+//
+// -c NONE writes the password field to /etc/shadow as is, since it holds a hash already.
+constexpr std::wstring_view rosterPrelude =
+    L"exec 3>&1 1>&2; "
+    L"r() { (LC_ALL=C; o=$3; printf '%s %s %s\\n' \"$1\" \"$2\" \"${#o}\"; "
+    L"printf '%s' \"$o\") >&3; }; "
+    L"if [ \"$(id -u)\" != 0 ]; then cat >/dev/null; r root 1 \"$(id -un)\"; exit 0; fi; "
+    L"c() { sed -n \"s/^[[:blank:]]*$1[[:blank:]]*=[[:blank:]]*//p\" /etc/adduser.conf 2>/dev/null "
+    L"| tail -n 1 | tr -d '\"'; }; "
+    L"dh=$(c DHOME); dh=${dh:-/home}; ds=$(c DSHELL); ds=${ds:-/bin/bash}; "
+    L"nl=$(printf '\\nx'); nl=${nl%x}; e=' '; n=''; "
+    L"while IFS= read -r l; do u=${l%%:*}; "
+    L"if getent passwd \"$u\" >/dev/null; then e=\"$e$u \"; else n=\"$n$l:$dh/$u:$ds$nl\"; fi; "
+    L"done; "
+    L"if [ -n \"$n\" ]; then printf '%s' \"$n\" | newusers -c NONE; r newusers $? ''; fi; "
+    L"g() { case $e in *\" $1 \"*) r \"user:$1\" 9 ''; return;; esac; "
+    L"o=$(set -e; p=$(getent passwd \"$1\"); h=${p#*:*:*:*:*:}; h=${h%%:*}; "
+    L"if [ -d /etc/skel ]; then cp -rT /etc/skel \"$h\"; chown -R \"$1:\" \"$h\"; fi; "
+    L"usermod -aG \"$2\" \"$1\" >&2; id -u \"$1\"); "
+    L"r \"user:$1\" $? \"$o\"; }; ";
+
+// What enforceDefaultUser needs to know, but for the registry, once the accounts exist.
+constexpr std::wstring_view rosterEpilogue =
+    L"o=$(cat /etc/wsl.conf 2>/dev/null); r wsl.conf $? \"$o\"; "
+    L"o=$(getent passwd); r passwd $? \"$o$nl\"; "
+    L"exit 0";
+
+// Splits a CSV [line] into its fields, unquoting them. Returns nullopt if a quote isn't closed.
+std::optional<std::vector<std::string>> csvFields(std::string_view line) {
+  std::vector<std::string> fields(1);
+  bool quoted = false;
+  for (std::size_t i = 0; i < line.size(); ++i) {
+    const char c = line[i];
+    if (quoted && c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+      fields.back() += '"';
+      ++i;
+    } else if (c == '"') {
+      quoted = !quoted;
+    } else if (c == ',' && !quoted) {
+      fields.emplace_back();
+    } else {
+      fields.back() += c;
+    }
+  }
+  if (quoted) {
+    return std::nullopt;
+  }
+  return fields;
+}
+
+bool isHeader(const std::vector<std::string>& fields) {
+  return fields.size() == 3 && iequals(trim(fields[0]), "name") &&
+         iequals(trim(fields[1]), "password") && iequals(trim(fields[2]), "groups");
+}
+
+std::wstring invalid(std::size_t line, std::wstring_view reason) {
+  return L"line " + std::to_wstring(line) + L": " + std::wstring{reason};
+}
+
+class RootLaunches;
+
+// The RootLaunches to undo if the console goes away before it does.
+std::atomic<RootLaunches*> switchedToRoot{nullptr};
+
+// Makes root the default user of the distro while alive, as WslLaunch runs commands as the default
+// user, which is the regular account created at install time by the time rosters are applied. That
+// setting is persistent and seen by every launch, from wsl.exe or another launcher alike, thus it's
+// only kept for the time it takes to start a process. The previous default user is restored however
+// the launch went, and when the console is closed or interrupted meanwhile.
+class RootLaunches {
+ public:
+  explicit RootLaunches(WslApiBackend& api) : api_{api} {
+    if (FAILED(api_.WslGetDistributionConfiguration(previous_))) {
+      return;
+    }
+    if (previous_.defaultUid == 0) {
+      active_ = true;
+      return;
+    }
+    switchedToRoot = this;
+#ifdef _WIN32
+    SetConsoleCtrlHandler(restoreOnExit, TRUE);
+#endif
+    pending_ = true;
+    active_ = SUCCEEDED(api_.WslConfigureDistribution(0, previous_.flags));
+  }
+
+  ~RootLaunches() {
+#ifdef _WIN32
+    SetConsoleCtrlHandler(restoreOnExit, FALSE);
+#endif
+    restore();
+    switchedToRoot = nullptr;
+  }
+
+  RootLaunches(const RootLaunches&) = delete;
+  RootLaunches& operator=(const RootLaunches&) = delete;
+
+  // Whether launches run as root.
+  bool active() const { return active_; }
+
+ private:
+  // Restores the previous default user, once, from whichever thread comes first.
+  void restore() {
+    if (pending_.exchange(false)) {
+      api_.WslConfigureDistribution(previous_.defaultUid, previous_.flags);
+    }
+  }
+
+#ifdef _WIN32
+  // Runs on a thread of its own on Ctrl-C, Ctrl-Break, or when the console is closed, right before
+  // the default handler terminates the launcher.
+  static BOOL WINAPI restoreOnExit(DWORD) {
+    if (auto* root = switchedToRoot.load()) {
+      root->restore();
+    }
+    return FALSE;
+  }
+#endif
+
+  WslApiBackend& api_;
+  DistributionConfiguration previous_;
+  std::atomic<bool> pending_{false};
+  bool active_ = false;
+};
+}  // namespace
+
+std::optional<Roster> Roster::parse(std::string_view contents, std::wstring& error) {
+  Roster roster;
+  std::size_t number = 0;
+  for (auto line : SplitView{contents, '\n'}) {
+    ++number;
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (trim(line).empty() || trim(line).front() == '#') {
+      continue;
+    }
+    const auto fields = csvFields(line);
+    if (!fields) {
+      error = invalid(number, L"unterminated quote");
+      return std::nullopt;
+    }
+    if (roster.users.empty() && isHeader(*fields)) {
+      continue;
+    }
+    if (fields->size() > 3) {
+      error = invalid(number, L"expected name,password,groups");
+      return std::nullopt;
+    }
+
+    Entry entry;
+    entry.name = trim((*fields)[0]);
+    if (!isValidUserName(entry.name)) {
+      error = invalid(number, L"not a valid user name, see NAME_REGEX in adduser.conf(5)");
+      return std::nullopt;
+    }
+    const auto listed = [&](const Entry& user) { return user.name == entry.name; };
+    if (std::any_of(roster.users.begin(), roster.users.end(), listed)) {
+      error = invalid(number, L"the user is listed twice");
+      return std::nullopt;
+    }
+    if (const auto hash = fields->size() > 1 ? trim((*fields)[1]) : ""; !hash.empty()) {
+      if (!isPasswordHash(hash)) {
+        error = invalid(number, L"not a password hash, see crypt(5)");
+        return std::nullopt;
+      }
+      entry.passwordHash = std::string{hash};
+    }
+    if (const auto groups = fields->size() > 2 ? trim((*fields)[2]) : ""; !groups.empty()) {
+      for (const auto group : SplitView{groups, ';'}) {
+        if (!isValidUserName(trim(group))) {
+          error = invalid(number, L"not a semicolon-separated list of group names");
+          return std::nullopt;
+        }
+        entry.extraGroups.emplace_back(trim(group));
+      }
+    }
+    roster.users.push_back(std::move(entry));
+  }
+  if (roster.users.empty()) {
+    error = L"no users are listed";
+    return std::nullopt;
+  }
+  return roster;
+}
+
+std::optional<Roster> Roster::load(const std::filesystem::path& file, std::wstring& error) {
+  std::error_code sizeError;
+  const auto size = std::filesystem::file_size(file, sizeError);
+  if (!sizeError && size > MaxRosterSize) {
+    error = L"the file is too large";
+    return std::nullopt;
+  }
+  std::ifstream stream{file, std::ios::binary};
+  std::ostringstream contents;
+  if (sizeError || !stream || !(contents << stream.rdbuf())) {
+    error = L"could not read the file";
+    return std::nullopt;
+  }
+  return parse(contents.str(), error);
+}
+
+std::optional<RosterReport> provisionRoster(WslApiBackend& api, const Roster& roster) {
+  Trace::Span span{"provisionRoster", "config"};
+  span.arg("users", std::to_string(roster.users.size()));
+
+  // The passwd lines newusers reads, up to the GECOS field, the script adding the rest. Like
+  // adduser, newusers creates a group named after each user and picks the UIDs. A missing password
+  // is locked.
+  std::string input;
+  std::wstring script{rosterPrelude};
+  for (const auto& user : roster.users) {
+    input += user.name + ':' + user.passwordHash.value_or("!") + ":::\n";
+
+    std::wstring groups{DefaultUserGroups};
+    for (const auto& group : user.extraGroups) {
+      groups += L',' + toWide(group);
+    }
+    script += L"g " + shellQuote(toWide(user.name)) + L' ' + shellQuote(groups) + L"; ";
+  }
+  script += rosterEpilogue;
+
+  RosterReport report;
+  for (const auto& user : roster.users) {
+    report.users.push_back({user.name});
+  }
+  auto& probes = report.defaultUser;
+  ProbeDemultiplexer demux{[&](ProbeSection&& section) {
+    span.arg(section.name, std::to_string(section.exitCode));
+    if (section.name == "root") {
+      report.notRoot = std::move(section.data);
+    } else if (section.name == "newusers" && section.exitCode != 0) {
+      Helpers::PrintMessage(MSG_NEWUSERS_FAILED, section.exitCode);
+    } else if (section.name == "wsl.conf" && section.exitCode == 0) {
+      probes.wslConfUser = IniFile{section.data}.get("user", "default").value_or("");
+      probes.users.lookFor(probes.wslConfUser);
+    } else if (section.name == "passwd" && section.exitCode == 0) {
+      probes.users.feed(section.data);
+      probes.users.finish();
+      report.passwd = std::move(section.data);
+    } else if (section.name.rfind("user:", 0) == 0) {
+      const auto name = std::string_view{section.name}.substr(5);
+      auto user = std::find_if(report.users.begin(), report.users.end(),
+                               [&](const RosterResult& result) { return result.name == name; });
+      if (user == report.users.end()) {
+        return;
+      }
+      user->exitCode = section.exitCode;
+      const auto* end = section.data.data() + section.data.size();
+      if (section.exitCode == UserExists) {
+        user->status = RosterResult::Status::Exists;
+      } else if (auto [ptr, error] = std::from_chars(section.data.data(), end, user->uid);
+                 section.exitCode == 0 && error == std::errc{} && ptr == end) {
+        user->status = RosterResult::Status::Created;
+      }
+    }
+  }};
+
+  // Nothing is asked, but there is no telling how long creating a large roster takes. The script
+  // needs a POSIX shell, root's login shell may be any.
+  WslProcessPool::Request request;
+  request.command = directExecCommand({L"/bin/sh", L"-c", script});
+  request.input = std::move(input);
+  // Only called before the result is ready, which is only read below.
+  request.onOutput = [&demux](std::string_view chunk) { demux.feed(chunk); };
+
+  // Creating accounts takes root. The user a process runs as is settled once it's launched, thus
+  // the default user is restored before waiting for the script.
+  std::optional<WslProcessPool::Process> process;
+  {
+    RootLaunches root{api};
+    if (!root.active()) {
+      return std::nullopt;
+    }
+    process = WslProcessPool::shared().launch(api, std::move(request));
+  }
+  const auto result = process->get();
+  if (!result.error.empty() || result.exitCode != 0 || !demux.complete()) {
+    return std::nullopt;
+  }
+  return report;
+}
+
+bool applyRoster(WslApiBackend& api, const Roster& roster) {
+  auto report = provisionRoster(api, roster);
+  if (!report) {
+    Helpers::PrintMessage(MSG_ROSTER_FAILED);
+    return false;
+  }
+  if (!report->notRoot.empty()) {
+    Helpers::PrintMessage(MSG_ROSTER_NOT_ROOT, toWide(report->notRoot).c_str());
+    return false;
+  }
+
+  bool success = true;
+  for (const auto& user : report->users) {
+    std::wstring line = toWide(user.name) + L": ";
+    switch (user.status) {
+      case RosterResult::Status::Created:
+        line += L"created with UID " + std::to_wstring(user.uid);
+        break;
+      case RosterResult::Status::Exists:
+        line += L"already exists, left as is";
+        break;
+      case RosterResult::Status::Failed:
+        line += L"failed with exit code " + std::to_wstring(user.exitCode);
+        success = false;
+        break;
+    }
+    _putws(line.c_str());
+  }
+
+  report->defaultUser.registryUid = registryDefaultUid(api);
+  if (!enforceDefaultUser(api, report->defaultUser)) {
+    return false;
+  }
+  const UserTable users{std::move(report->passwd)};
+  const auto uid = registryDefaultUid(api);
+  for (UserTable::Index i = 0; i < users.size(); ++i) {
+    if (users.uid(i) == uid) {
+      _putws((L"Default user: " + toWide(users.name(i))).c_str());
+      break;
+    }
+  }
+  return success;
+}
+
+}  // namespace Ubuntu
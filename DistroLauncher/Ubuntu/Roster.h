@@ -0,0 +1,73 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ubuntu {
+// The user accounts `config --users <file>` creates in bulk, e.g. on shared lab machines. The file
+// is CSV, with a line per account:
+//
+//   name,password,groups
+//   alice,$6$...,docker;libvirt
+//   bob,,
+//
+// The password is a crypt(3) hash, as found in /etc/shadow, or nothing for it to be disabled. The
+// groups, separated with ';', are added on top of the ones every default user is in. Fields may be
+// double-quoted. Blank lines, lines starting with '#' and the header line above are ignored.
+//
+// Everything is validated before anything is launched in the distro, as for answer files.
+struct Roster {
+  struct Entry {
+    std::string name;
+    std::optional<std::string> passwordHash;
+    std::vector<std::string> extraGroups;
+  };
+
+  std::vector<Entry> users;
+
+  // Parses and validates [contents]. Returns nullopt with the reason in [error] if they're invalid.
+  static std::optional<Roster> parse(std::string_view contents, std::wstring& error);
+
+  // Reads and validates [file], as parse() does.
+  static std::optional<Roster> load(const std::filesystem::path& file, std::wstring& error);
+};
+
+// What became of each account of a roster.
+struct RosterResult {
+  enum class Status { Created, Exists, Failed };
+
+  std::string name;
+  Status status = Status::Failed;
+  // The UID of the account, if created.
+  unsigned long uid = UID_INVALID;
+  // The exit code of the step that failed, if any.
+  int exitCode = 0;
+};
+
+struct RosterReport {
+  // A result per account, in roster order.
+  std::vector<RosterResult> users;
+  // What the distro tells about the default user once the accounts exist, but for the registry.
+  DefaultUserProbes defaultUser;
+  // The passwd database, to name the default user.
+  std::string passwd;
+  // The user the script ran as if not root, as /etc/wsl.conf sets another default user, which
+  // overrides the one the launcher sets. Nothing was done then.
+  std::string notRoot;
+};
+
+// Creates the accounts of [roster] in a single launch: a single newusers run, fed with the roster
+// through its standard input, so that the hashes never show up on a command line, followed by the
+// group memberships of each account. Accounts which already exist are left as they are. The script
+// runs as root, made the default user for the time it takes to launch it, unless /etc/wsl.conf sets
+// another default user. Returns nullopt if the script
+// couldn't be launched or didn't report its results.
+std::optional<RosterReport> provisionRoster(WslApiBackend& api, const Roster& roster);
+
+// Creates the accounts of [roster], prints what became of each, and then enforces the default user
+// with the same rules as after installing (see enforceDefaultUser): unless there is one already,
+// the account with the lowest UID becomes the default one. Returns false if anything failed.
+bool applyRoster(WslApiBackend& api, const Roster& roster);
+}  // namespace Ubuntu
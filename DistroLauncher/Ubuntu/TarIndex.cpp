@@ -0,0 +1,331 @@
+#include <stdafx.h>
+#include "TarIndex.h"
+
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <fstream>
+#include <vector>
+
+namespace Ubuntu {
+
+namespace {
+constexpr std::size_t BlockSize = 512;
+
+// Larger extended headers are not worth buffering: real ones hold a few paths at most.
+constexpr std::uint64_t MaxExtendedSize = 1024 * 1024;
+
+// Linux gives up resolving a path after as many links.
+constexpr int MaxLinkHops = 40;
+
+// Header fields, as offsets and sizes.
+struct Field {
+  std::size_t offset;
+  std::size_t size;
+};
+constexpr Field Name{0, 100};
+constexpr Field Size{124, 12};
+constexpr Field Checksum{148, 8};
+constexpr Field Type{156, 1};
+constexpr Field LinkName{157, 100};
+constexpr Field Magic{257, 6};
+constexpr Field Prefix{345, 155};
+
+std::string_view field(const std::array<char, BlockSize>& header, Field f) {
+  std::string_view value{header.data() + f.offset, f.size};
+  return value.substr(0, value.find('\0'));
+}
+
+// Numeric fields are octal, padded with blanks or NULs, or base-256 when their first bit is set.
+std::optional<std::uint64_t> number(const std::array<char, BlockSize>& header, Field f) {
+  std::string_view value{header.data() + f.offset, f.size};
+  if ((static_cast<unsigned char>(value[0]) & 0x80) != 0) {
+    std::uint64_t result = static_cast<unsigned char>(value[0]) & 0x7F;
+    for (const char c : value.substr(1)) {
+      if (result >> 56 != 0) {
+        return std::nullopt;
+      }
+      result = (result << 8) | static_cast<unsigned char>(c);
+    }
+    return result;
+  }
+  constexpr std::string_view blanks{" \0", 2};
+  const auto begin = value.find_first_not_of(blanks);
+  if (begin == std::string_view::npos) {
+    return 0;
+  }
+  value.remove_prefix(begin);
+  value = value.substr(0, value.find_first_of(blanks));
+  std::uint64_t result = 0;
+  auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result, 8);
+  if (error != std::errc{} || end != value.data() + value.size()) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+bool validChecksum(const std::array<char, BlockSize>& header) {
+  const auto expected = number(header, Checksum);
+  std::uint64_t sum = 0;
+  for (std::size_t i = 0; i < BlockSize; ++i) {
+    const bool inChecksum = i >= Checksum.offset && i < Checksum.offset + Checksum.size;
+    sum += inChecksum ? ' ' : static_cast<unsigned char>(header[i]);
+  }
+  return expected == sum;
+}
+
+std::uint64_t padding(std::uint64_t size) {
+  return (BlockSize - size % BlockSize) % BlockSize;
+}
+
+// Splits [path] into its components, ignoring empty ones and "." ones.
+std::vector<std::string_view> components(std::string_view path) {
+  std::vector<std::string_view> result;
+  while (!path.empty()) {
+    const auto slash = std::min(path.find('/'), path.size());
+    if (const auto component = path.substr(0, slash); !component.empty() && component != ".") {
+      result.push_back(component);
+    }
+    path.remove_prefix(std::min(slash + 1, path.size()));
+  }
+  return result;
+}
+
+// Removes the last component of the relative [path].
+void parent(std::string& path) {
+  const auto slash = path.rfind('/');
+  path.erase(slash == std::string::npos ? 0 : slash);
+}
+
+// Members are usually named relative to the root, but may start with "./" or "/", and directories
+// end with "/". They are indexed under the canonical relative name.
+std::string normalize(std::string_view path) {
+  std::string result;
+  for (const auto component : components(path)) {
+    if (component == "..") {
+      parent(result);
+      continue;
+    }
+    if (!result.empty()) {
+      result += '/';
+    }
+    result += component;
+  }
+  return result;
+}
+}  // namespace
+
+bool TarIndex::feed(std::string_view chunk) {
+  while (!chunk.empty()) {
+    std::size_t consumed = 0;
+    switch (state_) {
+      case State::Header:
+        consumed = std::min(chunk.size(), BlockSize - headerSize_);
+        std::copy_n(chunk.data(), consumed, header_.data() + headerSize_);
+        headerSize_ += consumed;
+        break;
+      case State::Data:
+        consumed = static_cast<std::size_t>(std::min<std::uint64_t>(chunk.size(), skip_));
+        skip_ -= consumed;
+        break;
+      case State::Extended:
+        consumed = static_cast<std::size_t>(
+            std::min<std::uint64_t>(chunk.size(), extendedSize_ - extended_.size()));
+        extended_.append(chunk.data(), consumed);
+        break;
+      case State::End:
+        return true;
+      case State::Corrupt:
+        return false;
+    }
+    chunk.remove_prefix(consumed);
+    position_ += consumed;
+
+    if (state_ == State::Header && headerSize_ == BlockSize) {
+      headerSize_ = 0;
+      header();
+    } else if (state_ == State::Extended && extended_.size() == extendedSize_) {
+      extended();
+    }
+    if (state_ == State::Data && skip_ == 0) {
+      state_ = State::Header;
+    }
+  }
+  return state_ != State::Corrupt;
+}
+
+void TarIndex::header() {
+  // The archive ends with zero blocks, the first one being enough to tell.
+  if (std::all_of(header_.begin(), header_.end(), [](char c) { return c == 0; })) {
+    state_ = State::End;
+    return;
+  }
+  const auto size = number(header_, Size);
+  if (!validChecksum(header_) || !size) {
+    state_ = State::Corrupt;
+    return;
+  }
+  const char type = header_[Type.offset];
+
+  // Extended headers describe the next member in their contents.
+  if (type == 'L' || type == 'K' || type == 'x') {
+    if (*size > MaxExtendedSize) {
+      state_ = State::Corrupt;
+      return;
+    }
+    extendedType_ = type;
+    extended_.clear();
+    extendedSize_ = *size;
+    skip_ = padding(*size);
+    state_ = State::Extended;
+    if (extendedSize_ == 0) {
+      extended();
+    }
+    return;
+  }
+
+  std::string name;
+  if (longName_) {
+    name = std::move(*longName_);
+  } else if (const auto prefix = field(header_, Prefix);
+             field(header_, Magic) == "ustar" && !prefix.empty()) {
+    // Only POSIX ustar headers have a prefix: GNU ones use the same space for something else.
+    name = std::string{prefix} + '/' + std::string{field(header_, Name)};
+  } else {
+    name = field(header_, Name);
+  }
+  std::string link = longLink_ ? std::move(*longLink_) : std::string{field(header_, LinkName)};
+  const std::uint64_t contentSize = paxSize_.value_or(*size);
+  longName_.reset();
+  longLink_.reset();
+  paxSize_.reset();
+
+  TarMember member;
+  member.offset = position_;
+  switch (type) {
+    case '0':
+    case '\0':
+    case '7':
+      member.type = TarMember::Type::File;
+      member.size = contentSize;
+      break;
+    case '5':
+      member.type = TarMember::Type::Directory;
+      break;
+    case '2':
+      member.type = TarMember::Type::Symlink;
+      member.link = std::move(link);
+      break;
+    case '1':
+      // The file linked to always comes first.
+      if (auto target = members_.find(normalize(link)); target != members_.end()) {
+        member = target->second;
+      }
+      break;
+    default:
+      break;
+  }
+  // Links, directories and devices have no contents, whatever their size field says.
+  const bool hasContents = type == '0' || type == '\0' || type == '7' || type > '7';
+  skip_ = hasContents ? contentSize + padding(contentSize) : 0;
+  state_ = State::Data;
+  members_.insert_or_assign(normalize(name), std::move(member));
+}
+
+void TarIndex::extended() {
+  state_ = State::Data;
+  if (extendedType_ == 'L' || extendedType_ == 'K') {
+    auto& target = extendedType_ == 'L' ? longName_ : longLink_;
+    target = extended_.substr(0, extended_.find('\0'));
+    return;
+  }
+
+  // pax records are "<length> <key>=<value>\n", the length counting the whole record.
+  std::string_view records{extended_};
+  while (!records.empty()) {
+    std::size_t length = 0;
+    auto [end, error] = std::from_chars(records.data(), records.data() + records.size(), length);
+    const auto prefix = static_cast<std::size_t>(end - records.data());
+    if (error != std::errc{} || length <= prefix + 1 || length > records.size() ||
+        records[prefix] != ' ' || records[length - 1] != '\n') {
+      state_ = State::Corrupt;
+      return;
+    }
+    const auto record = records.substr(prefix + 1, length - prefix - 2);
+    records.remove_prefix(length);
+
+    const auto equals = record.find('=');
+    if (equals == std::string_view::npos) {
+      continue;
+    }
+    const auto key = record.substr(0, equals);
+    const auto value = record.substr(equals + 1);
+    if (key == "path") {
+      longName_ = value;
+    } else if (key == "linkpath") {
+      longLink_ = value;
+    } else if (key == "size") {
+      std::uint64_t size = 0;
+      auto [sizeEnd, sizeError] = std::from_chars(value.data(), value.data() + value.size(), size);
+      if (sizeError != std::errc{} || sizeEnd != value.data() + value.size()) {
+        state_ = State::Corrupt;
+        return;
+      }
+      paxSize_ = size;
+    }
+  }
+}
+
+const TarMember* TarIndex::find(std::string_view path) const {
+  // Components left to resolve, the next one last.
+  auto pending = components(path);
+  std::reverse(pending.begin(), pending.end());
+  // The link targets the pending components point into, which must not move.
+  std::deque<std::string> targets;
+  std::string resolved;
+  int hops = 0;
+  while (!pending.empty()) {
+    const auto component = pending.back();
+    pending.pop_back();
+    if (component == "..") {
+      parent(resolved);
+      continue;
+    }
+    const auto directory = resolved.size();
+    if (!resolved.empty()) {
+      resolved += '/';
+    }
+    resolved += component;
+
+    // Archives don't always have members for the directories holding other members.
+    const auto found = members_.find(resolved);
+    if (found != members_.end() && found->second.type == TarMember::Type::Symlink) {
+      const auto& link = found->second.link;
+      if (link.empty() || ++hops > MaxLinkHops) {
+        return nullptr;
+      }
+      // Relative targets are relative to the directory holding the link.
+      resolved.erase(link.front() == '/' ? 0 : directory);
+      const auto next = components(targets.emplace_back(link));
+      pending.insert(pending.end(), next.rbegin(), next.rend());
+    }
+  }
+  const auto found = members_.find(resolved);
+  return found == members_.end() ? nullptr : &found->second;
+}
+
+std::optional<std::string> readTarMember(const std::filesystem::path& tar, const TarMember& member,
+                                         std::size_t maxSize) {
+  if (member.type != TarMember::Type::File || member.size > maxSize) {
+    return std::nullopt;
+  }
+  std::ifstream file{tar, std::ios::binary};
+  file.seekg(static_cast<std::streamoff>(member.offset));
+  std::string contents(static_cast<std::size_t>(member.size), '\0');
+  if (!file.read(contents.data(), static_cast<std::streamsize>(contents.size()))) {
+    return std::nullopt;
+  }
+  return contents;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,73 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace Ubuntu {
+struct TarMember {
+  enum class Type { File, Directory, Symlink, Other };
+  Type type = Type::Other;
+  // Where the contents start in the uncompressed archive.
+  std::uint64_t offset = 0;
+  std::uint64_t size = 0;
+  // The target of a symbolic link.
+  std::string link;
+};
+
+// The members of an uncompressed tar archive, indexed by name in a single streaming pass over it.
+//
+// Only headers are parsed: the contents are skipped as they stream by, so feeding the archive
+// while it is being written costs next to nothing. Understands the ustar, GNU (long names) and pax
+// (path, linkpath and size records) formats. Hard links are indexed as the file they link to.
+class TarIndex {
+ public:
+  // Feeds the next bytes of the archive, in chunks of any size. Returns false once the archive is
+  // found malformed, after which the index is incomplete and further chunks are ignored.
+  bool feed(std::string_view chunk);
+
+  // Whether the end of the archive was reached, thus every member is indexed.
+  bool complete() const { return state_ == State::End; }
+
+  std::size_t size() const { return members_.size(); }
+
+  // The member at [path], absolute or relative to the root of the archive. Symbolic links are
+  // followed, in [path] components as well, as the distro would once the archive is unpacked.
+  // Returns nullptr if there is no such member or links don't resolve within the archive.
+  const TarMember* find(std::string_view path) const;
+
+ private:
+  enum class State { Header, Data, Extended, End, Corrupt };
+
+  // Indexes the member described by the header just read.
+  void header();
+
+  // Applies the records of the GNU or pax extended header just read to the next member.
+  void extended();
+
+  State state_ = State::Header;
+  std::uint64_t position_ = 0;
+  std::array<char, 512> header_;
+  std::size_t headerSize_ = 0;
+  // Contents and padding left to skip.
+  std::uint64_t skip_ = 0;
+
+  char extendedType_ = 0;
+  std::string extended_;
+  std::uint64_t extendedSize_ = 0;
+  // Overrides of the next member's header fields.
+  std::optional<std::string> longName_;
+  std::optional<std::string> longLink_;
+  std::optional<std::uint64_t> paxSize_;
+
+  std::unordered_map<std::string, TarMember> members_;
+};
+
+// Reads the contents of [member] out of the uncompressed archive [tar], or nullopt on I/O errors or
+// if they are larger than [maxSize].
+std::optional<std::string> readTarMember(const std::filesystem::path& tar, const TarMember& member,
+                                         std::size_t maxSize);
+}  // namespace Ubuntu
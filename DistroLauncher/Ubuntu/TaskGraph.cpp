@@ -0,0 +1,108 @@
+#include <stdafx.h>
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace Ubuntu {
+
+TaskGraph::TaskId TaskGraph::add(std::string name, std::function<void()> work,
+                                 std::vector<TaskId> dependencies) {
+  const TaskId id = tasks_.size();
+  for (auto dependency : dependencies) {
+    if (dependency >= id) {
+      throw std::invalid_argument{"task dependencies must be added before their dependents"};
+    }
+    tasks_[dependency].dependents.push_back(id);
+  }
+  tasks_.push_back(Task{std::move(name), std::move(work), {}, dependencies.size()});
+  return id;
+}
+
+void TaskGraph::run(unsigned workers) {
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  std::deque<TaskId> ready;
+  std::vector<bool> skipped(tasks_.size(), false);
+  std::size_t unfinished = tasks_.size();
+  std::exception_ptr error;
+
+  for (TaskId id = 0; id < tasks_.size(); ++id) {
+    if (tasks_[id].pendingDependencies == 0) {
+      ready.push_back(id);
+    }
+  }
+
+  // Marks all tasks depending on [id], directly or not, as done without running them.
+  // Must be called with the mutex held.
+  std::function<void(TaskId)> skipDependentsOf = [&](TaskId id) {
+    for (auto dependent : tasks_[id].dependents) {
+      if (!skipped[dependent]) {
+        skipped[dependent] = true;
+        --unfinished;
+        skipDependentsOf(dependent);
+      }
+    }
+  };
+
+  auto worker = [&] {
+    std::unique_lock lock{mutex};
+    while (true) {
+      wakeUp.wait(lock, [&] { return !ready.empty() || unfinished == 0; });
+      if (ready.empty()) {
+        return;
+      }
+      auto id = ready.front();
+      ready.pop_front();
+      auto& task = tasks_[id];
+
+      lock.unlock();
+      std::exception_ptr failure;
+      {
+        Trace::Span span{task.name, "task"};
+        try {
+          task.work();
+        } catch (...) {
+          failure = std::current_exception();
+        }
+      }
+      lock.lock();
+
+      --unfinished;
+      if (failure) {
+        if (!error) {
+          error = failure;
+        }
+        skipDependentsOf(id);
+      } else {
+        for (auto dependent : task.dependents) {
+          if (--tasks_[dependent].pendingDependencies == 0 && !skipped[dependent]) {
+            ready.push_back(dependent);
+          }
+        }
+      }
+      wakeUp.notify_all();
+    }
+  };
+
+  // The calling thread is one of the workers.
+  std::vector<std::thread> threads;
+  auto workerCount = std::min<std::size_t>(std::max(workers, 1U), tasks_.size());
+  for (std::size_t i = 1; i < workerCount; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}  // namespace Ubuntu
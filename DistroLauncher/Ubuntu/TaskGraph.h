@@ -0,0 +1,37 @@
+#pragma once
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Ubuntu {
+// A tiny dependency-aware scheduler: tasks declare which other tasks they depend on and run on a
+// pool of worker threads as soon as all of their dependencies completed, so independent tasks
+// overlap in time.
+//
+// Tasks communicate their results through state captured by their callables. A task completing
+// happens-before any of its dependents starts, thus no extra synchronization is needed for state
+// written by a task and read by its dependents.
+class TaskGraph {
+ public:
+  using TaskId = std::size_t;
+
+  // Adds a task to the graph, to run once all of its dependencies completed successfully.
+  // Dependencies must have been added before.
+  TaskId add(std::string name, std::function<void()> work, std::vector<TaskId> dependencies = {});
+
+  // Runs all tasks on up to [workers] threads, blocking the caller until they all finish.
+  // If any task throws, its dependents are skipped and the first exception is rethrown once the
+  // remaining tasks in flight finish.
+  void run(unsigned workers = 4);
+
+ private:
+  struct Task {
+    std::string name;
+    std::function<void()> work;
+    std::vector<TaskId> dependents;
+    std::size_t pendingDependencies = 0;
+  };
+  std::vector<Task> tasks_;
+};
+}  // namespace Ubuntu
@@ -0,0 +1,219 @@
+#include <stdafx.h>
+#include "Trace.h"
+#include "Utf8.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace Ubuntu::Trace {
+
+namespace {
+struct Event {
+  std::string name;
+  std::string category;
+  std::string args;
+  double timestamp;  // microseconds since the session started.
+  double duration;   // microseconds.
+  unsigned threadId;
+};
+
+// Recording state, shared by all threads.
+std::atomic<bool> recording{false};
+std::mutex mutex;
+std::vector<Event> events;
+std::chrono::steady_clock::time_point origin;
+
+// Small sequential IDs read better in the trace viewer than the OS thread IDs.
+unsigned currentThreadId() {
+  static std::atomic<unsigned> next{1};
+  thread_local unsigned id = next++;
+  return id;
+}
+
+double microseconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+void appendJsonString(std::string& out, std::string_view str) {
+  out += '"';
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[7];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out += escaped;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+std::string hresult(HRESULT hr) {
+  char buffer[11];
+  std::snprintf(buffer, sizeof(buffer), "0x%08x", static_cast<unsigned>(hr));
+  return buffer;
+}
+}  // namespace
+
+Session::Session(std::filesystem::path output) : output_{std::move(output)} {
+  std::scoped_lock lock{mutex};
+  events.clear();
+  origin = std::chrono::steady_clock::now();
+  recording = true;
+}
+
+Session::~Session() {
+  recording = false;
+  std::scoped_lock lock{mutex};
+  std::string json{"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"};
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    const auto& e = events[i];
+    json += "{\"ph\":\"X\",\"pid\":1,\"tid\":";
+    json += std::to_string(e.threadId);
+    json += ",\"ts\":";
+    json += std::to_string(e.timestamp);
+    json += ",\"dur\":";
+    json += std::to_string(e.duration);
+    json += ",\"name\":";
+    appendJsonString(json, e.name);
+    json += ",\"cat\":";
+    appendJsonString(json, e.category);
+    json += ",\"args\":{";
+    json += e.args;
+    json += "}}";
+    json += (i + 1 < events.size()) ? ",\n" : "\n";
+  }
+  json += "]}\n";
+
+  std::ofstream file{output_, std::ios::binary | std::ios::trunc};
+  if (!file.write(json.data(), static_cast<std::streamsize>(json.size()))) {
+    std::wcerr << L"ERROR: failed to write the trace file " << output_.wstring() << L'\n';
+  }
+}
+
+bool enabled() {
+  return recording.load(std::memory_order_relaxed);
+}
+
+Span::Span(std::string_view name, std::string_view category) : enabled_{enabled()} {
+  if (enabled_) {
+    name_ = name;
+    category_ = category;
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+Span::~Span() {
+  if (!enabled_ || !enabled()) {
+    return;
+  }
+  auto end = std::chrono::steady_clock::now();
+  auto tid = currentThreadId();
+  std::scoped_lock lock{mutex};
+  events.push_back(Event{std::move(name_), std::move(category_), std::move(args_),
+                         microseconds(start_ - origin), microseconds(end - start_), tid});
+}
+
+Span& Span::arg(std::string_view key, std::string_view value) {
+  if (enabled_) {
+    if (!args_.empty()) {
+      args_ += ',';
+    }
+    appendJsonString(args_, key);
+    args_ += ':';
+    appendJsonString(args_, value);
+  }
+  return *this;
+}
+
+Span& Span::arg(std::string_view key, std::wstring_view value) {
+  if (!enabled_) {
+    return *this;
+  }
+  return arg(key, toUtf8(value));
+}
+
+BOOL TracedWslApi::WslIsOptionalComponentInstalled() {
+  Span span{"WslIsOptionalComponentInstalled", "wslapi"};
+  return api_.WslIsOptionalComponentInstalled();
+}
+
+BOOL TracedWslApi::WslIsDistributionRegistered() {
+  Span span{"WslIsDistributionRegistered", "wslapi"};
+  return api_.WslIsDistributionRegistered();
+}
+
+HRESULT TracedWslApi::WslRegisterDistribution(PCWSTR tarGzFilename) {
+  Span span{"WslRegisterDistribution", "wslapi"};
+  span.arg("tarball", std::wstring_view{tarGzFilename});
+  auto hr = api_.WslRegisterDistribution(tarGzFilename);
+  span.arg("hr", hresult(hr));
+  return hr;
+}
+
+HRESULT TracedWslApi::WslConfigureDistribution(ULONG defaultUID,
+                                               WSL_DISTRIBUTION_FLAGS wslDistributionFlags) {
+  Span span{"WslConfigureDistribution", "wslapi"};
+  span.arg("uid", std::to_string(defaultUID));
+  auto hr = api_.WslConfigureDistribution(defaultUID, wslDistributionFlags);
+  span.arg("hr", hresult(hr));
+  return hr;
+}
+
+HRESULT TracedWslApi::WslGetDistributionConfiguration(DistributionConfiguration& configuration) {
+  Span span{"WslGetDistributionConfiguration", "wslapi"};
+  auto hr = api_.WslGetDistributionConfiguration(configuration);
+  span.arg("hr", hresult(hr));
+  if (SUCCEEDED(hr)) {
+    span.arg("uid", std::to_string(configuration.defaultUid));
+  }
+  return hr;
+}
+
+HRESULT TracedWslApi::WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkingDirectory,
+                                           DWORD* exitCode) {
+  Span span{"WslLaunchInteractive", "wslapi"};
+  span.arg("command", std::wstring_view{command});
+  auto hr = api_.WslLaunchInteractive(command, useCurrentWorkingDirectory, exitCode);
+  span.arg("hr", hresult(hr));
+  if (SUCCEEDED(hr)) {
+    span.arg("exitCode", std::to_string(*exitCode));
+  }
+  return hr;
+}
+
+HRESULT TracedWslApi::WslLaunch(PCWSTR command, BOOL useCurrentWorkingDirectory, HANDLE stdIn,
+                                HANDLE stdOut, HANDLE stdErr, HANDLE* process) {
+  Span span{"WslLaunch", "wslapi"};
+  span.arg("command", std::wstring_view{command});
+  auto hr = api_.WslLaunch(command, useCurrentWorkingDirectory, stdIn, stdOut, stdErr, process);
+  span.arg("hr", hresult(hr));
+  return hr;
+}
+
+std::filesystem::path TracedWslApi::DistributionRootPath() const {
+  return api_.DistributionRootPath();
+}
+
+}  // namespace Ubuntu::Trace
@@ -0,0 +1,81 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+// Opt-in, low overhead timing of the launcher phases, written out in the Chrome trace-event JSON
+// format, which can be loaded in chrome://tracing or https://ui.perfetto.dev.
+//
+// Tracing is enabled either by the `install --trace <file>` option or by setting the environment
+// variable named by Ubuntu::Trace::EnvironmentVariable to the output file path.
+namespace Ubuntu::Trace {
+inline constexpr wchar_t EnvironmentVariable[] = L"UBUNTU_LAUNCHER_TRACE";
+
+// Records events while it exists and writes them to the output file when destroyed.
+// Only one session is expected per process.
+class Session {
+ public:
+  explicit Session(std::filesystem::path output);
+  ~Session();
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+ private:
+  std::filesystem::path output_;
+};
+
+// Whether a session is currently recording.
+bool enabled();
+
+// Measures the time between its construction and destruction as a complete event.
+// Costs nothing more than a flag check when tracing is disabled.
+class Span {
+ public:
+  Span(std::string_view name, std::string_view category);
+  ~Span();
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+  // Attaches a string argument to the event, shown in the trace viewer details pane.
+  Span& arg(std::string_view key, std::string_view value);
+  Span& arg(std::string_view key, std::wstring_view value);
+
+ private:
+  bool enabled_;
+  std::string name_;
+  std::string category_;
+  std::string args_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// A WSL API backend recording a span for each call forwarded to the wrapped one.
+class TracedWslApi : public WslApiBackend {
+ public:
+  explicit TracedWslApi(WslApiBackend& api) : api_{api} {}
+
+  BOOL WslIsOptionalComponentInstalled() override;
+
+  BOOL WslIsDistributionRegistered() override;
+
+  HRESULT WslRegisterDistribution(PCWSTR tarGzFilename) override;
+
+  HRESULT WslConfigureDistribution(ULONG defaultUID,
+                                   WSL_DISTRIBUTION_FLAGS wslDistributionFlags) override;
+
+  HRESULT WslGetDistributionConfiguration(DistributionConfiguration& configuration) override;
+
+  HRESULT WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkingDirectory,
+                               DWORD* exitCode) override;
+
+  HRESULT WslLaunch(PCWSTR command, BOOL useCurrentWorkingDirectory, HANDLE stdIn, HANDLE stdOut,
+                    HANDLE stdErr, HANDLE* process) override;
+
+  std::filesystem::path DistributionRootPath() const override;
+
+ private:
+  WslApiBackend& api_;
+};
+}  // namespace Ubuntu::Trace
@@ -0,0 +1,216 @@
+#include <stdafx.h>
+#include "UserDbCache.h"
+#include "Utf8.h"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#ifndef _WIN32
+#include <cstdlib>
+
+#include <sys/stat.h>
+#endif
+
+namespace Ubuntu {
+
+namespace {
+// Bumped whenever the snapshot layout changes, so older snapshots are ignored.
+constexpr char Magic[4] = {'U', 'D', 'B', '2'};
+
+std::filesystem::path localAppData() {
+#ifdef _WIN32
+  // Packaged apps get this redirected to their private package data.
+  wchar_t buffer[MAX_PATH];
+  DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", buffer, MAX_PATH);
+  if ((length == 0) || (length >= MAX_PATH)) {
+    return {};
+  }
+  return buffer;
+#else
+  if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+    return cache;
+  }
+  if (const char* home = std::getenv("HOME"); home && *home) {
+    return std::filesystem::path{home} / ".cache";
+  }
+  return {};
+#endif
+}
+
+template <typename T>
+void appendValue(std::string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool consumeValue(std::string_view& data, T& value) {
+  if (data.size() < sizeof(value)) {
+    return false;
+  }
+  std::memcpy(&value, data.data(), sizeof(value));
+  data.remove_prefix(sizeof(value));
+  return true;
+}
+
+// Times are printed as `stat -c %.9Y` does: seconds, then nanoseconds on 9 digits.
+std::string formatTime(std::int64_t nanoseconds) {
+  std::string fraction = std::to_string(nanoseconds % 1'000'000'000);
+  return std::to_string(nanoseconds / 1'000'000'000) + '.' +
+         std::string(9 - fraction.size(), '0') + fraction;
+}
+
+// Reads a time as formatTime prints it from [first], moving it past its end.
+bool parseTime(const char*& first, const char* last, std::int64_t& nanoseconds) {
+  std::int64_t seconds = 0;
+  auto [secondsEnd, secondsError] = std::from_chars(first, last, seconds);
+  if (secondsError != std::errc{} || seconds < 0 || last - secondsEnd < 10 || *secondsEnd != '.') {
+    return false;
+  }
+  std::int64_t fraction = 0;
+  auto [fractionEnd, fractionError] = std::from_chars(secondsEnd + 1, secondsEnd + 10, fraction);
+  if (fractionError != std::errc{} || fractionEnd != secondsEnd + 10) {
+    return false;
+  }
+  nanoseconds = seconds * 1'000'000'000 + fraction;
+  first = fractionEnd;
+  return true;
+}
+}  // namespace
+
+std::string PasswdStamp::str() const {
+  return std::to_string(size) + ' ' + formatTime(mtime) + ' ' + formatTime(ctime);
+}
+
+std::optional<PasswdStamp> PasswdStamp::parse(std::string_view str) {
+  while (!str.empty() && (str.back() == '\n' || str.back() == '\r')) {
+    str.remove_suffix(1);
+  }
+  PasswdStamp stamp;
+  const char* first = str.data();
+  const char* last = str.data() + str.size();
+  auto [sizeEnd, sizeError] = std::from_chars(first, last, stamp.size);
+  if (sizeError != std::errc{} || sizeEnd == last || *sizeEnd != ' ') {
+    return std::nullopt;
+  }
+  first = sizeEnd + 1;
+  if (!parseTime(first, last, stamp.mtime) || first == last || *first != ' ') {
+    return std::nullopt;
+  }
+  ++first;
+  if (!parseTime(first, last, stamp.ctime) || first != last) {
+    return std::nullopt;
+  }
+  return stamp;
+}
+
+UserDbCache::UserDbCache(const std::filesystem::path& directory, std::wstring_view distroName) :
+    file_{directory.empty() ? std::filesystem::path{} : directory / distroName / L"users.db"} {}
+
+UserDbCache UserDbCache::forDistro(std::wstring_view distroName) {
+  return UserDbCache{localAppData(), distroName};
+}
+
+std::optional<PasswdStamp> UserDbCache::currentStamp(const WslApiBackend& api) {
+  const auto passwd = api.DistributionRootPath() / L"etc" / L"passwd";
+#ifdef _WIN32
+  // Unlike GetFileAttributesExW, this reports the change time.
+  HANDLE file = CreateFileW(passwd.c_str(), FILE_READ_ATTRIBUTES,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return std::nullopt;
+  }
+  FILE_BASIC_INFO basic;
+  FILE_STANDARD_INFO standard;
+  const bool read =
+      GetFileInformationByHandleEx(file, FileBasicInfo, &basic, sizeof(basic)) != FALSE &&
+      GetFileInformationByHandleEx(file, FileStandardInfo, &standard, sizeof(standard)) != FALSE;
+  CloseHandle(file);
+  if (!read) {
+    return std::nullopt;
+  }
+  // FILETIMEs count 100ns intervals since 1601-01-01.
+  constexpr std::int64_t unixEpoch = 116444736000000000LL;
+  PasswdStamp stamp;
+  stamp.size = static_cast<std::uint64_t>(standard.EndOfFile.QuadPart);
+  stamp.mtime = (basic.LastWriteTime.QuadPart - unixEpoch) * 100;
+  stamp.ctime = (basic.ChangeTime.QuadPart - unixEpoch) * 100;
+  return stamp;
+#else
+  struct stat attributes;
+  if (stat(passwd.c_str(), &attributes) != 0) {
+    return std::nullopt;
+  }
+  auto nanoseconds = [](const timespec& time) {
+    return std::int64_t{time.tv_sec} * 1'000'000'000 + time.tv_nsec;
+  };
+  return PasswdStamp{static_cast<std::uint64_t>(attributes.st_size),
+                     nanoseconds(attributes.st_mtim), nanoseconds(attributes.st_ctim)};
+#endif
+}
+
+std::optional<UserDbCache::Snapshot> UserDbCache::load() const {
+  Trace::Span span{"UserDbCache::load", "init"};
+  if (file_.empty()) {
+    return std::nullopt;
+  }
+  std::ifstream file{file_, std::ios::binary};
+  if (!file) {
+    return std::nullopt;
+  }
+  const std::string contents{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+
+  std::string_view data{contents};
+  if (data.substr(0, sizeof(Magic)) != std::string_view{Magic, sizeof(Magic)}) {
+    return std::nullopt;
+  }
+  data.remove_prefix(sizeof(Magic));
+
+  PasswdStamp stamp;
+  if (!consumeValue(data, stamp.size) || !consumeValue(data, stamp.mtime) ||
+      !consumeValue(data, stamp.ctime)) {
+    return std::nullopt;
+  }
+  auto users = UserTable::deserialize(data);
+  if (!users) {
+    return std::nullopt;
+  }
+  return Snapshot{stamp, std::move(*users)};
+}
+
+void UserDbCache::store(const PasswdStamp& stamp, const UserTable& users) const {
+  Trace::Span span{"UserDbCache::store", "init"};
+  if (file_.empty()) {
+    return;
+  }
+  std::string contents{Magic, sizeof(Magic)};
+  appendValue(contents, stamp.size);
+  appendValue(contents, stamp.mtime);
+  appendValue(contents, stamp.ctime);
+  users.serialize(contents);
+
+  // Write to a temporary file first, so a concurrent launcher never reads half a snapshot.
+  std::error_code error;
+  std::filesystem::create_directories(file_.parent_path(), error);
+  auto temporary = file_;
+  temporary += L".tmp";
+  {
+    std::ofstream file{temporary, std::ios::binary | std::ios::trunc};
+    if (!file.write(contents.data(), static_cast<std::streamsize>(contents.size()))) {
+      return;
+    }
+  }
+  std::filesystem::rename(temporary, file_, error);
+}
+
+std::optional<std::uint32_t> UserDbCache::uidOf(const UserTable& users, std::wstring_view userName) {
+  if (auto found = users.find(toUtf8(userName))) {
+    return users.uid(*found);
+  }
+  return std::nullopt;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "UserTable.h"
+
+namespace Ubuntu {
+// Identifies a version of the distro's /etc/passwd by its size, and the times it and its inode
+// were last changed. The change time catches a file replaced by another of the same size within
+// the same tick, as the tools editing the user database do.
+struct PasswdStamp {
+  std::uint64_t size = 0;
+  // Nanoseconds since the Unix epoch. Windows only reports them in 100 ns units, which is the
+  // precision they are compared at.
+  std::int64_t mtime = 0;
+  std::int64_t ctime = 0;
+
+  // Formats the stamp as PasswdStampCommand prints it.
+  std::string str() const;
+  // Parses the output of PasswdStampCommand.
+  static std::optional<PasswdStamp> parse(std::string_view str);
+
+  friend bool operator==(const PasswdStamp& a, const PasswdStamp& b) {
+    return a.size == b.size && a.mtime / 100 == b.mtime / 100 && a.ctime / 100 == b.ctime / 100;
+  }
+  friend bool operator!=(const PasswdStamp& a, const PasswdStamp& b) { return !(a == b); }
+};
+
+// Prints the stamp of /etc/passwd, as PasswdStamp::parse reads it.
+inline constexpr std::wstring_view PasswdStampCommand = L"stat -c '%s %.9Y %.9Z' /etc/passwd";
+
+// Persists a snapshot of a distro's user table in the launcher's local application data, so users
+// can be looked up without launching Linux processes while /etc/passwd stays the same.
+//
+// Snapshots are only as fresh as /etc/passwd: users coming from other NSS sources (LDAP, SSSD...)
+// may be missing from them, thus a user not found in a snapshot is not proof it doesn't exist.
+class UserDbCache {
+ public:
+  struct Snapshot {
+    PasswdStamp stamp;
+    UserTable users;
+  };
+
+  // Stores the snapshot of [distroName] under [directory]. Nothing is stored if [directory] is empty.
+  UserDbCache(const std::filesystem::path& directory, std::wstring_view distroName);
+
+  // The cache of [distroName] in the local application data, which is private to the package.
+  static UserDbCache forDistro(std::wstring_view distroName);
+
+  // Reads the stamp of /etc/passwd through the distro file system, without launching processes.
+  static std::optional<PasswdStamp> currentStamp(const WslApiBackend& api);
+
+  // Loads the snapshot, if any. A corrupted snapshot is reported as missing.
+  std::optional<Snapshot> load() const;
+
+  // Replaces the snapshot. Failing to store it is not an error, the cache is just an optimization.
+  void store(const PasswdStamp& stamp, const UserTable& users) const;
+
+  // Finds the UID of [userName] in [users].
+  static std::optional<std::uint32_t> uidOf(const UserTable& users, std::wstring_view userName);
+
+ private:
+  std::filesystem::path file_;
+};
+}  // namespace Ubuntu
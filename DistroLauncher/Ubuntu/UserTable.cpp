@@ -0,0 +1,172 @@
+#include <stdafx.h>
+#include "UserTable.h"
+#include "PasswdScanner.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace Ubuntu {
+
+namespace {
+// Sorts the permutation [order] of [keys] with an LSD radix sort, one byte per pass. Passes in
+// which all keys share the same byte are skipped, which is common for the upper bytes of UIDs.
+void radixSort(const std::vector<std::uint32_t>& keys, std::vector<std::uint32_t>& order) {
+  std::vector<std::uint32_t> scratch(order.size());
+  for (unsigned shift = 0; shift < 32; shift += 8) {
+    std::array<std::size_t, 256> counts{};
+    for (auto i : order) {
+      ++counts[(keys[i] >> shift) & 0xFF];
+    }
+    if (std::find(counts.begin(), counts.end(), order.size()) != counts.end()) {
+      continue;
+    }
+
+    std::size_t offset = 0;
+    for (auto& count : counts) {
+      offset += count;
+      count = offset - count;
+    }
+    for (auto i : order) {
+      scratch[counts[(keys[i] >> shift) & 0xFF]++] = i;
+    }
+    order.swap(scratch);
+  }
+}
+
+template <typename T>
+void append(std::string& out, const std::vector<T>& values) {
+  out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+// Reads [count] values from the front of [data], advancing it.
+template <typename T>
+bool consume(std::string_view& data, std::vector<T>& values, std::size_t count) {
+  if (data.size() / sizeof(T) < count) {
+    return false;
+  }
+  values.resize(count);
+  std::memcpy(values.data(), data.data(), count * sizeof(T));
+  data.remove_prefix(count * sizeof(T));
+  return true;
+}
+
+template <typename T>
+void permute(std::vector<T>& values, const std::vector<std::uint32_t>& order) {
+  std::vector<T> sorted;
+  sorted.reserve(values.size());
+  for (auto i : order) {
+    sorted.push_back(values[i]);
+  }
+  values.swap(sorted);
+}
+}  // namespace
+
+UserTable::UserTable(std::string_view passwd) {
+  // One entry per line at most.
+  const auto lines = static_cast<std::size_t>(std::count(passwd.begin(), passwd.end(), '\n')) + 1;
+  nameOffsets_.reserve(lines);
+  nameSizes_.reserve(lines);
+  uids_.reserve(lines);
+  hasLogin_.reserve(lines);
+
+  // NOTE about ill-formed lines in passwd: this algorithm just skips them.
+  // Broken lines in /etc/passwd won't prevent the effects of the good lines.
+  // getent itself reports errors for broken lines but still output the good ones.
+  // The system behaves as if they don't exist. So we can ignore them as well.
+  // Name offsets are relative to [passwd] until the names are packed.
+  std::size_t namesSize = 0;
+  PasswdScanner scanner{passwd};
+  PasswdScanner::Line line;
+  while (scanner.next(line)) {
+    if (auto entry = parsePasswdEntry(line)) {
+      nameOffsets_.push_back(static_cast<std::uint32_t>(entry->name.data() - passwd.data()));
+      nameSizes_.push_back(static_cast<std::uint32_t>(entry->name.size()));
+      uids_.push_back(entry->uid);
+      hasLogin_.push_back(entry->hasLogin);
+      namesSize += entry->name.size();
+    }
+  }
+
+  sortByUid();
+
+  names_.reserve(namesSize);
+  for (Index i = 0; i < size(); ++i) {
+    const std::size_t offset = names_.size();
+    names_.append(passwd, nameOffsets_[i], nameSizes_[i]);
+    nameOffsets_[i] = static_cast<std::uint32_t>(offset);
+  }
+}
+
+void UserTable::sortByUid() {
+  if (std::is_sorted(uids_.begin(), uids_.end())) {
+    return;
+  }
+
+  std::vector<std::uint32_t> order(uids_.size());
+  for (std::uint32_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  radixSort(uids_, order);
+
+  permute(nameOffsets_, order);
+  permute(nameSizes_, order);
+  permute(uids_, order);
+  permute(hasLogin_, order);
+}
+
+// Layout: the user count, then the UIDs, login flags and name sizes arrays, then all names
+// concatenated. Integers are in the native byte order, snapshots never leave the machine.
+void UserTable::serialize(std::string& out) const {
+  const auto count = static_cast<std::uint32_t>(size());
+  out.append(reinterpret_cast<const char*>(&count), sizeof(count));
+  append(out, uids_);
+  append(out, hasLogin_);
+  append(out, nameSizes_);
+  for (Index i = 0; i < size(); ++i) {
+    out += name(i);
+  }
+}
+
+std::optional<UserTable> UserTable::deserialize(std::string_view data) {
+  std::vector<std::uint32_t> count;
+  UserTable table;
+  if (!consume(data, count, 1) || !consume(data, table.uids_, count[0]) ||
+      !consume(data, table.hasLogin_, count[0]) || !consume(data, table.nameSizes_, count[0])) {
+    return std::nullopt;
+  }
+
+  table.nameOffsets_.reserve(count[0]);
+  std::size_t offset = 0;
+  for (auto nameSize : table.nameSizes_) {
+    table.nameOffsets_.push_back(static_cast<std::uint32_t>(offset));
+    offset += nameSize;
+  }
+  if (offset != data.size() || !std::is_sorted(table.uids_.begin(), table.uids_.end())) {
+    return std::nullopt;
+  }
+  table.names_ = data;
+  return table;
+}
+
+std::optional<UserTable::Index> UserTable::find(std::string_view name) const {
+  // Only names of the right size are compared.
+  for (Index i = 0; i < size(); ++i) {
+    if (nameSizes_[i] == name.size() &&
+        std::memcmp(names_.data() + nameOffsets_[i], name.data(), name.size()) == 0) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<UserTable::Index> UserTable::firstLoginUser(std::uint32_t minUid) const {
+  for (auto it = std::lower_bound(uids_.begin(), uids_.end(), minUid); it != uids_.end(); ++it) {
+    if (Index i = it - uids_.begin(); hasLogin(i)) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ubuntu {
+// The users of a passwd database we care about, sorted by UID.
+//
+// Entries are stored as a struct of arrays. Names are packed into a single buffer in table order,
+// so building the table doesn't allocate once per user, looking a name up scans memory sequentially
+// and moving the table around is cheap.
+class UserTable {
+ public:
+  using Index = std::size_t;
+
+  UserTable() = default;
+
+  // Parses the contents of a passwd database, as output by getent. Ill-formed lines are skipped.
+  explicit UserTable(std::string_view passwd);
+
+  std::size_t size() const { return uids_.size(); }
+  bool empty() const { return uids_.empty(); }
+
+  std::string_view name(Index i) const {
+    return std::string_view{names_}.substr(nameOffsets_[i], nameSizes_[i]);
+  }
+  std::uint32_t uid(Index i) const { return uids_[i]; }
+  // Whether the login shell of the user allows logging in.
+  bool hasLogin(Index i) const { return hasLogin_[i] != 0; }
+
+  // Returns the user named [name], if any.
+  std::optional<Index> find(std::string_view name) const;
+
+  // Returns the user with the lowest UID greater than or equal to [minUid] allowed to log in.
+  std::optional<Index> firstLoginUser(std::uint32_t minUid) const;
+
+  // Appends a compact binary representation of the table to [out].
+  void serialize(std::string& out) const;
+
+  // Restores a table written by serialize(), or std::nullopt if [data] is not one.
+  static std::optional<UserTable> deserialize(std::string_view data);
+
+ private:
+  // Sorts all arrays by UID, preserving the database order of users sharing a UID.
+  void sortByUid();
+
+  // The names, concatenated.
+  std::string names_;
+  std::vector<std::uint32_t> nameOffsets_;
+  std::vector<std::uint32_t> nameSizes_;
+  std::vector<std::uint32_t> uids_;
+  std::vector<std::uint8_t> hasLogin_;
+};
+}  // namespace Ubuntu
@@ -0,0 +1,271 @@
+#include <stdafx.h>
+#include "Utf8.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define UTF8_SSE2
+#endif
+
+namespace Ubuntu {
+namespace {
+constexpr bool WideIsUtf16 = sizeof(wchar_t) == 2;
+constexpr char32_t Replacement = 0xFFFD;
+
+// Widens the ASCII characters [in] starts with into [out]. Returns how many there were.
+std::size_t widenAscii(const char* in, std::size_t size, wchar_t* out) {
+  std::size_t i = 0;
+#ifdef UTF8_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= size; i += 16) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    if (_mm_movemask_epi8(bytes) != 0) {
+      break;
+    }
+    const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+    auto* dest = reinterpret_cast<__m128i*>(out + i);
+    if constexpr (WideIsUtf16) {
+      _mm_storeu_si128(dest, low);
+      _mm_storeu_si128(dest + 1, high);
+    } else {
+      _mm_storeu_si128(dest, _mm_unpacklo_epi16(low, zero));
+      _mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(low, zero));
+      _mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(high, zero));
+      _mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(high, zero));
+    }
+  }
+#else
+  // Checks 8 bytes at a time otherwise.
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, in + i, sizeof(word));
+    if ((word & 0x8080808080808080) != 0) {
+      break;
+    }
+    for (std::size_t j = i; j < i + 8; ++j) {
+      out[j] = static_cast<wchar_t>(in[j]);
+    }
+  }
+#endif
+  for (; i < size && static_cast<unsigned char>(in[i]) < 0x80; ++i) {
+    out[i] = static_cast<wchar_t>(in[i]);
+  }
+  return i;
+}
+
+// Narrows the ASCII characters [in] starts with into [out]. Returns how many there were.
+std::size_t narrowAscii(const wchar_t* in, std::size_t size, char* out) {
+  std::size_t i = 0;
+#ifdef UTF8_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= size; i += 16) {
+    const auto* src = reinterpret_cast<const __m128i*>(in + i);
+    __m128i packed;
+    if constexpr (WideIsUtf16) {
+      const __m128i a = _mm_loadu_si128(src);
+      const __m128i b = _mm_loadu_si128(src + 1);
+      const __m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16(-0x80));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF) {
+        break;
+      }
+      packed = _mm_packus_epi16(a, b);
+    } else {
+      const __m128i a = _mm_loadu_si128(src);
+      const __m128i b = _mm_loadu_si128(src + 1);
+      const __m128i c = _mm_loadu_si128(src + 2);
+      const __m128i d = _mm_loadu_si128(src + 3);
+      const __m128i all = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+      const __m128i high = _mm_and_si128(all, _mm_set1_epi32(-0x80));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, zero)) != 0xFFFF) {
+        break;
+      }
+      packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+  }
+#endif
+  for (; i < size && static_cast<std::uint32_t>(in[i]) < 0x80; ++i) {
+    out[i] = static_cast<char>(in[i]);
+  }
+  return i;
+}
+
+// A sequence decoded from UTF-8.
+struct Decoded {
+  char32_t codePoint;
+  // The length of the sequence, or of its maximal ill-formed subpart if invalid.
+  std::size_t length;
+  bool valid;
+};
+
+// Decodes the sequence [in] starts with, whose first byte isn't ASCII. The ranges of valid bytes
+// are the ones of table 3-7 of the Unicode standard.
+Decoded decode(const unsigned char* in, std::size_t size) {
+  const unsigned char lead = in[0];
+  std::size_t length;
+  char32_t codePoint;
+  unsigned char low = 0x80;
+  unsigned char high = 0xBF;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+    codePoint = lead & 0x1F;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    codePoint = lead & 0x0F;
+    if (lead == 0xE0) {
+      low = 0xA0;  // Overlong.
+    } else if (lead == 0xED) {
+      high = 0x9F;  // Surrogates.
+    }
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    codePoint = lead & 0x07;
+    if (lead == 0xF0) {
+      low = 0x90;  // Overlong.
+    } else if (lead == 0xF4) {
+      high = 0x8F;  // Above U+10FFFF.
+    }
+  } else {
+    return {Replacement, 1, false};
+  }
+
+  for (std::size_t i = 1; i < length; ++i) {
+    if (i == size || in[i] < low || in[i] > high) {
+      return {Replacement, i, false};
+    }
+    codePoint = (codePoint << 6) | (in[i] & 0x3F);
+    low = 0x80;
+    high = 0xBF;
+  }
+  return {codePoint, length, true};
+}
+
+// Writes [codePoint] to [out], returning the number of wide characters written.
+std::size_t putWide(wchar_t* out, char32_t codePoint) {
+  if (WideIsUtf16 && codePoint >= 0x10000) {
+    codePoint -= 0x10000;
+    out[0] = static_cast<wchar_t>(0xD800 + (codePoint >> 10));
+    out[1] = static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FF));
+    return 2;
+  }
+  out[0] = static_cast<wchar_t>(codePoint);
+  return 1;
+}
+
+// Writes [codePoint] to [out] as UTF-8, returning the number of bytes written.
+std::size_t putUtf8(char* out, char32_t codePoint) {
+  if (codePoint < 0x80) {
+    out[0] = static_cast<char>(codePoint);
+    return 1;
+  }
+  if (codePoint < 0x800) {
+    out[0] = static_cast<char>(0xC0 | (codePoint >> 6));
+    out[1] = static_cast<char>(0x80 | (codePoint & 0x3F));
+    return 2;
+  }
+  if (codePoint < 0x10000) {
+    out[0] = static_cast<char>(0xE0 | (codePoint >> 12));
+    out[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xF0 | (codePoint >> 18));
+  out[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+  out[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+  out[3] = static_cast<char>(0x80 | (codePoint & 0x3F));
+  return 4;
+}
+
+bool decodeInto(std::wstring& out, std::string_view utf8, bool strict) {
+  // Every byte makes at most one wide character: a 4-byte sequence makes a surrogate pair.
+  const std::size_t start = out.size();
+  out.resize(start + utf8.size());
+  wchar_t* dest = out.data() + start;
+  const auto* in = reinterpret_cast<const unsigned char*>(utf8.data());
+  const std::size_t size = utf8.size();
+
+  std::size_t read = 0;
+  std::size_t written = 0;
+  while (read < size) {
+    const std::size_t ascii = widenAscii(utf8.data() + read, size - read, dest + written);
+    read += ascii;
+    written += ascii;
+    if (read == size) {
+      break;
+    }
+    const Decoded decoded = decode(in + read, size - read);
+    if (!decoded.valid && strict) {
+      out.resize(start);
+      return false;
+    }
+    written += putWide(dest + written, decoded.codePoint);
+    read += decoded.length;
+  }
+  out.resize(start + written);
+  return true;
+}
+}  // namespace
+
+void appendWide(std::wstring& out, std::string_view utf8) {
+  decodeInto(out, utf8, false);
+}
+
+bool appendWideStrict(std::wstring& out, std::string_view utf8) {
+  return decodeInto(out, utf8, true);
+}
+
+void appendUtf8(std::string& out, std::wstring_view wide) {
+  // A UTF-16 character makes at most 3 bytes, a surrogate pair 4. A UTF-32 one makes at most 4.
+  const std::size_t start = out.size();
+  out.resize(start + wide.size() * (WideIsUtf16 ? 3 : 4));
+  char* dest = out.data() + start;
+  const std::size_t size = wide.size();
+
+  std::size_t read = 0;
+  std::size_t written = 0;
+  while (read < size) {
+    const std::size_t ascii = narrowAscii(wide.data() + read, size - read, dest + written);
+    read += ascii;
+    written += ascii;
+    if (read == size) {
+      break;
+    }
+    char32_t codePoint = static_cast<std::uint32_t>(wide[read++]);
+    if constexpr (WideIsUtf16) {
+      codePoint &= 0xFFFF;
+      if (codePoint >= 0xD800 && codePoint <= 0xDBFF && read < size &&
+          (wide[read] & 0xFC00) == 0xDC00) {
+        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (wide[read++] - 0xDC00);
+      }
+    }
+    if ((codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF) {
+      codePoint = Replacement;
+    }
+    written += putUtf8(dest + written, codePoint);
+  }
+  out.resize(start + written);
+}
+
+std::wstring toWide(std::string_view utf8) {
+  std::wstring wide;
+  appendWide(wide, utf8);
+  return wide;
+}
+
+std::optional<std::wstring> toWideStrict(std::string_view utf8) {
+  std::wstring wide;
+  if (!appendWideStrict(wide, utf8)) {
+    return std::nullopt;
+  }
+  return wide;
+}
+
+std::string toUtf8(std::wstring_view wide) {
+  std::string utf8;
+  appendUtf8(utf8, wide);
+  return utf8;
+}
+}  // namespace Ubuntu
@@ -0,0 +1,30 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace Ubuntu {
+// Conversions between UTF-8, spoken by the distro, and wide strings, spoken by Windows: UTF-16 on
+// Windows, UTF-32 on POSIX hosts where wchar_t is 32-bit. The code page of the thread plays no
+// part. ASCII, which makes up nearly all of the text crossing the boundary (user names, commands,
+// paths, probe output), is converted 16 characters at a time where SSE2 is available.
+//
+// The append functions write after the current contents of [out], so that a buffer can be reused
+// across conversions without allocating again.
+
+// Appends [utf8] to [out]. Invalid sequences are replaced with U+FFFD, as the Unicode standard
+// recommends: one per maximal ill-formed subpart.
+void appendWide(std::wstring& out, std::string_view utf8);
+
+// Appends [utf8] to [out] and returns true, or returns false leaving [out] as it was if [utf8]
+// isn't valid UTF-8: overlong forms, surrogates and code points above U+10FFFF are all rejected.
+bool appendWideStrict(std::wstring& out, std::string_view utf8);
+
+// Appends [wide] to [out] as UTF-8. Unpaired surrogates are replaced with U+FFFD.
+void appendUtf8(std::string& out, std::wstring_view wide);
+
+// The returning forms of the above.
+std::wstring toWide(std::string_view utf8);
+std::optional<std::wstring> toWideStrict(std::string_view utf8);
+std::string toUtf8(std::wstring_view wide);
+}  // namespace Ubuntu
@@ -0,0 +1,47 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace Ubuntu {
+// What WslGetDistributionConfiguration reports, with the environment strings already copied out of
+// the COM-allocated memory the API hands out.
+struct DistributionConfiguration {
+  ULONG version = 0;
+  ULONG defaultUid = 0;
+  WSL_DISTRIBUTION_FLAGS flags = WSL_DISTRIBUTION_FLAGS_NONE;
+  std::vector<std::string> defaultEnvironment;
+};
+
+// The WSL API entry points the launcher depends on. The production implementation is the
+// WslApiLoader, which resolves them from wslapi.dll. Abstracting them allows running the launcher
+// core against other backends, such as the FakeWslApi used to profile install latency on Linux.
+class WslApiBackend {
+ public:
+  virtual ~WslApiBackend() = default;
+
+  virtual BOOL WslIsOptionalComponentInstalled() = 0;
+
+  virtual BOOL WslIsDistributionRegistered() = 0;
+
+  // [tarGzFilename] is either a gzip compressed or an uncompressed tar, relative paths being
+  // relative to the launcher executable.
+  virtual HRESULT WslRegisterDistribution(PCWSTR tarGzFilename) = 0;
+
+  virtual HRESULT WslConfigureDistribution(ULONG defaultUID,
+                                           WSL_DISTRIBUTION_FLAGS wslDistributionFlags) = 0;
+
+  // Reads the distribution configuration stored in the registry, without launching any Linux process.
+  virtual HRESULT WslGetDistributionConfiguration(DistributionConfiguration& configuration) = 0;
+
+  virtual HRESULT WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkingDirectory,
+                                       DWORD* exitCode) = 0;
+
+  virtual HRESULT WslLaunch(PCWSTR command, BOOL useCurrentWorkingDirectory, HANDLE stdIn,
+                            HANDLE stdOut, HANDLE stdErr, HANDLE* process) = 0;
+
+  // Where the distribution's root filesystem can be reached from the host, without launching any
+  // Linux process, e.g. \\wsl.localhost\<DistributionName>.
+  virtual std::filesystem::path DistributionRootPath() const = 0;
+};
+}  // namespace Ubuntu
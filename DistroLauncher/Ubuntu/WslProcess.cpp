@@ -0,0 +1,35 @@
+#include <stdafx.h>
+#include "WslProcess.h"
+
+#include <utility>
+
+namespace Ubuntu {
+
+WslProcess::Result WslProcess::run(WslApiBackend& api, DWORD timeout, const OutputHandler& onOutput) {
+  WslProcessPool::Request request;
+  request.command = command_;
+  request.input = input_;
+  // The handler is only called while we wait for the result below.
+  if (onOutput) {
+    request.onOutput = [&onOutput](std::string_view chunk) { onOutput(chunk); };
+  }
+  request.timeout = timeout;
+  request.maxOutputSize = maxOutputSize_;
+
+  auto result = WslProcessPool::shared().launch(api, std::move(request)).get();
+  if (!result.error.empty()) {
+    return {std::move(result.error), result.exitCode};
+  }
+
+  if (result.exitCode != 0) {
+    return {L"exited with error", result.exitCode};
+  }
+
+  if (result.outputSize == 0) {
+    return {L"could not read the process output", 0};
+  }
+
+  return {{}, 0, std::move(result.stdOut)};
+}
+
+}  // namespace Ubuntu
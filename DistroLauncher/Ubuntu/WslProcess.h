@@ -0,0 +1,46 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "ProcessPool.h"
+
+namespace Ubuntu {
+// A non-interactive WSL process, run synchronously on the launcher's WslProcessPool.
+//
+// The output pipe is drained while the process runs, so the process never blocks on a full pipe no
+// matter how much it writes. Likewise, input given to the process is written while its output is
+// read, so that neither side waits for the other.
+class WslProcess {
+ public:
+  // Receives the output of the process as it is read, in chunks of arbitrary size.
+  using OutputHandler = WslProcessPool::OutputHandler;
+
+  static constexpr std::size_t DefaultMaxOutputSize = WslProcessPool::DefaultMaxOutputSize;
+
+ private:
+  std::wstring command_;
+  std::size_t maxOutputSize_;
+  std::optional<std::string> input_;
+
+ public:
+  struct Result {
+    std::wstring error;
+    std::size_t exitCode = static_cast<std::size_t>(-1);
+    std::string stdOut;
+  };
+
+  // Runs the process via WSL api and wait for timeout milliseconds.
+  // If [onOutput] is provided the output is handed to it as it arrives, before the process exits,
+  // and is not retained in the result. Otherwise the whole output is returned in Result::stdOut.
+  // Either way, the process fails if it writes more than the maximum output size.
+  Result run(WslApiBackend& api, DWORD timeout, const OutputHandler& onOutput = {});
+
+  // Makes the process read [input] from its standard input instead of the console, which keeps the
+  // data out of the command line, where any process could read it.
+  void setInput(std::string input) { input_ = std::move(input); }
+
+  explicit WslProcess(std::wstring command_, std::size_t maxOutputSize = DefaultMaxOutputSize) :
+      command_{command_}, maxOutputSize_{maxOutputSize} {};
+};
+}  // namespace Ubuntu
@@ -0,0 +1,816 @@
+#include <stdafx.h>
+#include "Zstd.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+
+namespace Ubuntu {
+
+namespace {
+constexpr std::uint32_t FrameMagic = 0xFD2FB528;
+constexpr std::uint32_t SkippableMagic = 0x184D2A50;
+constexpr std::uint32_t SkippableMagicMask = 0xFFFFFFF0;
+// The seekable format uses this particular skippable frame for its seek table.
+constexpr std::uint32_t SeekTableFrameMagic = 0x184D2A5E;
+constexpr std::uint32_t SeekableMagic = 0x8F92EAB1;
+
+constexpr std::size_t MaxBlockSize = 128 * 1024;
+
+// Decoding bails out on the first inconsistency by throwing this, which never escapes this file:
+// the checks are too many and too deep for status codes to keep the decoder readable.
+struct Corrupt {};
+
+void check(bool condition) {
+  if (!condition) {
+    throw Corrupt{};
+  }
+}
+
+// The index of the highest bit set, or -1 if none.
+int highestBit(std::uint64_t value) {
+  int bit = -1;
+  while (value != 0) {
+    value >>= 1;
+    ++bit;
+  }
+  return bit;
+}
+
+std::uint64_t loadLittleEndian(const unsigned char* p, std::size_t size) {
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    value |= std::uint64_t{p[i]} << (8 * i);
+  }
+  return value;
+}
+
+std::uint64_t load64(const unsigned char* p) {
+  std::uint64_t value;
+  std::memcpy(&value, p, sizeof(value));  // Windows only runs on little-endian machines.
+  return value;
+}
+
+std::uint32_t load32(const unsigned char* p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// Reads whole bytes, front to back.
+class ByteReader {
+ public:
+  ByteReader(const unsigned char* data, std::size_t size) : next_{data}, end_{data + size} {}
+
+  std::size_t remaining() const { return static_cast<std::size_t>(end_ - next_); }
+  const unsigned char* data() const { return next_; }
+
+  const unsigned char* take(std::size_t size) {
+    check(size <= remaining());
+    const auto* taken = next_;
+    next_ += size;
+    return taken;
+  }
+
+  unsigned byte() { return *take(1); }
+
+  std::uint64_t littleEndian(std::size_t size) { return loadLittleEndian(take(size), size); }
+
+ private:
+  const unsigned char* next_;
+  const unsigned char* end_;
+};
+
+// Reads the bits of table descriptions, least significant first. Those are only a few bytes long.
+class ForwardBits {
+ public:
+  ForwardBits(const unsigned char* data, std::size_t size) : data_{data}, size_{size} {}
+
+  std::uint32_t read(unsigned count) {
+    check(position_ + count <= size_ * 8);
+    std::uint32_t value = 0;
+    for (unsigned i = 0; i < count; ++i, ++position_) {
+      value |= std::uint32_t{(data_[position_ / 8] >> (position_ % 8)) & 1u} << i;
+    }
+    return value;
+  }
+
+  void rewind(unsigned count) { position_ -= count; }
+
+  std::size_t bytesConsumed() const { return (position_ + 7) / 8; }
+
+ private:
+  const unsigned char* data_;
+  std::size_t size_;
+  std::size_t position_ = 0;
+};
+
+// Reads the entropy coded bit streams, which are written forwards and read backwards, starting
+// from the last bit set in their last byte. Reading past the beginning yields zeros, which is how
+// streams signal their end: position() tells how far past it the reader went.
+class BackwardBits {
+ public:
+  BackwardBits(const unsigned char* data, std::size_t size) : data_{data}, size_{size} {
+    check(size > 0 && data[size - 1] != 0);
+    position_ = static_cast<std::int64_t>(size * 8) - (8 - highestBit(data[size - 1]));
+  }
+
+  // Up to 56 bits at once.
+  std::uint64_t read(unsigned count) {
+    if (count == 0) {
+      return 0;
+    }
+    position_ -= count;
+    if (position_ >= 0) {
+      return (word(static_cast<std::size_t>(position_ / 8)) >> (position_ % 8)) & mask(count);
+    }
+    const std::int64_t missing = -position_;
+    if (missing >= count) {
+      return 0;
+    }
+    return (word(0) & mask(count - static_cast<unsigned>(missing))) << missing;
+  }
+
+  std::int64_t position() const { return position_; }
+
+ private:
+  static std::uint64_t mask(unsigned count) { return (std::uint64_t{1} << count) - 1; }
+
+  std::uint64_t word(std::size_t byte) const {
+    if (byte + 8 <= size_) {
+      return load64(data_ + byte);
+    }
+    return loadLittleEndian(data_ + byte, size_ - byte);
+  }
+
+  const unsigned char* data_;
+  std::size_t size_;
+  std::int64_t position_;
+};
+
+// A finite state entropy (tANS) decoding table.
+class Fse {
+ public:
+  static constexpr unsigned MaxAccuracyLog = 9;
+
+  // Builds the table from normalized counts, -1 standing for "less than one".
+  void build(const std::int16_t* counts, std::size_t symbolCount, unsigned accuracyLog) {
+    check(accuracyLog <= MaxAccuracyLog);
+    accuracyLog_ = accuracyLog;
+    const unsigned size = 1u << accuracyLog;
+    std::array<std::uint16_t, 256> next{};
+    unsigned highThreshold = size;
+    for (std::size_t s = 0; s < symbolCount; ++s) {
+      if (counts[s] == -1) {
+        check(highThreshold > 0);
+        symbols_[--highThreshold] = static_cast<std::uint8_t>(s);
+        next[s] = 1;
+      }
+    }
+
+    const unsigned step = (size >> 1) + (size >> 3) + 3;
+    const unsigned mask = size - 1;
+    unsigned position = 0;
+    for (std::size_t s = 0; s < symbolCount; ++s) {
+      if (counts[s] <= 0) {
+        continue;
+      }
+      next[s] = static_cast<std::uint16_t>(counts[s]);
+      for (int i = 0; i < counts[s]; ++i) {
+        symbols_[position] = static_cast<std::uint8_t>(s);
+        do {
+          position = (position + step) & mask;
+        } while (position >= highThreshold);
+      }
+    }
+    check(position == 0);
+
+    for (unsigned state = 0; state < size; ++state) {
+      const std::uint16_t nextState = next[symbols_[state]]++;
+      numBits_[state] = static_cast<std::uint8_t>(accuracyLog - highestBit(nextState));
+      base_[state] = static_cast<std::uint16_t>((nextState << numBits_[state]) - size);
+    }
+  }
+
+  // Reads a table description and builds the table from it.
+  void read(ForwardBits& in, unsigned maxAccuracyLog, std::size_t maxSymbols) {
+    const unsigned accuracyLog = in.read(4) + 5;
+    check(accuracyLog <= maxAccuracyLog);
+    std::array<std::int16_t, 256> counts{};
+    int remaining = 1 << accuracyLog;
+    std::size_t symbol = 0;
+    while (remaining > 0 && symbol < maxSymbols) {
+      const unsigned bits = static_cast<unsigned>(highestBit(remaining + 1) + 1);
+      std::uint32_t value = in.read(bits);
+      // Small values are written with one bit less.
+      const std::uint32_t lowerMask = (1u << (bits - 1)) - 1;
+      const std::uint32_t threshold = (1u << bits) - 1 - static_cast<std::uint32_t>(remaining + 1);
+      if ((value & lowerMask) < threshold) {
+        in.rewind(1);
+        value &= lowerMask;
+      } else if (value > lowerMask) {
+        value -= threshold;
+      }
+      const int count = static_cast<int>(value) - 1;
+      remaining -= count < 0 ? -count : count;
+      counts[symbol++] = static_cast<std::int16_t>(count);
+      if (count == 0) {
+        // Zero counts are followed by the number of symbols also having none.
+        for (;;) {
+          const unsigned repeat = in.read(2);
+          for (unsigned i = 0; i < repeat && symbol < maxSymbols; ++i) {
+            counts[symbol++] = 0;
+          }
+          if (repeat != 3) {
+            break;
+          }
+        }
+      }
+    }
+    check(remaining == 0);
+    build(counts.data(), symbol, accuracyLog);
+  }
+
+  // A table always decoding [symbol], without reading any bits.
+  void rle(std::uint8_t symbol) {
+    accuracyLog_ = 0;
+    symbols_[0] = symbol;
+    numBits_[0] = 0;
+    base_[0] = 0;
+  }
+
+  std::uint16_t initialState(BackwardBits& in) const {
+    return static_cast<std::uint16_t>(in.read(accuracyLog_));
+  }
+
+  std::uint8_t symbol(std::uint16_t state) const { return symbols_[state]; }
+
+  void update(std::uint16_t& state, BackwardBits& in) const {
+    state = static_cast<std::uint16_t>(base_[state] + in.read(numBits_[state]));
+  }
+
+ private:
+  unsigned accuracyLog_ = 0;
+  std::array<std::uint8_t, 1u << MaxAccuracyLog> symbols_{};
+  std::array<std::uint8_t, 1u << MaxAccuracyLog> numBits_{};
+  std::array<std::uint16_t, 1u << MaxAccuracyLog> base_{};
+};
+
+// The Huffman table the literals are coded with.
+class Huffman {
+ public:
+  static constexpr unsigned MaxBits = 11;
+
+  bool empty() const { return maxBits_ == 0; }
+
+  // Reads the tree description, as weights either FSE compressed or packed in nibbles.
+  void read(ByteReader& in) {
+    std::array<std::uint8_t, 256> weights{};
+    std::size_t count = 0;
+    const unsigned header = in.byte();
+    if (header >= 128) {
+      count = header - 127;
+      const auto* packed = in.take((count + 1) / 2);
+      for (std::size_t i = 0; i < count; ++i) {
+        weights[i] = (i % 2 == 0) ? packed[i / 2] >> 4 : packed[i / 2] & 0xF;
+      }
+    } else {
+      const auto* compressed = in.take(header);
+      ForwardBits description{compressed, header};
+      Fse fse;
+      fse.read(description, 6, 12);
+      const auto consumed = description.bytesConsumed();
+      BackwardBits stream{compressed + consumed, header - consumed};
+      // Two interleaved states, until the stream is exhausted.
+      std::uint16_t states[2] = {fse.initialState(stream), fse.initialState(stream)};
+      for (int current = 0;; current ^= 1) {
+        check(count < 255);
+        weights[count++] = fse.symbol(states[current]);
+        fse.update(states[current], stream);
+        if (stream.position() < 0) {
+          check(count < 255);
+          weights[count++] = fse.symbol(states[current ^ 1]);
+          break;
+        }
+      }
+    }
+    build(weights.data(), count);
+  }
+
+  // Decodes [count] symbols from a single stream.
+  void decode(const unsigned char* data, std::size_t size, unsigned char* out,
+              std::size_t count) const {
+    check(!empty());
+    BackwardBits in{data, size};
+    const std::uint32_t mask = (1u << maxBits_) - 1;
+    auto state = static_cast<std::uint32_t>(in.read(maxBits_));
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = symbols_[state];
+      const unsigned bits = numBits_[state];
+      state = ((state << bits) | static_cast<std::uint32_t>(in.read(bits))) & mask;
+    }
+    // The last state holds no bits from the stream.
+    check(in.position() == -static_cast<std::int64_t>(maxBits_));
+  }
+
+ private:
+  // Turns weights into code lengths, the last symbol's weight being implied by the others.
+  void build(const std::uint8_t* weights, std::size_t count) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      check(weights[i] <= MaxBits);
+      sum += weights[i] > 0 ? std::uint64_t{1} << (weights[i] - 1) : 0;
+    }
+    check(sum > 0);
+    const int maxBits = highestBit(sum) + 1;
+    const std::uint64_t left = (std::uint64_t{1} << maxBits) - sum;
+    check(maxBits <= static_cast<int>(MaxBits) && (left & (left - 1)) == 0);
+
+    std::array<std::uint8_t, 256> bits{};
+    for (std::size_t i = 0; i < count; ++i) {
+      bits[i] = weights[i] > 0 ? static_cast<std::uint8_t>(maxBits + 1 - weights[i]) : 0;
+    }
+    bits[count] = static_cast<std::uint8_t>(maxBits - highestBit(left));
+    ++count;
+
+    // Codes are assigned by decreasing length, then by increasing symbol value.
+    std::array<std::uint32_t, MaxBits + 2> rankCount{};
+    for (std::size_t i = 0; i < count; ++i) {
+      ++rankCount[bits[i]];
+    }
+    std::array<std::uint32_t, MaxBits + 2> rankStart{};
+    for (int length = maxBits; length >= 1; --length) {
+      rankStart[length - 1] = rankStart[length] + (rankCount[length] << (maxBits - length));
+      std::fill(numBits_.begin() + rankStart[length], numBits_.begin() + rankStart[length - 1],
+                static_cast<std::uint8_t>(length));
+    }
+    check(rankStart[0] == (1u << maxBits));
+    for (std::size_t symbol = 0; symbol < count; ++symbol) {
+      if (bits[symbol] != 0) {
+        const std::uint32_t span = 1u << (maxBits - bits[symbol]);
+        std::fill_n(symbols_.begin() + rankStart[bits[symbol]], span,
+                    static_cast<std::uint8_t>(symbol));
+        rankStart[bits[symbol]] += span;
+      }
+    }
+    maxBits_ = static_cast<unsigned>(maxBits);
+  }
+
+  unsigned maxBits_ = 0;
+  std::array<std::uint8_t, 1u << MaxBits> symbols_{};
+  std::array<std::uint8_t, 1u << MaxBits> numBits_{};
+};
+
+// Sequence codes: baselines and extra bits of literal lengths, match lengths and offsets.
+constexpr std::uint32_t literalLengthBase[36] = {
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,   10,  11,  12,  13,   14,   15,   16,    18,
+    20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536};
+constexpr std::uint8_t literalLengthBits[36] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,
+                                                0, 0, 0, 0, 1, 1, 1, 1, 2, 2,  3,  3,
+                                                4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+constexpr std::uint32_t matchLengthBase[53] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11, 12,  13,  14,  15,  16,   17,   18,   19,   20,
+    21, 22, 23, 24, 25, 26, 27, 28, 29, 30,  31,  32,  33,  34,   35,   37,   39,   41,
+    43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051, 4099, 8195, 16387, 32771, 65539};
+constexpr std::uint8_t matchLengthBits[53] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 4, 4,
+                                              5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+
+// The distributions used by the Predefined_Mode.
+constexpr std::int16_t literalLengthDefault[36] = {4, 3, 2, 2, 2, 2, 2, 2, 2, 2,  2,  2,
+                                                   2, 1, 1, 1, 2, 2, 2, 2, 2, 2,  2,  2,
+                                                   2, 3, 2, 1, 1, 1, 1, 1, -1, -1, -1, -1};
+constexpr std::int16_t matchLengthDefault[53] = {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  1,  1,  1,  1,  1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1};
+constexpr std::int16_t offsetDefault[29] = {1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1,
+                                            1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1};
+
+struct SequenceCode {
+  const std::int16_t* defaultCounts;
+  std::size_t defaultSymbols;
+  unsigned defaultAccuracyLog;
+  unsigned maxAccuracyLog;
+  std::size_t maxSymbols;
+};
+constexpr SequenceCode literalLengthCode{literalLengthDefault, 36, 6, 9, 36};
+constexpr SequenceCode offsetCode{offsetDefault, 29, 5, 8, 32};
+constexpr SequenceCode matchLengthCode{matchLengthDefault, 53, 6, 9, 53};
+
+// Decodes a frame into a buffer holding its whole contents, which is thus the whole window too.
+class FrameDecoder {
+ public:
+  FrameDecoder(unsigned char* output, std::size_t capacity) :
+      begin_{output}, out_{output}, end_{output + capacity} {}
+
+  // Decodes the frame following the magic number in [in], returning the decoded size.
+  std::size_t run(ByteReader& in) {
+    const unsigned descriptor = in.byte();
+    const unsigned contentSizeFlag = descriptor >> 6;
+    const bool singleSegment = (descriptor & 0x20) != 0;
+    const bool hasChecksum = (descriptor & 0x04) != 0;
+    check((descriptor & 0x08) == 0);
+    if (!singleSegment) {
+      in.byte();  // The window descriptor: the whole frame is in memory anyway.
+    }
+    static constexpr std::size_t dictionaryIdSizes[4] = {0, 1, 2, 4};
+    check(in.littleEndian(dictionaryIdSizes[descriptor & 3]) == 0);
+
+    std::optional<std::uint64_t> contentSize;
+    static constexpr std::size_t contentSizeSizes[4] = {0, 2, 4, 8};
+    const std::size_t contentSizeSize =
+        contentSizeFlag == 0 && singleSegment ? 1 : contentSizeSizes[contentSizeFlag];
+    if (contentSizeSize != 0) {
+      contentSize = in.littleEndian(contentSizeSize) + (contentSizeSize == 2 ? 256 : 0);
+      check(*contentSize <= static_cast<std::uint64_t>(end_ - out_));
+    }
+
+    for (bool last = false; !last;) {
+      const auto header = static_cast<std::uint32_t>(in.littleEndian(3));
+      last = (header & 1) != 0;
+      const std::size_t size = header >> 3;
+      switch ((header >> 1) & 3) {
+        case 0:
+          check(size <= available());
+          std::memcpy(out_, in.take(size), size);
+          out_ += size;
+          break;
+        case 1:
+          check(size <= available());
+          std::memset(out_, static_cast<int>(in.byte()), size);
+          out_ += size;
+          break;
+        case 2: {
+          check(size <= MaxBlockSize);
+          ByteReader block{in.take(size), size};
+          compressedBlock(block);
+          break;
+        }
+        default:
+          throw Corrupt{};
+      }
+    }
+
+    const auto decoded = static_cast<std::size_t>(out_ - begin_);
+    check(!contentSize || *contentSize == decoded);
+    if (hasChecksum) {
+      check(in.littleEndian(4) == (xxh64(begin_, decoded) & 0xFFFFFFFF));
+    }
+    return decoded;
+  }
+
+ private:
+  std::size_t available() const { return static_cast<std::size_t>(end_ - out_); }
+
+  void compressedBlock(ByteReader& in) {
+    literals(in);
+    sequences(in);
+  }
+
+  void literals(ByteReader& in) {
+    const unsigned first = in.byte();
+    const unsigned type = first & 3;
+    const unsigned format = (first >> 2) & 3;
+    literalsSize_ = 0;
+    literalsUsed_ = 0;
+
+    if (type == 0 || type == 1) {
+      std::size_t size = first >> 3;
+      if (format == 1) {
+        size = (first >> 4) + (in.byte() << 4);
+      } else if (format == 3) {
+        size = (first >> 4) + (in.byte() << 4);
+        size += in.byte() << 12;
+      }
+      check(size <= MaxBlockSize);
+      literalsSize_ = size;
+      if (type == 0) {
+        std::memcpy(literals_.data(), in.take(size), size);
+      } else {
+        std::memset(literals_.data(), static_cast<int>(in.byte()), size);
+      }
+      return;
+    }
+
+    // Compressed literals, with a new Huffman table, or the previous one for treeless literals.
+    static constexpr std::size_t headerSizes[4] = {3, 3, 4, 5};
+    static constexpr unsigned sizeBits[4] = {10, 10, 14, 18};
+    const std::uint64_t header = first | (in.littleEndian(headerSizes[format] - 1) << 8);
+    const std::uint64_t sizeMask = (1u << sizeBits[format]) - 1;
+    const auto regenerated = static_cast<std::size_t>((header >> 4) & sizeMask);
+    const auto compressed = static_cast<std::size_t>((header >> (4 + sizeBits[format])) & sizeMask);
+    check(regenerated <= MaxBlockSize);
+    ByteReader section{in.take(compressed), compressed};
+    if (type == 2) {
+      huffman_.read(section);
+    }
+    literalsSize_ = regenerated;
+
+    if (format == 0) {
+      huffman_.decode(section.data(), section.remaining(), literals_.data(), regenerated);
+      return;
+    }
+    // Four streams, preceded by the sizes of the first three.
+    std::size_t streamSizes[4];
+    for (int i = 0; i < 3; ++i) {
+      streamSizes[i] = static_cast<std::size_t>(section.littleEndian(2));
+    }
+    const std::size_t total = section.remaining();
+    check(streamSizes[0] + streamSizes[1] + streamSizes[2] <= total);
+    streamSizes[3] = total - streamSizes[0] - streamSizes[1] - streamSizes[2];
+    const std::size_t quarter = (regenerated + 3) / 4;
+    check(3 * quarter <= regenerated);
+    unsigned char* out = literals_.data();
+    for (int i = 0; i < 4; ++i) {
+      const std::size_t count = i < 3 ? quarter : regenerated - 3 * quarter;
+      huffman_.decode(section.take(streamSizes[i]), streamSizes[i], out, count);
+      out += count;
+    }
+  }
+
+  void table(Fse& fse, bool& ready, unsigned mode, ByteReader& in, const SequenceCode& code) {
+    switch (mode) {
+      case 0:
+        fse.build(code.defaultCounts, code.defaultSymbols, code.defaultAccuracyLog);
+        break;
+      case 1: {
+        const unsigned symbol = in.byte();
+        check(symbol < code.maxSymbols);
+        fse.rle(static_cast<std::uint8_t>(symbol));
+        break;
+      }
+      case 2: {
+        ForwardBits description{in.data(), in.remaining()};
+        fse.read(description, code.maxAccuracyLog, code.maxSymbols);
+        in.take(description.bytesConsumed());
+        break;
+      }
+      default:
+        // Repeat_Mode: the table of the previous block.
+        check(ready);
+        break;
+    }
+    ready = true;
+  }
+
+  void sequences(ByteReader& in) {
+    std::size_t count = in.byte();
+    if (count >= 128) {
+      if (count == 255) {
+        count = static_cast<std::size_t>(in.littleEndian(2)) + 0x7F00;
+      } else {
+        count = ((count - 128) << 8) + in.byte();
+      }
+    }
+
+    if (count > 0) {
+      const unsigned modes = in.byte();
+      check((modes & 3) == 0);
+      table(literalLengths_, tablesReady_[0], modes >> 6, in, literalLengthCode);
+      table(offsets_, tablesReady_[1], (modes >> 4) & 3, in, offsetCode);
+      table(matchLengths_, tablesReady_[2], (modes >> 2) & 3, in, matchLengthCode);
+
+      BackwardBits bits{in.data(), in.remaining()};
+      auto literalLengthState = literalLengths_.initialState(bits);
+      auto offsetState = offsets_.initialState(bits);
+      auto matchLengthState = matchLengths_.initialState(bits);
+      for (std::size_t i = 0; i < count; ++i) {
+        const unsigned offsetSymbol = offsets_.symbol(offsetState);
+        const unsigned matchLengthSymbol = matchLengths_.symbol(matchLengthState);
+        const unsigned literalLengthSymbol = literalLengths_.symbol(literalLengthState);
+        check(offsetSymbol < 32 && matchLengthSymbol < 53 && literalLengthSymbol < 36);
+
+        const std::uint64_t offsetValue =
+            (std::uint64_t{1} << offsetSymbol) + bits.read(offsetSymbol);
+        const auto matchLength = static_cast<std::size_t>(
+            matchLengthBase[matchLengthSymbol] + bits.read(matchLengthBits[matchLengthSymbol]));
+        const unsigned literalLengthExtra = literalLengthBits[literalLengthSymbol];
+        const auto literalLength = static_cast<std::size_t>(
+            literalLengthBase[literalLengthSymbol] + bits.read(literalLengthExtra));
+        execute(literalLength, offsetValue, matchLength);
+
+        if (i + 1 < count) {
+          literalLengths_.update(literalLengthState, bits);
+          matchLengths_.update(matchLengthState, bits);
+          offsets_.update(offsetState, bits);
+        }
+      }
+      check(bits.position() == 0);
+    } else {
+      check(in.remaining() == 0);
+    }
+
+    // The literals not consumed by any sequence come last.
+    copyLiterals(literalsSize_ - literalsUsed_);
+  }
+
+  void copyLiterals(std::size_t length) {
+    check(length <= literalsSize_ - literalsUsed_ && length <= available());
+    std::memcpy(out_, literals_.data() + literalsUsed_, length);
+    literalsUsed_ += length;
+    out_ += length;
+  }
+
+  void execute(std::size_t literalLength, std::uint64_t offsetValue, std::size_t matchLength) {
+    copyLiterals(literalLength);
+
+    std::uint64_t offset;
+    if (offsetValue > 3) {
+      offset = offsetValue - 3;
+      repeats_[2] = repeats_[1];
+      repeats_[1] = repeats_[0];
+      repeats_[0] = offset;
+    } else {
+      // Repeated offsets, shifted by one when there are no literals.
+      const auto index = static_cast<std::size_t>(offsetValue - 1 + (literalLength == 0 ? 1 : 0));
+      if (index == 0) {
+        offset = repeats_[0];
+      } else {
+        offset = index < 3 ? repeats_[index] : repeats_[0] - 1;
+        if (index > 1) {
+          repeats_[2] = repeats_[1];
+        }
+        repeats_[1] = repeats_[0];
+        repeats_[0] = offset;
+      }
+    }
+
+    check(offset > 0 && offset <= static_cast<std::uint64_t>(out_ - begin_) &&
+          matchLength <= available());
+    const unsigned char* from = out_ - offset;
+    if (offset >= matchLength) {
+      std::memcpy(out_, from, matchLength);
+    } else {
+      // Overlapping copies repeat the last [offset] bytes.
+      for (std::size_t i = 0; i < matchLength; ++i) {
+        out_[i] = from[i];
+      }
+    }
+    out_ += matchLength;
+  }
+
+  unsigned char* begin_;
+  unsigned char* out_;
+  unsigned char* end_;
+
+  // State carried from block to block within the frame.
+  Huffman huffman_;
+  Fse literalLengths_;
+  Fse offsets_;
+  Fse matchLengths_;
+  bool tablesReady_[3] = {false, false, false};
+  std::uint64_t repeats_[3] = {1, 4, 8};
+
+  std::array<unsigned char, MaxBlockSize> literals_;
+  std::size_t literalsSize_ = 0;
+  std::size_t literalsUsed_ = 0;
+};
+
+constexpr std::uint64_t Prime1 = 11400714785074694791ULL;
+constexpr std::uint64_t Prime2 = 14029467366897019727ULL;
+constexpr std::uint64_t Prime3 = 1609587929392839161ULL;
+constexpr std::uint64_t Prime4 = 9650029242287828579ULL;
+constexpr std::uint64_t Prime5 = 2870177450012600261ULL;
+
+std::uint64_t rotl(std::uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+std::uint64_t xxhRound(std::uint64_t accumulator, std::uint64_t input) {
+  return rotl(accumulator + input * Prime2, 31) * Prime1;
+}
+
+std::uint64_t xxhMerge(std::uint64_t hash, std::uint64_t accumulator) {
+  return (hash ^ xxhRound(0, accumulator)) * Prime1 + Prime4;
+}
+}  // namespace
+
+bool decompressZstd(std::string_view input, unsigned char* output, std::size_t outputSize) try {
+  ByteReader in{reinterpret_cast<const unsigned char*>(input.data()), input.size()};
+  std::size_t decoded = 0;
+  while (in.remaining() > 0) {
+    const auto magic = static_cast<std::uint32_t>(in.littleEndian(4));
+    if ((magic & SkippableMagicMask) == SkippableMagic) {
+      in.take(static_cast<std::size_t>(in.littleEndian(4)));
+      continue;
+    }
+    check(magic == FrameMagic);
+    // The literals buffer makes the decoder too large for the stack.
+    auto frame = std::make_unique<FrameDecoder>(output + decoded, outputSize - decoded);
+    decoded += frame->run(in);
+  }
+  return decoded == outputSize;
+} catch (const Corrupt&) {
+  return false;
+}
+
+std::uint64_t xxh64(const unsigned char* data, std::size_t size, std::uint64_t seed) {
+  const unsigned char* end = data + size;
+  std::uint64_t hash;
+  if (size >= 32) {
+    std::uint64_t v1 = seed + Prime1 + Prime2;
+    std::uint64_t v2 = seed + Prime2;
+    std::uint64_t v3 = seed;
+    std::uint64_t v4 = seed - Prime1;
+    for (; end - data >= 32; data += 32) {
+      v1 = xxhRound(v1, load64(data));
+      v2 = xxhRound(v2, load64(data + 8));
+      v3 = xxhRound(v3, load64(data + 16));
+      v4 = xxhRound(v4, load64(data + 24));
+    }
+    hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    hash = xxhMerge(hash, v1);
+    hash = xxhMerge(hash, v2);
+    hash = xxhMerge(hash, v3);
+    hash = xxhMerge(hash, v4);
+  } else {
+    hash = seed + Prime5;
+  }
+  hash += size;
+
+  for (; end - data >= 8; data += 8) {
+    hash = rotl(hash ^ xxhRound(0, load64(data)), 27) * Prime1 + Prime4;
+  }
+  if (end - data >= 4) {
+    hash = rotl(hash ^ (std::uint64_t{load32(data)} * Prime1), 23) * Prime2 + Prime3;
+    data += 4;
+  }
+  for (; data < end; ++data) {
+    hash = rotl(hash ^ (*data * Prime5), 11) * Prime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= Prime2;
+  hash ^= hash >> 29;
+  hash *= Prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+std::optional<std::size_t> SeekTable::size(std::string_view footer) {
+  if (footer.size() != FooterSize) {
+    return std::nullopt;
+  }
+  const auto* p = reinterpret_cast<const unsigned char*>(footer.data());
+  const unsigned descriptor = p[4];
+  if (load32(p + 5) != SeekableMagic || (descriptor & 0x7C) != 0) {
+    return std::nullopt;
+  }
+  const std::size_t entrySize = (descriptor & 0x80) != 0 ? 12 : 8;
+  // The skippable frame header, the entries and the footer.
+  return 8 + std::size_t{load32(p)} * entrySize + FooterSize;
+}
+
+std::optional<SeekTable> SeekTable::parse(std::string_view table, std::uint64_t fileSize) {
+  if (table.size() < FooterSize) {
+    return std::nullopt;
+  }
+  const auto tableSize = size(table.substr(table.size() - FooterSize));
+  if (!tableSize || *tableSize != table.size() || fileSize < table.size()) {
+    return std::nullopt;
+  }
+  const auto* p = reinterpret_cast<const unsigned char*>(table.data());
+  if (load32(p) != SeekTableFrameMagic || load32(p + 4) != table.size() - 8) {
+    return std::nullopt;
+  }
+
+  SeekTable parsed;
+  const bool hasChecksums = (p[table.size() - 5] & 0x80) != 0;
+  const std::size_t entrySize = hasChecksums ? 12 : 8;
+  const std::size_t count = (table.size() - 8 - FooterSize) / entrySize;
+  parsed.frames.reserve(count);
+  std::uint64_t compressedOffset = 0;
+  for (const auto* entry = p + 8; parsed.frames.size() < count; entry += entrySize) {
+    Frame frame;
+    frame.compressedOffset = compressedOffset;
+    frame.decompressedOffset = parsed.decompressedSize;
+    frame.compressedSize = load32(entry);
+    frame.decompressedSize = load32(entry + 4);
+    if (frame.compressedSize > MaxFrameSize || frame.decompressedSize > MaxFrameSize) {
+      return std::nullopt;
+    }
+    if (hasChecksums) {
+      frame.checksum = load32(entry + 8);
+    }
+    compressedOffset += frame.compressedSize;
+    parsed.decompressedSize += frame.decompressedSize;
+    parsed.frames.push_back(frame);
+  }
+  // The frames and the table must make up the whole file.
+  if (compressedOffset + table.size() != fileSize) {
+    return std::nullopt;
+  }
+  return parsed;
+}
+
+std::size_t SeekTable::frameAt(std::uint64_t offset) const {
+  auto next = std::upper_bound(frames.begin(), frames.end(), offset,
+                               [](std::uint64_t value, const Frame& frame) {
+                                 return value < frame.decompressedOffset;
+                               });
+  return static_cast<std::size_t>(next - frames.begin()) - 1;
+}
+
+}  // namespace Ubuntu
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace Ubuntu {
+// A self-contained Zstandard (RFC 8878) decoder for the seekable format: a file made of
+// independently decodable frames, followed by a skippable frame holding a table of their sizes.
+// The table tells where every frame starts, both compressed and decompressed, thus frames can be
+// decoded in parallel, or individually to read a part of the contents without decoding the rest.
+//
+// The image build writes the rootfs in that format as install.tar.zst, next to the gzip one (see
+// wsl-builder/prepare-build/rootfs). Dictionaries are not supported, as it has no use for them.
+
+// Decodes the zstd frames in [input], skipping skippable frames, into [output], which must be
+// exactly as large as the decoded data. Frame checksums are verified when present.
+bool decompressZstd(std::string_view input, unsigned char* output, std::size_t outputSize);
+
+// The XXH64 hash, used by zstd for checksums.
+std::uint64_t xxh64(const unsigned char* data, std::size_t size, std::uint64_t seed = 0);
+
+struct SeekTable {
+  struct Frame {
+    std::uint64_t compressedOffset = 0;
+    std::uint64_t decompressedOffset = 0;
+    std::uint32_t compressedSize = 0;
+    std::uint32_t decompressedSize = 0;
+    // The lower 32 bits of the XXH64 of the decompressed frame, if the table records them.
+    std::optional<std::uint32_t> checksum;
+  };
+  std::vector<Frame> frames;
+  std::uint64_t decompressedSize = 0;
+
+  // The size of the seek table footer, which is enough to learn the size of the whole table.
+  static constexpr std::size_t FooterSize = 9;
+
+  // The largest frame accepted, compressed or not, 16 times the frames the image build writes.
+  // Frames are allocated whole, and the table tells their sizes before they're checked.
+  static constexpr std::uint32_t MaxFrameSize = 64 * 1024 * 1024;
+
+  // The size of the skippable frame holding the seek table, given the last FooterSize bytes of a
+  // file, or nullopt if the file doesn't end with a seek table.
+  static std::optional<std::size_t> size(std::string_view footer);
+
+  // Parses the skippable frame holding the seek table, found at the end of a file of [fileSize]
+  // bytes. Returns nullopt if it's malformed, doesn't match the file, or lists a frame larger than
+  // MaxFrameSize.
+  static std::optional<SeekTable> parse(std::string_view table, std::uint64_t fileSize);
+
+  // The index of the frame holding the decompressed byte at [offset], which must be in range.
+  std::size_t frameAt(std::uint64_t offset) const;
+};
+}  // namespace Ubuntu
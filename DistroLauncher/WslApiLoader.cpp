@@ -6,7 +6,7 @@
 #include "stdafx.h"
 #include "WslApiLoader.h"
 
-WslApiLoader::WslApiLoader(const std::wstring& distributionName) :
+WslApiLoader::WslApiLoader(PCWSTR distributionName) :
     _distributionName(distributionName)
 {
     _wslApiDll = LoadLibraryEx(L"wslapi.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
@@ -14,6 +14,7 @@ WslApiLoader::WslApiLoader(const std::wstring& distributionName) :
         _isDistributionRegistered = (WSL_IS_DISTRIBUTION_REGISTERED)GetProcAddress(_wslApiDll, "WslIsDistributionRegistered");
         _registerDistribution = (WSL_REGISTER_DISTRIBUTION)GetProcAddress(_wslApiDll, "WslRegisterDistribution");
         _configureDistribution = (WSL_CONFIGURE_DISTRIBUTION)GetProcAddress(_wslApiDll, "WslConfigureDistribution");
+        _getDistributionConfiguration = (WSL_GET_DISTRIBUTION_CONFIGURATION)GetProcAddress(_wslApiDll, "WslGetDistributionConfiguration");
         _launchInteractive = (WSL_LAUNCH_INTERACTIVE)GetProcAddress(_wslApiDll, "WslLaunchInteractive");
         _launch = (WSL_LAUNCH)GetProcAddress(_wslApiDll, "WslLaunch");
     }
@@ -32,18 +33,19 @@ BOOL WslApiLoader::WslIsOptionalComponentInstalled()
             (_isDistributionRegistered != nullptr) &&
             (_registerDistribution != nullptr) &&
             (_configureDistribution != nullptr) &&
+            (_getDistributionConfiguration != nullptr) &&
             (_launchInteractive != nullptr) &&
             (_launch != nullptr));
 }
 
 BOOL WslApiLoader::WslIsDistributionRegistered()
 {
-    return _isDistributionRegistered(_distributionName.c_str());
+    return _isDistributionRegistered(_distributionName);
 }
 
-HRESULT WslApiLoader::WslRegisterDistribution()
+HRESULT WslApiLoader::WslRegisterDistribution(PCWSTR tarGzFilename)
 {
-    HRESULT hr = _registerDistribution(_distributionName.c_str(), L"install.tar.gz");
+    HRESULT hr = _registerDistribution(_distributionName, tarGzFilename);
     if (FAILED(hr)) {
         Helpers::PrintMessage(MSG_WSL_REGISTER_DISTRIBUTION_FAILED, hr);
     }
@@ -53,7 +55,7 @@ HRESULT WslApiLoader::WslRegisterDistribution()
 
 HRESULT WslApiLoader::WslConfigureDistribution(ULONG defaultUID, WSL_DISTRIBUTION_FLAGS wslDistributionFlags)
 {
-    HRESULT hr = _configureDistribution(_distributionName.c_str(), defaultUID, wslDistributionFlags);
+    HRESULT hr = _configureDistribution(_distributionName, defaultUID, wslDistributionFlags);
     if (FAILED(hr)) {
         Helpers::PrintMessage(MSG_WSL_CONFIGURE_DISTRIBUTION_FAILED, hr);
     }
@@ -61,9 +63,35 @@ HRESULT WslApiLoader::WslConfigureDistribution(ULONG defaultUID, WSL_DISTRIBUTIO
     return hr;
 }
 
+HRESULT WslApiLoader::WslGetDistributionConfiguration(Ubuntu::DistributionConfiguration& configuration)
+{
+    PSTR *environment = nullptr;
+    ULONG environmentCount = 0;
+    HRESULT hr = _getDistributionConfiguration(_distributionName,
+                                               &configuration.version,
+                                               &configuration.defaultUid,
+                                               &configuration.flags,
+                                               &environment,
+                                               &environmentCount);
+    if (FAILED(hr)) {
+        Helpers::PrintMessage(MSG_WSL_GET_DISTRIBUTION_CONFIGURATION_FAILED, hr);
+        return hr;
+    }
+
+    // The caller owns both the array and each of the strings.
+    configuration.defaultEnvironment.clear();
+    for (ULONG index = 0; index < environmentCount; index += 1) {
+        configuration.defaultEnvironment.emplace_back(environment[index]);
+        CoTaskMemFree(environment[index]);
+    }
+    CoTaskMemFree(environment);
+
+    return hr;
+}
+
 HRESULT WslApiLoader::WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkingDirectory, DWORD *exitCode)
 {
-    HRESULT hr = _launchInteractive(_distributionName.c_str(), command, useCurrentWorkingDirectory, exitCode);
+    HRESULT hr = _launchInteractive(_distributionName, command, useCurrentWorkingDirectory, exitCode);
     if (FAILED(hr)) {
         Helpers::PrintMessage(MSG_WSL_LAUNCH_INTERACTIVE_FAILED, command, hr);
     }
@@ -73,10 +101,15 @@ HRESULT WslApiLoader::WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkin
 
 HRESULT WslApiLoader::WslLaunch(PCWSTR command, BOOL useCurrentWorkingDirectory, HANDLE stdIn, HANDLE stdOut, HANDLE stdErr, HANDLE *process)
 {
-    HRESULT hr = _launch(_distributionName.c_str(), command, useCurrentWorkingDirectory, stdIn, stdOut, stdErr, process);
+    HRESULT hr = _launch(_distributionName, command, useCurrentWorkingDirectory, stdIn, stdOut, stdErr, process);
     if (FAILED(hr)) {
         Helpers::PrintMessage(MSG_WSL_LAUNCH_FAILED, command, hr);
     }
 
     return hr;
 }
+
+std::filesystem::path WslApiLoader::DistributionRootPath() const
+{
+    return std::filesystem::path{L"\\\\wsl.localhost"} / _distributionName;
+}
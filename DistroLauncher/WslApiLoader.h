@@ -18,38 +18,43 @@ typedef HRESULT (STDAPICALLTYPE* WSL_GET_DISTRIBUTION_CONFIGURATION)(PCWSTR, ULO
 typedef HRESULT (STDAPICALLTYPE* WSL_LAUNCH_INTERACTIVE)(PCWSTR, PCWSTR, BOOL, DWORD *);
 typedef HRESULT (STDAPICALLTYPE* WSL_LAUNCH)(PCWSTR, PCWSTR, BOOL, HANDLE, HANDLE, HANDLE, HANDLE *);
 
-class WslApiLoader
+class WslApiLoader : public Ubuntu::WslApiBackend
 {
   public:
-    WslApiLoader(const std::wstring& distributionName);
+    WslApiLoader(PCWSTR distributionName);
     ~WslApiLoader();
 
-    BOOL WslIsOptionalComponentInstalled();
+    BOOL WslIsOptionalComponentInstalled() override;
 
-    BOOL WslIsDistributionRegistered();
+    BOOL WslIsDistributionRegistered() override;
 
-    HRESULT WslRegisterDistribution();
+    HRESULT WslRegisterDistribution(PCWSTR tarGzFilename) override;
 
     HRESULT WslConfigureDistribution(ULONG defaultUID,
-                                     WSL_DISTRIBUTION_FLAGS wslDistributionFlags);
+                                     WSL_DISTRIBUTION_FLAGS wslDistributionFlags) override;
+
+    HRESULT WslGetDistributionConfiguration(Ubuntu::DistributionConfiguration& configuration) override;
 
     HRESULT WslLaunchInteractive(PCWSTR command,
                                  BOOL useCurrentWorkingDirectory,
-                                 DWORD *exitCode);
+                                 DWORD *exitCode) override;
 
     HRESULT WslLaunch(PCWSTR command,
                       BOOL useCurrentWorkingDirectory,
                       HANDLE stdIn,
                       HANDLE stdOut,
                       HANDLE stdErr,
-                      HANDLE *process);
+                      HANDLE *process) override;
+
+    std::filesystem::path DistributionRootPath() const override;
 
   private:
-    std::wstring _distributionName;
+    PCWSTR _distributionName;
     HMODULE _wslApiDll;
     WSL_IS_DISTRIBUTION_REGISTERED _isDistributionRegistered;
     WSL_REGISTER_DISTRIBUTION _registerDistribution;
     WSL_CONFIGURE_DISTRIBUTION _configureDistribution;
+    WSL_GET_DISTRIBUTION_CONFIGURATION _getDistributionConfiguration;
     WSL_LAUNCH_INTERACTIVE _launchInteractive;
     WSL_LAUNCH _launch;
 };
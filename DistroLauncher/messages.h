@@ -0,0 +1,136 @@
+// Generated by wsl-builder/compile-messages from messages.mc. DO NOT EDIT.
+#pragma once
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::Hex> MSG_WSL_REGISTER_DISTRIBUTION_FAILED{
+    1001,
+    L"WslRegisterDistribution failed with error: 0x%1\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::Hex> MSG_WSL_CONFIGURE_DISTRIBUTION_FAILED{
+    1002,
+    L"WslConfigureDistribution failed with error: 0x%1\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::String, Ubuntu::Insert::Hex> MSG_WSL_LAUNCH_INTERACTIVE_FAILED{
+    1003,
+    L"WslLaunchInteractive %1 failed with error: 0x%2\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::String, Ubuntu::Insert::Hex> MSG_WSL_LAUNCH_FAILED{
+    1004,
+    L"WslLaunch %1 failed with error: 0x%2\n"};
+
+inline constexpr Ubuntu::Message<> MSG_USAGE{
+    1005,
+    L"Launches or configures a Linux distribution.\n"
+    L"\n"
+    L"Usage: \n"
+    L"    <no args> \n"
+    L"        Launches the user's default shell in the user's home directory.\n"
+    L"\n"
+    L"    install [--root] [--answers <file>] [--trace <file>]\n"
+    L"        Install the distribuiton and do not launch the shell when complete.\n"
+    L"          --root\n"
+    L"              Do not create a user account and leave the default user set to root.\n"
+    L"          --answers <file>\n"
+    L"              Install without asking anything. <file> gives the user account to\n"
+    L"              create, if any, with its password hash and groups, /etc/wsl.conf keys\n"
+    L"              and whether to skip cloud-init. It is checked before anything is\n"
+    L"              installed.\n"
+    L"          --trace <file>\n"
+    L"              Record the duration of each installation step into <file>, in the\n"
+    L"              Chrome trace-event JSON format.\n"
+    L"\n"
+    L"    run <command line> \n"
+    L"        Run the provided command line in the current working directory. If no\n"
+    L"        command line is provided, the default shell is launched.\n"
+    L"        Set UBUNTU_LAUNCHER_AGENT=1 to run commands through a background agent\n"
+    L"        kept running in the distribution, which saves starting a shell through\n"
+    L"        WSL for each command. The agent gives commands neither input nor a\n"
+    L"        terminal, thus it is only used when the standard input is redirected\n"
+    L"        from NUL.\n"
+    L"\n"
+    L"    exec <program> [arguments...]\n"
+    L"    run --exec <program> [arguments...]\n"
+    L"        Run <program> in the current working directory with the arguments\n"
+    L"        exactly as given: no shell expands, splits or re-quotes them. The exit\n"
+    L"        code of <program> is the exit code of the launcher.\n"
+    L"\n"
+    L"    config [setting [value]] \n"
+    L"        Configure settings for this distribution.\n"
+    L"        Settings:\n"
+    L"          --default-user <username>\n"
+    L"              Sets the default user to <username>. This must be an existing user.\n"
+    L"          --users <roster.csv>\n"
+    L"              Creates the user accounts listed in <roster.csv>, a line per account:\n"
+    L"              name,password hash,groups separated with ';'. Existing accounts are\n"
+    L"              left as they are. The default user is then chosen as after install.\n"
+    L"\n"
+    L"    help \n"
+    L"        Print usage information and exit.\n"};
+
+inline constexpr Ubuntu::Message<> MSG_STATUS_INSTALLING{
+    1006,
+    L"Installing, this may take a few minutes...\n"};
+
+inline constexpr Ubuntu::Message<> MSG_INSTALL_SUCCESS{
+    1007,
+    L"Installation successful!\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::Hex, Ubuntu::Insert::String> MSG_ERROR_CODE{
+    1008,
+    L"Error: 0x%1 %2\n"};
+
+inline constexpr Ubuntu::Message<> MSG_ENTER_USERNAME{
+    1009,
+    L"Enter new UNIX username: "};
+
+inline constexpr Ubuntu::Message<> MSG_CREATE_USER_PROMPT{
+    1010,
+    L"Please create a default UNIX user account. The username does not need to match your Windows username.\n"
+    L"For more information visit: https://aka.ms/wslusers\n"};
+
+inline constexpr Ubuntu::Message<> MSG_PRESS_A_KEY{
+    1011,
+    L"Press any key to continue...\n"};
+
+inline constexpr Ubuntu::Message<> MSG_INSTALL_ALREADY_EXISTS{
+    1013,
+    L"The distribution installation has become corrupted.\n"
+    L"Please select Reset from App Settings or uninstall and reinstall the app.\n"};
+
+inline constexpr Ubuntu::Message<> MSG_ENABLE_VIRTUALIZATION{
+    1014,
+    L"Please enable the Virtual Machine Platform Windows feature and ensure virtualization is enabled in the BIOS.\n"
+    L"For information please visit https://aka.ms/enablevirtualization\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::Hex> MSG_WSL_GET_DISTRIBUTION_CONFIGURATION_FAILED{
+    1015,
+    L"WslGetDistributionConfiguration failed with error: 0x%1\n"};
+
+inline constexpr Ubuntu::Message<> MSG_ROOTFS_CORRUPT{
+    1016,
+    L"The root filesystem shipped with the app is corrupted.\n"
+    L"Please uninstall and reinstall the app.\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::String, Ubuntu::Insert::String> MSG_ANSWER_FILE_INVALID{
+    1017,
+    L"The answer file %1 is invalid: %2\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::String, Ubuntu::Insert::String> MSG_ROSTER_INVALID{
+    1018,
+    L"The user roster %1 is invalid: %2\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::String> MSG_USER_EXISTS{
+    1019,
+    L"The user %1 already exists, please choose another username.\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::Decimal> MSG_NEWUSERS_FAILED{
+    1020,
+    L"newusers exited with %1\n"};
+
+inline constexpr Ubuntu::Message<> MSG_ROSTER_FAILED{
+    1021,
+    L"Failed to create the users: the script didn't report its results.\n"};
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::String> MSG_ROSTER_NOT_ROOT{
+    1022,
+    L"Failed to create the users: /etc/wsl.conf makes %1 the default user, thus the launcher can't run commands as root.\n"
+    L"Remove the default setting of the [user] section of /etc/wsl.conf and try again.\n"};
@@ -9,6 +9,7 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include "targetver.h"
 
 #include <stdio.h>
@@ -17,21 +18,38 @@
 #include <stdio.h>
 #include <conio.h>
 #include <io.h>
+#include <wslapi.h>
+#else
+// Portable build of the launcher core (see Ubuntu/Platform.h).
+#include "Ubuntu/Platform.h"
+#endif
 #include <iostream>
 #include <string>
 #include <memory>
+#include <optional>
 #include <assert.h>
 #include <locale>
-#include <codecvt>
+#include <filesystem>
+#include <future>
 #include <string_view>
 #include <vector>
-#include <wslapi.h>
+#include "Ubuntu/WslApiBackend.h"
+#ifdef _WIN32
 #include "WslApiLoader.h"
+#endif
+#include "Ubuntu/Message.h"
 #include "Helpers.h"
 #include "DistributionInfo.h"
 
-// Message strings compiled from .MC file.
+// Message strings compiled from .MC file (see Ubuntu/Message.h).
 #include "messages.h"
 
 // Ubuntu extensions
+#include "Ubuntu/Agent.h"
+#include "Ubuntu/AnswerFile.h"
+#include "Ubuntu/DirectExec.h"
+#include "Ubuntu/ImageFacts.h"
 #include "Ubuntu/InitTasks.h"
+#include "Ubuntu/Rootfs.h"
+#include "Ubuntu/Roster.h"
+#include "Ubuntu/Trace.h"
@@ -0,0 +1,122 @@
+#include <stdafx.h>
+#include "Ubuntu/AnswerFile.h"
+#include "tests/Check.h"
+
+#include <fstream>
+
+using Ubuntu::AnswerFile;
+
+// Checks what answer files accept, and that anything else is reported rather than ignored.
+namespace {
+void checkUserNames() {
+  // Up to 32 characters, the '$' suffix of machine accounts included.
+  for (const std::string_view valid : {"a", "alice", "a-b_c9", "machine$",
+                                       "abcdefghijklmnopqrstuvwxyz012345",
+                                       "abcdefghijklmnopqrstuvwxyz01234$"}) {
+    CHECK(Ubuntu::isValidUserName(valid));
+  }
+  for (const std::string_view invalid :
+       {"", "$", "Alice", "9lives", "-a", "_a", "a$$", "a$b", "al ice", "alice:x", "al.ice",
+        "abcdefghijklmnopqrstuvwxyz0123456", "abcdefghijklmnopqrstuvwxyz012345$",
+        "\xc3\xa9t\xc3\xa9"}) {
+    CHECK(!Ubuntu::isValidUserName(invalid));
+  }
+}
+
+void checkPasswordHashes() {
+  for (const std::string_view valid :
+       {"$6$salt$Fe6h.pDZTgW8Rqz/ZkQw0X", "!$6$salt$Fe6h.pDZTgW8Rqz/ZkQw0X", "$y$j9T$salt$hash",
+        "$2b$10$a,b=c-d", "abJnggxhB/yWI"}) {
+    CHECK(Ubuntu::isPasswordHash(valid));
+  }
+  // Passwords in clear are no hashes, nor is a lock with nothing to unlock, nor anything which
+  // would break the shadow line.
+  for (const std::string_view invalid :
+       {"", "!", "!!", "hunter2", "password", "$6$", "$6salt", "$6$salt:hash", "$6$salt$hash\n",
+        "$6$ salt", "pass word", "$6$'"}) {
+    CHECK(!Ubuntu::isPasswordHash(invalid));
+  }
+}
+
+void checkValid() {
+  std::wstring error;
+  const auto answers = AnswerFile::parse(
+      "# Unattended\r\n[User]\r\nName = alice$\r\npassword = \"!$6$salt$hash\"\r\n"
+      "groups = docker , libvirt\r\n[install]\r\nskip-cloud-init = Yes\r\n"
+      "[wsl.conf]\r\nboot.systemd = true\r\nautomount.options = \"metadata,umask=22\"\r\n",
+      error);
+  CHECK(answers && error.empty());
+  if (answers) {
+    CHECK(answers->userName == "alice$");
+    CHECK(answers->passwordHash == "!$6$salt$hash");
+    CHECK((answers->extraGroups == std::vector<std::string>{"docker", "libvirt"}));
+    CHECK(answers->skipCloudInit);
+    CHECK(answers->wslConf.size() == 2);
+    CHECK(answers->wslConf.size() == 2 && answers->wslConf[1].section == "automount" &&
+          answers->wslConf[1].key == "options" && answers->wslConf[1].value == "metadata,umask=22");
+  }
+
+  // Nothing to do is fine, and so is a file with no user.
+  CHECK(AnswerFile::parse("", error));
+  const auto noUser = AnswerFile::parse("[install]\nskip-cloud-init = off\n", error);
+  CHECK(noUser && noUser->userName.empty() && !noUser->skipCloudInit);
+}
+
+void checkInvalid() {
+  for (const std::string_view contents : {
+           "[user]\nname = Alice\n",
+           "[user]\nname = abcdefghijklmnopqrstuvwxyz0123456\n",
+           "[user]\nname = a$$\n",
+           "[user]\nname = alice\npassword = hunter2\n",
+           "[user]\nname = alice\npassword = !\n",
+           "[user]\nname = alice\ngroups = docker libvirt\n",
+           "[user]\nname = alice\ngroups = docker,,libvirt\n",
+           "[user]\nname = alice\nshell = /bin/zsh\n",
+           "name = alice\n",
+           "[users]\nname = alice\n",
+           "[user]\npassword = $6$salt$hash\n",
+           "[user]\ngroups = docker\n",
+           "[install]\nskip-cloud-init = maybe\n",
+           "[wsl.conf]\nsystemd = true\n",
+           "[wsl.conf]\n.systemd = true\n",
+           "[wsl.conf]\nboot. = true\n",
+           "[wsl.conf]\nboot.systemd.enabled = true\n",
+           "[wsl.conf]\nboot.sys temd = true\n",
+           "[wsl.conf]\nuser.default = \xff\n",
+       }) {
+    std::wstring error;
+    CHECK(!AnswerFile::parse(contents, error));
+    CHECK(!error.empty());
+  }
+
+  std::wstring error;
+  CHECK(!AnswerFile::parse("[user]\nname = alice\nhome = /srv/alice\n", error));
+  CHECK(error == L"[user] home: unknown setting");
+}
+
+// Files are sized up before anything is read out of them.
+void checkLoad() {
+  const auto directory = std::filesystem::temp_directory_path() / "AnswerFileTest";
+  std::filesystem::create_directories(directory);
+  const auto path = directory / "answers.ini";
+  std::wstring error;
+  CHECK(!AnswerFile::load(path, error) && error == L"could not read the file");
+
+  std::ofstream{path} << "[user]\nname = alice\n";
+  const auto answers = AnswerFile::load(path, error);
+  CHECK(answers && answers->userName == "alice");
+
+  std::filesystem::resize_file(path, 2 * 1024 * 1024);
+  CHECK(!AnswerFile::load(path, error) && error == L"the file is too large");
+  std::filesystem::remove_all(directory);
+}
+}  // namespace
+
+int main() {
+  checkUserNames();
+  checkPasswordHashes();
+  checkValid();
+  checkInvalid();
+  checkLoad();
+  return checkResult();
+}
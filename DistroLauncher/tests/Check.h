@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+inline int checkFailures = 0;
+
+// Reports a failed expectation and carries on, so that a run lists every failure at once.
+#define CHECK(condition)                                                                  \
+  do {                                                                                    \
+    if (!(condition)) {                                                                   \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      ++checkFailures;                                                                    \
+    }                                                                                     \
+  } while (false)
+
+// What main() returns: whether every check passed.
+inline int checkResult() {
+  return checkFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
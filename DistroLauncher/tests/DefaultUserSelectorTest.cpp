@@ -0,0 +1,73 @@
+#include <stdafx.h>
+#include "Ubuntu/DefaultUserSelector.h"
+#include "tests/Check.h"
+
+using Ubuntu::DefaultUserSelector;
+
+// Picks the default user out of a passwd database fed in chunks of every size, lines splitting
+// anywhere in them, and out of the same database already parsed.
+namespace {
+constexpr std::string_view Passwd =
+    "root:x:0:0:root:/root:/bin/bash\n"
+    "daemon:x:1:1:daemon:/usr/sbin:/usr/sbin/nologin\n"
+    "sync:x:4:65534:sync:/bin:/bin/sync\n"
+    "builder:x:999:999::/var/lib/builder:/bin/bash\n"
+    "nobody:x:65534:65534:nobody:/nonexistent:/usr/sbin/nologin\n"
+    "locked:x:1000:1000::/home/locked:/bin/false\n"
+    "carol:x:1002:1002::/home/carol:/usr/bin/zsh\n"
+    "broken line\n"
+    "bob:x:1001:1001::/home/bob:/bin/bash\n"
+    "alice:x:1004:1004::/home/alice:/bin/sh\n"
+    "alice:x:1003:1003::/home/alice2:/bin/sh";
+
+// The lowest regular UID with a login shell wins: system accounts and accounts which can't log in
+// are skipped, wherever they are in the database.
+void checkChunks() {
+  for (std::size_t chunkSize = 1; chunkSize <= Passwd.size(); ++chunkSize) {
+    DefaultUserSelector users;
+    users.lookFor("alice");
+    for (std::size_t offset = 0; offset < Passwd.size(); offset += chunkSize) {
+      users.feed(Passwd.substr(offset, chunkSize));
+    }
+    // The last line isn't over until the database is.
+    CHECK(users.named() == 1004u);
+    users.finish();
+    CHECK(!users.empty());
+    CHECK(users.named() == 1003u);
+    CHECK(users.firstLoginUser() == 1001u);
+  }
+}
+
+void checkTable() {
+  DefaultUserSelector users;
+  users.lookFor("carol");
+  users.feed(Ubuntu::UserTable{Passwd});
+  CHECK(!users.empty());
+  CHECK(users.named() == 1002u);
+  CHECK(users.firstLoginUser() == 1001u);
+}
+
+void checkNoCandidate() {
+  DefaultUserSelector system;
+  system.lookFor("alice");
+  system.feed(Passwd.substr(0, Passwd.find("carol")));
+  system.finish();
+  CHECK(!system.empty());
+  CHECK(!system.named());
+  CHECK(!system.firstLoginUser());
+
+  DefaultUserSelector garbage;
+  garbage.feed("broken line\n");
+  garbage.feed("another one");
+  garbage.finish();
+  CHECK(garbage.empty());
+  CHECK(!garbage.firstLoginUser());
+}
+}  // namespace
+
+int main() {
+  checkChunks();
+  checkTable();
+  checkNoCandidate();
+  return checkResult();
+}
@@ -0,0 +1,31 @@
+#include <stdafx.h>
+#include "Ubuntu/FakeWslApi.h"
+#include "Ubuntu/WslProcess.h"
+#include "tests/Check.h"
+
+// Runs commands through the fake backend, directly on the host, as the init tasks would.
+int main() {
+  Ubuntu::FakeWslApi api{{}};
+  CHECK(!api.WslIsDistributionRegistered());
+  CHECK(SUCCEEDED(api.WslRegisterDistribution(L"install.tar.gz")));
+  CHECK(api.WslIsDistributionRegistered());
+
+  CHECK(SUCCEEDED(api.WslConfigureDistribution(1000, WSL_DISTRIBUTION_FLAGS_DEFAULT)));
+  CHECK(api.defaultUid() == 1000);
+
+  Ubuntu::WslProcess echo{L"echo hello"};
+  const auto echoed = echo.run(api, 10000);
+  CHECK(echoed.exitCode == 0);
+  CHECK(echoed.stdOut == "hello\n");
+
+  Ubuntu::WslProcess cat{L"cat"};
+  cat.setInput("from stdin");
+  const auto catted = cat.run(api, 10000);
+  CHECK(catted.exitCode == 0);
+  CHECK(catted.stdOut == "from stdin");
+
+  Ubuntu::WslProcess failing{L"exit 3"};
+  CHECK(failing.run(api, 10000).exitCode == 3);
+
+  return checkResult();
+}
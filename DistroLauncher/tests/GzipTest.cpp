@@ -0,0 +1,161 @@
+#include <stdafx.h>
+#include "Ubuntu/Gzip.h"
+#include "Ubuntu/Rootfs.h"
+#include "tests/Check.h"
+
+#include <fstream>
+#include <random>
+
+#include <zlib.h>
+
+// Decodes what zlib encodes: raw DEFLATE streams at every level and strategy, and BGZF files made
+// of zlib members as the image build writes them, decoded on several threads.
+namespace {
+constexpr std::size_t BgzfBlockSize = 0xff00;
+
+std::string testData(std::size_t size, unsigned seed) {
+  std::mt19937 random{seed};
+  std::string data;
+  while (data.size() < size) {
+    if (random() % 2 == 0) {
+      data += "usr/share/doc/package/changelog.Debian.gz";
+      data += static_cast<char>(random() % 4);
+    } else {
+      for (std::size_t i = random() % 3000; i > 0; --i) {
+        data += static_cast<char>(random());
+      }
+    }
+  }
+  data.resize(size);
+  return data;
+}
+
+std::string zlibDeflate(std::string_view data, int level, int strategy) {
+  z_stream stream{};
+  // Negative window bits for a raw stream, without zlib header nor trailer.
+  if (deflateInit2(&stream, level, Z_DEFLATED, -15, 9, strategy) != Z_OK) {
+    return {};
+  }
+  // deflateBound() falls short for stored blocks of tiny inputs.
+  std::string out(deflateBound(&stream, static_cast<uLong>(data.size())) + 64, '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(out.data());
+  stream.avail_out = static_cast<uInt>(out.size());
+  const int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return result == Z_STREAM_END ? out : std::string{};
+}
+
+void put16(std::string& out, std::uint32_t value) {
+  out += static_cast<char>(value & 0xFF);
+  out += static_cast<char>((value >> 8) & 0xFF);
+}
+
+void put32(std::string& out, std::uint32_t value) {
+  put16(out, value & 0xFFFF);
+  put16(out, value >> 16);
+}
+
+std::uint32_t zlibCrc(std::string_view data) {
+  return static_cast<std::uint32_t>(
+      ::crc32(0, reinterpret_cast<const Bytef*>(data.data()), static_cast<uInt>(data.size())));
+}
+
+std::string bgzfMember(std::string_view data) {
+  const std::string deflated = zlibDeflate(data, 6, Z_DEFAULT_STRATEGY);
+  std::string member{"\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16};
+  put16(member, static_cast<std::uint32_t>(18 + deflated.size() + 8 - 1));
+  member += deflated;
+  put32(member, zlibCrc(data));
+  put32(member, static_cast<std::uint32_t>(data.size()));
+  return member;
+}
+
+std::string bgzf(std::string_view data) {
+  std::string file;
+  for (std::size_t offset = 0; offset < data.size(); offset += BgzfBlockSize) {
+    file += bgzfMember(data.substr(offset, BgzfBlockSize));
+  }
+  return file + bgzfMember({});
+}
+
+void writeFile(const std::filesystem::path& path, std::string_view contents) {
+  std::ofstream{path, std::ios::binary}.write(contents.data(), contents.size());
+}
+
+std::string readFile(const std::filesystem::path& path) {
+  std::ifstream file{path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+void checkInflate() {
+  for (std::size_t size : {0, 1, 100, 70000, 1 << 20}) {
+    const std::string data = testData(size, static_cast<unsigned>(size));
+    for (int level : {0, 1, 6, 9}) {
+      for (int strategy : {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED}) {
+        const std::string deflated = zlibDeflate(data, level, strategy);
+        CHECK(!deflated.empty());
+        std::string inflated(size, '\0');
+        CHECK(Ubuntu::inflate(deflated, reinterpret_cast<unsigned char*>(inflated.data()), size));
+        CHECK(inflated == data);
+      }
+    }
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    CHECK(Ubuntu::crc32(0, bytes, data.size()) == zlibCrc(data));
+    // The CRC can be computed piecewise.
+    CHECK(Ubuntu::crc32(Ubuntu::crc32(0, bytes, size / 3), bytes + size / 3, size - size / 3) ==
+          zlibCrc(data));
+  }
+}
+
+void checkBlockGzip(const std::filesystem::path& directory) {
+  const std::string data = testData(3 << 20, 7);
+  const std::string file = bgzf(data);
+  const auto source = directory / "install.tar.gz";
+  const auto destination = directory / "install.tar";
+  writeFile(source, file);
+
+  CHECK(Ubuntu::bgzfMemberSize(file) == bgzfMember(data.substr(0, BgzfBlockSize)).size());
+  CHECK(Ubuntu::isBlockGzip(source));
+  for (unsigned workers : {1, 2, 8}) {
+    std::size_t progress = 0;
+    const auto onProgress = [&](std::string_view written) { progress += written.size(); };
+    CHECK(Ubuntu::decompressBlockGzip(source, destination, workers, onProgress));
+    CHECK(readFile(destination) == data);
+    CHECK(progress == data.size());
+  }
+
+  // A single gzip member, as the images were before, is not BGZF.
+  writeFile(source, std::string{"\x1f\x8b\x08\0\0\0\0\0\0\xff", 10} +
+                        zlibDeflate(data, 6, Z_DEFAULT_STRATEGY));
+  CHECK(!Ubuntu::isBlockGzip(source));
+
+  // Corrupting a byte of the payload of a member in the middle fails its CRC, or its decoding.
+  std::string corrupt = file;
+  corrupt[corrupt.size() / 2] ^= 0x20;
+  writeFile(source, corrupt);
+  CHECK(!Ubuntu::decompressBlockGzip(source, destination, 4));
+
+  // A member claiming more than BGZF allows is refused before anything is allocated for it.
+  std::string oversized;
+  for (int i = 0; i < 64; ++i) {
+    std::string member = bgzfMember("x");
+    member.replace(member.size() - 4, 4, "ðÿÿÿ");
+    oversized += member;
+  }
+  writeFile(source, oversized);
+  CHECK(!Ubuntu::decompressBlockGzip(source, destination, 4));
+}
+}  // namespace
+
+int main() {
+  checkInflate();
+
+  const auto directory = std::filesystem::temp_directory_path() / "GzipTest";
+  std::filesystem::create_directories(directory);
+  checkBlockGzip(directory);
+  std::filesystem::remove_all(directory);
+  return checkResult();
+}
@@ -0,0 +1,99 @@
+#include <stdafx.h>
+#include "Ubuntu/HashTree.h"
+#include "tests/Check.h"
+
+#include <fstream>
+
+// Checks that a shipped manifest is only trusted if its root hash is the one embedded at build
+// time, and that chunks are verified against it.
+namespace {
+constexpr std::size_t ChunkSize = 1000;
+
+std::string hex(const Ubuntu::Sha256Digest& digest) {
+  std::string out;
+  for (const unsigned char byte : digest) {
+    out += "0123456789abcdef"[byte >> 4];
+    out += "0123456789abcdef"[byte & 0xf];
+  }
+  return out;
+}
+
+Ubuntu::Sha256Digest digest(std::string_view data) {
+  return Ubuntu::sha256(reinterpret_cast<const unsigned char*>(data.data()), data.size());
+}
+
+// The manifest the build writes for [data], and its root hash.
+std::pair<std::string, std::string> manifest(std::string_view data) {
+  std::string digests;
+  std::string lines;
+  for (std::size_t offset = 0; offset < data.size(); offset += ChunkSize) {
+    const auto chunk = digest(data.substr(offset, ChunkSize));
+    digests.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    lines += hex(chunk) + '\n';
+  }
+  const std::string root = hex(digest(digests));
+  return {std::to_string(ChunkSize) + ' ' + std::to_string(data.size()) + ' ' + root + '\n' + lines,
+          root};
+}
+
+void writeFile(const std::filesystem::path& path, std::string_view contents) {
+  std::ofstream{path, std::ios::binary}.write(contents.data(), contents.size());
+}
+}  // namespace
+
+int main() {
+  const auto directory = std::filesystem::temp_directory_path() / "HashTreeTest";
+  std::filesystem::create_directories(directory);
+  const auto rootfs = directory / "install.tar.gz";
+  auto manifestPath = rootfs;
+  manifestPath += L".hashtree";
+
+  std::string data(4500, '\0');
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i * 7 + i / 13);
+  }
+  const auto [contents, root] = manifest(data);
+  const std::string otherRoot = manifest(data.substr(1)).second;
+
+  // Without an embedded root hash, as in development builds, the manifest isn't trusted.
+  writeFile(manifestPath, contents);
+  auto shipped = Ubuntu::loadHashTree(rootfs, {});
+  CHECK(!shipped.tree && !shipped.malformed);
+  CHECK(Ubuntu::expectedRootHash(rootfs).empty());
+
+  shipped = Ubuntu::loadHashTree(rootfs, root);
+  CHECK(shipped.tree && !shipped.malformed);
+  CHECK(shipped.tree && hex(shipped.tree->root()) == root);
+
+  // A consistent manifest for another file is as bad as none.
+  shipped = Ubuntu::loadHashTree(rootfs, otherRoot);
+  CHECK(!shipped.tree && shipped.malformed);
+  std::filesystem::remove(manifestPath);
+  shipped = Ubuntu::loadHashTree(rootfs, root);
+  CHECK(!shipped.tree && shipped.malformed);
+  writeFile(manifestPath, contents.substr(0, contents.size() - 10));
+  shipped = Ubuntu::loadHashTree(rootfs, root);
+  CHECK(!shipped.tree && shipped.malformed);
+
+  // Chunks are verified in pieces of any size.
+  const auto tree = Ubuntu::HashTree::parse(contents);
+  CHECK(tree && tree->chunkCount() == 5 && tree->chunkSize(4) == 500);
+  for (const bool corrupt : {false, true}) {
+    std::string read = data;
+    if (corrupt) {
+      read[2345] ^= 0x10;
+    }
+    Ubuntu::ChunkVerifier verifier{*tree};
+    for (std::size_t offset = 0; offset < read.size(); offset += 700) {
+      CHECK(verifier.feed(std::string_view{read}.substr(offset, 700)));
+      for (std::size_t job = 0; job < verifier.jobs(); ++job) {
+        verifier.run(job);
+      }
+    }
+    CHECK(verifier.complete());
+    CHECK(verifier.failed() == corrupt);
+  }
+
+  std::filesystem::remove_all(directory);
+  return checkResult();
+}
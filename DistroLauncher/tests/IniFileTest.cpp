@@ -0,0 +1,92 @@
+#include <stdafx.h>
+#include "Ubuntu/IniFile.h"
+#include "tests/Check.h"
+
+using Ubuntu::IniFile;
+using Ubuntu::setIniValue;
+
+// Checks the reader against the GetPrivateProfileString rules it replaced, and that setIniValue
+// leaves everything but the line it writes as it was.
+namespace {
+void checkComments() {
+  const IniFile ini{"# [user]\n; default=commented\n[user]\n  # default=indented\ndefault=bob\n"};
+  CHECK(ini.sections().size() == 1);
+  CHECK(ini.entries().size() == 1);
+  CHECK(ini.get("user", "default") == "bob");
+}
+
+void checkSyntax() {
+  const IniFile ini{"top=level\n[ User ]\n\tDEFAULT = \"bob\" \nno equal sign\n[empty]\n"};
+  CHECK(ini.get("", "top") == "level");
+  CHECK(ini.get("user", "default") == "bob");
+  CHECK(ini.get("USER", "Default") == "bob");
+  CHECK(ini.sections().size() == 2);
+  CHECK(ini.sections()[1] == "empty");
+  CHECK(ini.entries().size() == 2);
+}
+
+// The first occurrence wins, even if its section appears again later.
+void checkDuplicates() {
+  const IniFile ini{"[user]\ndefault=bob\ndefault=alice\n[boot]\nsystemd=true\n[user]\n"
+                    "default=carol\nother=1\n"};
+  CHECK(ini.get("user", "default") == "bob");
+  CHECK(ini.get("user", "other") == "1");
+  CHECK(ini.sections().size() == 2);
+  CHECK(!ini.get("boot", "default"));
+  CHECK(!ini.get("automount", "enabled"));
+  CHECK(!ini.get("", "default"));
+}
+
+void checkLineEndings() {
+  const IniFile crlf{"[user]\r\ndefault = bob\r\n\r\n[boot]\r\nsystemd=true\r\n"};
+  CHECK(crlf.get("user", "default") == "bob");
+  CHECK(crlf.get("boot", "systemd") == "true");
+
+  const IniFile unterminated{"[user]\ndefault=bob"};
+  CHECK(unterminated.get("user", "default") == "bob");
+  CHECK(IniFile{""}.entries().empty());
+}
+
+void checkReplace() {
+  CHECK(setIniValue("[user]\ndefault=bob\ndefault=alice\n", "user", "default", "carol") ==
+        "[user]\ndefault = carol\ndefault=alice\n");
+  CHECK(setIniValue("# header\n[User]\n  Default = bob  # not a comment\n[boot]\n", "user",
+                    "default", "carol") == "# header\n[User]\ndefault = carol\n[boot]\n");
+  CHECK(setIniValue("[user]\r\ndefault=bob\r\n", "user", "default", "carol") ==
+        "[user]\r\ndefault = carol\r\n");
+  CHECK(setIniValue("[user]\ndefault=bob", "user", "default", "carol") ==
+        "[user]\ndefault = carol");
+}
+
+void checkAppend() {
+  // After the last key of the section, wherever it appears.
+  CHECK(setIniValue("[user]\ndefault=bob\n[boot]\nsystemd=true\n", "boot", "command", "x") ==
+        "[user]\ndefault=bob\n[boot]\nsystemd=true\ncommand = x\n");
+  CHECK(setIniValue("[boot]\nsystemd=true\n[user]\n[boot]\ncommand=x\n[network]\n", "boot",
+                    "protectBinfmt", "false") ==
+        "[boot]\nsystemd=true\n[user]\n[boot]\ncommand=x\nprotectBinfmt = false\n[network]\n");
+  // After the header of a section with no keys.
+  CHECK(setIniValue("[user]\n# nothing yet\n[boot]\n", "user", "default", "bob") ==
+        "[user]\ndefault = bob\n# nothing yet\n[boot]\n");
+  // In a new section, at the end.
+  CHECK(setIniValue("", "user", "default", "bob") == "[user]\ndefault = bob\n");
+  CHECK(setIniValue("[boot]\nsystemd=true", "user", "default", "bob") ==
+        "[boot]\nsystemd=true\n[user]\ndefault = bob\n");
+  // With the line breaks of the file.
+  CHECK(setIniValue("[user]\r\nother=1\r\n", "user", "default", "bob") ==
+        "[user]\r\nother=1\r\ndefault = bob\r\n");
+  CHECK(setIniValue("[user]\r\n", "user", "default", "bob") == "[user]\r\ndefault = bob\r\n");
+  CHECK(setIniValue("[boot]\r\nsystemd=true", "user", "default", "bob") ==
+        "[boot]\r\nsystemd=true\r\n[user]\r\ndefault = bob\r\n");
+}
+}  // namespace
+
+int main() {
+  checkComments();
+  checkSyntax();
+  checkDuplicates();
+  checkLineEndings();
+  checkReplace();
+  checkAppend();
+  return checkResult();
+}
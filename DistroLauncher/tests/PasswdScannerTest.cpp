@@ -0,0 +1,101 @@
+#include <stdafx.h>
+#include "Ubuntu/PasswdScanner.h"
+#include "Ubuntu/SplitView.h"
+#include "tests/Check.h"
+
+#include <random>
+
+using Ubuntu::PasswdScanner;
+
+namespace {
+constexpr PasswdScanner::Isa Isas[] = {PasswdScanner::Isa::Scalar, PasswdScanner::Isa::Sse2,
+                                       PasswdScanner::Isa::Avx2};
+
+// Splits [text] as the scanner replaced: lines split by '\n', each split by ':'.
+std::vector<std::vector<std::string_view>> splitViews(std::string_view text) {
+  std::vector<std::vector<std::string_view>> lines;
+  for (auto line : Ubuntu::SplitView{text, '\n'}) {
+    auto& fields = lines.emplace_back();
+    for (auto field : Ubuntu::SplitView{line, ':'}) {
+      if (fields.size() < PasswdScanner::FieldCount) {
+        fields.push_back(field);
+      }
+    }
+  }
+  return lines;
+}
+
+std::vector<std::vector<std::string_view>> scan(std::string_view text, PasswdScanner::Isa isa) {
+  std::vector<std::vector<std::string_view>> lines;
+  PasswdScanner scanner{text, isa};
+  PasswdScanner::Line line;
+  while (scanner.next(line)) {
+    lines.emplace_back(line.fields.begin(), line.fields.begin() + line.count);
+  }
+  return lines;
+}
+
+void checkAgrees(std::string_view text) {
+  const auto expected = splitViews(text);
+  for (const auto isa : Isas) {
+    if (!PasswdScanner::supports(isa)) {
+      continue;
+    }
+    const auto lines = scan(text, isa);
+    CHECK(lines == expected);
+    // Views must point into the text, not merely have the same contents.
+    for (std::size_t i = 0; i < lines.size() && i < expected.size(); ++i) {
+      for (std::size_t j = 0; j < lines[i].size() && j < expected[i].size(); ++j) {
+        CHECK(lines[i][j].data() == expected[i][j].data());
+      }
+    }
+  }
+}
+
+// Random text made mostly of delimiters and short fields, so that every layout of lines and fields
+// across 64 bytes blocks comes up.
+std::string randomText(std::mt19937& random, std::size_t size) {
+  constexpr std::string_view alphabet = "::\n\nab/0";
+  std::uniform_int_distribution<std::size_t> pick{0, alphabet.size() - 1};
+  std::string text(size, '\0');
+  for (auto& c : text) {
+    c = alphabet[pick(random)];
+  }
+  return text;
+}
+}  // namespace
+
+int main() {
+  CHECK(PasswdScanner::supports(PasswdScanner::Isa::Scalar));
+  CHECK(PasswdScanner::supports(PasswdScanner::bestIsa()));
+
+  for (std::string_view text :
+       {"", "\n", "\n\n", ":", "::\n:", "root:x:0:0:root:/root:/bin/bash",
+        "root:x:0:0:root:/root:/bin/bash\n", "a:b:c:d:e:f:g:h:i\nj", "trailing:\n\nempty:lines\n\n",
+        "u:x:1000:1000:a field spanning the first block boundary of 64 bytes:/home/u:/bin/sh\n"}) {
+    checkAgrees(text);
+  }
+
+  std::mt19937 random{20240229};
+  for (std::size_t size = 0; size <= 300; ++size) {
+    for (int round = 0; round < 8; ++round) {
+      checkAgrees(randomText(random, size));
+    }
+  }
+
+  // Bytes equal to a delimiter once sign-extended or shifted must not match.
+  std::string highBytes;
+  for (int c = 0; c < 256; ++c) {
+    highBytes += static_cast<char>(c);
+  }
+  checkAgrees(highBytes + highBytes);
+
+  PasswdScanner scanner{"u:x:1000:1000::/home/u:/bin/bash\n"};
+  PasswdScanner::Line line;
+  CHECK(scanner.next(line));
+  const auto entry = Ubuntu::parsePasswdEntry(line);
+  CHECK(entry.has_value() && entry->name == "u" && entry->uid == 1000 && entry->hasLogin);
+  CHECK(!scanner.next(line));
+
+  return checkResult();
+}
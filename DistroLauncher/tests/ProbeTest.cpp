@@ -0,0 +1,159 @@
+#include <stdafx.h>
+#include "Ubuntu/FakeWslApi.h"
+#include "Ubuntu/Probe.h"
+#include "Ubuntu/WslProcess.h"
+#include "tests/Check.h"
+
+using Ubuntu::ProbeDemultiplexer;
+using Ubuntu::ProbeSection;
+
+// Splits probe output fed in chunks of every size, malformed or not, and then the output of a real
+// probe run through the fake backend.
+namespace {
+struct Demuxed {
+  std::vector<ProbeSection> sections;
+  bool accepted = true;
+  bool complete = false;
+};
+
+Demuxed demux(std::string_view stream, std::size_t chunkSize) {
+  Demuxed result;
+  ProbeDemultiplexer demultiplexer{
+      [&](ProbeSection&& section) { result.sections.push_back(std::move(section)); }};
+  for (std::size_t offset = 0; offset < stream.size(); offset += chunkSize) {
+    result.accepted = demultiplexer.feed(stream.substr(offset, chunkSize)) && result.accepted;
+  }
+  result.complete = demultiplexer.complete();
+  return result;
+}
+
+bool same(const ProbeSection& section, std::string_view name, int exitCode, std::string_view data) {
+  return section.name == name && section.exitCode == exitCode && section.data == data;
+}
+
+// Whatever the chunks, headers and bodies split anywhere in them.
+void checkWellFormed() {
+  const std::string_view stream =
+      "passwd 0 12\nroot:x:0:0:\n"
+      "empty 1 0\n"
+      "lines 3 9\nax1\nx\nx7\n"
+      "streamed -\n root:x:0:0:\n x\n \nx2\n"
+      "unterminated -\n a\n b\nx0\n"
+      "nothing -\n \nx1\n"
+      "last 255 2\n\n\n";
+  for (std::size_t chunkSize = 1; chunkSize <= stream.size(); ++chunkSize) {
+    const auto result = demux(stream, chunkSize);
+    CHECK(result.accepted && result.complete);
+    CHECK(result.sections.size() == 7);
+    if (result.sections.size() == 7) {
+      CHECK(same(result.sections[0], "passwd", 0, "root:x:0:0:\n"));
+      CHECK(same(result.sections[1], "empty", 1, ""));
+      CHECK(same(result.sections[2], "lines", 3, "ax1\nx\nx7\n"));
+      CHECK(same(result.sections[3], "streamed", 2, "root:x:0:0:\nx\n"));
+      CHECK(same(result.sections[4], "unterminated", 0, "a\nb"));
+      CHECK(same(result.sections[5], "nothing", 1, ""));
+      CHECK(same(result.sections[6], "last", 255, "\n\n"));
+    }
+  }
+}
+
+void checkStreamed() {
+  std::string streamed;
+  std::vector<ProbeSection> sections;
+  ProbeDemultiplexer demultiplexer{
+      [&](ProbeSection&& section) { sections.push_back(std::move(section)); }};
+  demultiplexer.stream("big", [&](std::string_view chunk) { streamed += chunk; });
+  for (const char c : std::string_view{"a 0 1\nxbig 0 5\nhello"}) {
+    CHECK(demultiplexer.feed({&c, 1}));
+  }
+  CHECK(demultiplexer.complete());
+  CHECK(streamed == "hello");
+  CHECK(sections.size() == 2 && same(sections[1], "big", 0, ""));
+
+  // Lines of a streamed section are handed over before they end, or the section does.
+  streamed.clear();
+  CHECK(demultiplexer.feed("big -\n hel"));
+  CHECK(streamed == "hel");
+  CHECK(demultiplexer.feed("lo\n"));
+  CHECK(streamed == "hello");
+  CHECK(demultiplexer.feed(" \nx0\n"));
+  CHECK(demultiplexer.complete());
+  CHECK(streamed == "hello\n");
+  CHECK(sections.size() == 3 && same(sections[2], "big", 0, ""));
+}
+
+void checkMalformed() {
+  // A section cut short is only incomplete: more may come.
+  auto result = demux("a 0 5\nabc", 2);
+  CHECK(result.accepted && !result.complete && result.sections.empty());
+  result = demux("a 0 1\nxb 0", 3);
+  CHECK(result.accepted && !result.complete && result.sections.size() == 1);
+  result = demux("a -\n line\n", 2);
+  CHECK(result.accepted && !result.complete && result.sections.empty());
+
+  for (const std::string_view header :
+       {"a  5\n", "a 0\n", " 0 0\n", "a x 0\n", "a 0 -1\n", "a 0 5 x\n", "a 0 +5\n", "\n",
+        "a - 0\n", "a -\nline\n", "a -\n a\nx\n", "a -\n a\nx1 \n"}) {
+    for (std::size_t chunkSize : {std::size_t{1}, header.size()}) {
+      result = demux(header, chunkSize);
+      CHECK(!result.accepted && !result.complete && result.sections.empty());
+    }
+  }
+
+  // Once malformed, nothing more is read, not even well-formed sections.
+  result = demux("a 0 1\nxgarbage\nb 0 0\n", 1);
+  CHECK(!result.accepted && result.sections.size() == 1);
+  // Trailing garbage without a line break is an incomplete header.
+  result = demux("a 0 1\nxgarbage", 4);
+  CHECK(result.accepted && !result.complete && result.sections.size() == 1);
+}
+
+// Through the real section function, outputs without a trailing line break, with line breaks and
+// with the marker character, commands exiting the shell and failing ones keep their framing.
+void checkProbe() {
+  const std::vector<Ubuntu::ProbeQuery> queries{
+      {L"marker", L"printf 'ax1\\nx'; exit 3"},
+      {L"empty", L"true"},
+      {L"lines", L"printf '\\n\\n'"},
+      {L"quotes", L"printf '%s' \"it's \\\\ $((6 * 7))\""},
+      {L"missing", L"/nonexistent 2>&1"},
+      {L"utf8", L"printf '\\303\\251'"},
+      {L"streamed", L"printf 'a\\n\\n x\\nb'; exit 4", true},
+      {L"streamed-lines", L"printf 'a\\n\\n'", true},
+      {L"streamed-empty", L"true", true},
+  };
+  Ubuntu::FakeWslApi api{{}};
+  Ubuntu::WslProcess probe{Ubuntu::probeCommand(queries)};
+  probe.setInput({});
+  std::vector<ProbeSection> sections;
+  ProbeDemultiplexer demultiplexer{
+      [&](ProbeSection&& section) { sections.push_back(std::move(section)); }};
+  bool accepted = true;
+  const auto result = probe.run(api, 10000, [&](std::string_view chunk) {
+    accepted = demultiplexer.feed(chunk) && accepted;
+  });
+
+  CHECK(result.error.empty());
+  CHECK(accepted && demultiplexer.complete());
+  CHECK(sections.size() == queries.size());
+  if (sections.size() == queries.size()) {
+    CHECK(same(sections[0], "marker", 3, "ax1\nx"));
+    CHECK(same(sections[1], "empty", 0, ""));
+    CHECK(same(sections[2], "lines", 0, "\n\n"));
+    CHECK(same(sections[3], "quotes", 0, "it's \\ 42"));
+    CHECK(sections[4].name == "missing" && sections[4].exitCode == 127);
+    CHECK(same(sections[5], "utf8", 0, "\xc3\xa9"));
+    CHECK(same(sections[6], "streamed", 4, "a\n\n x\nb"));
+    CHECK(same(sections[7], "streamed-lines", 0, "a\n\n"));
+    CHECK(same(sections[8], "streamed-empty", 0, ""));
+  }
+}
+}  // namespace
+
+int main() {
+  checkWellFormed();
+  checkStreamed();
+  checkMalformed();
+  checkProbe();
+  return checkResult();
+}
@@ -0,0 +1,120 @@
+#include <stdafx.h>
+#include "Ubuntu/FakeWslApi.h"
+#include "Ubuntu/ProcessPool.h"
+#include "tests/Check.h"
+
+#include <chrono>
+
+using Ubuntu::WslProcessPool;
+using Clock = std::chrono::steady_clock;
+
+// Runs processes through the fake backend on a pool of its own: many at once, each with its own
+// timeout, cancelled, or moving more data than a pipe buffer holds both ways.
+namespace {
+// Far more than any pipe buffer, 64 KiB on Linux.
+constexpr std::size_t LargeSize = 4 * 1024 * 1024;
+
+WslProcessPool::Request request(std::wstring command) {
+  WslProcessPool::Request request;
+  request.command = std::move(command);
+  request.input.emplace();
+  return request;
+}
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The processes wait side by side, not one after the other.
+void checkConcurrent(Ubuntu::FakeWslApi& api, WslProcessPool& pool) {
+  constexpr int Count = 16;
+  const auto start = Clock::now();
+  std::vector<WslProcessPool::Process> processes;
+  std::atomic<int> completed{0};
+  for (int i = 0; i < Count; ++i) {
+    processes.push_back(pool.launch(
+        api, request(L"sleep 0.5; echo " + std::to_wstring(i) + L"; exit " + std::to_wstring(i)),
+        [&](const WslProcessPool::Result&) { ++completed; }));
+  }
+  for (int i = 0; i < Count; ++i) {
+    const auto result = processes[i].get();
+    CHECK(result.error.empty());
+    CHECK(result.exitCode == static_cast<DWORD>(i));
+    CHECK(result.stdOut == std::to_string(i) + "\n");
+  }
+  CHECK(completed == Count);
+  CHECK(secondsSince(start) < Count * 0.5 / 2);
+}
+
+// A process timing out is terminated alone, the others run on.
+void checkTimeout(Ubuntu::FakeWslApi& api, WslProcessPool& pool) {
+  const auto start = Clock::now();
+  auto slow = request(L"sleep 10");
+  slow.timeout = 200;
+  auto timedOut = pool.launch(api, std::move(slow));
+  auto patient = pool.launch(api, request(L"sleep 1; echo done"));
+
+  const auto result = timedOut.get();
+  CHECK(!result.error.empty());
+  CHECK(secondsSince(start) < 5);
+  const auto other = patient.get();
+  CHECK(other.error.empty() && other.stdOut == "done\n");
+}
+
+void checkCancel(Ubuntu::FakeWslApi& api, WslProcessPool& pool) {
+  const auto start = Clock::now();
+  auto cancelled = pool.launch(api, request(L"sleep 10"));
+  auto other = pool.launch(api, request(L"echo still here"));
+  cancelled.cancel();
+  const auto result = cancelled.get();
+  CHECK(result.error == L"cancelled");
+  CHECK(secondsSince(start) < 5);
+  CHECK(other.get().stdOut == "still here\n");
+
+  // Once completed, there is nothing left to cancel.
+  auto done = pool.launch(api, request(L"true"));
+  done.future().wait();
+  done.cancel();
+  CHECK(done.get().error.empty());
+}
+
+// Input is written while output is read, so neither side waits for the other whatever the sizes.
+void checkLargeOutput(Ubuntu::FakeWslApi& api, WslProcessPool& pool) {
+  std::string input(LargeSize, '\0');
+  for (std::size_t i = 0; i < input.size(); ++i) {
+    input[i] = static_cast<char>('a' + i % 26);
+  }
+  auto echo = request(L"cat");
+  echo.input = input;
+  auto collected = pool.launch(api, std::move(echo));
+
+  std::size_t streamedSize = 0;
+  auto stream = request(L"head -c " + std::to_wstring(LargeSize) + L" /dev/zero");
+  stream.onOutput = [&](std::string_view chunk) { streamedSize += chunk.size(); };
+  auto streamed = pool.launch(api, std::move(stream));
+
+  const auto result = collected.get();
+  CHECK(result.error.empty() && result.exitCode == 0);
+  CHECK(result.stdOut == input);
+  CHECK(result.outputSize == LargeSize);
+  const auto streamedResult = streamed.get();
+  CHECK(streamedResult.error.empty() && streamedResult.stdOut.empty());
+  CHECK(streamedResult.outputSize == LargeSize && streamedSize == LargeSize);
+
+  // Past the limit, the process is terminated.
+  auto capped = request(L"head -c " + std::to_wstring(LargeSize) + L" /dev/zero");
+  capped.maxOutputSize = LargeSize / 4;
+  capped.onError = [](std::string_view) {};
+  CHECK(pool.launch(api, std::move(capped)).get().error == L"process output is too big");
+}
+}  // namespace
+
+int main() {
+  Ubuntu::FakeWslApi api{{}};
+  WslProcessPool pool;
+  checkConcurrent(api, pool);
+  checkTimeout(api, pool);
+  checkCancel(api, pool);
+  checkLargeOutput(api, pool);
+  return checkResult();
+}
@@ -0,0 +1,119 @@
+#include <stdafx.h>
+#include "Ubuntu/FakeWslApi.h"
+#include "Ubuntu/Provisioning.h"
+#include "tests/Check.h"
+
+#include <fstream>
+#include <sstream>
+
+using Ubuntu::ProvisioningResult;
+using Ubuntu::ProvisioningStep;
+
+// Runs provisioning scripts through the fake backend: steps commit or roll back as a whole, and
+// each gets its own input only.
+namespace {
+std::filesystem::path directory;
+
+std::string readFile(const std::filesystem::path& path) {
+  std::ifstream file{path};
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// A command appending [mark] to the journal, recording what ran in which order.
+std::wstring journal(std::wstring_view mark) {
+  return L"printf '%s ' " + std::wstring{mark} + L" >>" + (directory / "journal").wstring();
+}
+
+bool same(const Ubuntu::ProbeSection& section, std::string_view name, int exitCode,
+          std::string_view data) {
+  return section.name == name && section.exitCode == exitCode && section.data == data;
+}
+
+// A required step failing undoes the ones before it, latest first, and stops the script.
+void checkRollback() {
+  std::filesystem::remove(directory / "journal");
+  const std::vector<ProvisioningStep> steps{
+      {"first", journal(L"first"), journal(L"undo-first")},
+      {"second", journal(L"second") + L"; exit 3", journal(L"undo-second"), true},
+      {"third", journal(L"third") + L"; exit 4", journal(L"undo-third")},
+      {"fourth", journal(L"fourth"), journal(L"undo-fourth")},
+  };
+  Ubuntu::FakeWslApi api{{}};
+  const auto result = Ubuntu::provision(api, steps);
+  CHECK(result && !result->committed);
+  CHECK(result && result->sections.size() == 5);
+  if (result && result->sections.size() == 5) {
+    CHECK(same(result->sections[0], "first", 0, ""));
+    CHECK(same(result->sections[1], "second", 3, ""));
+    CHECK(same(result->sections[2], "third", 4, ""));
+    CHECK(same(result->sections[3], "undo-second", 0, ""));
+    CHECK(same(result->sections[4], "undo-first", 0, ""));
+  }
+  CHECK(result && !result->find("fourth"));
+  CHECK(readFile(directory / "journal") == "first second third undo-second undo-first ");
+
+  // Optional steps failing don't prevent the commit.
+  std::filesystem::remove(directory / "journal");
+  const std::vector<ProvisioningStep> optional{steps[0], steps[1], steps[3]};
+  const auto committed = Ubuntu::provision(api, optional);
+  CHECK(committed && committed->committed && committed->sections.size() == 3);
+  CHECK(readFile(directory / "journal") == "first second fourth ");
+}
+
+// Inputs reach the step they belong to, and nothing else, whatever the steps read.
+void checkInput() {
+  std::vector<ProvisioningStep> steps{
+      {"one", L"cat", L"", false, true},
+      {"none", L"cat", L"", false, true},
+      {"two", L"cat; cat", L"", false, true},
+      {"argv", L"ps -o args= -p $$ 2>/dev/null || true", L"", false, true},
+  };
+  steps[0].input = "first secret";
+  steps[2].input = "second 'secret' \\";
+  CHECK(Ubuntu::provisioningInput(steps) == "first secret\nsecond 'secret' \\\n");
+
+  Ubuntu::FakeWslApi api{{}};
+  const auto result = Ubuntu::provision(api, steps);
+  CHECK(result && result->committed);
+  CHECK(result && result->find("one") && result->find("one")->data == "first secret");
+  CHECK(result && result->find("none") && result->find("none")->data.empty());
+  CHECK(result && result->find("two") && result->find("two")->data == "second 'secret' \\");
+  const auto* argv = result ? result->find("argv") : nullptr;
+  CHECK(argv && argv->data.find("secret") == std::string::npos);
+}
+
+void checkCreatedUid() {
+  Ubuntu::FakeWslApi api{{}};
+  const std::vector<ProvisioningStep> steps{{"uid", L"echo 1234", L"", false, true}};
+  const auto result = Ubuntu::provision(api, steps);
+  CHECK(result && Ubuntu::createdUid(*result) == 1234ul);
+
+  ProvisioningResult rolledBack{false, {{"uid", 0, "1234"}}};
+  CHECK(!Ubuntu::createdUid(rolledBack));
+  ProvisioningResult garbage{true, {{"uid", 0, "12x"}}};
+  CHECK(!Ubuntu::createdUid(garbage));
+  ProvisioningResult missing{true, {{"usermod", 0, ""}}};
+  CHECK(!Ubuntu::createdUid(missing));
+
+  // The steps creating a user end with the one reporting its UID.
+  const auto create = Ubuntu::createUserSteps({L"user", L"$6$hash", {L"docker"}});
+  CHECK(create.size() == 4 && create.back().name == "uid" && create.back().capture);
+  CHECK(create.size() == 4 && create[1].input == "user:$6$hash");
+  CHECK(create.size() == 4 && create[2].command.find(L"netdev,docker") != std::wstring::npos);
+}
+}  // namespace
+
+int main() {
+  directory = std::filesystem::temp_directory_path() / "ProvisioningTest";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+
+  checkRollback();
+  checkInput();
+  checkCreatedUid();
+
+  std::filesystem::remove_all(directory);
+  return checkResult();
+}
@@ -0,0 +1,170 @@
+#include <stdafx.h>
+#include "Ubuntu/FakeWslApi.h"
+#include "Ubuntu/InitTasks.h"
+#include "Ubuntu/Roster.h"
+#include "tests/Check.h"
+
+#include <fstream>
+
+#include <sys/stat.h>
+
+// Parses rosters, then applies one through the fake backend while the default user is a regular
+// account, as it is once the distro is installed. The account management commands are stand-ins,
+// recording accounts in a file of their own rather than in the host's database, but they fail
+// unless run as root, as the real ones do. Switching users takes root, thus applying the roster is
+// skipped otherwise.
+namespace {
+constexpr int Skipped = 77;
+constexpr ULONG Nobody = 65534;
+
+std::filesystem::path directory;
+
+void checkParse() {
+  std::wstring error;
+  const auto parsed = Ubuntu::Roster::parse(
+      "Name, Password, Groups\r\n# lab accounts\r\n\r\n"
+      "alice,!$6$salt$hash,docker ; libvirt\r\n"
+      "\"bob\",\"\",\n"
+      "host$\n"
+      " carol , $y$j9T$salt$hash ,\"video;audio\"",
+      error);
+  CHECK(parsed && error.empty());
+  CHECK(parsed && parsed->users.size() == 4);
+  if (parsed && parsed->users.size() == 4) {
+    const auto& users = parsed->users;
+    CHECK(users[0].name == "alice" && users[0].passwordHash == "!$6$salt$hash");
+    CHECK((users[0].extraGroups == std::vector<std::string>{"docker", "libvirt"}));
+    CHECK(users[1].name == "bob" && !users[1].passwordHash && users[1].extraGroups.empty());
+    CHECK(users[2].name == "host$" && !users[2].passwordHash);
+    CHECK(users[3].name == "carol" && users[3].passwordHash == "$y$j9T$salt$hash");
+    CHECK((users[3].extraGroups == std::vector<std::string>{"video", "audio"}));
+  }
+
+  for (const std::string_view contents : {
+           "",
+           "name,password,groups\n# nobody\n",
+           "Alice,,\n",
+           "a$$,,\n",
+           "abcdefghijklmnopqrstuvwxyz0123456,,\n",
+           "alice,,\nbob,,\nalice,,\n",
+           "alice,hunter2,\n",
+           "alice,!,\n",
+           "alice,,docker libvirt\n",
+           "alice,,docker;;libvirt\n",
+           "alice,,docker,libvirt\n",
+           "\"alice,,\n",
+           "alice,,\nname,password,groups\n",
+       }) {
+    std::wstring reason;
+    CHECK(!Ubuntu::Roster::parse(contents, reason));
+    CHECK(!reason.empty());
+  }
+}
+
+void writeShim(const std::string& name, const std::string& body) {
+  const auto path = directory / "bin" / name;
+  std::ofstream{path} << "#!/bin/sh\n" << body;
+  chmod(path.c_str(), 0755);
+}
+
+void writeShims() {
+  std::filesystem::create_directories(directory / "bin");
+  const std::string asRoot = "[ \"$(id -u)\" = 0 ] || exit 1\n";
+  writeShim("newusers", asRoot + R"sh(uid=2000
+while IFS=: read -r name password a b c home shell; do
+  uid=$((uid + 1))
+  mkdir -p "$ROSTER_TEST_STATE/home/$name"
+  echo "$name:x:$uid:$uid::$ROSTER_TEST_STATE/home/$name:$shell" >> "$ROSTER_TEST_STATE/passwd"
+done
+)sh");
+  writeShim("getent", R"sh(if [ $# -ge 2 ]; then
+  grep "^$2:" "$ROSTER_TEST_STATE/passwd" 2>/dev/null || /usr/bin/getent "$@"
+else
+  /usr/bin/getent "$@"; cat "$ROSTER_TEST_STATE/passwd" 2>/dev/null
+fi
+)sh");
+  // ROSTER_TEST_AS stands for the default user /etc/wsl.conf may set, which WSL runs commands as.
+  writeShim("id", R"sh(if [ -n "$ROSTER_TEST_AS" ] && [ $# -eq 1 ]; then
+  case $1 in -u) echo 1000;; -un) echo "$ROSTER_TEST_AS";; *) exec /usr/bin/id "$@";; esac
+elif [ "$1" = -u ] && [ $# -eq 2 ]; then
+  line=$(getent passwd "$2") || exit 1; echo "$line" | cut -d: -f3
+else
+  exec /usr/bin/id "$@"
+fi
+)sh");
+  writeShim("usermod", asRoot);
+  writeShim("chown", asRoot);
+}
+
+Ubuntu::Roster roster() {
+  std::wstring error;
+  auto parsed = Ubuntu::Roster::parse("name,password,groups\nalice,,docker\nroot,,\n", error);
+  CHECK(parsed.has_value());
+  return parsed.value_or(Ubuntu::Roster{});
+}
+
+void checkAppliedAsRoot() {
+  Ubuntu::FakeWslApi api{{}};
+  CHECK(SUCCEEDED(api.WslConfigureDistribution(Nobody, WSL_DISTRIBUTION_FLAGS_DEFAULT)));
+
+  const auto report = Ubuntu::provisionRoster(api, roster());
+  CHECK(report.has_value());
+  if (report) {
+    CHECK(report->users.size() == 2);
+    CHECK(report->users[0].name == "alice");
+    CHECK(report->users[0].status == Ubuntu::RosterResult::Status::Created);
+    CHECK(report->users[0].uid == 2001);
+    CHECK(report->users[1].status == Ubuntu::RosterResult::Status::Exists);
+    CHECK(report->passwd.find("\nalice:x:2001:") != std::string::npos);
+  }
+  CHECK(api.defaultUid() == Nobody);
+}
+
+// When /etc/wsl.conf sets the default user, nothing runs as root, thus nothing is done.
+void checkWslConfOverride() {
+  Ubuntu::FakeWslApi api{{}};
+  CHECK(SUCCEEDED(api.WslConfigureDistribution(Nobody, WSL_DISTRIBUTION_FLAGS_DEFAULT)));
+  setenv("ROSTER_TEST_AS", "carol", 1);
+  std::wstring error;
+  const auto carol = Ubuntu::Roster::parse("carol,,\n", error);
+  const auto report = Ubuntu::provisionRoster(api, carol.value_or(Ubuntu::Roster{}));
+  unsetenv("ROSTER_TEST_AS");
+  CHECK(report.has_value());
+  if (report) {
+    CHECK(report->notRoot == "carol");
+    CHECK(report->users.size() == 1 &&
+          report->users[0].status == Ubuntu::RosterResult::Status::Failed);
+  }
+  CHECK(!std::filesystem::exists(directory / "home" / "carol"));
+  CHECK(api.defaultUid() == Nobody);
+}
+
+// The default user is restored even if the script can't be launched.
+void checkRestoredOnFailure() {
+  Ubuntu::FakeWslApi api{{{}, {}, "/nonexistent/sh"}};
+  CHECK(SUCCEEDED(api.WslConfigureDistribution(Nobody, WSL_DISTRIBUTION_FLAGS_DEFAULT)));
+  CHECK(!Ubuntu::provisionRoster(api, roster()).has_value());
+  CHECK(api.defaultUid() == Nobody);
+}
+}  // namespace
+
+int main() {
+  checkParse();
+  if (geteuid() != 0) {
+    std::fprintf(stderr, "skipped: switching to the default user takes root\n");
+    return checkFailures == 0 ? Skipped : checkResult();
+  }
+  directory = std::filesystem::temp_directory_path() / "RosterTest";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  writeShims();
+  setenv("ROSTER_TEST_STATE", directory.c_str(), 1);
+  setenv("PATH", (directory.string() + "/bin:" + std::getenv("PATH")).c_str(), 1);
+
+  checkAppliedAsRoot();
+  checkWslConfOverride();
+  checkRestoredOnFailure();
+
+  std::filesystem::remove_all(directory);
+  return checkResult();
+}
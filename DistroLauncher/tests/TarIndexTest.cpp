@@ -0,0 +1,231 @@
+#include <stdafx.h>
+#include "Ubuntu/TarIndex.h"
+#include "tests/Check.h"
+
+#include <fstream>
+
+using Ubuntu::TarIndex;
+using Ubuntu::TarMember;
+
+// Indexes an archive built header by header, fed in chunks of every size, in each of the formats
+// tar writers use in the wild, then looks members up through links as the distro would.
+namespace {
+constexpr std::size_t BlockSize = 512;
+
+struct Header {
+  std::string_view name;
+  char type = '0';
+  std::uint64_t size = 0;
+  std::string_view link;
+  std::string_view prefix;
+  // GNU headers have another magic, and use the ustar prefix for timestamps.
+  bool gnu = false;
+  // Whether the size is written in base-256, as GNU tar does for large files.
+  bool binarySize = false;
+};
+
+std::string header(const Header& h) {
+  std::string block(BlockSize, '\0');
+  block.replace(0, h.name.size(), h.name);
+  block.replace(100, 7, "0000644");
+  if (h.binarySize) {
+    block[124] = static_cast<char>(0x80);
+    for (std::size_t i = 0; i < 8; ++i) {
+      block[135 - i] = static_cast<char>((h.size >> (8 * i)) & 0xff);
+    }
+  } else {
+    char size[12];
+    std::snprintf(size, sizeof(size), "%011llo", static_cast<unsigned long long>(h.size));
+    block.replace(124, 11, size);
+  }
+  block[156] = h.type;
+  block.replace(157, h.link.size(), h.link);
+  const std::string_view magic = h.gnu ? std::string_view{"ustar  \0", 8}
+                                       : std::string_view{"ustar\0" "00", 8};
+  block.replace(257, magic.size(), magic);
+  block.replace(345, h.prefix.size(), h.prefix);
+
+  std::uint64_t sum = 0;
+  block.replace(148, 8, 8, ' ');
+  for (const char c : block) {
+    sum += static_cast<unsigned char>(c);
+  }
+  char checksum[8];
+  std::snprintf(checksum, sizeof(checksum), "%06llo", static_cast<unsigned long long>(sum));
+  block.replace(148, 7, checksum, 7);
+  return block;
+}
+
+std::string padded(std::string data) {
+  data.resize((data.size() + BlockSize - 1) / BlockSize * BlockSize, '\0');
+  return data;
+}
+
+std::string member(Header h, std::string_view contents = {}) {
+  h.size = contents.size();
+  return header(h) + padded(std::string{contents});
+}
+
+// A pax record, whose length counts its own digits.
+std::string paxRecord(std::string_view key, std::string_view value) {
+  const std::string body = " " + std::string{key} + "=" + std::string{value} + "\n";
+  auto length = body.size() + 1;
+  while (std::to_string(length).size() + body.size() != length) {
+    ++length;
+  }
+  return std::to_string(length) + body;
+}
+
+const std::string LongName = "usr/lib/" + std::string(150, 'a');
+const std::string PasswdContents = "root:x:0:0:root:/root:/bin/bash\n";
+constexpr int HopCount = 41;
+
+std::string archive() {
+  std::string tar;
+  tar += member({"./etc/", '5'});
+  tar += member({"./etc/passwd"}, PasswdContents);
+  tar += member({"doc/pkg/copyright", '0', 0, {}, "usr/share"}, "copyright\n");
+  tar += member({"usr/bin/tool", '0', 0, {}, "garbage", true}, "tool\n");
+
+  // GNU long names and long link targets.
+  tar += member({"././@LongLink", 'L', 0, {}, {}, true}, LongName + '\0');
+  tar += member({LongName.substr(0, 99), '0', 0, {}, {}, true}, "long\n");
+  tar += member({"././@LongLink", 'K', 0, {}, {}, true}, "/" + LongName + '\0');
+  tar += member({"usr/lib/longlink", '2', 0, "/usr/lib/aaa", {}, true});
+
+  // pax overrides of the path, the link target and the size of the next member.
+  const std::string paxContents(3000, 'p');
+  tar += member({"PaxHeaders/0", 'x'},
+                paxRecord("mtime", "1700000000.5") + paxRecord("path", "usr/share/pax/data") +
+                    paxRecord("size", std::to_string(paxContents.size())));
+  tar += header({"truncated-name", '0', 0}) + padded(paxContents);
+  tar += member({"PaxHeaders/1", 'x'}, paxRecord("linkpath", "../doc/pkg/copyright"));
+  tar += member({"usr/share/pax/link", '2', 0, "truncated-link"});
+
+  // Hard links, and members whose size field says nothing of their contents.
+  tar += member({"etc/passwd-", '1', 0, "./etc/passwd"});
+  tar += header({"dev/null", '3', 100});
+  tar += header({"usr/bin/big", '0', 5, {}, {}, true, true}) + padded("12345");
+
+  // Symbolic links, relative, absolute, to directories, dangling or looping.
+  tar += member({"etc/pw", '2', 0, "passwd"});
+  tar += member({"bin", '2', 0, "usr/bin"});
+  tar += member({"root-passwd", '2', 0, "/etc/passwd"});
+  tar += member({"etc/up", '2', 0, ".."});
+  tar += member({"etc/dangling", '2', 0, "missing"});
+  tar += member({"loop-a", '2', 0, "loop-b"});
+  tar += member({"loop-b", '2', 0, "./loop-a"});
+  for (int hop = 0; hop < HopCount; ++hop) {
+    const std::string name = "hop" + std::to_string(hop);
+    const std::string link = hop == 0 ? "etc/passwd" : "hop" + std::to_string(hop - 1);
+    tar += member({name, '2', 0, link});
+  }
+  return tar + std::string(2 * BlockSize, '\0');
+}
+
+std::string_view contents(std::string_view tar, const TarMember* member) {
+  if (!member || member->type != TarMember::Type::File) {
+    return "<none>";
+  }
+  return tar.substr(member->offset, member->size);
+}
+
+void checkIndex(std::string_view tar, const TarIndex& index) {
+  CHECK(index.size() == 18 + HopCount);
+
+  const auto* etc = index.find("etc");
+  CHECK(etc && etc->type == TarMember::Type::Directory);
+  CHECK(contents(tar, index.find("/etc/passwd")) == PasswdContents);
+  CHECK(contents(tar, index.find("./etc//passwd")) == PasswdContents);
+  CHECK(contents(tar, index.find("usr/share/doc/pkg/copyright")) == "copyright\n");
+  CHECK(contents(tar, index.find("usr/bin/tool")) == "tool\n");
+  CHECK(contents(tar, index.find(LongName)) == "long\n");
+  CHECK(contents(tar, index.find("usr/lib/longlink")) == "long\n");
+  CHECK(contents(tar, index.find("usr/share/pax/data")) == std::string(3000, 'p'));
+  CHECK(!index.find("truncated-name"));
+  CHECK(contents(tar, index.find("usr/share/pax/link")) == "copyright\n");
+
+  const auto* passwd = index.find("etc/passwd");
+  const auto* hardLink = index.find("etc/passwd-");
+  CHECK(passwd && hardLink && hardLink->offset == passwd->offset && hardLink->size == passwd->size);
+  const auto* device = index.find("dev/null");
+  CHECK(device && device->type == TarMember::Type::Other);
+  CHECK(contents(tar, index.find("usr/bin/big")) == "12345");
+
+  const auto* link = index.find("etc/pw");
+  CHECK(link && link == passwd);
+  CHECK(index.find("bin/tool") == index.find("usr/bin/tool"));
+  CHECK(index.find("root-passwd") == passwd);
+  CHECK(index.find("etc/up/etc/up/root-passwd") == passwd);
+  // ".." after a link is the parent of its target, not of the link.
+  CHECK(index.find("bin/../../etc/passwd") == passwd);
+  CHECK(!index.find("bin/../etc/passwd"));
+  CHECK(!index.find("etc/dangling"));
+  CHECK(!index.find("loop-a"));
+
+  // As many hops as Linux follows resolve, one more doesn't.
+  CHECK(index.find("hop" + std::to_string(HopCount - 2)) == passwd);
+  CHECK(!index.find("hop" + std::to_string(HopCount - 1)));
+}
+
+void checkChunks(std::string_view tar) {
+  for (std::size_t chunkSize = 1; chunkSize <= tar.size(); ++chunkSize) {
+    TarIndex index;
+    bool accepted = true;
+    for (std::size_t offset = 0; offset < tar.size(); offset += chunkSize) {
+      accepted = index.feed(tar.substr(offset, chunkSize)) && accepted;
+    }
+    CHECK(accepted && index.complete());
+    checkIndex(tar, index);
+  }
+}
+
+void checkMalformed(const std::string& tar) {
+  // A header whose checksum doesn't match is corrupt, and so is what follows.
+  auto corrupt = tar;
+  corrupt[BlockSize + 10] ^= 1;
+  TarIndex index;
+  CHECK(!index.feed(corrupt));
+  CHECK(!index.complete());
+  CHECK(!index.feed(std::string(BlockSize, '\0')));
+
+  // A truncated archive is accepted so far, but not complete.
+  TarIndex truncated;
+  CHECK(truncated.feed(std::string_view{tar}.substr(0, tar.size() - 2 * BlockSize)));
+  CHECK(!truncated.complete());
+
+  TarIndex badRecord;
+  CHECK(!badRecord.feed(member({"PaxHeaders/0", 'x'}, "99 path=x\n")));
+  TarIndex badSize;
+  CHECK(!badSize.feed(member({"PaxHeaders/0", 'x'}, paxRecord("size", "12x"))));
+
+  // Extended headers are buffered, up to a point.
+  TarIndex huge;
+  CHECK(!huge.feed(header({"././@LongLink", 'L', 2 * 1024 * 1024, {}, {}, true})));
+}
+
+void checkRead(const std::string& tar) {
+  const auto directory = std::filesystem::temp_directory_path() / "TarIndexTest";
+  std::filesystem::create_directories(directory);
+  const auto path = directory / "install.tar";
+  std::ofstream{path, std::ios::binary}.write(tar.data(), tar.size());
+
+  TarIndex index;
+  CHECK(index.feed(tar) && index.complete());
+  const auto* passwd = index.find("root-passwd");
+  CHECK(passwd && Ubuntu::readTarMember(path, *passwd, 1024) == PasswdContents);
+  CHECK(passwd && !Ubuntu::readTarMember(path, *passwd, PasswdContents.size() - 1));
+  const auto* etc = index.find("etc");
+  CHECK(etc && !Ubuntu::readTarMember(path, *etc, 1024));
+
+  std::filesystem::remove_all(directory);
+}
+}  // namespace
+
+int main() {
+  const auto tar = archive();
+  checkChunks(tar);
+  checkMalformed(tar);
+  checkRead(tar);
+  return checkResult();
+}
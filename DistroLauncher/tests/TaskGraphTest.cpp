@@ -0,0 +1,126 @@
+#include <stdafx.h>
+#include "Ubuntu/TaskGraph.h"
+#include "tests/Check.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+
+using Ubuntu::TaskGraph;
+
+// Checks the order tasks run in, what a failure skips, and that independent tasks overlap.
+namespace {
+// Records the tasks in the order they start, from any thread.
+struct Journal {
+  std::mutex mutex;
+  std::vector<std::string> started;
+
+  std::function<void()> task(std::string name) {
+    return [this, name] {
+      std::lock_guard lock{mutex};
+      started.push_back(name);
+    };
+  }
+
+  std::size_t position(std::string_view name) const {
+    return std::find(started.begin(), started.end(), name) - started.begin();
+  }
+
+  bool ran(std::string_view name) const { return position(name) < started.size(); }
+};
+
+// a -> b -> d, a -> c -> d, e on its own, as the init tasks of the launcher.
+void checkOrder() {
+  for (const unsigned workers : {1U, 2U, 4U}) {
+    Journal journal;
+    TaskGraph graph;
+    const auto a = graph.add("a", journal.task("a"));
+    const auto b = graph.add("b", journal.task("b"), {a});
+    const auto c = graph.add("c", journal.task("c"), {a});
+    graph.add("d", journal.task("d"), {b, c});
+    graph.add("e", journal.task("e"));
+    graph.run(workers);
+
+    CHECK(journal.started.size() == 5);
+    CHECK(journal.position("a") < journal.position("b"));
+    CHECK(journal.position("a") < journal.position("c"));
+    CHECK(journal.position("b") < journal.position("d"));
+    CHECK(journal.position("c") < journal.position("d"));
+    CHECK(journal.ran("e"));
+  }
+}
+
+// A failure skips the dependents of the task, direct or not, but nothing else, and is rethrown.
+void checkFailure() {
+  for (const unsigned workers : {1U, 4U}) {
+    Journal journal;
+    TaskGraph graph;
+    const auto a = graph.add("a", journal.task("a"));
+    const auto failing = graph.add("failing", [] { throw std::runtime_error{"failed"}; }, {a});
+    const auto b = graph.add("b", journal.task("b"), {failing});
+    graph.add("c", journal.task("c"), {a, b});
+    graph.add("d", journal.task("d"), {a});
+    graph.add("e", journal.task("e"));
+
+    std::string error;
+    try {
+      graph.run(workers);
+    } catch (const std::runtime_error& e) {
+      error = e.what();
+    }
+    CHECK(error == "failed");
+    CHECK(journal.ran("a") && journal.ran("d") && journal.ran("e"));
+    CHECK(!journal.ran("b") && !journal.ran("c"));
+  }
+}
+
+// Each of two independent tasks waits for the other to start, which only ends well if they run
+// at the same time. The wait is bounded, so a regression fails rather than hangs.
+void checkConcurrency() {
+  std::mutex mutex;
+  std::condition_variable arrived;
+  int started = 0;
+  bool overlapped[2] = {false, false};
+  auto meet = [&](int index) {
+    return [&, index] {
+      std::unique_lock lock{mutex};
+      ++started;
+      arrived.notify_all();
+      overlapped[index] =
+          arrived.wait_for(lock, std::chrono::seconds{10}, [&] { return started == 2; });
+    };
+  };
+
+  TaskGraph graph;
+  const auto first = graph.add("first", meet(0));
+  const auto second = graph.add("second", meet(1));
+  bool joined = false;
+  graph.add("join", [&] { joined = overlapped[0] && overlapped[1]; }, {first, second});
+  graph.run(2);
+  CHECK(overlapped[0] && overlapped[1]);
+  CHECK(joined);
+}
+
+void checkInvalid() {
+  TaskGraph graph;
+  bool rejected = false;
+  try {
+    graph.add("ahead", [] {}, {0});
+  } catch (const std::invalid_argument&) {
+    rejected = true;
+  }
+  CHECK(rejected);
+  // Nothing to run is fine.
+  graph.run();
+}
+}  // namespace
+
+int main() {
+  checkOrder();
+  checkFailure();
+  checkConcurrency();
+  checkInvalid();
+  return checkResult();
+}
@@ -0,0 +1,68 @@
+#include <stdafx.h>
+#include "Ubuntu/FakeWslApi.h"
+#include "Ubuntu/UserDbCache.h"
+#include "Ubuntu/WslProcess.h"
+#include "tests/Check.h"
+
+using Ubuntu::PasswdStamp;
+
+// Checks that the stamp the launcher reads through the file system matches the one the distro
+// prints, and that snapshots survive a round trip.
+namespace {
+void checkParse() {
+  const auto stamp = PasswdStamp::parse("1146 1792167090.726595999 1792167091.000000012\n");
+  CHECK(stamp && stamp->size == 1146);
+  CHECK(stamp && stamp->mtime == 1792167090'726595999);
+  CHECK(stamp && stamp->ctime == 1792167091'000000012);
+  CHECK(stamp && stamp->str() == "1146 1792167090.726595999 1792167091.000000012");
+
+  for (const std::string_view invalid :
+       {"", "1146", "1146 1792167090 1792167091", "1146 1792167090.7265959 1792167091.000000012",
+        "1146 1792167090.726595999", "1146 1792167090.726595999 1792167091.000000012 1",
+        "1146 -1.000000000 0.000000000", "x 0.000000000 0.000000000"}) {
+    CHECK(!PasswdStamp::parse(invalid));
+  }
+}
+
+// Windows reports times in 100 ns units.
+void checkPrecision() {
+  const PasswdStamp stamp{10, 1'000'000'123, 2'000'000'000};
+  CHECK((stamp == PasswdStamp{10, 1'000'000'100, 2'000'000'099}));
+  CHECK((stamp != PasswdStamp{10, 1'000'000'200, 2'000'000'000}));
+  CHECK((stamp != PasswdStamp{10, 1'000'000'123, 2'000'000'100}));
+  CHECK((stamp != PasswdStamp{11, 1'000'000'123, 2'000'000'000}));
+}
+
+void checkCurrentStamp() {
+  Ubuntu::FakeWslApi api{{}};
+  Ubuntu::WslProcess stat{std::wstring{Ubuntu::PasswdStampCommand}};
+  const auto printed = stat.run(api, 10000);
+  CHECK(printed.exitCode == 0);
+  const auto parsed = PasswdStamp::parse(printed.stdOut);
+  const auto current = Ubuntu::UserDbCache::currentStamp(api);
+  CHECK(parsed && current && *parsed == *current);
+  CHECK(parsed && parsed->str() + '\n' == printed.stdOut);
+}
+
+void checkSnapshot() {
+  const auto directory = std::filesystem::temp_directory_path() / "UserDbCacheTest";
+  std::filesystem::remove_all(directory);
+  const Ubuntu::UserDbCache cache{directory, L"Ubuntu"};
+  CHECK(!cache.load());
+
+  const PasswdStamp stamp{42, 1'000'000'123, 2'000'000'456};
+  cache.store(stamp, Ubuntu::UserTable{"root:x:0:0:root:/root:/bin/bash\n"});
+  const auto snapshot = cache.load();
+  CHECK(snapshot && snapshot->stamp.str() == stamp.str());
+  CHECK(snapshot && Ubuntu::UserDbCache::uidOf(snapshot->users, L"root") == 0u);
+  std::filesystem::remove_all(directory);
+}
+}  // namespace
+
+int main() {
+  checkParse();
+  checkPrecision();
+  checkCurrentStamp();
+  checkSnapshot();
+  return checkResult();
+}
@@ -0,0 +1,110 @@
+#include <stdafx.h>
+#include "Ubuntu/PasswdScanner.h"
+#include "Ubuntu/UserTable.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using Ubuntu::UserTable;
+
+// Times building UserTable from a shuffled passwd of a million users, and looking users up in it,
+// against the vector of entries sorted with std::sort it replaced.
+namespace {
+constexpr std::size_t Users = 1'000'000;
+constexpr int Rounds = 5;
+constexpr int Lookups = 100;
+
+// The previous representation: one entry per user, owning its name.
+struct UserEntry {
+  std::string name;
+  std::uint32_t uid = -1;
+  bool hasLogin = false;
+};
+
+std::vector<UserEntry> parseUsers(std::string_view passwd) {
+  std::vector<UserEntry> users;
+  Ubuntu::PasswdScanner scanner{passwd};
+  Ubuntu::PasswdScanner::Line line;
+  while (scanner.next(line)) {
+    if (auto entry = Ubuntu::parsePasswdEntry(line)) {
+      users.push_back({std::string{entry->name}, entry->uid, entry->hasLogin});
+    }
+  }
+  std::sort(users.begin(), users.end(),
+            [](const UserEntry& a, const UserEntry& b) { return a.uid < b.uid; });
+  return users;
+}
+
+std::string shuffledPasswd() {
+  std::vector<std::uint32_t> uids(Users);
+  for (std::size_t i = 0; i < Users; ++i) {
+    uids[i] = static_cast<std::uint32_t>(i);
+  }
+  std::shuffle(uids.begin(), uids.end(), std::mt19937{42});
+  std::string passwd;
+  for (auto uid : uids) {
+    const std::string name = "user" + std::to_string(uid);
+    passwd += name + ":x:" + std::to_string(uid) + ":100:" + name + ":/home/" + name +
+              (uid < 1000 ? ":/usr/sbin/nologin\n" : ":/bin/bash\n");
+  }
+  return passwd;
+}
+
+// Runs [task] Rounds times and returns the best time in milliseconds.
+template <class Task>
+double bestOf(Task task) {
+  double best = 1e300;
+  for (int round = 0; round < Rounds; ++round) {
+    const auto start = std::chrono::steady_clock::now();
+    task();
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+}  // namespace
+
+int main() {
+  const std::string passwd = shuffledPasswd();
+  std::printf("%zu shuffled users, %zu MiB\n", Users, passwd.size() >> 20);
+
+  std::vector<std::string> names;
+  for (int i = 0; i < Lookups; ++i) {
+    names.push_back("user" + std::to_string((i * 7919) % Users));
+  }
+
+  std::vector<UserEntry> users;
+  const double vectorBuild = bestOf([&] { users = parseUsers(passwd); });
+  std::size_t vectorHeap = users.capacity() * sizeof(UserEntry);
+  for (const auto& user : users) {
+    vectorHeap += user.name.capacity() > 15 ? user.name.capacity() + 1 : 0;
+  }
+  std::size_t found = 0;
+  const double vectorLookup = bestOf([&] {
+    for (const auto& name : names) {
+      found += std::find_if(users.begin(), users.end(),
+                            [&](const UserEntry& u) { return u.name == name; }) != users.end();
+    }
+  });
+
+  UserTable table;
+  const double tableBuild = bestOf([&] { table = UserTable{passwd}; });
+  std::size_t tableHeap = table.size() * (3 * sizeof(std::uint32_t) + 1);
+  for (UserTable::Index i = 0; i < table.size(); ++i) {
+    tableHeap += table.name(i).size();
+  }
+  const double tableLookup = bestOf([&] {
+    for (const auto& name : names) {
+      found += table.find(name).has_value();
+    }
+  });
+
+  std::printf("%-18s %10s %14s %12s\n", "", "build (ms)", "100 finds (ms)", "heap (MiB)");
+  std::printf("%-18s %10.1f %14.1f %12.1f\n", "vector + std::sort", vectorBuild, vectorLookup,
+              vectorHeap / 1048576.0);
+  std::printf("%-18s %10.1f %14.1f %12.1f\n", "UserTable", tableBuild, tableLookup,
+              tableHeap / 1048576.0);
+  return found == 2 * Rounds * Lookups ? 0 : 1;
+}
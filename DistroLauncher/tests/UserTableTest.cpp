@@ -0,0 +1,114 @@
+#include <stdafx.h>
+#include "Ubuntu/UserTable.h"
+#include "tests/Check.h"
+
+#include <algorithm>
+#include <random>
+
+using Ubuntu::UserTable;
+
+namespace {
+std::string passwdLine(std::string_view name, std::uint32_t uid, bool login = true) {
+  return std::string{name} + ":x:" + std::to_string(uid) + ":" + std::to_string(uid) + "::/home/" +
+         std::string{name} + (login ? ":/bin/bash\n" : ":/usr/sbin/nologin\n");
+}
+
+// Whether [table] is sorted by UID, users sharing one being in the order of their names, which the
+// tests below give in database order.
+bool sortedStably(const UserTable& table) {
+  for (UserTable::Index i = 1; i < table.size(); ++i) {
+    if (table.uid(i - 1) > table.uid(i) ||
+        (table.uid(i - 1) == table.uid(i) && table.name(i - 1) >= table.name(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void checkSortsShuffledUsers() {
+  std::mt19937 random{7};
+  // UIDs spanning all four bytes, so that no radix pass is skipped, and repeated UIDs.
+  std::vector<std::uint32_t> uids;
+  for (std::uint32_t i = 0; i < 5000; ++i) {
+    uids.push_back(random() % 3 == 0 ? i % 50 : static_cast<std::uint32_t>(random()));
+  }
+  std::vector<std::size_t> order(uids.size());
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), random);
+
+  std::string passwd;
+  for (std::size_t line = 0; line < order.size(); ++line) {
+    // Names sort as the line numbers do.
+    std::string name = std::to_string(line);
+    name.insert(0, 6 - name.size(), '0');
+    passwd += passwdLine(name, uids[order[line]]);
+  }
+  const UserTable table{passwd};
+  CHECK(table.size() == uids.size());
+  CHECK(sortedStably(table));
+
+  std::vector<std::uint32_t> sortedUids = uids;
+  std::sort(sortedUids.begin(), sortedUids.end());
+  for (UserTable::Index i = 0; i < table.size(); ++i) {
+    CHECK(table.uid(i) == sortedUids[i]);
+  }
+}
+
+void checkLookups() {
+  const std::string passwd = passwdLine("root", 0) + passwdLine("nobody", 65534, false) +
+                             "broken:line\n" + "bad:x:not-a-uid:0::/:/bin/sh\n" +
+                             passwdLine("daemon", 1, false) + passwdLine("zoe", 1001) +
+                             passwdLine("adam", 1000) + passwdLine("svc", 999) +
+                             passwdLine("locked", 1000, false);
+  const UserTable table{passwd};
+  CHECK(table.size() == 7);
+  for (UserTable::Index i = 1; i < table.size(); ++i) {
+    CHECK(table.uid(i - 1) <= table.uid(i));
+  }
+
+  const auto zoe = table.find("zoe");
+  CHECK(zoe.has_value() && table.uid(*zoe) == 1001 && table.hasLogin(*zoe));
+  const auto nobody = table.find("nobody");
+  CHECK(nobody.has_value() && table.uid(*nobody) == 65534 && !table.hasLogin(*nobody));
+  CHECK(!table.find("broken").has_value());
+  CHECK(!table.find("bad").has_value());
+  CHECK(!table.find("ada").has_value());
+  CHECK(!table.find("").has_value());
+
+  const auto first = table.firstLoginUser(1000);
+  CHECK(first.has_value() && table.name(*first) == "adam");
+  const auto afterAdam = table.firstLoginUser(1001);
+  CHECK(afterAdam.has_value() && table.name(*afterAdam) == "zoe");
+  CHECK(!table.firstLoginUser(1002).has_value());
+  const auto any = table.firstLoginUser(0);
+  CHECK(any.has_value() && table.name(*any) == "root");
+
+  std::string snapshot;
+  table.serialize(snapshot);
+  const auto restored = UserTable::deserialize(snapshot);
+  CHECK(restored.has_value() && restored->size() == table.size());
+  for (UserTable::Index i = 0; restored && i < table.size(); ++i) {
+    CHECK(restored->name(i) == table.name(i));
+    CHECK(restored->uid(i) == table.uid(i));
+    CHECK(restored->hasLogin(i) == table.hasLogin(i));
+  }
+  CHECK(!UserTable::deserialize(std::string_view{snapshot}.substr(0, snapshot.size() - 1)));
+  CHECK(!UserTable::deserialize(snapshot + "x"));
+}
+}  // namespace
+
+int main() {
+  CHECK(UserTable{""}.empty());
+  CHECK(UserTable{"\n\n"}.empty());
+
+  // Users sharing a UID keep their database order.
+  const UserTable shared{passwdLine("b", 1000) + passwdLine("a", 1000) + passwdLine("c", 5)};
+  CHECK(shared.size() == 3);
+  CHECK(shared.name(0) == "c" && shared.name(1) == "b" && shared.name(2) == "a");
+
+  checkSortsShuffledUsers();
+  checkLookups();
+  return checkResult();
+}
@@ -0,0 +1,77 @@
+#include <stdafx.h>
+#include "Ubuntu/Utf8.h"
+
+#include <chrono>
+#include <codecvt>
+#include <locale>
+
+// Times the conversions of Utf8.h against the std::wstring_convert they replaced, over the kinds of
+// text crossing the boundary between Windows and the distro.
+namespace {
+volatile std::size_t sink;
+
+// Runs [convert] [iterations] times and returns the mean time of a run in nanoseconds.
+template <class Convert>
+double nanoseconds(int iterations, Convert convert) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    sink = convert();
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+using Codecvt = std::wstring_convert<std::codecvt_utf8<wchar_t>>;
+}  // namespace
+
+int main() {
+  std::string passwd;
+  std::string mixed;
+  for (int i = 0; i < 2000; ++i) {
+    const std::string name = "user" + std::to_string(i);
+    const std::string uid = std::to_string(1000 + i);
+    passwd += name + ":x:" + uid + ":" + uid + "::/home/" + name + ":/bin/bash\n";
+    mixed += "Jos\xC3\xA9 M\xC3\xBCller \xE6\x97\xA5\xE6\x9C\xAC\n";
+  }
+  const struct {
+    const char* name;
+    std::string text;
+    int iterations;
+  } cases[] = {
+      {"user name", "jdoe1234", 2'000'000},
+      {"command", "ls -la /home/jdoe1234/projects && git -C /home/jdoe1234/projects/wsl status",
+       1'000'000},
+      {"getent passwd", passwd, 2000},
+      {"non-ASCII", mixed, 2000},
+  };
+
+  // from_bytes and to_bytes are std::wstring_convert, the append functions reuse their buffer.
+  std::printf("%-14s %8s %10s %10s %10s %10s %10s %10s\n", "ns per call", "bytes", "from_bytes",
+              "toWide", "appendWide", "to_bytes", "toUtf8", "appendUtf8");
+  for (const auto& [name, text, iterations] : cases) {
+    const std::wstring wide = Ubuntu::toWide(text);
+    std::wstring wideBuffer;
+    std::string utf8Buffer;
+    const double fromCodecvt = nanoseconds(iterations, [&] {
+      return Codecvt{}.from_bytes(text.data(), text.data() + text.size()).size();
+    });
+    const double toWide = nanoseconds(iterations, [&] { return Ubuntu::toWide(text).size(); });
+    const double appendWide = nanoseconds(iterations, [&] {
+      wideBuffer.clear();
+      Ubuntu::appendWide(wideBuffer, text);
+      return wideBuffer.size();
+    });
+    const double toCodecvt = nanoseconds(iterations, [&] {
+      return Codecvt{}.to_bytes(wide.data(), wide.data() + wide.size()).size();
+    });
+    const double toUtf8 = nanoseconds(iterations, [&] { return Ubuntu::toUtf8(wide).size(); });
+    const double appendUtf8 = nanoseconds(iterations, [&] {
+      utf8Buffer.clear();
+      Ubuntu::appendUtf8(utf8Buffer, wide);
+      return utf8Buffer.size();
+    });
+    std::printf("%-14s %8zu %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f\n", name, text.size(),
+                fromCodecvt, toWide, appendWide, toCodecvt, toUtf8, appendUtf8);
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include <stdafx.h>
+#include "Ubuntu/Utf8.h"
+#include "tests/Check.h"
+
+#include <random>
+
+using namespace Ubuntu;
+
+namespace {
+constexpr bool WideIsUtf16 = sizeof(wchar_t) == 2;
+const std::wstring Replacement(1, static_cast<wchar_t>(0xFFFD));
+
+std::string encode(char32_t c) {
+  std::string out;
+  if (c < 0x80) {
+    out += static_cast<char>(c);
+  } else if (c < 0x800) {
+    out += static_cast<char>(0xC0 | (c >> 6));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  } else if (c < 0x10000) {
+    out += static_cast<char>(0xE0 | (c >> 12));
+    out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (c >> 18));
+    out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  }
+  return out;
+}
+
+void appendCodePoint(std::wstring& out, char32_t c) {
+  if (WideIsUtf16 && c >= 0x10000) {
+    c -= 0x10000;
+    out += static_cast<wchar_t>(0xD800 + (c >> 10));
+    out += static_cast<wchar_t>(0xDC00 + (c & 0x3FF));
+  } else {
+    out += static_cast<wchar_t>(c);
+  }
+}
+
+// A random valid code point, mostly ASCII so that both the vectorized and the scalar paths run.
+char32_t randomCodePoint(std::mt19937& random) {
+  switch (random() % 10) {
+    case 0:
+      return 0x80 + random() % 0x780;
+    case 1: {
+      char32_t c;
+      do {
+        c = 0x800 + random() % 0xF800;
+      } while (c >= 0xD800 && c <= 0xDFFF);
+      return c;
+    }
+    case 2:
+      return 0x10000 + random() % 0x100000;
+    default:
+      return random() % 0x80;
+  }
+}
+
+void checkRoundTrips() {
+  std::mt19937 random{42};
+  for (int round = 0; round < 20000; ++round) {
+    std::string utf8;
+    std::wstring wide;
+    for (std::size_t i = random() % 60; i > 0; --i) {
+      const char32_t c = randomCodePoint(random);
+      utf8 += encode(c);
+      appendCodePoint(wide, c);
+    }
+    CHECK(toWide(utf8) == wide);
+    const auto strict = toWideStrict(utf8);
+    CHECK(strict && *strict == wide);
+    CHECK(toUtf8(wide) == utf8);
+
+    // Appending keeps what the buffer held.
+    std::wstring appended = L"pre";
+    appendWide(appended, utf8);
+    CHECK(appended == L"pre" + wide);
+    std::string narrowed = "pre";
+    appendUtf8(narrowed, wide);
+    CHECK(narrowed == "pre" + utf8);
+  }
+}
+
+void checkInvalidSequences() {
+  const std::wstring r = Replacement;
+  CHECK(toWide("a\x80z") == L"a" + r + L"z");
+  // Overlong forms, surrogates and code points above U+10FFFF: one U+FFFD per byte.
+  CHECK(toWide("\xC0\xAF") == r + r);
+  CHECK(toWide("\xE0\x80\xAF") == r + r + r);
+  CHECK(toWide("\xED\xA0\x80") == r + r + r);
+  CHECK(toWide("\xF4\x90\x80\x80") == r + r + r + r);
+  // Truncated sequences: one U+FFFD for the maximal subpart.
+  CHECK(toWide("\xE2\x82") == r);
+  CHECK(toWide("\xE2\x82z") == r + L"z");
+  CHECK(toWide("\xF0\x9F\x98") == r);
+
+  CHECK(!toWideStrict("ok\xE2\x82"));
+  std::wstring kept = L"kept";
+  CHECK(!appendWideStrict(kept, "\xFF"));
+  CHECK(kept == L"kept");
+
+  std::wstring unpaired;
+  unpaired += static_cast<wchar_t>(0xD800);
+  unpaired += L'a';
+  CHECK(toUtf8(unpaired) == "\xEF\xBF\xBD" "a");
+}
+
+// A non-ASCII character right past a vector-sized run of ASCII.
+void checkBlockBoundaries() {
+  for (std::size_t position = 0; position < 80; ++position) {
+    std::string utf8(100, 'q');
+    utf8.replace(position, 2, "\xC3\xA9");
+    const std::wstring wide = toWide(utf8);
+    CHECK(wide.size() == 99 && wide[position] == static_cast<wchar_t>(0xE9));
+    CHECK(toUtf8(wide) == utf8);
+  }
+}
+}  // namespace
+
+int main() {
+  CHECK(toWide("").empty());
+  CHECK(toUtf8(L"").empty());
+  checkRoundTrips();
+  checkInvalidSequences();
+  checkBlockBoundaries();
+  return checkResult();
+}
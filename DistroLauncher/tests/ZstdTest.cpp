@@ -0,0 +1,166 @@
+#include <stdafx.h>
+#include "Ubuntu/Rootfs.h"
+#include "Ubuntu/Zstd.h"
+#include "tests/Check.h"
+
+#include <fstream>
+#include <random>
+
+// Decodes seekable zstd files whose frames are compressed by the zstd command given as argument,
+// as the image build does: as a whole, frame by frame on several threads, and by random reads.
+namespace {
+std::filesystem::path directory;
+std::string zstdCommand;
+
+std::string testData(std::size_t size) {
+  std::mt19937 random{3};
+  std::string data;
+  while (data.size() < size) {
+    if (random() % 2 == 0) {
+      data += "usr/lib/x86_64-linux-gnu/libc.so.6";
+      data += static_cast<char>(random() % 4);
+    } else {
+      for (std::size_t i = random() % 3000; i > 0; --i) {
+        data += static_cast<char>(random());
+      }
+    }
+  }
+  data.resize(size);
+  return data;
+}
+
+void writeFile(const std::filesystem::path& path, std::string_view contents) {
+  std::ofstream{path, std::ios::binary}.write(contents.data(), contents.size());
+}
+
+std::string readFile(const std::filesystem::path& path) {
+  std::ifstream file{path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+void put32(std::string& out, std::uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out += static_cast<char>((value >> (8 * i)) & 0xFF);
+  }
+}
+
+// Compresses [data] into a single frame with the zstd command and [options].
+std::string zstdFrame(std::string_view data, const std::string& options) {
+  const auto input = directory / "frame";
+  const auto output = directory / "frame.zst";
+  writeFile(input, data);
+  const std::string command = zstdCommand + " -q -f " + options + " " + input.string() + " -o " +
+                              output.string();
+  CHECK(std::system(command.c_str()) == 0);
+  return readFile(output);
+}
+
+// The seekable zstd file holding [data] in frames of [frameSize], compressed with [options], with
+// checksums in the seek table if [checksums].
+std::string seekableZstd(std::string_view data, std::size_t frameSize, const std::string& options,
+                         bool checksums) {
+  std::string frames;
+  std::string entries;
+  std::uint32_t count = 0;
+  for (std::size_t offset = 0; offset < data.size(); offset += frameSize, ++count) {
+    const auto chunk = data.substr(offset, frameSize);
+    const std::string frame = zstdFrame(chunk, options);
+    frames += frame;
+    put32(entries, static_cast<std::uint32_t>(frame.size()));
+    put32(entries, static_cast<std::uint32_t>(chunk.size()));
+    if (checksums) {
+      const auto* bytes = reinterpret_cast<const unsigned char*>(chunk.data());
+      put32(entries, static_cast<std::uint32_t>(Ubuntu::xxh64(bytes, chunk.size())));
+    }
+  }
+  std::string file = frames;
+  put32(file, 0x184D2A5E);
+  put32(file, static_cast<std::uint32_t>(entries.size() + Ubuntu::SeekTable::FooterSize));
+  file += entries;
+  put32(file, count);
+  file += static_cast<char>(checksums ? 0x80 : 0);
+  put32(file, 0x8F92EAB1);
+  return file;
+}
+
+void checkSeekable(std::string_view data, std::size_t frameSize, const std::string& options,
+                   bool checksums) {
+  const std::string file = seekableZstd(data, frameSize, options, checksums);
+  const auto source = directory / "install.tar.zst";
+  const auto destination = directory / "install.tar";
+  writeFile(source, file);
+
+  std::string whole(data.size(), '\0');
+  CHECK(Ubuntu::decompressZstd(file, reinterpret_cast<unsigned char*>(whole.data()), whole.size()));
+  CHECK(whole == data);
+
+  for (unsigned workers : {1, 4}) {
+    CHECK(Ubuntu::decompressSeekableZstd(source, destination, workers));
+    CHECK(readFile(destination) == data);
+  }
+
+  auto reader = Ubuntu::SeekableZstd::open(source);
+  CHECK(reader.has_value());
+  if (!reader) {
+    return;
+  }
+  CHECK(reader->size() == data.size());
+  CHECK(reader->table().frames.size() == (data.size() + frameSize - 1) / frameSize);
+  std::mt19937 random{11};
+  for (int i = 0; i < 50 && !data.empty(); ++i) {
+    const std::size_t offset = random() % data.size();
+    const std::size_t size =
+        std::min<std::size_t>(random() % (2 * frameSize), data.size() - offset);
+    std::string read(size, '\0');
+    CHECK(reader->read(offset, size, reinterpret_cast<unsigned char*>(read.data())));
+    CHECK(read == data.substr(offset, size));
+  }
+  std::string past(2, '\0');
+  CHECK(!reader->read(data.size() - 1, 2, reinterpret_cast<unsigned char*>(past.data())));
+}
+
+void checkCorruption(std::string_view data) {
+  std::string file = seekableZstd(data, 1 << 20, "-3", false);
+  const auto source = directory / "install.tar.zst";
+  const auto destination = directory / "install.tar";
+
+  // The frames carry checksums of their contents.
+  std::string corrupt = file;
+  corrupt[corrupt.size() / 2] ^= 0x01;
+  writeFile(source, corrupt);
+  CHECK(!Ubuntu::decompressSeekableZstd(source, destination, 4));
+
+  // A seek table listing a frame larger than any image has is refused before the frame is read.
+  std::string oversized = file;
+  const std::size_t frames = (data.size() + (1 << 20) - 1) >> 20;
+  oversized.replace(oversized.size() - Ubuntu::SeekTable::FooterSize - 8 * frames + 4, 4,
+                    "\xf0\xff\xff\xff");
+  writeFile(source, oversized);
+  CHECK(!Ubuntu::SeekableZstd::open(source).has_value());
+  CHECK(!Ubuntu::decompressSeekableZstd(source, destination, 4));
+
+  // A file without a seek table, as the zstd command writes, is not seekable.
+  writeFile(source, zstdFrame(data, "-3"));
+  CHECK(!Ubuntu::SeekableZstd::open(source).has_value());
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::fprintf(stderr, "usage: %s ZSTD_COMMAND\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  zstdCommand = argv[1];
+  directory = std::filesystem::temp_directory_path() / "ZstdTest";
+  std::filesystem::create_directories(directory);
+
+  const std::string data = testData(5 << 20);
+  checkSeekable(data, 1 << 20, "-19", false);
+  checkSeekable(data, 300000, "-1 --no-check", true);
+  checkSeekable(data.substr(0, 1000), 1 << 20, "-3", true);
+  checkSeekable({}, 1 << 20, "-3", false);
+  checkCorruption(data);
+
+  std::filesystem::remove_all(directory);
+  return checkResult();
+}
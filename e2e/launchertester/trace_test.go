@@ -0,0 +1,49 @@
+package launchertester
+
+import (
+	"context"
+	"encoding/json"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/stretchr/testify/require"
+)
+
+// TestInstallTrace ensures installing with --trace records the installation phases in the Chrome trace-event format.
+func TestInstallTrace(t *testing.T) {
+	wslSetup(t)
+
+	ctx, cancel := context.WithTimeout(context.Background(), installTimeout)
+	defer cancel()
+
+	tracePath := filepath.Join(t.TempDir(), "trace.json")
+	out, err := launcherCommand(ctx, "install", "--root", "--trace", "'"+tracePath+"'").CombinedOutput()
+	require.NoErrorf(t, err, "Unexpected error installing: %s\n%v", out, err)
+
+	data, err := os.ReadFile(tracePath)
+	require.NoError(t, err, "Trace file should have been written")
+
+	var trace struct {
+		TraceEvents []struct {
+			Name  string  `json:"name"`
+			Phase string  `json:"ph"`
+			Ts    float64 `json:"ts"`
+			Dur   float64 `json:"dur"`
+		} `json:"traceEvents"`
+	}
+	require.NoError(t, json.Unmarshal(data, &trace), "Trace file should be valid JSON: %s", data)
+
+	got := make(map[string]bool)
+	for _, e := range trace.TraceEvents {
+		require.Equal(t, "X", e.Phase, "All trace events should be complete events")
+		require.GreaterOrEqual(t, e.Dur, 0.0, "Event %q should have a non-negative duration", e.Name)
+		got[e.Name] = true
+	}
+
+	// Installing with --root launches nothing interactively: resolv.conf is deleted and the
+	// initialization tasks run through the process pool.
+	for _, want := range []string{"InstallDistribution", "WslRegisterDistribution", "CheckInitTasks", "DeleteResolvConf", "WslLaunch"} {
+		require.Truef(t, got[want], "Trace should contain a %q event", want)
+	}
+}
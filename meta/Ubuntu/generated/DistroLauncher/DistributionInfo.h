@@ -13,14 +13,16 @@ namespace DistributionInfo
     //
     // WARNING: This value must not change between versions of your app,
     // otherwise users upgrading from older versions will see launch failures.
-    const std::wstring Name = L"Ubuntu";
+    inline constexpr wchar_t Name[] = L"Ubuntu";
 
     // The title bar for the console window while the distribution is installing.
-    const std::wstring WindowTitle = L"Ubuntu";
+    inline constexpr wchar_t WindowTitle[] = L"Ubuntu";
 
-    // Create and configure a user account.
-    bool CreateUser(std::wstring_view userName);
+    // Create and configure a user account, returning its UID. Returns UID_INVALID if that failed, in
+    // which case no account is left behind. /etc/resolv.conf is also deleted on the way if
+    // [deleteResolvConf], saving a launch of its own.
+    ULONG CreateUser(Ubuntu::WslApiBackend& api, std::wstring_view userName, bool deleteResolvConf);
 
     // Query the UID of the user account.
-    ULONG QueryUid(std::wstring_view userName);
+    ULONG QueryUid(Ubuntu::WslApiBackend& api, std::wstring_view userName);
 }
\ No newline at end of file
@@ -0,0 +1,3 @@
+module github.com/ubuntu/wsl/wsl-builder/compile-messages
+
+go 1.21.4
@@ -0,0 +1,23 @@
+package main
+
+import (
+	"fmt"
+	"os"
+)
+
+// This tool only depends on the standard library, as it runs as part of the launcher build.
+func main() {
+	if len(os.Args) != 3 {
+		fmt.Fprintln(os.Stderr, `Usage: compile-messages MC_FILE HEADER
+
+Compiles the message catalog MC_FILE, in the syntax of the Windows Message Compiler,
+into HEADER: a C++ header declaring every message as a constant with its text and
+the format of its inserts, to be printed with Helpers::PrintMessage.`)
+		os.Exit(2)
+	}
+
+	if err := compileMessages(os.Args[1], os.Args[2]); err != nil {
+		fmt.Fprintf(os.Stderr, "compile-messages: %v\n", err)
+		os.Exit(1)
+	}
+}
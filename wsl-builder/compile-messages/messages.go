@@ -0,0 +1,271 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"fmt"
+	"os"
+	"strconv"
+	"strings"
+)
+
+// maxInserts is the number of inserts a message can have, so that they are a single digit in the
+// compiled text.
+const maxInserts = 9
+
+// insertFormats maps the !format! of a message insert to the Ubuntu::Insert it compiles to. An
+// insert without format is a string.
+var insertFormats = map[string]string{
+	"":   "String",
+	"s":  "String",
+	"ws": "String",
+	"d":  "Decimal",
+	"i":  "Decimal",
+	"u":  "Unsigned",
+	"x":  "Hex",
+}
+
+// message is a message of the catalog, its text compiled.
+type message struct {
+	id      uint64
+	name    string
+	lines   []string // text lines, line breaks included, inserts as %1 to %9.
+	inserts []string // Ubuntu::Insert of each insert.
+}
+
+// compileMessages compiles the message catalog at mcPath into a C++ header at headerPath.
+func compileMessages(mcPath, headerPath string) error {
+	f, err := os.Open(mcPath)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+
+	messages, err := parseCatalog(bufio.NewScanner(f))
+	if err != nil {
+		return fmt.Errorf("%s:%v", mcPath, err)
+	}
+
+	var out bytes.Buffer
+	writeHeader(&out, messages)
+
+	// Leave an up to date header untouched, not to rebuild everything including it.
+	if current, err := os.ReadFile(headerPath); err == nil && bytes.Equal(current, out.Bytes()) {
+		return nil
+	}
+	return os.WriteFile(headerPath, out.Bytes(), 0644)
+}
+
+// parseCatalog parses the message definitions of a catalog, skipping its header statements and
+// comments. Only the first language of each message is kept.
+func parseCatalog(s *bufio.Scanner) (messages []message, err error) {
+	var lineNo int
+	var nextID uint64
+	var current *message
+	var inText, skipText bool
+
+	for s.Scan() {
+		lineNo++
+		line := strings.TrimRight(s.Text(), "\r")
+
+		if inText {
+			if line == "." {
+				inText = false
+				if !skipText {
+					if err := current.compileText(); err != nil {
+						return nil, fmt.Errorf("%d: %s: %v", lineNo, current.name, err)
+					}
+					messages = append(messages, *current)
+				}
+				skipText = true
+				continue
+			}
+			if !skipText {
+				current.lines = append(current.lines, line)
+			}
+			continue
+		}
+
+		if strings.HasPrefix(line, ";") || strings.TrimSpace(line) == "" {
+			continue
+		}
+
+		for _, field := range strings.Fields(line) {
+			key, value, _ := strings.Cut(field, "=")
+			switch key {
+			case "MessageId":
+				id := nextID
+				if value != "" {
+					if id, err = strconv.ParseUint(value, 0, 16); err != nil {
+						return nil, fmt.Errorf("%d: invalid MessageId %q", lineNo, value)
+					}
+				}
+				current = &message{id: id}
+				nextID = id + 1
+				skipText = false
+			case "SymbolicName":
+				if current == nil {
+					return nil, fmt.Errorf("%d: SymbolicName before MessageId", lineNo)
+				}
+				current.name = value
+			case "Language":
+				if current == nil {
+					return nil, fmt.Errorf("%d: message text before MessageId", lineNo)
+				}
+				if current.name == "" {
+					return nil, fmt.Errorf("%d: message %d has no SymbolicName", lineNo, current.id)
+				}
+				inText = true
+			}
+		}
+	}
+	if err := s.Err(); err != nil {
+		return nil, err
+	}
+	if inText {
+		return nil, fmt.Errorf("%d: message text not terminated by a line with a single period", lineNo)
+	}
+
+	return messages, nil
+}
+
+// compileText translates the escape sequences of the message text as FormatMessage does: each line
+// ends with a line break, unless the text ends with %0, and inserts are numbered from %1, with an
+// optional printf-like !format!.
+func (m *message) compileText() error {
+	var compiled []string
+	formats := make(map[int]string)
+	noBreak := false
+
+	for _, line := range m.lines {
+		var b strings.Builder
+		for i := 0; i < len(line); i++ {
+			if line[i] != '%' {
+				b.WriteByte(line[i])
+				continue
+			}
+			if i+1 == len(line) {
+				return fmt.Errorf("trailing %%")
+			}
+			i++
+			switch c := line[i]; {
+			case c == '0':
+				noBreak = true
+			case c == 'n':
+				compiled = append(compiled, b.String()+"\n")
+				b.Reset()
+			case c == 'r':
+				b.WriteByte('\r')
+			case c == 't':
+				b.WriteByte('\t')
+			case c == 'b':
+				b.WriteByte(' ')
+			case c == '%':
+				b.WriteString("%%")
+			case c == '.' || c == '!':
+				b.WriteByte(c)
+			case c >= '1' && c <= '9':
+				j := i + 1
+				for j < len(line) && j < i+2 && line[j] >= '0' && line[j] <= '9' {
+					j++
+				}
+				n, _ := strconv.Atoi(line[i:j])
+				if n > maxInserts {
+					return fmt.Errorf("insert %%%d: at most %d inserts are supported", n, maxInserts)
+				}
+				format := ""
+				if j < len(line) && line[j] == '!' {
+					end := strings.IndexByte(line[j+1:], '!')
+					if end < 0 {
+						return fmt.Errorf("insert %%%d: unterminated format", n)
+					}
+					format = line[j+1 : j+1+end]
+					j += end + 2
+				}
+				insert, ok := insertFormats[format]
+				if !ok {
+					return fmt.Errorf("insert %%%d: unsupported format !%s!", n, format)
+				}
+				if previous, ok := formats[n]; ok && previous != insert {
+					return fmt.Errorf("insert %%%d used as both %s and %s", n, previous, insert)
+				}
+				formats[n] = insert
+				fmt.Fprintf(&b, "%%%d", n)
+				i = j - 1
+			default:
+				return fmt.Errorf("unsupported escape sequence %%%c", c)
+			}
+		}
+		if noBreak {
+			compiled = append(compiled, b.String())
+			break
+		}
+		compiled = append(compiled, b.String()+"\n")
+	}
+
+	last := 0
+	for n := range formats {
+		last = max(last, n)
+	}
+	for n := 1; n <= last; n++ {
+		insert, ok := formats[n]
+		if !ok {
+			return fmt.Errorf("insert %%%d is missing while %%%d is used", n, last)
+		}
+		m.inserts = append(m.inserts, insert)
+	}
+	m.lines = compiled
+	return nil
+}
+
+// writeHeader writes the C++ declarations of messages into out.
+func writeHeader(out *bytes.Buffer, messages []message) {
+	out.WriteString(`// Generated by wsl-builder/compile-messages from messages.mc. DO NOT EDIT.
+#pragma once
+
+`)
+	for _, m := range messages {
+		var inserts []string
+		for _, insert := range m.inserts {
+			inserts = append(inserts, "Ubuntu::Insert::"+insert)
+		}
+		fmt.Fprintf(out, "inline constexpr Ubuntu::Message<%s> %s{\n    %d,", strings.Join(inserts, ", "), m.name, m.id)
+		if len(m.lines) == 0 {
+			out.WriteString(` L""`)
+		}
+		for _, line := range m.lines {
+			fmt.Fprintf(out, "\n    L%s", quote(line))
+		}
+		out.WriteString("};\n\n")
+	}
+	out.Truncate(out.Len() - 1)
+}
+
+// quote returns s as the contents of a C++ string literal.
+func quote(s string) string {
+	var b strings.Builder
+	b.WriteByte('"')
+	for _, r := range s {
+		switch {
+		case r == '"' || r == '\\':
+			b.WriteByte('\\')
+			b.WriteRune(r)
+		case r == '\n':
+			b.WriteString(`\n`)
+		case r == '\r':
+			b.WriteString(`\r`)
+		case r == '\t':
+			b.WriteString(`\t`)
+		case r < 0x20 || r == 0x7f:
+			fmt.Fprintf(&b, `\%03o`, r)
+		case r < 0x80:
+			b.WriteRune(r)
+		case r <= 0xffff:
+			fmt.Fprintf(&b, `\u%04x`, r)
+		default:
+			fmt.Fprintf(&b, `\U%08x`, r)
+		}
+	}
+	b.WriteByte('"')
+	return b.String()
+}
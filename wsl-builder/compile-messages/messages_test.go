@@ -0,0 +1,162 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestCompileMessages(t *testing.T) {
+	t.Parallel()
+
+	catalog := `; A comment
+MessageIdTypedef=DWORD
+LanguageNames=(English=0x409:MSG00409)
+
+MessageId=0x10
+SymbolicName=MSG_INSERTS
+Language=English
+Line one%n
+100%% done, %1!x! of %2!d! for %3.%0
+.
+Language=French
+Ignored, only the first language is kept.
+.
+
+MessageId=
+SymbolicName=MSG_ESCAPES
+Language=English
+Tab%there "quoted" \ %b%.%!
+` + "café\r" + `
+.
+
+MessageId=
+SymbolicName=MSG_EMPTY
+Language=English
+.
+`
+	want := `// Generated by wsl-builder/compile-messages from messages.mc. DO NOT EDIT.
+#pragma once
+
+inline constexpr Ubuntu::Message<Ubuntu::Insert::Hex, Ubuntu::Insert::Decimal, Ubuntu::Insert::String> MSG_INSERTS{
+    16,
+    L"Line one\n"
+    L"\n"
+    L"100%% done, %1 of %2 for %3."};
+
+inline constexpr Ubuntu::Message<> MSG_ESCAPES{
+    17,
+    L"Tab\there \"quoted\" \\  .!\n"
+    L"caf\u00e9\n"};
+
+inline constexpr Ubuntu::Message<> MSG_EMPTY{
+    18, L""};
+`
+
+	dir := t.TempDir()
+	mcPath := filepath.Join(dir, "messages.mc")
+	headerPath := filepath.Join(dir, "messages.h")
+	if err := os.WriteFile(mcPath, []byte(catalog), 0644); err != nil {
+		t.Fatalf("setup failed: %v", err)
+	}
+	if err := compileMessages(mcPath, headerPath); err != nil {
+		t.Fatalf("compileMessages failed: %v", err)
+	}
+	got, err := os.ReadFile(headerPath)
+	if err != nil {
+		t.Fatalf("could not read the header: %v", err)
+	}
+	if string(got) != want {
+		t.Errorf("got header:\n%s\nwant:\n%s", got, want)
+	}
+
+	// An up to date header is left untouched, not to rebuild what includes it.
+	past := time.Unix(1_000_000_000, 0)
+	if err := os.Chtimes(headerPath, past, past); err != nil {
+		t.Fatalf("setup failed: %v", err)
+	}
+	if err := compileMessages(mcPath, headerPath); err != nil {
+		t.Fatalf("compileMessages failed: %v", err)
+	}
+	if info, err := os.Stat(headerPath); err != nil || !info.ModTime().Equal(past) {
+		t.Errorf("an up to date header was rewritten")
+	}
+}
+
+func TestParseCatalogRejects(t *testing.T) {
+	t.Parallel()
+
+	// Wraps a message text in the definition of a valid message.
+	text := func(lines string) string {
+		return "MessageId=1\nSymbolicName=MSG\nLanguage=English\n" + lines + "\n.\n"
+	}
+
+	tests := map[string]struct {
+		catalog string
+		wantErr string
+	}{
+		"invalid message id":             {catalog: "MessageId=zz\n", wantErr: "1: invalid MessageId"},
+		"message id out of range":        {catalog: "MessageId=0x10000\n", wantErr: "invalid MessageId"},
+		"symbolic name before id":        {catalog: "SymbolicName=MSG\n", wantErr: "SymbolicName before MessageId"},
+		"text before id":                 {catalog: "Language=English\nText\n.\n", wantErr: "message text before MessageId"},
+		"no symbolic name":               {catalog: "MessageId=1\nLanguage=English\n", wantErr: "message 1 has no SymbolicName"},
+		"unterminated text":              {catalog: "MessageId=1\nSymbolicName=MSG\nLanguage=English\nText\n", wantErr: "not terminated"},
+		"trailing percent":               {catalog: text("100%"), wantErr: "5: MSG: trailing %"},
+		"unsupported escape":             {catalog: text("%q"), wantErr: "unsupported escape sequence %q"},
+		"too many inserts":               {catalog: text("%10"), wantErr: "insert %10: at most 9 inserts"},
+		"unterminated format":            {catalog: text("%1!x"), wantErr: "insert %1: unterminated format"},
+		"unsupported format":             {catalog: text("%1!f!"), wantErr: "insert %1: unsupported format !f!"},
+		"insert with two formats":        {catalog: text("%1!d! %1!s!"), wantErr: "insert %1 used as both Decimal and String"},
+		"missing first insert":           {catalog: text("%2"), wantErr: "insert %1 is missing while %2 is used"},
+		"missing insert between others":  {catalog: text("%1 %3"), wantErr: "insert %2 is missing while %3 is used"},
+		"missing insert on another line": {catalog: text("%1%n%3!x!"), wantErr: "insert %2 is missing while %3 is used"},
+	}
+	for name, tc := range tests {
+		tc := tc
+		t.Run(name, func(t *testing.T) {
+			t.Parallel()
+
+			messages, err := parseCatalog(bufio.NewScanner(strings.NewReader(tc.catalog)))
+			if err == nil {
+				t.Fatalf("parseCatalog succeeded with %v, want an error", messages)
+			}
+			if !strings.Contains(err.Error(), tc.wantErr) {
+				t.Errorf("got error %q, want it to contain %q", err, tc.wantErr)
+			}
+		})
+	}
+}
+
+// The catalog of the launcher compiles into the header checked in next to it.
+func TestLauncherCatalog(t *testing.T) {
+	t.Parallel()
+
+	f, err := os.Open(filepath.Join("..", "..", "DistroLauncher", "messages.mc"))
+	if err != nil {
+		t.Fatalf("could not open the catalog: %v", err)
+	}
+	defer f.Close()
+	messages, err := parseCatalog(bufio.NewScanner(f))
+	if err != nil {
+		t.Fatalf("parseCatalog failed: %v", err)
+	}
+	var out bytes.Buffer
+	writeHeader(&out, messages)
+	if len(messages) == 0 || !bytes.Contains(out.Bytes(), []byte("inline constexpr Ubuntu::Message<")) {
+		t.Errorf("got no messages from the catalog")
+	}
+
+	// The portable build compiles the checked-in header without running this tool.
+	checkedIn, err := os.ReadFile(filepath.Join("..", "..", "DistroLauncher", "messages.h"))
+	if err != nil {
+		t.Fatalf("could not read the checked-in header: %v", err)
+	}
+	if !bytes.Equal(checkedIn, out.Bytes()) {
+		t.Errorf("DistroLauncher/messages.h is out of date with messages.mc, regenerate it with:\n" +
+			"go run ./wsl-builder/compile-messages DistroLauncher/messages.mc DistroLauncher/messages.h")
+	}
+}
@@ -13,14 +13,17 @@ import (
 	"net/http"
 	"net/url"
 	"os"
+	"os/exec"
 	"path"
 	"path/filepath"
 	"strconv"
 	"strings"
+	"sync"
 	"time"
 
 	shutil "github.com/termie/go-shutil"
 	"github.com/ubuntu/wsl/wsl-builder/common"
+	"github.com/ubuntu/wsl/wsl-builder/prepare-build/rootfs"
 	"golang.org/x/sync/errgroup"
 )
 
@@ -51,10 +54,13 @@ func prepareBuild(buildIDPath, appID, rootfses string, noChecksum bool, buildID
 		buildNumber = fmt.Sprintf("%d", buildID)
 	}
 
-	archs, err := getRootfses(rootPath, rootfses, noChecksum)
+	archs, rootHashes, err := getRootfses(rootPath, rootfses, noChecksum)
 	if err != nil {
 		return err
 	}
+	if err := rootfs.WriteRootHashesHeader(filepath.Join(rootPath, "DistroLauncher", "RootfsHashes.h"), rootHashes); err != nil {
+		return err
+	}
 
 	if err := prepareAssets(rootPath, appID, buildNumber, archs); err != nil {
 		return err
@@ -93,50 +99,88 @@ func extractAndStoreNextBuildNumber(buildIDPath string) (buildNumber string, err
 // getRootfs downloads one rootfs file in tar.gz format and place
 // it where the distro launcher build system expects. If `uri` points to
 // a local regular file, it is copied from disk instead of downloaded.
-func getRootfs(uri, rootPath, winArch string, noChecksum bool) error {
+// It returns the root hashes of the rootfs files to ship.
+func getRootfs(uri, rootPath, winArch string, noChecksum bool) ([]rootfs.RootHash, error) {
 	if err := os.MkdirAll(winArch, 0755); err != nil {
-		return err
+		return nil, err
 	}
 
 	if isLocalFile(uri) {
 		if !noChecksum {
 			log.Printf("Checksum not supported for local URI")
 		}
-		return copyLocalFile(uri, filepath.Join(rootPath, winArch, "install.tar.gz"))
+		if err := copyLocalFile(uri, filepath.Join(rootPath, winArch, "install.tar.gz")); err != nil {
+			return nil, err
+		}
+		return packRootfs(filepath.Join(rootPath, winArch, "install.tar.gz"))
 	}
 
 	if err := downloadFile(uri, filepath.Join(rootPath, winArch, "install.tar.gz")); err != nil {
-		return err
+		return nil, err
 	}
 
 	if noChecksum {
-		return nil
+		return packRootfs(filepath.Join(rootPath, winArch, "install.tar.gz"))
 	}
 
 	u, err := url.Parse(uri)
 	if err != nil {
-		return err
+		return nil, err
 	}
 	u.Path = filepath.Join(path.Dir(u.Path), "SHA256SUMS")
 	checksumURL := strings.ReplaceAll(u.String(), "%5C", "/")
 	checksumDest := filepath.Join(rootPath, winArch, "SHA256SUMS")
 	if err := downloadFile(checksumURL, checksumDest); err != nil {
-		return err
+		return nil, err
 	}
 	if err := checksumMatches(filepath.Join(rootPath, winArch, "install.tar.gz"), filepath.Base(uri), checksumDest); err != nil {
-		return err
+		return nil, err
 	}
-	return nil
+	return packRootfs(filepath.Join(rootPath, winArch, "install.tar.gz"))
+}
+
+// packRootfs converts the rootfs at `path`, once checksummed, to the formats the launcher
+// decompresses on all cores, writes their hash trees and returns their root hashes.
+// The seekable zstd rootfs, which the launcher prefers, is only written if the zstd command is
+// available.
+func packRootfs(path string) ([]rootfs.RootHash, error) {
+	log.Printf("recompressing %s as block gzip", path)
+	if err := rootfs.RecompressBlockGzip(path); err != nil {
+		return nil, err
+	}
+	root, err := rootfs.WriteHashTree(path)
+	if err != nil {
+		return nil, err
+	}
+	hashes := []rootfs.RootHash{{File: filepath.Base(path), Root: root}}
+
+	zstd, err := exec.LookPath("zstd")
+	if err != nil {
+		log.Printf("Warning: zstd not found, %s won't be shipped as seekable zstd", path)
+		return hashes, nil
+	}
+	zstPath := filepath.Join(filepath.Dir(path), "install.tar.zst")
+	log.Printf("compressing %s", zstPath)
+	if err := rootfs.WriteSeekableZstd(path, zstPath, zstd); err != nil {
+		return nil, err
+	}
+	if root, err = rootfs.WriteHashTree(zstPath); err != nil {
+		return nil, err
+	}
+	return append(hashes, rootfs.RootHash{File: filepath.Base(zstPath), Root: root}), nil
 }
 
 // getRootfses returns a list of windows archs we will build on
 // and place rootfses into the path expected by the WSL build process for each arch.
-func getRootfses(rootPath, rootfses string, noChecksum bool) ([]string, error) {
+// It also returns the root hashes of the rootfs files shipped for each arch.
+func getRootfses(rootPath, rootfses string, noChecksum bool) ([]string, map[string][]rootfs.RootHash, error) {
 	requestedArches := make(map[string]struct{})
+	rootHashes := make(map[string][]rootfs.RootHash)
+	var mu sync.Mutex
 
 	var g errgroup.Group
-	for _, rootfs := range strings.Split(rootfses, ",") {
-		e := strings.Split(rootfs, "::")
+	for _, entry := range strings.Split(rootfses, ",") {
+		e := strings.Split(entry, "::")
 		rootfsURL := e[0]
 
 		// Register arch
@@ -154,17 +198,24 @@ func getRootfses(rootPath, rootfses string, noChecksum bool) ([]string, error) {
 		case 2:
 			arch = e[1]
 		default:
-			return nil, fmt.Errorf("invalid url/rootfs form. Only one :: separator to arch is allowded. Got: %q", rootfs)
+			return nil, nil, fmt.Errorf("invalid url/rootfs form. Only one :: separator to arch is allowded. Got: %q", entry)
 		}
 		winArch, ok := linuxToWindowsArch[arch]
 		if !ok {
-			return nil, fmt.Errorf("arch %q not supported in WSL (no Windows equivalent)", arch)
+			return nil, nil, fmt.Errorf("arch %q not supported in WSL (no Windows equivalent)", arch)
 		}
 		requestedArches[winArch] = struct{}{}
 
 		// Obtains rootfs and checksum it if `noChecksum==false`
 		g.Go(func() error {
-			return getRootfs(rootfsURL, rootPath, winArch, noChecksum)
+			hashes, err := getRootfs(rootfsURL, rootPath, winArch, noChecksum)
+			if err != nil {
+				return err
+			}
+			mu.Lock()
+			defer mu.Unlock()
+			rootHashes[winArch] = hashes
+			return nil
 		})
 	}
 
@@ -173,7 +224,10 @@ func getRootfses(rootPath, rootfses string, noChecksum bool) ([]string, error) {
 		arches = append(arches, a)
 	}
 
-	return arches, g.Wait()
+	if err := g.Wait(); err != nil {
+		return nil, nil, err
+	}
+	return arches, rootHashes, nil
 }
 
 // isLocalFile returns true if `url` points to a regular local file.
@@ -0,0 +1,135 @@
+// Package rootfs converts the rootfs tarballs to the formats the launcher decompresses on all
+// cores while installing, instead of leaving WSL to inflate them on a single thread.
+package rootfs
+
+import (
+	"bytes"
+	"compress/flate"
+	"compress/gzip"
+	"encoding/binary"
+	"fmt"
+	"hash/crc32"
+	"io"
+	"os"
+	"runtime"
+	"sync"
+)
+
+const (
+	// bgzfBlockSize is the amount of data per BGZF member, which bgzip uses too: it's small enough
+	// for the member to fit in 64 KiB even if the data doesn't compress.
+	bgzfBlockSize = 0xff00
+	// bgzfMaxMemberSize is the largest member size the header can record.
+	bgzfMaxMemberSize = 1 << 16
+	bgzfHeaderSize    = 18
+	gzipTrailerSize   = 8
+)
+
+// bgzfEOF is the empty member ending a BGZF file.
+var bgzfEOF = []byte{
+	0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+	0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+}
+
+// RecompressBlockGzip recompresses the gzip file at path in place as a block gzip (BGZF) file:
+// a series of gzip members of at most 64 KiB, each recording its size in its header. Any gzip
+// reader, WSL included, reads it as before, while the launcher can split it into members without
+// decoding it and decode them in parallel.
+func RecompressBlockGzip(path string) (err error) {
+	defer func() {
+		if err != nil {
+			err = fmt.Errorf("could not recompress %q as block gzip: %v", path, err)
+		}
+	}()
+
+	src, err := os.Open(path)
+	if err != nil {
+		return err
+	}
+	defer src.Close()
+	r, err := gzip.NewReader(src)
+	if err != nil {
+		return err
+	}
+
+	tmp := path + ".bgzf"
+	dst, err := os.Create(tmp)
+	if err != nil {
+		return err
+	}
+	defer os.Remove(tmp)
+	if err := writeBlockGzip(dst, r, runtime.NumCPU()); err != nil {
+		dst.Close()
+		return err
+	}
+	if err := dst.Close(); err != nil {
+		return err
+	}
+	src.Close()
+	return os.Rename(tmp, path)
+}
+
+// writeBlockGzip compresses the contents of r into w as BGZF, compressing up to workers members
+// concurrently.
+func writeBlockGzip(w io.Writer, r io.Reader, workers int) error {
+	batch := make([]byte, workers*bgzfBlockSize)
+	members := make([][]byte, workers)
+	for {
+		n, err := io.ReadFull(r, batch)
+		if err != nil && err != io.EOF && err != io.ErrUnexpectedEOF {
+			return err
+		}
+
+		blocks := (n + bgzfBlockSize - 1) / bgzfBlockSize
+		var wg sync.WaitGroup
+		for i := 0; i < blocks; i++ {
+			wg.Add(1)
+			go func(i int) {
+				defer wg.Done()
+				members[i] = compressBlock(batch[i*bgzfBlockSize : min((i+1)*bgzfBlockSize, n)])
+			}(i)
+		}
+		wg.Wait()
+		for _, member := range members[:blocks] {
+			if _, err := w.Write(member); err != nil {
+				return err
+			}
+		}
+
+		if n < len(batch) {
+			break
+		}
+	}
+	_, err := w.Write(bgzfEOF)
+	return err
+}
+
+// compressBlock returns the BGZF member holding data, which is at most bgzfBlockSize bytes.
+func compressBlock(data []byte) []byte {
+	member := deflateBlock(data, flate.BestCompression)
+	if len(member)+gzipTrailerSize > bgzfMaxMemberSize {
+		// Stored blocks only add a few bytes per block size.
+		member = deflateBlock(data, flate.NoCompression)
+	}
+
+	member = binary.LittleEndian.AppendUint32(member, crc32.ChecksumIEEE(data))
+	member = binary.LittleEndian.AppendUint32(member, uint32(len(data)))
+	binary.LittleEndian.PutUint16(member[16:], uint16(len(member)-1))
+	return member
+}
+
+// deflateBlock returns the BGZF member header, its size left to fill, followed by data compressed
+// at level.
+func deflateBlock(data []byte, level int) []byte {
+	var b bytes.Buffer
+	b.Grow(bgzfHeaderSize + len(data) + gzipTrailerSize)
+	// Magic, deflate, FEXTRA, no time, no extra flags, unknown OS, then the "BC" extra subfield.
+	b.Write([]byte{0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0})
+	fw, err := flate.NewWriter(&b, level)
+	if err != nil {
+		panic(err) // The levels we use are valid.
+	}
+	fw.Write(data)
+	fw.Close()
+	return b.Bytes()
+}
@@ -0,0 +1,139 @@
+package rootfs
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"io"
+	"math/rand"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+// testData returns size bytes mixing text, which compresses, and random bytes, which don't.
+func testData(size int) []byte {
+	rng := rand.New(rand.NewSource(1))
+	var b bytes.Buffer
+	for b.Len() < size {
+		if rng.Intn(2) == 0 {
+			b.WriteString("usr/share/doc/package/changelog.Debian.gz\x00")
+		} else {
+			chunk := make([]byte, rng.Intn(5000))
+			rng.Read(chunk)
+			b.Write(chunk)
+		}
+	}
+	return b.Bytes()[:size]
+}
+
+// members splits a BGZF file into members by the sizes their headers record.
+func members(t *testing.T, file []byte) [][]byte {
+	t.Helper()
+	var members [][]byte
+	for len(file) > 0 {
+		if len(file) < bgzfHeaderSize || !bytes.Equal(file[:4], []byte{0x1f, 0x8b, 8, 4}) ||
+			string(file[12:14]) != "BC" {
+			t.Fatalf("no BGZF member header at offset %d", len(members))
+		}
+		size := int(binary.LittleEndian.Uint16(file[16:])) + 1
+		if size > len(file) {
+			t.Fatalf("member %d is truncated", len(members))
+		}
+		members = append(members, file[:size])
+		file = file[size:]
+	}
+	return members
+}
+
+func TestWriteBlockGzip(t *testing.T) {
+	t.Parallel()
+
+	tests := map[string]struct {
+		size    int
+		workers int
+	}{
+		"empty":                        {size: 0, workers: 4},
+		"less than a block":            {size: 1000, workers: 4},
+		"exactly a block":              {size: bgzfBlockSize, workers: 4},
+		"exactly a batch":              {size: 4 * bgzfBlockSize, workers: 4},
+		"several batches with a tail":  {size: 9*bgzfBlockSize + 17, workers: 4},
+		"several batches on one core":  {size: 3*bgzfBlockSize + 1, workers: 1},
+		"incompressible data in batch": {size: 2 << 20, workers: 3},
+	}
+	for name, tc := range tests {
+		tc := tc
+		t.Run(name, func(t *testing.T) {
+			t.Parallel()
+
+			data := testData(tc.size)
+			var out bytes.Buffer
+			if err := writeBlockGzip(&out, bytes.NewReader(data), tc.workers); err != nil {
+				t.Fatalf("writeBlockGzip failed: %v", err)
+			}
+
+			ms := members(t, out.Bytes())
+			wantMembers := (tc.size+bgzfBlockSize-1)/bgzfBlockSize + 1
+			if len(ms) != wantMembers {
+				t.Errorf("got %d members, want %d", len(ms), wantMembers)
+			}
+			if !bytes.Equal(ms[len(ms)-1], bgzfEOF) {
+				t.Errorf("the file doesn't end with the BGZF EOF member")
+			}
+
+			// Any gzip reader reads the members as a single stream.
+			r, err := gzip.NewReader(&out)
+			if err != nil {
+				t.Fatalf("gzip.NewReader failed: %v", err)
+			}
+			got, err := io.ReadAll(r)
+			if err != nil {
+				t.Fatalf("reading the BGZF file back failed: %v", err)
+			}
+			if !bytes.Equal(got, data) {
+				t.Errorf("the BGZF file doesn't hold the original data")
+			}
+		})
+	}
+}
+
+func TestRecompressBlockGzip(t *testing.T) {
+	t.Parallel()
+
+	data := testData(1 << 20)
+	path := filepath.Join(t.TempDir(), "install.tar.gz")
+	var gz bytes.Buffer
+	w := gzip.NewWriter(&gz)
+	w.Write(data)
+	w.Close()
+	if err := os.WriteFile(path, gz.Bytes(), 0644); err != nil {
+		t.Fatalf("setup failed: %v", err)
+	}
+
+	if err := RecompressBlockGzip(path); err != nil {
+		t.Fatalf("RecompressBlockGzip failed: %v", err)
+	}
+
+	file, err := os.ReadFile(path)
+	if err != nil {
+		t.Fatalf("could not read the recompressed file: %v", err)
+	}
+	members(t, file)
+	r, err := gzip.NewReader(bytes.NewReader(file))
+	if err != nil {
+		t.Fatalf("gzip.NewReader failed: %v", err)
+	}
+	if got, err := io.ReadAll(r); err != nil || !bytes.Equal(got, data) {
+		t.Errorf("the recompressed file doesn't hold the original data (error: %v)", err)
+	}
+	if _, err := os.Stat(path + ".bgzf"); !os.IsNotExist(err) {
+		t.Errorf("the temporary file was left behind")
+	}
+
+	if err := os.WriteFile(path, []byte("not gzip"), 0644); err != nil {
+		t.Fatalf("setup failed: %v", err)
+	}
+	if err := RecompressBlockGzip(path); err == nil {
+		t.Errorf("RecompressBlockGzip should fail on a file which is not gzip")
+	}
+}
@@ -0,0 +1,129 @@
+package rootfs
+
+import (
+	"bytes"
+	"crypto/sha256"
+	"fmt"
+	"io"
+	"os"
+	"sort"
+	"strings"
+)
+
+// HashTreeChunkSize is the size of the rootfs chunks the launcher verifies independently.
+const HashTreeChunkSize = 4 << 20
+
+// RootHash is the root hash of the hash tree of a rootfs file.
+type RootHash struct {
+	// File is the name the file is shipped under, such as install.tar.gz.
+	File string
+	// Root is the root hash in lowercase hexadecimal.
+	Root string
+}
+
+// WriteHashTree writes the hash tree of the rootfs at path next to it, as "<path>.hashtree", for
+// the launcher to verify the rootfs while decompressing it, and returns its root hash.
+// The first line holds the chunk size, the file size and the root hash: the SHA-256 of the chunk
+// hashes concatenated. Each following line holds the SHA-256 of a chunk.
+func WriteHashTree(path string) (root string, err error) {
+	defer func() {
+		if err != nil {
+			err = fmt.Errorf("could not write hash tree for %q: %v", path, err)
+		}
+	}()
+
+	f, err := os.Open(path)
+	if err != nil {
+		return "", err
+	}
+	defer f.Close()
+
+	var size int64
+	var chunks [][]byte
+	rootHash := sha256.New()
+	for {
+		h := sha256.New()
+		n, err := io.CopyN(h, f, HashTreeChunkSize)
+		if err != nil && err != io.EOF {
+			return "", err
+		}
+		if n == 0 {
+			break
+		}
+		size += n
+		sum := h.Sum(nil)
+		chunks = append(chunks, sum)
+		rootHash.Write(sum)
+	}
+	root = fmt.Sprintf("%x", rootHash.Sum(nil))
+
+	var manifest strings.Builder
+	fmt.Fprintf(&manifest, "%d %d %s\n", HashTreeChunkSize, size, root)
+	for _, sum := range chunks {
+		fmt.Fprintf(&manifest, "%x\n", sum)
+	}
+	if err := os.WriteFile(path+".hashtree", []byte(manifest.String()), 0644); err != nil {
+		return "", err
+	}
+	return root, nil
+}
+
+// archMacros maps the Windows architectures to the MSVC macro defined when building for them.
+var archMacros = map[string]string{
+	"ARM64": "_M_ARM64",
+	"x64":   "_M_X64",
+}
+
+// WriteRootHashesHeader writes the C++ header embedding the root hashes of the rootfs files of each
+// Windows architecture into the launcher, at path. The launcher only trusts a shipped hash tree
+// whose root hash it embeds, so that neither the rootfs nor its hash tree can be replaced without
+// being noticed.
+func WriteRootHashesHeader(path string, hashes map[string][]RootHash) error {
+	var arches []string
+	for arch := range hashes {
+		if _, ok := archMacros[arch]; !ok {
+			return fmt.Errorf("no architecture macro known for %q", arch)
+		}
+		arches = append(arches, arch)
+	}
+	sort.Strings(arches)
+
+	var out bytes.Buffer
+	out.WriteString(`// Generated by wsl-builder/prepare-build from the rootfs it packed. DO NOT EDIT.
+#pragma once
+#include <array>
+
+#include "Ubuntu/HashTree.h"
+
+// The root hashes of the hash trees of the rootfs files shipped for the architecture being built.
+`)
+	for i, arch := range arches {
+		directive := "#elif"
+		if i == 0 {
+			directive = "#if"
+		}
+		fmt.Fprintf(&out, "%s defined(%s)\n", directive, archMacros[arch])
+		writeRootHashes(&out, hashes[arch])
+	}
+	if len(arches) > 0 {
+		out.WriteString("#else\n")
+	}
+	writeRootHashes(&out, nil)
+	if len(arches) > 0 {
+		out.WriteString("#endif\n")
+	}
+	return os.WriteFile(path, out.Bytes(), 0644)
+}
+
+func writeRootHashes(out *bytes.Buffer, hashes []RootHash) {
+	fmt.Fprintf(out, "inline constexpr std::array<Ubuntu::ExpectedRootHash, %d> ExpectedRootHashes", len(hashes))
+	if len(hashes) == 0 {
+		out.WriteString("{};\n")
+		return
+	}
+	out.WriteString("{{\n")
+	for _, h := range hashes {
+		fmt.Fprintf(out, "    {L%q, %q},\n", h.File, h.Root)
+	}
+	out.WriteString("}};\n")
+}
@@ -0,0 +1,128 @@
+package rootfs
+
+import (
+	"crypto/sha256"
+	"fmt"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+)
+
+func TestWriteHashTree(t *testing.T) {
+	t.Parallel()
+
+	tests := map[string]struct {
+		size int
+	}{
+		"empty":                   {size: 0},
+		"less than a chunk":       {size: 1000},
+		"exactly a chunk":         {size: HashTreeChunkSize},
+		"several chunks and tail": {size: 2*HashTreeChunkSize + 5},
+	}
+	for name, tc := range tests {
+		tc := tc
+		t.Run(name, func(t *testing.T) {
+			t.Parallel()
+
+			data := testData(tc.size)
+			path := filepath.Join(t.TempDir(), "install.tar.gz")
+			if err := os.WriteFile(path, data, 0644); err != nil {
+				t.Fatalf("setup failed: %v", err)
+			}
+
+			root, err := WriteHashTree(path)
+			if err != nil {
+				t.Fatalf("WriteHashTree failed: %v", err)
+			}
+
+			var want strings.Builder
+			rootHash := sha256.New()
+			var chunks []string
+			for offset := 0; offset < tc.size; offset += HashTreeChunkSize {
+				sum := sha256.Sum256(data[offset:min(offset+HashTreeChunkSize, tc.size)])
+				rootHash.Write(sum[:])
+				chunks = append(chunks, fmt.Sprintf("%x\n", sum))
+			}
+			wantRoot := fmt.Sprintf("%x", rootHash.Sum(nil))
+			fmt.Fprintf(&want, "%d %d %s\n%s", HashTreeChunkSize, tc.size, wantRoot, strings.Join(chunks, ""))
+
+			if root != wantRoot {
+				t.Errorf("got root hash %s, want %s", root, wantRoot)
+			}
+			manifest, err := os.ReadFile(path + ".hashtree")
+			if err != nil {
+				t.Fatalf("could not read the manifest: %v", err)
+			}
+			if string(manifest) != want.String() {
+				t.Errorf("got manifest:\n%s\nwant:\n%s", manifest, want.String())
+			}
+		})
+	}
+}
+
+func TestWriteRootHashesHeader(t *testing.T) {
+	t.Parallel()
+
+	tests := map[string]struct {
+		hashes map[string][]RootHash
+		want   string
+	}{
+		"no rootfs": {
+			want: "inline constexpr std::array<Ubuntu::ExpectedRootHash, 0> ExpectedRootHashes{};\n",
+		},
+		"one arch": {
+			hashes: map[string][]RootHash{"x64": {{File: "install.tar.gz", Root: "ab01"}}},
+			want: `#if defined(_M_X64)
+inline constexpr std::array<Ubuntu::ExpectedRootHash, 1> ExpectedRootHashes{{
+    {L"install.tar.gz", "ab01"},
+}};
+#else
+inline constexpr std::array<Ubuntu::ExpectedRootHash, 0> ExpectedRootHashes{};
+#endif
+`,
+		},
+		"two arches": {
+			hashes: map[string][]RootHash{
+				"x64":   {{File: "install.tar.gz", Root: "ab01"}, {File: "install.tar.zst", Root: "cd02"}},
+				"ARM64": {{File: "install.tar.gz", Root: "ef03"}},
+			},
+			want: `#if defined(_M_ARM64)
+inline constexpr std::array<Ubuntu::ExpectedRootHash, 1> ExpectedRootHashes{{
+    {L"install.tar.gz", "ef03"},
+}};
+#elif defined(_M_X64)
+inline constexpr std::array<Ubuntu::ExpectedRootHash, 2> ExpectedRootHashes{{
+    {L"install.tar.gz", "ab01"},
+    {L"install.tar.zst", "cd02"},
+}};
+#else
+inline constexpr std::array<Ubuntu::ExpectedRootHash, 0> ExpectedRootHashes{};
+#endif
+`,
+		},
+	}
+	for name, tc := range tests {
+		tc := tc
+		t.Run(name, func(t *testing.T) {
+			t.Parallel()
+
+			path := filepath.Join(t.TempDir(), "RootfsHashes.h")
+			if err := WriteRootHashesHeader(path, tc.hashes); err != nil {
+				t.Fatalf("WriteRootHashesHeader failed: %v", err)
+			}
+			header, err := os.ReadFile(path)
+			if err != nil {
+				t.Fatalf("could not read the header: %v", err)
+			}
+			if !strings.HasSuffix(string(header), "shipped for the architecture being built.\n"+tc.want) {
+				t.Errorf("got header:\n%s\nwant it to end with:\n%s", header, tc.want)
+			}
+		})
+	}
+
+	err := WriteRootHashesHeader(filepath.Join(t.TempDir(), "RootfsHashes.h"), map[string][]RootHash{"riscv": nil})
+	if err == nil {
+		t.Errorf("WriteRootHashesHeader should fail for an unknown architecture")
+	}
+}
@@ -0,0 +1,130 @@
+package rootfs
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"os"
+	"os/exec"
+	"runtime"
+	"sync"
+)
+
+const (
+	// seekableFrameSize is the amount of data per zstd frame. Frames are what the launcher decodes
+	// in parallel, and reading a file out of the rootfs decodes the frames it spans.
+	seekableFrameSize = 4 << 20
+	// zstdLevel is the compression level of the frames.
+	zstdLevel = 19
+
+	seekTableFrameMagic = 0x184D2A5E
+	seekableMagic       = 0x8F92EAB1
+)
+
+// WriteSeekableZstd writes the contents of the gzip file at gzPath to zstPath in the zstd seekable
+// format: independent zstd frames followed by a skippable frame holding the table of their sizes.
+// WSL can't import it, but the launcher decompresses it on all cores, faster than gzip.
+//
+// Frames are compressed by the zstd command at zstd, whose output is a standard zstd frame
+// recording its content size and checksum.
+func WriteSeekableZstd(gzPath, zstPath, zstd string) (err error) {
+	defer func() {
+		if err != nil {
+			err = fmt.Errorf("could not write seekable zstd %q: %v", zstPath, err)
+		}
+	}()
+
+	src, err := os.Open(gzPath)
+	if err != nil {
+		return err
+	}
+	defer src.Close()
+	r, err := gzip.NewReader(src)
+	if err != nil {
+		return err
+	}
+
+	dst, err := os.Create(zstPath)
+	if err != nil {
+		return err
+	}
+	if err := writeSeekableZstd(dst, r, runtime.NumCPU(), zstdCommand(zstd)); err != nil {
+		dst.Close()
+		os.Remove(zstPath)
+		return err
+	}
+	return dst.Close()
+}
+
+// zstdCommand returns a function compressing data into a single zstd frame with the zstd command
+// at path.
+func zstdCommand(path string) func(data []byte) ([]byte, error) {
+	return func(data []byte) ([]byte, error) {
+		// The content size is only recorded when the command is told the size of its input.
+		cmd := exec.Command(path, "-q", "-c", fmt.Sprintf("-%d", zstdLevel), fmt.Sprintf("--stream-size=%d", len(data)))
+		cmd.Stdin = bytes.NewReader(data)
+		frame, err := cmd.Output()
+		var exitErr *exec.ExitError
+		if errors.As(err, &exitErr) {
+			return nil, fmt.Errorf("%v: %s", err, exitErr.Stderr)
+		}
+		return frame, err
+	}
+}
+
+// writeSeekableZstd compresses the contents of r into w in the zstd seekable format, compressing
+// up to workers frames concurrently with compress.
+func writeSeekableZstd(w io.Writer, r io.Reader, workers int, compress func([]byte) ([]byte, error)) error {
+	// Each entry holds the compressed and the decompressed size of a frame.
+	var table []byte
+	batch := make([]byte, workers*seekableFrameSize)
+	frames := make([][]byte, workers)
+	errs := make([]error, workers)
+	for {
+		n, err := io.ReadFull(r, batch)
+		if err != nil && err != io.EOF && err != io.ErrUnexpectedEOF {
+			return err
+		}
+
+		count := (n + seekableFrameSize - 1) / seekableFrameSize
+		var wg sync.WaitGroup
+		for i := 0; i < count; i++ {
+			wg.Add(1)
+			go func(i int) {
+				defer wg.Done()
+				frames[i], errs[i] = compress(batch[i*seekableFrameSize : min((i+1)*seekableFrameSize, n)])
+			}(i)
+		}
+		wg.Wait()
+		for i, frame := range frames[:count] {
+			if errs[i] != nil {
+				return errs[i]
+			}
+			if _, err := w.Write(frame); err != nil {
+				return err
+			}
+			table = binary.LittleEndian.AppendUint32(table, uint32(len(frame)))
+			table = binary.LittleEndian.AppendUint32(table, uint32(min((i+1)*seekableFrameSize, n)-i*seekableFrameSize))
+		}
+
+		if n < len(batch) {
+			break
+		}
+	}
+
+	// The skippable frame header, the entries, then the footer: the number of frames, a descriptor
+	// telling there are no checksums in the entries, and the seekable magic number.
+	entries := len(table) / 8
+	var seekTable []byte
+	seekTable = binary.LittleEndian.AppendUint32(seekTable, seekTableFrameMagic)
+	seekTable = binary.LittleEndian.AppendUint32(seekTable, uint32(len(table)+9))
+	seekTable = append(seekTable, table...)
+	seekTable = binary.LittleEndian.AppendUint32(seekTable, uint32(entries))
+	seekTable = append(seekTable, 0)
+	seekTable = binary.LittleEndian.AppendUint32(seekTable, seekableMagic)
+	_, err := w.Write(seekTable)
+	return err
+}
@@ -0,0 +1,164 @@
+package rootfs
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"testing"
+)
+
+// seekTableEntry is a frame as recorded in the seek table.
+type seekTableEntry struct {
+	compressedSize, decompressedSize int
+}
+
+// parseSeekTable returns the frames a seekable zstd file records, checking its layout.
+func parseSeekTable(t *testing.T, file []byte) []seekTableEntry {
+	t.Helper()
+
+	if len(file) < 17 {
+		t.Fatalf("the file is too small to hold a seek table")
+	}
+	footer := file[len(file)-9:]
+	if binary.LittleEndian.Uint32(footer[5:]) != seekableMagic {
+		t.Fatalf("the file doesn't end with the seekable magic number")
+	}
+	if footer[4] != 0 {
+		t.Fatalf("unexpected seek table descriptor %#x", footer[4])
+	}
+	count := int(binary.LittleEndian.Uint32(footer))
+	tableSize := 8 + 8*count + 9
+	if tableSize > len(file) {
+		t.Fatalf("the seek table is larger than the file")
+	}
+	table := file[len(file)-tableSize:]
+	if binary.LittleEndian.Uint32(table) != seekTableFrameMagic || int(binary.LittleEndian.Uint32(table[4:])) != tableSize-8 {
+		t.Fatalf("the seek table is not a well-formed skippable frame")
+	}
+
+	var entries []seekTableEntry
+	framesSize := 0
+	for i := 0; i < count; i++ {
+		entry := table[8+8*i:]
+		e := seekTableEntry{int(binary.LittleEndian.Uint32(entry)), int(binary.LittleEndian.Uint32(entry[4:]))}
+		framesSize += e.compressedSize
+		entries = append(entries, e)
+	}
+	if framesSize+tableSize != len(file) {
+		t.Fatalf("the frames and the seek table don't make up the whole file")
+	}
+	return entries
+}
+
+// zstdDecompress decompresses data with the zstd command, which skips the seek table as any
+// skippable frame.
+func zstdDecompress(t *testing.T, zstd string, data []byte) []byte {
+	t.Helper()
+
+	cmd := exec.Command(zstd, "-q", "-d", "-c")
+	cmd.Stdin = bytes.NewReader(data)
+	out, err := cmd.Output()
+	if err != nil {
+		t.Fatalf("zstd -d failed: %v", err)
+	}
+	return out
+}
+
+func TestWriteSeekableZstd(t *testing.T) {
+	t.Parallel()
+
+	zstd, err := exec.LookPath("zstd")
+	if err != nil {
+		t.Skip("the zstd command is not available")
+	}
+
+	tests := map[string]struct {
+		size    int
+		workers int
+	}{
+		"empty":                       {size: 0, workers: 4},
+		"less than a frame":           {size: 1000, workers: 4},
+		"exactly a frame":             {size: seekableFrameSize, workers: 2},
+		"several batches with a tail": {size: 5*seekableFrameSize + 3, workers: 2},
+	}
+	for name, tc := range tests {
+		tc := tc
+		t.Run(name, func(t *testing.T) {
+			t.Parallel()
+
+			data := testData(tc.size)
+			var out bytes.Buffer
+			if err := writeSeekableZstd(&out, bytes.NewReader(data), tc.workers, zstdCommand(zstd)); err != nil {
+				t.Fatalf("writeSeekableZstd failed: %v", err)
+			}
+			file := out.Bytes()
+
+			entries := parseSeekTable(t, file)
+			if want := (tc.size + seekableFrameSize - 1) / seekableFrameSize; len(entries) != want {
+				t.Errorf("got %d frames, want %d", len(entries), want)
+			}
+
+			// Every frame decodes on its own to the part of the data the table says.
+			var offset, decompressed int
+			for i, e := range entries {
+				frame := zstdDecompress(t, zstd, file[offset:offset+e.compressedSize])
+				if !bytes.Equal(frame, data[decompressed:decompressed+e.decompressedSize]) {
+					t.Errorf("frame %d doesn't hold the data the seek table says", i)
+				}
+				offset += e.compressedSize
+				decompressed += e.decompressedSize
+			}
+			if decompressed != tc.size {
+				t.Errorf("the frames hold %d bytes, want %d", decompressed, tc.size)
+			}
+
+			// And the whole file decodes as a regular zstd file.
+			if got := zstdDecompress(t, zstd, file); !bytes.Equal(got, data) {
+				t.Errorf("the file doesn't hold the original data")
+			}
+		})
+	}
+}
+
+func TestWriteSeekableZstdFromGzip(t *testing.T) {
+	t.Parallel()
+
+	zstd, err := exec.LookPath("zstd")
+	if err != nil {
+		t.Skip("the zstd command is not available")
+	}
+
+	dir := t.TempDir()
+	data := testData(1 << 20)
+	var gz bytes.Buffer
+	w := gzip.NewWriter(&gz)
+	w.Write(data)
+	w.Close()
+	gzPath := filepath.Join(dir, "install.tar.gz")
+	zstPath := filepath.Join(dir, "install.tar.zst")
+	if err := os.WriteFile(gzPath, gz.Bytes(), 0644); err != nil {
+		t.Fatalf("setup failed: %v", err)
+	}
+
+	if err := WriteSeekableZstd(gzPath, zstPath, zstd); err != nil {
+		t.Fatalf("WriteSeekableZstd failed: %v", err)
+	}
+	file, err := os.ReadFile(zstPath)
+	if err != nil {
+		t.Fatalf("could not read the seekable zstd file: %v", err)
+	}
+	parseSeekTable(t, file)
+	if got := zstdDecompress(t, zstd, file); !bytes.Equal(got, data) {
+		t.Errorf("the file doesn't hold the contents of the gzip file")
+	}
+
+	if err := WriteSeekableZstd(gzPath, zstPath, filepath.Join(dir, "no-zstd")); err == nil {
+		t.Errorf("WriteSeekableZstd should fail without a working zstd command")
+	}
+	if _, err := os.Stat(zstPath); !os.IsNotExist(err) {
+		t.Errorf("a partial file was left behind")
+	}
+}